@@ -24,7 +24,8 @@ import (
 //
 // List of changes:
 // • version 1: initial version released with Clear Containers 2.1
-const Version = 1
+// • version 2: compact binary encoding (see FlagBinary)
+const Version = 2
 
 // The Hello payload is issued first after connecting to the proxy socket.
 // It is used to let the proxy know about a new container on the system along
@@ -116,18 +117,36 @@ type Bye struct {
 // data. If wanting stderr as its own stream, a second sequence number needs to
 // be allocated.
 //
+// Output for the client is queued by the proxy. outputPolicy, optional, selects
+// what happens when the client doesn't read it fast enough and the queue is
+// full:
+//   - "block": wait for the client, holding up the output of the other
+//     processes running in the same VM,
+//   - "drop-oldest": drop the oldest queued data,
+//   - "disconnect": close the connection to the client.
+// The default policy is set by the proxy's -io-output-policy option.
+//
 // The result of an allocateIO operation is encoded as an AllocateIoResult.
 //
 //  {
 //    "id": "allocateIO",
 //    "data": {
-//      "nStreams": 2
+//      "nStreams": 2,
+//      "outputPolicy": "drop-oldest"
 //    }
 //  }
 type AllocateIo struct {
-	NStreams int `json:"nStreams"`
+	NStreams     int    `json:"nStreams"`
+	OutputPolicy string `json:"outputPolicy,omitempty"`
 }
 
+// Output policies of an AllocateIo payload
+const (
+	OutputPolicyBlock      = "block"
+	OutputPolicyDropOldest = "drop-oldest"
+	OutputPolicyDisconnect = "disconnect"
+)
+
 // AllocateIoResult is the result from a successful allocateIO.
 //
 // The sequence numbers allocated are:
@@ -0,0 +1,393 @@
+// Copyright (c) 2016 Intel Corporation
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+package api
+
+import (
+	"encoding/binary"
+	"encoding/json"
+	"errors"
+	"fmt"
+	"math"
+	"reflect"
+)
+
+// Compact binary encoding
+//
+// When FlagBinary is set in the message header, the payload uses a compact
+// binary encoding instead of JSON. Integers are big endian and strings are
+// encoded as a 16-bit length followed by the string bytes.
+//
+// A Request starts with a 1 byte op code followed by the fields of its
+// payload, in the order they are declared:
+//
+//   hello (1):      containerId, ctlSerial, ioSerial, console (strings)
+//   attach (2):     containerId (string)
+//   bye (3):        containerId (string)
+//   allocateIO (4): nStreams (uint32), followed by outputPolicy (string)
+//                   only if it is set
+//   hyper (5):      hyperName (string), followed by the hyperstart JSON data
+//                   for the rest of the message
+//
+// A Response is encoded as success (1 byte), error (string), the number of
+// results (1 byte) and that many (name (string), value (int64)) pairs. Only
+// integer results can be encoded.
+//
+// A message is always answered using the encoding of the request, so clients
+// can mix both encodings on a connection. Clients should only use the binary
+// encoding once hello or attach has returned a version >= BinaryVersion.
+
+// FlagBinary is set in the message header flags when the payload uses the
+// compact binary encoding.
+const FlagBinary = 1 << 0
+
+// BinaryVersion is the first protocol version supporting FlagBinary.
+const BinaryVersion = 2
+
+const (
+	opHello      = 1
+	opAttach     = 2
+	opBye        = 3
+	opAllocateIo = 4
+	opHyper      = 5
+)
+
+var opNames = map[byte]string{
+	opHello:      "hello",
+	opAttach:     "attach",
+	opBye:        "bye",
+	opAllocateIo: "allocateIO",
+	opHyper:      "hyper",
+}
+
+var errShortMessage = errors.New("binary message too short")
+
+// ErrNotBinary is returned when a message cannot use the binary encoding.
+var ErrNotBinary = errors.New("message cannot be binary encoded")
+
+type binaryEncoder struct {
+	buf []byte
+}
+
+func (e *binaryEncoder) byte(b byte) {
+	e.buf = append(e.buf, b)
+}
+
+func (e *binaryEncoder) uint32(v uint32) {
+	var b [4]byte
+	binary.BigEndian.PutUint32(b[:], v)
+	e.buf = append(e.buf, b[:]...)
+}
+
+func (e *binaryEncoder) int64(v int64) {
+	var b [8]byte
+	binary.BigEndian.PutUint64(b[:], uint64(v))
+	e.buf = append(e.buf, b[:]...)
+}
+
+func (e *binaryEncoder) string(s string) error {
+	if len(s) > math.MaxUint16 {
+		return fmt.Errorf("string too long (%d bytes)", len(s))
+	}
+
+	var b [2]byte
+	binary.BigEndian.PutUint16(b[:], uint16(len(s)))
+	e.buf = append(e.buf, b[:]...)
+	e.buf = append(e.buf, s...)
+
+	return nil
+}
+
+type binaryDecoder struct {
+	buf []byte
+}
+
+func (d *binaryDecoder) byte() (byte, error) {
+	if len(d.buf) < 1 {
+		return 0, errShortMessage
+	}
+	b := d.buf[0]
+	d.buf = d.buf[1:]
+	return b, nil
+}
+
+func (d *binaryDecoder) uint32() (uint32, error) {
+	if len(d.buf) < 4 {
+		return 0, errShortMessage
+	}
+	v := binary.BigEndian.Uint32(d.buf)
+	d.buf = d.buf[4:]
+	return v, nil
+}
+
+func (d *binaryDecoder) int64() (int64, error) {
+	if len(d.buf) < 8 {
+		return 0, errShortMessage
+	}
+	v := int64(binary.BigEndian.Uint64(d.buf))
+	d.buf = d.buf[8:]
+	return v, nil
+}
+
+func (d *binaryDecoder) string() (string, error) {
+	if len(d.buf) < 2 {
+		return "", errShortMessage
+	}
+	n := int(binary.BigEndian.Uint16(d.buf))
+	if len(d.buf) < 2+n {
+		return "", errShortMessage
+	}
+	s := string(d.buf[2 : 2+n])
+	d.buf = d.buf[2+n:]
+	return s, nil
+}
+
+func (d *binaryDecoder) strings(s ...*string) error {
+	var err error
+
+	for _, p := range s {
+		if *p, err = d.string(); err != nil {
+			return err
+		}
+	}
+
+	return nil
+}
+
+// NewBinaryRequest creates a Request carrying payload, to be sent with the
+// binary encoding. payload must be a pointer to one of the Hello, Attach,
+// Bye, AllocateIo or Hyper payloads.
+func NewBinaryRequest(payload interface{}) *Request {
+	return &Request{
+		payload: payload,
+		binary:  true,
+	}
+}
+
+// Binary returns true if the request uses the binary encoding.
+func (req *Request) Binary() bool {
+	return req.binary
+}
+
+// DecodeData decodes the request payload into v, which must be a pointer to
+// the payload struct expected for the request ID.
+func (req *Request) DecodeData(v interface{}) error {
+	if req.payload == nil {
+		return json.Unmarshal(req.Data, v)
+	}
+
+	dst := reflect.ValueOf(v)
+	src := reflect.ValueOf(req.payload)
+	if dst.Type() != src.Type() {
+		return fmt.Errorf("%s: unexpected payload type %s", req.ID,
+			dst.Type())
+	}
+	dst.Elem().Set(src.Elem())
+
+	return nil
+}
+
+// MarshalBinary implements encoding.BinaryMarshaler.
+func (req *Request) MarshalBinary() ([]byte, error) {
+	e := binaryEncoder{}
+	var err error
+
+	switch p := req.payload.(type) {
+	case *Hello:
+		e.byte(opHello)
+		for _, s := range []string{p.ContainerID, p.CtlSerial,
+			p.IoSerial, p.Console} {
+			if err = e.string(s); err != nil {
+				return nil, err
+			}
+		}
+	case *Attach:
+		e.byte(opAttach)
+		err = e.string(p.ContainerID)
+	case *Bye:
+		e.byte(opBye)
+		err = e.string(p.ContainerID)
+	case *AllocateIo:
+		e.byte(opAllocateIo)
+		e.uint32(uint32(p.NStreams))
+		if p.OutputPolicy != "" {
+			err = e.string(p.OutputPolicy)
+		}
+	case *Hyper:
+		e.byte(opHyper)
+		err = e.string(p.HyperName)
+		e.buf = append(e.buf, p.Data...)
+	default:
+		return nil, ErrNotBinary
+	}
+
+	if err != nil {
+		return nil, err
+	}
+
+	return e.buf, nil
+}
+
+// UnmarshalBinary implements encoding.BinaryUnmarshaler.
+func (req *Request) UnmarshalBinary(data []byte) error {
+	d := binaryDecoder{buf: data}
+	var err error
+
+	op, err := d.byte()
+	if err != nil {
+		return err
+	}
+
+	id, ok := opNames[op]
+	if !ok {
+		return fmt.Errorf("unknown binary op %d", op)
+	}
+
+	switch op {
+	case opHello:
+		p := &Hello{}
+		err = d.strings(&p.ContainerID, &p.CtlSerial, &p.IoSerial,
+			&p.Console)
+		req.payload = p
+	case opAttach:
+		p := &Attach{}
+		p.ContainerID, err = d.string()
+		req.payload = p
+	case opBye:
+		p := &Bye{}
+		p.ContainerID, err = d.string()
+		req.payload = p
+	case opAllocateIo:
+		var n uint32
+		n, err = d.uint32()
+		p := &AllocateIo{NStreams: int(n)}
+		if err == nil && len(d.buf) > 0 {
+			p.OutputPolicy, err = d.string()
+		}
+		req.payload = p
+	case opHyper:
+		p := &Hyper{}
+		p.HyperName, err = d.string()
+		if len(d.buf) > 0 {
+			p.Data = json.RawMessage(d.buf)
+		}
+		d.buf = nil
+		req.payload = p
+	}
+
+	if err != nil {
+		return err
+	}
+
+	if len(d.buf) != 0 {
+		return fmt.Errorf("%s: %d trailing bytes", id, len(d.buf))
+	}
+
+	req.ID = id
+	req.binary = true
+
+	return nil
+}
+
+func resultToInt64(v interface{}) (int64, bool) {
+	switch n := v.(type) {
+	case int:
+		return int64(n), true
+	case int64:
+		return n, true
+	case uint64:
+		return int64(n), n <= math.MaxInt64
+	case float64:
+		return int64(n), n == math.Trunc(n)
+	}
+
+	return 0, false
+}
+
+// MarshalBinary implements encoding.BinaryMarshaler. ErrNotBinary is
+// returned if Data holds a non-integer result.
+func (resp *Response) MarshalBinary() ([]byte, error) {
+	e := binaryEncoder{}
+
+	if len(resp.Data) > math.MaxUint8 {
+		return nil, ErrNotBinary
+	}
+
+	if resp.Success {
+		e.byte(1)
+	} else {
+		e.byte(0)
+	}
+
+	if err := e.string(resp.Error); err != nil {
+		return nil, err
+	}
+
+	e.byte(byte(len(resp.Data)))
+	for name, value := range resp.Data {
+		n, ok := resultToInt64(value)
+		if !ok {
+			return nil, ErrNotBinary
+		}
+		if err := e.string(name); err != nil {
+			return nil, err
+		}
+		e.int64(n)
+	}
+
+	return e.buf, nil
+}
+
+// UnmarshalBinary implements encoding.BinaryUnmarshaler. As with JSON,
+// results are decoded as float64.
+func (resp *Response) UnmarshalBinary(data []byte) error {
+	d := binaryDecoder{buf: data}
+
+	success, err := d.byte()
+	if err != nil {
+		return err
+	}
+	resp.Success = success != 0
+
+	if resp.Error, err = d.string(); err != nil {
+		return err
+	}
+
+	n, err := d.byte()
+	if err != nil {
+		return err
+	}
+
+	resp.Data = nil
+	for i := 0; i < int(n); i++ {
+		name, err := d.string()
+		if err != nil {
+			return err
+		}
+		value, err := d.int64()
+		if err != nil {
+			return err
+		}
+		if resp.Data == nil {
+			resp.Data = make(map[string]interface{})
+		}
+		resp.Data[name] = float64(value)
+	}
+
+	if len(d.buf) != 0 {
+		return fmt.Errorf("response: %d trailing bytes", len(d.buf))
+	}
+
+	return nil
+}
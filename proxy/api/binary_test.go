@@ -0,0 +1,264 @@
+// Copyright (c) 2016 Intel Corporation
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+package api
+
+import (
+	"encoding/json"
+	"testing"
+
+	"github.com/stretchr/testify/assert"
+)
+
+const testContainerID = "756535dc6e9ab9b560f84c85063f55952273a23192641fc2756aa9721d9d1e16"
+
+var testExecCmd = json.RawMessage(`{"container":"` + testContainerID + `",` +
+	`"process":{"terminal":false,"stdio":1,"stderr":2,` +
+	`"args":["/bin/sh","-c","true"],` +
+	`"envs":[{"env":"PATH","value":"/usr/bin:/bin"}]}}`)
+
+var testPayloads = []struct {
+	id      string
+	payload interface{}
+}{
+	{"hello", &Hello{
+		ContainerID: testContainerID,
+		CtlSerial:   "/run/cc-oci-runtime/" + testContainerID + "/ga-ctl.sock",
+		IoSerial:    "/run/cc-oci-runtime/" + testContainerID + "/ga-tty.sock",
+		Console:     "/run/cc-oci-runtime/" + testContainerID + "/console.sock",
+	}},
+	{"attach", &Attach{ContainerID: testContainerID}},
+	{"bye", &Bye{ContainerID: testContainerID}},
+	{"allocateIO", &AllocateIo{NStreams: 2}},
+	{"allocateIO", &AllocateIo{NStreams: 1, OutputPolicy: OutputPolicyBlock}},
+	{"hyper", &Hyper{HyperName: "execcmd", Data: testExecCmd}},
+}
+
+func TestBinaryRequest(t *testing.T) {
+	for _, test := range testPayloads {
+		data, err := NewBinaryRequest(test.payload).MarshalBinary()
+		assert.Nil(t, err)
+
+		req := Request{}
+		assert.Nil(t, req.UnmarshalBinary(data))
+		assert.Equal(t, test.id, req.ID)
+		assert.True(t, req.Binary())
+		assert.Equal(t, test.payload, req.payload)
+
+		// truncated messages are rejected (the hyperstart data of
+		// hyper is opaque to the proxy)
+		if test.id != "hyper" {
+			req = Request{}
+			assert.NotNil(t, req.UnmarshalBinary(data[:len(data)-1]))
+		}
+	}
+
+	req := Request{}
+	assert.NotNil(t, req.UnmarshalBinary(nil))
+	assert.NotNil(t, req.UnmarshalBinary([]byte{0xff}))
+
+	_, err := NewBinaryRequest(&Response{}).MarshalBinary()
+	assert.Equal(t, ErrNotBinary, err)
+}
+
+func TestDecodeData(t *testing.T) {
+	// binary
+	req := NewBinaryRequest(&Bye{ContainerID: "foo"})
+	bye := Bye{}
+	assert.Nil(t, req.DecodeData(&bye))
+	assert.Equal(t, "foo", bye.ContainerID)
+
+	hello := Hello{}
+	assert.NotNil(t, req.DecodeData(&hello))
+
+	// JSON
+	req = &Request{ID: "bye", Data: []byte(`{"containerId":"bar"}`)}
+	assert.Nil(t, req.DecodeData(&bye))
+	assert.Equal(t, "bar", bye.ContainerID)
+	assert.False(t, req.Binary())
+}
+
+func TestBinaryResponse(t *testing.T) {
+	responses := []Response{
+		{Success: true},
+		{Success: false, Error: "no payload named 'foo'"},
+		{Success: true, Data: map[string]interface{}{
+			"version": float64(Version),
+			"ioBase":  float64(1 << 40),
+		}},
+	}
+
+	for _, r := range responses {
+		data, err := r.MarshalBinary()
+		assert.Nil(t, err)
+
+		resp := Response{}
+		assert.Nil(t, resp.UnmarshalBinary(data))
+		assert.Equal(t, r, resp)
+	}
+
+	// integer results are converted as encoding/json does
+	r := Response{Success: true, Data: map[string]interface{}{
+		"version": Version,
+		"ioBase":  uint64(4),
+	}}
+	data, err := r.MarshalBinary()
+	assert.Nil(t, err)
+	resp := Response{}
+	assert.Nil(t, resp.UnmarshalBinary(data))
+	assert.Equal(t, float64(Version), resp.Data["version"])
+	assert.Equal(t, float64(4), resp.Data["ioBase"])
+
+	// non-integer results can't be binary encoded
+	r.Data["foo"] = "bar"
+	_, err = r.MarshalBinary()
+	assert.Equal(t, ErrNotBinary, err)
+}
+
+func TestReadMessageBinary(t *testing.T) {
+	c0, c1, err := socketpair()
+	assert.Nil(t, err)
+	defer c0.Close()
+	defer c1.Close()
+
+	hello := testPayloads[0].payload
+	assert.Nil(t, WriteMessageAs(c0, NewBinaryRequest(hello), true))
+
+	req := Request{}
+	assert.Nil(t, ReadMessage(c1, &req))
+	assert.Equal(t, "hello", req.ID)
+	assert.Equal(t, hello, req.payload)
+
+	// binary messages can't be decoded into arbitrary types
+	assert.Nil(t, WriteMessageAs(c0, NewBinaryRequest(hello), true))
+	var m map[string]interface{}
+	assert.NotNil(t, ReadMessage(c1, &m))
+}
+
+// Encode and decode cost of the requests issued for each container, in both
+// encodings. The JSON benchmarks mirror what the proxy does: decode the
+// Request and then its payload.
+
+func benchmarkRequestsJSON(b *testing.B, decode bool) {
+	reqs := make([]Request, len(testPayloads))
+	for i, test := range testPayloads {
+		data, _ := json.Marshal(test.payload)
+		reqs[i] = Request{ID: test.id, Data: data}
+	}
+	encoded := make([][]byte, len(reqs))
+	for i := range reqs {
+		encoded[i], _ = json.Marshal(&reqs[i])
+	}
+
+	b.ReportAllocs()
+	b.ResetTimer()
+
+	for n := 0; n < b.N; n++ {
+		for i, test := range testPayloads {
+			if !decode {
+				data, _ := json.Marshal(test.payload)
+				req := Request{ID: test.id, Data: data}
+				if _, err := json.Marshal(&req); err != nil {
+					b.Fatal(err)
+				}
+				continue
+			}
+
+			req := Request{}
+			if err := json.Unmarshal(encoded[i], &req); err != nil {
+				b.Fatal(err)
+			}
+			if err := req.DecodeData(testPayloads[i].payload); err != nil {
+				b.Fatal(err)
+			}
+		}
+	}
+}
+
+func benchmarkRequestsBinary(b *testing.B, decode bool) {
+	encoded := make([][]byte, len(testPayloads))
+	for i, test := range testPayloads {
+		encoded[i], _ = NewBinaryRequest(test.payload).MarshalBinary()
+	}
+
+	b.ReportAllocs()
+	b.ResetTimer()
+
+	for n := 0; n < b.N; n++ {
+		for i, test := range testPayloads {
+			if !decode {
+				if _, err := NewBinaryRequest(test.payload).MarshalBinary(); err != nil {
+					b.Fatal(err)
+				}
+				continue
+			}
+
+			req := Request{}
+			if err := req.UnmarshalBinary(encoded[i]); err != nil {
+				b.Fatal(err)
+			}
+		}
+	}
+}
+
+func BenchmarkRequestEncodeJSON(b *testing.B) {
+	benchmarkRequestsJSON(b, false)
+}
+
+func BenchmarkRequestDecodeJSON(b *testing.B) {
+	benchmarkRequestsJSON(b, true)
+}
+
+func BenchmarkRequestEncodeBinary(b *testing.B) {
+	benchmarkRequestsBinary(b, false)
+}
+
+func BenchmarkRequestDecodeBinary(b *testing.B) {
+	benchmarkRequestsBinary(b, true)
+}
+
+var testResponse = Response{
+	Success: true,
+	Data:    map[string]interface{}{"ioBase": float64(1234)},
+}
+
+func BenchmarkResponseJSON(b *testing.B) {
+	b.ReportAllocs()
+
+	for n := 0; n < b.N; n++ {
+		data, err := json.Marshal(&testResponse)
+		if err != nil {
+			b.Fatal(err)
+		}
+		resp := Response{}
+		if err := json.Unmarshal(data, &resp); err != nil {
+			b.Fatal(err)
+		}
+	}
+}
+
+func BenchmarkResponseBinary(b *testing.B) {
+	b.ReportAllocs()
+
+	for n := 0; n < b.N; n++ {
+		data, err := testResponse.MarshalBinary()
+		if err != nil {
+			b.Fatal(err)
+		}
+		resp := Response{}
+		if err := resp.UnmarshalBinary(data); err != nil {
+			b.Fatal(err)
+		}
+	}
+}
@@ -25,6 +25,9 @@ import (
 // high level API.
 type Client struct {
 	conn *net.UnixConn
+
+	// Use the binary encoding, negotiated by Hello or Attach
+	binary bool
 }
 
 // NewClient creates a new client object to communicate with the proxy using
@@ -44,6 +47,19 @@ func (client *Client) Close() {
 func (client *Client) sendPayload(id string, payload interface{}) (*Response, error) {
 	var err error
 
+	if client.binary {
+		data, err := NewBinaryRequest(payload).MarshalBinary()
+		if err == nil {
+			if err = writeFrame(client.conn, FlagBinary, data); err != nil {
+				return nil, err
+			}
+			return client.readResponse()
+		}
+		if err != ErrNotBinary {
+			return nil, err
+		}
+	}
+
 	req := Request{}
 	req.ID = id
 	if payload != nil {
@@ -56,6 +72,10 @@ func (client *Client) sendPayload(id string, payload interface{}) (*Response, er
 		return nil, err
 	}
 
+	return client.readResponse()
+}
+
+func (client *Client) readResponse() (*Response, error) {
 	resp := Response{}
 	if err := ReadMessage(client.conn, &resp); err != nil {
 		return nil, err
@@ -115,6 +135,7 @@ func (client *Client) Hello(containerID, ctlSerial, ioSerial string,
 		return nil, errors.New("hello: no version in response")
 	}
 	ret.Version = int(val.(float64))
+	client.binary = ret.Version >= BinaryVersion
 
 	return ret, errorFromResponse(resp)
 }
@@ -148,14 +169,17 @@ func (client *Client) Attach(containerID string, options *AttachOptions) (*Attac
 		return nil, errors.New("attach: no version in response")
 	}
 	ret.Version = int(val.(float64))
+	client.binary = ret.Version >= BinaryVersion
 
 	return ret, errorFromResponse(resp)
 }
 
-// AllocateIo wraps the AllocateIo payload (see payload description for more details)
-func (client *Client) AllocateIo(nStreams int) (ioBase uint64, ioFile *os.File, err error) {
+// AllocateIo wraps the AllocateIo payload (see payload description for more
+// details). An empty outputPolicy selects the proxy's default.
+func (client *Client) AllocateIo(nStreams int, outputPolicy string) (ioBase uint64, ioFile *os.File, err error) {
 	allocate := AllocateIo{
-		NStreams: nStreams,
+		NStreams:     nStreams,
+		OutputPolicy: outputPolicy,
 	}
 
 	resp, err := client.sendPayload("allocateIO", &allocate)
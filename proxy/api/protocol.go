@@ -15,6 +15,7 @@
 package api
 
 import (
+	"encoding"
 	"encoding/binary"
 	"encoding/json"
 	"errors"
@@ -36,9 +37,16 @@ type header struct {
 // The list of possible payloads are documented in this package.
 //
 // Each Request has a corresponding Response message sent back from the proxy.
+//
+// A Request can also use the compact binary encoding (see FlagBinary), in
+// which case handlers should use DecodeData to retrieve the payload.
 type Request struct {
 	ID   string          `json:"id"`
 	Data json.RawMessage `json:"data,omitempty"`
+
+	// Decoded payload and encoding of binary requests
+	payload interface{}
+	binary  bool
 }
 
 // A Response is a JSON message sent back from the proxy to a client after a
@@ -53,7 +61,7 @@ type Response struct {
 }
 
 // ReadMessage reads a message from reader. A message is either a Request or a
-// Response
+// Response. Both the JSON and the binary encodings are accepted.
 func ReadMessage(reader io.Reader, msg interface{}) error {
 	buf := make([]byte, headerLength)
 	n, err := reader.Read(buf)
@@ -81,6 +89,14 @@ func ReadMessage(reader io.Reader, msg interface{}) error {
 		received += n
 	}
 
+	if header.flags&FlagBinary != 0 {
+		u, ok := msg.(encoding.BinaryUnmarshaler)
+		if !ok {
+			return errors.New("unexpected binary message")
+		}
+		return u.UnmarshalBinary(data)
+	}
+
 	err = json.Unmarshal(data, msg)
 	if err != nil {
 		return err
@@ -97,8 +113,30 @@ func WriteMessage(writer io.Writer, msg interface{}) error {
 		return err
 	}
 
+	return writeFrame(writer, 0, data)
+}
+
+// WriteMessageAs writes a message into writer using the binary encoding if
+// binary is true and msg can be binary encoded, falling back to JSON
+// otherwise.
+func WriteMessageAs(writer io.Writer, msg interface{}, binary bool) error {
+	if m, ok := msg.(encoding.BinaryMarshaler); ok && binary {
+		data, err := m.MarshalBinary()
+		if err == nil {
+			return writeFrame(writer, FlagBinary, data)
+		}
+		if err != ErrNotBinary {
+			return err
+		}
+	}
+
+	return WriteMessage(writer, msg)
+}
+
+func writeFrame(writer io.Writer, flags uint32, data []byte) error {
 	buf := make([]byte, headerLength)
 	binary.BigEndian.PutUint32(buf[0:4], uint32(len(data)))
+	binary.BigEndian.PutUint32(buf[4:8], flags)
 	n, err := writer.Write(buf)
 	if err != nil {
 		return err
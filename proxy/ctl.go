@@ -0,0 +1,260 @@
+// Copyright (c) 2017 Intel Corporation
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+package main
+
+import (
+	"encoding/binary"
+	"errors"
+	"fmt"
+	"io"
+	"net"
+	"sync"
+	"time"
+
+	"github.com/containers/virtcontainers/hyperstart"
+	"github.com/golang/glog"
+	hyper "github.com/hyperhq/runv/hyperstart/api/json"
+)
+
+// ctl messages are made of an 8 bytes header, the command code and the
+// message length, header included, both big endian, followed by the payload.
+const (
+	ctlHeaderSize   = 8
+	ctlLengthOffset = 4
+
+	// Largest message hyperstart accepts
+	ctlMaxSize = 10240
+)
+
+// Maximum number of ctl requests a VM can have in flight. Further requests
+// wait for a slot, within their timeout.
+const ctlMaxPending = 64
+
+// Same as the hyperstart package codeList, which isn't exported
+var ctlCodes = map[string]uint32{
+	hyperstart.Version:        hyper.INIT_VERSION,
+	hyperstart.StartPod:       hyper.INIT_STARTPOD,
+	hyperstart.DestroyPod:     hyper.INIT_DESTROYPOD,
+	hyperstart.ExecCmd:        hyper.INIT_EXECCMD,
+	hyperstart.Ready:          hyper.INIT_READY,
+	hyperstart.Ack:            hyper.INIT_ACK,
+	hyperstart.Error:          hyper.INIT_ERROR,
+	hyperstart.WinSize:        hyper.INIT_WINSIZE,
+	hyperstart.Ping:           hyper.INIT_PING,
+	hyperstart.Next:           hyper.INIT_NEXT,
+	hyperstart.WriteFile:      hyper.INIT_WRITEFILE,
+	hyperstart.ReadFile:       hyper.INIT_READFILE,
+	hyperstart.NewContainer:   hyper.INIT_NEWCONTAINER,
+	hyperstart.KillContainer:  hyper.INIT_KILLCONTAINER,
+	hyperstart.OnlineCPUMem:   hyper.INIT_ONLINECPUMEM,
+	hyperstart.SetupInterface: hyper.INIT_SETUPINTERFACE,
+	hyperstart.SetupRoute:     hyper.INIT_SETUPROUTE,
+}
+
+type ctlReply struct {
+	msg *hyper.DecodedMessage
+	err error
+}
+
+// ctlChannel lets the clients of a VM share the hyperstart ctl channel
+// without waiting for each other's commands to complete.
+//
+// hyperstart handles ctl commands in order and its ACK/ERROR replies don't say
+// which command they answer. Commands are written as soon as they're submitted
+// and each reply goes to the oldest command still waiting for one.
+type ctlChannel struct {
+	conn    net.Conn
+	timeout time.Duration
+
+	// One token per request in flight, bounding the pending queue
+	slots chan struct{}
+
+	// Protects pending and err, and serializes writes on conn so the
+	// queue order is the order commands go out in
+	sync.Mutex
+
+	// Requests waiting for a reply, oldest first. Requests that timed out
+	// stay there until their reply comes and is dropped.
+	pending []chan ctlReply
+
+	// Set once the channel is unusable
+	err error
+}
+
+var errCtlClosed = errors.New("ctl channel closed")
+
+func newCtlChannel(conn net.Conn, maxPending int, timeout time.Duration) *ctlChannel {
+	return &ctlChannel{
+		conn:    conn,
+		timeout: timeout,
+		slots:   make(chan struct{}, maxPending),
+	}
+}
+
+// send writes the hyperstart command cmd and waits for its reply
+func (ctl *ctlChannel) send(cmd string, data []byte) (*hyper.DecodedMessage, error) {
+	code, ok := ctlCodes[cmd]
+	if !ok {
+		return nil, fmt.Errorf("unknown command '%s'", cmd)
+	}
+
+	length := ctlHeaderSize + len(data)
+	if length > ctlMaxSize {
+		return nil, fmt.Errorf("message too long %d", length)
+	}
+
+	deadline := time.Now().Add(ctl.timeout)
+	timer := time.NewTimer(ctl.timeout)
+	defer timer.Stop()
+
+	select {
+	case ctl.slots <- struct{}{}:
+	case <-timer.C:
+		return nil, fmt.Errorf("%s: too many ctl requests in flight", cmd)
+	}
+
+	msg := make([]byte, length)
+	binary.BigEndian.PutUint32(msg[:], code)
+	binary.BigEndian.PutUint32(msg[ctlLengthOffset:], uint32(length))
+	copy(msg[ctlHeaderSize:], data)
+
+	done := make(chan ctlReply, 1)
+
+	ctl.Lock()
+	err := ctl.err
+	if err == nil {
+		ctl.conn.SetWriteDeadline(deadline)
+		if _, err = ctl.conn.Write(msg); err != nil {
+			// A partial write leaves the channel out of sync
+			ctl.fail(fmt.Errorf("error writing ctl command: %v", err))
+		} else {
+			ctl.pending = append(ctl.pending, done)
+		}
+	}
+	ctl.Unlock()
+
+	if err != nil {
+		<-ctl.slots
+		return nil, err
+	}
+
+	select {
+	case reply := <-done:
+		return reply.msg, reply.err
+	case <-timer.C:
+		return nil, fmt.Errorf("%s: timed out waiting for hyperstart", cmd)
+	}
+}
+
+// fail marks the channel as unusable and fails the pending requests. Needs to
+// be called with the lock held.
+func (ctl *ctlChannel) fail(err error) {
+	if ctl.err != nil {
+		return
+	}
+
+	ctl.err = err
+	for _, done := range ctl.pending {
+		done <- ctlReply{err: err}
+		<-ctl.slots
+	}
+	ctl.pending = nil
+}
+
+func (ctl *ctlChannel) reply(reply ctlReply) {
+	ctl.Lock()
+	defer ctl.Unlock()
+
+	if len(ctl.pending) == 0 {
+		glog.V(1).Info("unexpected ctl reply from hyperstart")
+		return
+	}
+
+	done := ctl.pending[0]
+	ctl.pending[0] = nil
+	ctl.pending = ctl.pending[1:]
+
+	done <- reply
+	<-ctl.slots
+}
+
+func (ctl *ctlChannel) readMessage() (*hyper.DecodedMessage, error) {
+	header := make([]byte, ctlHeaderSize)
+	if _, err := io.ReadFull(ctl.conn, header); err != nil {
+		return nil, err
+	}
+
+	length := int(binary.BigEndian.Uint32(header[ctlLengthOffset:]))
+	if length < ctlHeaderSize {
+		length = ctlHeaderSize
+	}
+
+	data := make([]byte, length-ctlHeaderSize)
+	if _, err := io.ReadFull(ctl.conn, data); err != nil {
+		return nil, err
+	}
+
+	return &hyper.DecodedMessage{
+		Code:    binary.BigEndian.Uint32(header),
+		Message: data,
+	}, nil
+}
+
+// waitForReady reads the ctl channel until hyperstart says it's ready. It needs
+// to be called before serve().
+func (ctl *ctlChannel) waitForReady() error {
+	for {
+		msg, err := ctl.readMessage()
+		if err != nil {
+			return fmt.Errorf("error waiting for hyperstart: %v", err)
+		}
+
+		switch msg.Code {
+		case hyper.INIT_READY:
+			return nil
+		case hyper.INIT_NEXT:
+			continue
+		default:
+			return fmt.Errorf("CMD ID received %d not matching expected %d",
+				msg.Code, hyper.INIT_READY)
+		}
+	}
+}
+
+// serve dispatches the replies read from the ctl channel until it's closed
+func (ctl *ctlChannel) serve() {
+	for {
+		msg, err := ctl.readMessage()
+		if err != nil {
+			break
+		}
+
+		switch msg.Code {
+		case hyper.INIT_NEXT, hyper.INIT_READY:
+			continue
+		case hyper.INIT_ACK:
+			ctl.reply(ctlReply{msg: msg})
+		case hyper.INIT_ERROR:
+			ctl.reply(ctlReply{err: fmt.Errorf("ERROR received from Hyperstart")})
+		default:
+			ctl.reply(ctlReply{err: fmt.Errorf("CMD ID received %d not matching expected %d",
+				msg.Code, hyper.INIT_ACK)})
+		}
+	}
+
+	ctl.Lock()
+	ctl.fail(errCtlClosed)
+	ctl.Unlock()
+}
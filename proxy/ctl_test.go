@@ -0,0 +1,196 @@
+// Copyright (c) 2017 Intel Corporation
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+package main
+
+import (
+	"encoding/binary"
+	"net"
+	"testing"
+	"time"
+
+	"github.com/containers/virtcontainers/hyperstart"
+	hyper "github.com/hyperhq/runv/hyperstart/api/json"
+	"github.com/stretchr/testify/assert"
+)
+
+// Fake hyperstart end of a ctlChannel
+type ctlPeer struct {
+	t    *testing.T
+	conn net.Conn
+	ctl  *ctlChannel
+}
+
+// newCtlPeer returns a ctlPeer whose replies aren't dispatched until serve() is
+// called
+func newCtlPeer(t *testing.T, maxPending int, timeout time.Duration) *ctlPeer {
+	c0, c1, err := Socketpair()
+	assert.Nil(t, err)
+
+	return &ctlPeer{
+		t:    t,
+		conn: c0,
+		ctl:  newCtlChannel(c1, maxPending, timeout),
+	}
+}
+
+func newServingCtlPeer(t *testing.T, maxPending int, timeout time.Duration) *ctlPeer {
+	peer := newCtlPeer(t, maxPending, timeout)
+	go peer.ctl.serve()
+	return peer
+}
+
+// read returns the next command code written by the ctlChannel
+func (peer *ctlPeer) read() uint32 {
+	other := &ctlChannel{conn: peer.conn}
+	msg, err := other.readMessage()
+	assert.Nil(peer.t, err)
+	return msg.Code
+}
+
+func (peer *ctlPeer) write(code uint32, data []byte) {
+	msg := make([]byte, ctlHeaderSize+len(data))
+	binary.BigEndian.PutUint32(msg[:], code)
+	binary.BigEndian.PutUint32(msg[ctlLengthOffset:], uint32(len(msg)))
+	copy(msg[ctlHeaderSize:], data)
+	_, err := peer.conn.Write(msg)
+	assert.Nil(peer.t, err)
+}
+
+func (peer *ctlPeer) close() {
+	peer.conn.Close()
+	peer.ctl.conn.Close()
+}
+
+type ctlResult struct {
+	msg *hyper.DecodedMessage
+	err error
+}
+
+// send submits cmd from another goroutine, the result being available on the
+// returned channel
+func (peer *ctlPeer) send(cmd string) chan ctlResult {
+	result := make(chan ctlResult, 1)
+	go func() {
+		msg, err := peer.ctl.send(cmd, nil)
+		result <- ctlResult{msg, err}
+	}()
+	return result
+}
+
+func TestCtlChannelReplies(t *testing.T) {
+	peer := newServingCtlPeer(t, ctlMaxPending, time.Minute)
+
+	version := peer.send(hyperstart.Version)
+	assert.Equal(t, uint32(hyper.INIT_VERSION), peer.read())
+
+	// A second command goes out before the first one is answered
+	winsize := peer.send(hyperstart.WinSize)
+	assert.Equal(t, uint32(hyper.INIT_WINSIZE), peer.read())
+
+	// NEXT and READY aren't replies, ACK and ERROR are taken in order
+	peer.write(hyper.INIT_NEXT, []byte{0, 0, 0, 8})
+	peer.write(hyper.INIT_READY, nil)
+	peer.write(hyper.INIT_ACK, []byte("foo"))
+	peer.write(hyper.INIT_ERROR, nil)
+
+	r := <-version
+	assert.Nil(t, r.err)
+	assert.Equal(t, []byte("foo"), r.msg.Message)
+
+	r = <-winsize
+	assert.NotNil(t, r.err)
+
+	// Unknown commands never make it to hyperstart
+	_, err := peer.ctl.send("foo", nil)
+	assert.NotNil(t, err)
+
+	peer.close()
+}
+
+func TestCtlChannelTimeout(t *testing.T) {
+	peer := newServingCtlPeer(t, ctlMaxPending, 100*time.Millisecond)
+
+	slow := peer.send(hyperstart.NewContainer)
+	assert.Equal(t, uint32(hyper.INIT_NEWCONTAINER), peer.read())
+	r := <-slow
+	assert.NotNil(t, r.err)
+
+	// The reply to the timed out command is dropped when it comes
+	winsize := peer.send(hyperstart.WinSize)
+	assert.Equal(t, uint32(hyper.INIT_WINSIZE), peer.read())
+	peer.write(hyper.INIT_ERROR, nil)
+	peer.write(hyper.INIT_ACK, nil)
+	r = <-winsize
+	assert.Nil(t, r.err)
+
+	peer.close()
+}
+
+func TestCtlChannelQueueFull(t *testing.T) {
+	peer := newServingCtlPeer(t, 1, 100*time.Millisecond)
+
+	first := peer.send(hyperstart.NewContainer)
+	assert.Equal(t, uint32(hyper.INIT_NEWCONTAINER), peer.read())
+
+	// No slot is freed until hyperstart replies
+	_, err := peer.ctl.send(hyperstart.WinSize, nil)
+	assert.NotNil(t, err)
+	<-first
+	_, err = peer.ctl.send(hyperstart.WinSize, nil)
+	assert.NotNil(t, err)
+
+	peer.write(hyper.INIT_ACK, nil)
+	winsize := peer.send(hyperstart.WinSize)
+	assert.Equal(t, uint32(hyper.INIT_WINSIZE), peer.read())
+	peer.write(hyper.INIT_ACK, nil)
+	r := <-winsize
+	assert.Nil(t, r.err)
+
+	peer.close()
+}
+
+func TestCtlChannelClosed(t *testing.T) {
+	peer := newServingCtlPeer(t, ctlMaxPending, time.Minute)
+
+	pending := peer.send(hyperstart.Version)
+	assert.Equal(t, uint32(hyper.INIT_VERSION), peer.read())
+	peer.conn.Close()
+
+	r := <-pending
+	assert.NotNil(t, r.err)
+
+	_, err := peer.ctl.send(hyperstart.Version, nil)
+	assert.NotNil(t, err)
+
+	peer.ctl.conn.Close()
+}
+
+func TestCtlChannelWaitForReady(t *testing.T) {
+	peer := newCtlPeer(t, ctlMaxPending, time.Minute)
+	peer.write(hyper.INIT_NEXT, []byte{0, 0, 0, 8})
+	peer.write(hyper.INIT_READY, nil)
+	assert.Nil(t, peer.ctl.waitForReady())
+	peer.close()
+
+	peer = newCtlPeer(t, ctlMaxPending, time.Minute)
+	peer.write(hyper.INIT_ACK, nil)
+	assert.NotNil(t, peer.ctl.waitForReady())
+	peer.close()
+
+	peer = newCtlPeer(t, ctlMaxPending, time.Minute)
+	peer.conn.Close()
+	assert.NotNil(t, peer.ctl.waitForReady())
+	peer.close()
+}
@@ -0,0 +1,134 @@
+// Copyright (c) 2017 Intel Corporation
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+package main
+
+import (
+	"encoding/binary"
+	"fmt"
+	"io"
+	"io/ioutil"
+	"sync"
+
+	"github.com/golang/glog"
+)
+
+// I/O frames, as exchanged with hyperstart and the shims, are made of a 12
+// bytes header followed by the payload:
+//   - the session (sequence number), 8 bytes,
+//   - the frame length, header included, 4 bytes.
+//
+// Both integers are big endian.
+const (
+	ioFrameHeaderSize   = 12
+	ioFrameLengthOffset = 8
+
+	// Largest frame hyperstart accepts (src/init.c, hyper_channel_ops,
+	// rbuf_size). It's also the size of the pooled buffers.
+	ioFrameMaxSize = 10240
+)
+
+// An ioFrame is a full I/O frame, header included, read in a single buffer.
+// Forwarding it is a matter of writing that buffer out again: the payload is
+// never copied.
+type ioFrame struct {
+	buf []byte
+}
+
+// Buffers big enough for any valid frame are recycled to keep the
+// per-frame cost of the I/O paths away from the garbage collector.
+var ioFramePool = sync.Pool{
+	New: func() interface{} {
+		return &ioFrame{buf: make([]byte, ioFrameMaxSize)}
+	},
+}
+
+// readIoFrame reads the next frame from r, skipping oversized ones. The frame
+// has to be given back with release() once done with.
+func readIoFrame(r io.Reader) (*ioFrame, error) {
+	frame := ioFramePool.Get().(*ioFrame)
+	buf := frame.buf[:ioFrameMaxSize]
+	var length int
+
+	for {
+		if _, err := io.ReadFull(r, buf[:ioFrameHeaderSize]); err != nil {
+			frame.release()
+			return nil, err
+		}
+
+		length = int(binary.BigEndian.Uint32(buf[ioFrameLengthOffset:]))
+		if length < ioFrameHeaderSize {
+			length = ioFrameHeaderSize
+		}
+
+		if length <= ioFrameMaxSize {
+			break
+		}
+
+		// Oversized frames can't be forwarded. Their payload is
+		// discarded as it arrives, to stay in sync with the stream
+		// without trusting the peer's length for an allocation.
+		glog.Warningf("dropping %d bytes I/O frame for session %d",
+			length, binary.BigEndian.Uint64(buf))
+		_, err := io.CopyN(ioutil.Discard, r, int64(length-ioFrameHeaderSize))
+		if err == io.EOF {
+			err = io.ErrUnexpectedEOF
+		}
+		if err != nil {
+			frame.release()
+			return nil, err
+		}
+	}
+
+	if _, err := io.ReadFull(r, buf[ioFrameHeaderSize:length]); err != nil {
+		frame.release()
+		return nil, err
+	}
+
+	frame.buf = buf[:length]
+	return frame, nil
+}
+
+func (frame *ioFrame) session() uint64 {
+	return binary.BigEndian.Uint64(frame.buf)
+}
+
+func (frame *ioFrame) payload() []byte {
+	return frame.buf[ioFrameHeaderSize:]
+}
+
+// write sends the frame to w with a single Write() so frames from different
+// goroutines never interleave on the same connection.
+func (frame *ioFrame) write(w io.Writer) error {
+	length := len(frame.buf)
+
+	// The length read from the peer may have been shorter than the header
+	binary.BigEndian.PutUint32(frame.buf[ioFrameLengthOffset:], uint32(length))
+
+	n, err := w.Write(frame.buf)
+	if err != nil {
+		return err
+	}
+
+	if n != length {
+		return fmt.Errorf("%d bytes written out of %d expected", n, length)
+	}
+
+	return nil
+}
+
+func (frame *ioFrame) release() {
+	frame.buf = frame.buf[:ioFrameMaxSize]
+	ioFramePool.Put(frame)
+}
@@ -0,0 +1,223 @@
+// Copyright (c) 2017 Intel Corporation
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+package main
+
+import (
+	"bytes"
+	"encoding/binary"
+	"fmt"
+	"io"
+	"io/ioutil"
+	"net"
+	"runtime"
+	"sync"
+	"syscall"
+	"testing"
+	"time"
+
+	"github.com/stretchr/testify/assert"
+)
+
+func newIoFrameData(session uint64, length uint32, payload []byte) []byte {
+	data := make([]byte, ioFrameHeaderSize+len(payload))
+	binary.BigEndian.PutUint64(data[:], session)
+	binary.BigEndian.PutUint32(data[ioFrameLengthOffset:], length)
+	copy(data[ioFrameHeaderSize:], payload)
+	return data
+}
+
+func TestIoFrameForward(t *testing.T) {
+	payload := []byte("foo bar")
+	data := newIoFrameData(3, uint32(ioFrameHeaderSize+len(payload)), payload)
+
+	// Two frames back to back, read one at a time
+	frame, err := readIoFrame(bytes.NewReader(append(data, data...)))
+	assert.Nil(t, err)
+	assert.Equal(t, uint64(3), frame.session())
+	assert.Equal(t, payload, frame.payload())
+
+	var out bytes.Buffer
+	assert.Nil(t, frame.write(&out))
+	assert.Equal(t, data, out.Bytes())
+	frame.release()
+}
+
+func TestIoFrameShortLength(t *testing.T) {
+	// A length smaller than the header means no payload, and is fixed up
+	// when forwarding the frame
+	frame, err := readIoFrame(bytes.NewReader(newIoFrameData(1, 4, nil)))
+	assert.Nil(t, err)
+	assert.Equal(t, 0, len(frame.payload()))
+
+	var out bytes.Buffer
+	assert.Nil(t, frame.write(&out))
+	assert.Equal(t, newIoFrameData(1, ioFrameHeaderSize, nil), out.Bytes())
+	frame.release()
+}
+
+func TestIoFrameOversized(t *testing.T) {
+	payload := make([]byte, ioFrameMaxSize)
+	data := newIoFrameData(1, uint32(ioFrameHeaderSize+len(payload)), payload)
+	next := newIoFrameData(2, ioFrameHeaderSize, nil)
+	r := bytes.NewReader(append(data, next...))
+
+	// Oversized frames are consumed but can't be forwarded
+	frame, err := readIoFrame(r)
+	assert.Nil(t, err)
+	assert.Equal(t, uint64(2), frame.session())
+	frame.release()
+
+	_, err = readIoFrame(r)
+	assert.Equal(t, io.EOF, err)
+}
+
+func TestIoFrameHugeLength(t *testing.T) {
+	// The length announced by the peer isn't allocated up front
+	data := newIoFrameData(1, 0xffffffff, nil)
+
+	var before, after runtime.MemStats
+	runtime.ReadMemStats(&before)
+	_, err := readIoFrame(bytes.NewReader(data))
+	runtime.ReadMemStats(&after)
+
+	assert.Equal(t, io.ErrUnexpectedEOF, err)
+	assert.True(t, after.TotalAlloc-before.TotalAlloc < 1024*1024)
+}
+
+func TestIoFrameTruncated(t *testing.T) {
+	data := newIoFrameData(1, ioFrameHeaderSize+8, []byte("foo"))
+
+	_, err := readIoFrame(bytes.NewReader(data))
+	assert.Equal(t, io.ErrUnexpectedEOF, err)
+
+	_, err = readIoFrame(bytes.NewReader(data[:4]))
+	assert.Equal(t, io.ErrUnexpectedEOF, err)
+
+	_, err = readIoFrame(bytes.NewReader(nil))
+	assert.Equal(t, io.EOF, err)
+}
+
+// Size of the frames used by the I/O benchmarks, header included.
+const ioBenchFrameSize = 4096
+
+func cpuTime() time.Duration {
+	var usage syscall.Rusage
+
+	if err := syscall.Getrusage(syscall.RUSAGE_SELF, &usage); err != nil {
+		return 0
+	}
+
+	return time.Duration(usage.Utime.Nano() + usage.Stime.Nano())
+}
+
+// benchmarkIo forwards b.N frames between the hyperstart I/O channel and
+// nSessions shims, spreading the frames evenly across sessions. The CPU time
+// includes the benchmark's own shim and hyperstart ends.
+func benchmarkIo(b *testing.B, nSessions int, toHyper bool) {
+	hyper, proxyEnd, err := Socketpair()
+	if err != nil {
+		b.Fatal(err)
+	}
+
+	vm := newVM("benchmark", "", "")
+	vm.io = proxyEnd
+
+	shims := make([]net.Conn, nSessions)
+	frames := make([][]byte, nSessions)
+	for i := range shims {
+		shim, client, err := Socketpair()
+		if err != nil {
+			b.Fatal(err)
+		}
+		shims[i] = shim
+
+		ioBase := vm.AllocateIo(1, uint64(i), client, ioPolicyBlock)
+		payload := make([]byte, ioBenchFrameSize-ioFrameHeaderSize)
+		frames[i] = newIoFrameData(ioBase, ioBenchFrameSize, payload)
+	}
+
+	if !toHyper {
+		vm.wg.Add(1)
+		go vm.ioHyperToClients()
+	}
+
+	// Number of frames sent to/from session i
+	nFrames := func(i int) int64 {
+		n := b.N / nSessions
+		if i < b.N%nSessions {
+			n++
+		}
+		return int64(n)
+	}
+
+	b.SetBytes(ioBenchFrameSize)
+	b.ReportAllocs()
+	start := cpuTime()
+	b.ResetTimer()
+
+	var wg sync.WaitGroup
+	if toHyper {
+		for i := range shims {
+			wg.Add(1)
+			go func(i int) {
+				for n := nFrames(i); n > 0; n-- {
+					shims[i].Write(frames[i])
+				}
+				wg.Done()
+			}(i)
+		}
+		io.CopyN(ioutil.Discard, hyper, int64(b.N)*ioBenchFrameSize)
+	} else {
+		for i := range shims {
+			wg.Add(1)
+			go func(i int) {
+				io.CopyN(ioutil.Discard, shims[i], nFrames(i)*ioBenchFrameSize)
+				wg.Done()
+			}(i)
+		}
+		for n := 0; n < b.N; n++ {
+			hyper.Write(frames[n%nSessions])
+		}
+	}
+	wg.Wait()
+
+	b.StopTimer()
+	mb := float64(b.N) * ioBenchFrameSize / (1024 * 1024)
+	b.Logf("%d frames, %.3f ms CPU/MB", b.N,
+		float64(cpuTime()-start)/float64(time.Millisecond)/mb)
+
+	hyper.Close()
+	proxyEnd.Close()
+	for _, shim := range shims {
+		shim.Close()
+	}
+	vm.Close()
+}
+
+func BenchmarkIoHyperToClients(b *testing.B) {
+	for _, n := range []int{1, 16, 256} {
+		b.Run(fmt.Sprintf("sessions=%d", n), func(b *testing.B) {
+			benchmarkIo(b, n, false)
+		})
+	}
+}
+
+func BenchmarkIoClientsToHyper(b *testing.B) {
+	for _, n := range []int{1, 16, 256} {
+		b.Run(fmt.Sprintf("sessions=%d", n), func(b *testing.B) {
+			benchmarkIo(b, n, true)
+		})
+	}
+}
@@ -0,0 +1,341 @@
+// Copyright (c) 2017 Intel Corporation
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+package main
+
+import (
+	"bufio"
+	"fmt"
+	"io"
+	"net"
+	"net/http"
+	"os"
+	"path/filepath"
+	"runtime"
+	"sort"
+	"strings"
+	"sync"
+	"sync/atomic"
+	"time"
+
+	"github.com/golang/glog"
+)
+
+// I/O directions, as seen from the VM
+const (
+	ioIn  = iota // client -> hyperstart
+	ioOut        // hyperstart -> client
+)
+
+var ioDirections = [...]string{"in", "out"}
+
+// Upper bounds, in seconds, of the ctl round-trip latency histogram buckets
+var ctlLatencyBuckets = [...]float64{
+	.0005, .001, .0025, .005, .01, .025, .05, .1, .25, .5, 1, 2.5, 5, 10,
+}
+
+// Per-VM counters. The I/O ones are updated for every frame and are only
+// accessed atomically, the ctl ones are protected by the mutex.
+type vmMetrics struct {
+	// Payload bytes and frames received, indexed by direction
+	ioBytes  [2]uint64
+	ioFrames [2]uint64
+
+	// Output frames that couldn't be written to their client
+	ioDropped uint64
+
+	// Sessions with a client still connected
+	ioSessions int64
+
+	sync.Mutex
+
+	// ctl requests, hashed by hyperstart command
+	ctlRequests map[string]uint64
+
+	// One counter per bucket, the last one being +Inf
+	ctlLatency      [len(ctlLatencyBuckets) + 1]uint64
+	ctlLatencySum   float64
+	ctlLatencyCount uint64
+}
+
+func newVMMetrics() *vmMetrics {
+	return &vmMetrics{
+		ctlRequests: make(map[string]uint64),
+	}
+}
+
+func (m *vmMetrics) addIo(direction int, payload int) {
+	atomic.AddUint64(&m.ioBytes[direction], uint64(payload))
+	atomic.AddUint64(&m.ioFrames[direction], 1)
+}
+
+func (m *vmMetrics) addCtl(cmd string, latency time.Duration) {
+	seconds := latency.Seconds()
+	bucket := sort.SearchFloat64s(ctlLatencyBuckets[:], seconds)
+
+	m.Lock()
+	m.ctlRequests[cmd]++
+	m.ctlLatency[bucket]++
+	m.ctlLatencySum += seconds
+	m.ctlLatencyCount++
+	m.Unlock()
+}
+
+// A consistent copy of the metrics of a VM, taken when rendering them
+type vmMetricsSnapshot struct {
+	vm *vm
+	vmMetrics
+	lost     bool
+	sessions []*ioSession
+}
+
+func (vm *vm) metricsSnapshot() *vmMetricsSnapshot {
+	m := vm.metrics
+	s := &vmMetricsSnapshot{vm: vm}
+
+	for i := range ioDirections {
+		s.ioBytes[i] = atomic.LoadUint64(&m.ioBytes[i])
+		s.ioFrames[i] = atomic.LoadUint64(&m.ioFrames[i])
+	}
+	s.ioSessions = atomic.LoadInt64(&m.ioSessions)
+	s.ioDropped = atomic.LoadUint64(&m.ioDropped)
+
+	m.Lock()
+	s.ctlRequests = make(map[string]uint64, len(m.ctlRequests))
+	for cmd, n := range m.ctlRequests {
+		s.ctlRequests[cmd] = n
+	}
+	s.ctlLatency = m.ctlLatency
+	s.ctlLatencySum = m.ctlLatencySum
+	s.ctlLatencyCount = m.ctlLatencyCount
+	m.Unlock()
+
+	select {
+	case <-vm.vmLost:
+		s.lost = true
+	default:
+	}
+
+	for seq, session := range vm.sessions() {
+		if seq == session.ioBase && atomic.LoadInt32(&session.closed) == 0 {
+			s.sessions = append(s.sessions, session)
+		}
+	}
+	sort.Sort(sessionsByIoBase(s.sessions))
+
+	return s
+}
+
+type sessionsByIoBase []*ioSession
+
+func (a sessionsByIoBase) Len() int           { return len(a) }
+func (a sessionsByIoBase) Swap(i, j int)      { a[i], a[j] = a[j], a[i] }
+func (a sessionsByIoBase) Less(i, j int) bool { return a[i].ioBase < a[j].ioBase }
+
+var labelEscaper = strings.NewReplacer(`\`, `\\`, `"`, `\"`, "\n", `\n`)
+
+type metricsWriter struct {
+	*bufio.Writer
+}
+
+func (w metricsWriter) header(name, kind, help string) {
+	fmt.Fprintf(w, "# HELP %s %s\n# TYPE %s %s\n", name, help, name, kind)
+}
+
+// sample writes a sample, labels being given as name, value pairs
+func (w metricsWriter) sample(name string, value interface{}, labels ...string) {
+	w.WriteString(name)
+	for i := 0; i+1 < len(labels); i += 2 {
+		if i == 0 {
+			w.WriteByte('{')
+		} else {
+			w.WriteByte(',')
+		}
+		fmt.Fprintf(w, "%s=\"%s\"", labels[i], labelEscaper.Replace(labels[i+1]))
+	}
+	if len(labels) > 0 {
+		w.WriteByte('}')
+	}
+	fmt.Fprintf(w, " %v\n", value)
+}
+
+// writeMetrics renders the proxy metrics in the Prometheus text format
+func (proxy *proxy) writeMetrics(out io.Writer) error {
+	var mem runtime.MemStats
+	runtime.ReadMemStats(&mem)
+
+	vms := proxy.vms.list()
+	snapshots := make([]*vmMetricsSnapshot, len(vms))
+	for i, vm := range vms {
+		snapshots[i] = vm.metricsSnapshot()
+	}
+
+	w := metricsWriter{bufio.NewWriter(out)}
+
+	w.header("go_goroutines", "gauge", "Number of goroutines.")
+	w.sample("go_goroutines", runtime.NumGoroutine())
+	w.header("go_memstats_heap_alloc_bytes", "gauge", "Heap bytes allocated and still in use.")
+	w.sample("go_memstats_heap_alloc_bytes", mem.HeapAlloc)
+	w.header("go_memstats_heap_inuse_bytes", "gauge", "Heap bytes in in-use spans.")
+	w.sample("go_memstats_heap_inuse_bytes", mem.HeapInuse)
+	w.header("go_memstats_heap_objects", "gauge", "Number of allocated heap objects.")
+	w.sample("go_memstats_heap_objects", mem.HeapObjects)
+	w.header("go_gc_count", "counter", "Number of completed GC cycles.")
+	w.sample("go_gc_count", mem.NumGC)
+
+	w.header("cc_proxy_vms", "gauge", "Number of registered VMs.")
+	w.sample("cc_proxy_vms", len(vms))
+	w.header("cc_proxy_vm_lost_total", "counter", "Number of VMs lost since the proxy started.")
+	w.sample("cc_proxy_vm_lost_total", atomic.LoadUint64(&proxy.vmLost))
+
+	w.header("cc_proxy_vm_lost", "gauge", "Whether the VM has been lost, waiting for bye.")
+	for _, s := range snapshots {
+		lost := 0
+		if s.lost {
+			lost = 1
+		}
+		w.sample("cc_proxy_vm_lost", lost, "vm", s.vm.containerID)
+	}
+
+	w.header("cc_proxy_vm_ctl_requests_total", "counter", "ctl requests sent to hyperstart.")
+	for _, s := range snapshots {
+		cmds := make([]string, 0, len(s.ctlRequests))
+		for cmd := range s.ctlRequests {
+			cmds = append(cmds, cmd)
+		}
+		sort.Strings(cmds)
+		for _, cmd := range cmds {
+			w.sample("cc_proxy_vm_ctl_requests_total", s.ctlRequests[cmd],
+				"vm", s.vm.containerID, "command", cmd)
+		}
+	}
+
+	w.header("cc_proxy_vm_ctl_latency_seconds", "histogram", "ctl requests round-trip time.")
+	for _, s := range snapshots {
+		var cumulative uint64
+		for i, n := range s.ctlLatency {
+			le := "+Inf"
+			if i < len(ctlLatencyBuckets) {
+				le = fmt.Sprint(ctlLatencyBuckets[i])
+			}
+			cumulative += n
+			w.sample("cc_proxy_vm_ctl_latency_seconds_bucket", cumulative,
+				"vm", s.vm.containerID, "le", le)
+		}
+		w.sample("cc_proxy_vm_ctl_latency_seconds_sum", s.ctlLatencySum,
+			"vm", s.vm.containerID)
+		w.sample("cc_proxy_vm_ctl_latency_seconds_count", s.ctlLatencyCount,
+			"vm", s.vm.containerID)
+	}
+
+	w.header("cc_proxy_vm_io_bytes_total", "counter", "I/O payload bytes received.")
+	for _, s := range snapshots {
+		for i, direction := range ioDirections {
+			w.sample("cc_proxy_vm_io_bytes_total", s.ioBytes[i],
+				"vm", s.vm.containerID, "direction", direction)
+		}
+	}
+
+	w.header("cc_proxy_vm_io_frames_total", "counter", "I/O frames received.")
+	for _, s := range snapshots {
+		for i, direction := range ioDirections {
+			w.sample("cc_proxy_vm_io_frames_total", s.ioFrames[i],
+				"vm", s.vm.containerID, "direction", direction)
+		}
+	}
+
+	w.header("cc_proxy_vm_io_dropped_frames_total", "counter", "Output frames that couldn't be written to their client.")
+	for _, s := range snapshots {
+		w.sample("cc_proxy_vm_io_dropped_frames_total", s.ioDropped, "vm", s.vm.containerID)
+	}
+
+	w.header("cc_proxy_vm_io_sessions", "gauge", "I/O sessions with a connected client.")
+	for _, s := range snapshots {
+		w.sample("cc_proxy_vm_io_sessions", s.ioSessions, "vm", s.vm.containerID)
+	}
+
+	w.header("cc_proxy_session_io_bytes_total", "counter", "I/O payload bytes received for a session.")
+	for _, s := range snapshots {
+		for _, session := range s.sessions {
+			for i, direction := range ioDirections {
+				w.sample("cc_proxy_session_io_bytes_total",
+					atomic.LoadUint64(&session.ioBytes[i]),
+					"vm", s.vm.containerID,
+					"session", fmt.Sprint(session.ioBase),
+					"client", fmt.Sprint(session.clientID),
+					"direction", direction)
+			}
+		}
+	}
+
+	w.header("cc_proxy_session_io_queued_frames", "gauge", "Output frames waiting to be written to the client.")
+	for _, s := range snapshots {
+		for _, session := range s.sessions {
+			w.sample("cc_proxy_session_io_queued_frames", len(session.out),
+				"vm", s.vm.containerID,
+				"session", fmt.Sprint(session.ioBase),
+				"client", fmt.Sprint(session.clientID))
+		}
+	}
+
+	w.header("cc_proxy_session_io_dropped_frames_total", "counter", "Output frames that couldn't be written to the client.")
+	for _, s := range snapshots {
+		for _, session := range s.sessions {
+			w.sample("cc_proxy_session_io_dropped_frames_total",
+				atomic.LoadUint64(&session.dropped),
+				"vm", s.vm.containerID,
+				"session", fmt.Sprint(session.ioBase),
+				"client", fmt.Sprint(session.clientID))
+		}
+	}
+
+	return w.Flush()
+}
+
+func (proxy *proxy) metricsHandler(w http.ResponseWriter, r *http.Request) {
+	w.Header().Set("Content-Type", "text/plain; version=0.0.4")
+	if err := proxy.writeMetrics(w); err != nil {
+		glog.V(1).Info("couldn't write metrics: ", err)
+	}
+}
+
+// serveMetrics serves the proxy metrics over HTTP, at /metrics, on the unix
+// socket socketPath
+func (proxy *proxy) serveMetrics(socketPath string) error {
+	if err := os.MkdirAll(filepath.Dir(socketPath), 0750); err != nil {
+		return fmt.Errorf("couldn't create metrics socket directory: %v", err)
+	}
+	if err := os.Remove(socketPath); err != nil && !os.IsNotExist(err) {
+		return fmt.Errorf("couldn't remove existing metrics socket: %v", err)
+	}
+	l, err := net.ListenUnix("unix", &net.UnixAddr{Name: socketPath, Net: "unix"})
+	if err != nil {
+		return fmt.Errorf("couldn't create metrics socket: %v", err)
+	}
+	if err = os.Chmod(socketPath, 0660|os.ModeSocket); err != nil {
+		l.Close()
+		return fmt.Errorf("couldn't set mode on metrics socket: %v", err)
+	}
+
+	mux := http.NewServeMux()
+	mux.HandleFunc("/metrics", proxy.metricsHandler)
+
+	glog.V(1).Info("metrics available on ", socketPath)
+
+	go func() {
+		http.Serve(l, mux)
+	}()
+
+	return nil
+}
@@ -0,0 +1,133 @@
+// Copyright (c) 2017 Intel Corporation
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+package main
+
+import (
+	"bytes"
+	"io/ioutil"
+	"net"
+	"net/http"
+	"os"
+	"path/filepath"
+	"strings"
+	"sync/atomic"
+	"testing"
+	"time"
+
+	"github.com/stretchr/testify/assert"
+)
+
+func TestMetricsCtlLatency(t *testing.T) {
+	m := newVMMetrics()
+
+	m.addCtl("version", 2*time.Millisecond)
+	m.addCtl("version", time.Millisecond)
+	m.addCtl("newcontainer", time.Minute)
+
+	assert.Equal(t, uint64(2), m.ctlRequests["version"])
+	assert.Equal(t, uint64(1), m.ctlRequests["newcontainer"])
+	assert.Equal(t, uint64(3), m.ctlLatencyCount)
+
+	// Buckets are inclusive of their upper bound
+	assert.Equal(t, uint64(1), m.ctlLatency[1])
+	assert.Equal(t, uint64(1), m.ctlLatency[2])
+	assert.Equal(t, uint64(1), m.ctlLatency[len(ctlLatencyBuckets)])
+}
+
+func TestWriteMetrics(t *testing.T) {
+	proxy := newProxy()
+
+	vm := newVM(`foo"bar`, "", "")
+	proxy.vms.add(vm)
+	c0, c1 := net.Pipe()
+	ioBase := vm.AllocateIo(2, 42, c1, ioPolicyBlock)
+	session := vm.findSession(ioBase)
+
+	vm.metrics.addCtl("version", time.Millisecond)
+	vm.metrics.addIo(ioOut, 10)
+	session.ioBytes[ioOut] = 10
+	proxy.vms.add(newVM("lost", "", ""))
+	proxy.vms.get("lost").signalVMLost()
+	proxy.vmLost = 1
+
+	var buf bytes.Buffer
+	assert.Nil(t, proxy.writeMetrics(&buf))
+	out := buf.String()
+
+	for _, line := range []string{
+		"# TYPE cc_proxy_vm_ctl_latency_seconds histogram",
+		"cc_proxy_vms 2",
+		"cc_proxy_vm_lost_total 1",
+		`cc_proxy_vm_lost{vm="lost"} 1`,
+		`cc_proxy_vm_lost{vm="foo\"bar"} 0`,
+		`cc_proxy_vm_ctl_requests_total{vm="foo\"bar",command="version"} 1`,
+		`cc_proxy_vm_ctl_latency_seconds_bucket{vm="foo\"bar",le="0.0005"} 0`,
+		`cc_proxy_vm_ctl_latency_seconds_bucket{vm="foo\"bar",le="0.001"} 1`,
+		`cc_proxy_vm_ctl_latency_seconds_bucket{vm="foo\"bar",le="+Inf"} 1`,
+		`cc_proxy_vm_ctl_latency_seconds_count{vm="foo\"bar"} 1`,
+		`cc_proxy_vm_io_bytes_total{vm="foo\"bar",direction="out"} 10`,
+		`cc_proxy_vm_io_frames_total{vm="foo\"bar",direction="out"} 1`,
+		`cc_proxy_vm_io_frames_total{vm="foo\"bar",direction="in"} 0`,
+		`cc_proxy_vm_io_sessions{vm="foo\"bar"} 1`,
+		`cc_proxy_session_io_bytes_total{vm="foo\"bar",session="1",client="42",direction="out"} 10`,
+	} {
+		assert.Contains(t, out, line+"\n")
+	}
+
+	// Sessions whose client is gone aren't reported anymore
+	c0.Close()
+	for atomic.LoadInt32(&session.closed) == 0 {
+		time.Sleep(time.Millisecond)
+	}
+
+	buf.Reset()
+	assert.Nil(t, proxy.writeMetrics(&buf))
+	out = buf.String()
+	assert.Contains(t, out, `cc_proxy_vm_io_sessions{vm="foo\"bar"} 0`+"\n")
+	assert.False(t, strings.Contains(out, "cc_proxy_session_io_bytes_total{"))
+
+	vm.Close()
+}
+
+func TestServeMetrics(t *testing.T) {
+	dir, err := ioutil.TempDir("", "cc-proxy-test")
+	assert.Nil(t, err)
+	defer os.RemoveAll(dir)
+
+	socketPath := filepath.Join(dir, "metrics", "metrics.sock")
+	proxy := newProxy()
+	assert.Nil(t, proxy.serveMetrics(socketPath))
+
+	client := http.Client{
+		Transport: &http.Transport{
+			Dial: func(network, addr string) (net.Conn, error) {
+				return net.Dial("unix", socketPath)
+			},
+		},
+	}
+
+	resp, err := client.Get("http://cc-proxy/metrics")
+	assert.Nil(t, err)
+	body, err := ioutil.ReadAll(resp.Body)
+	resp.Body.Close()
+	assert.Nil(t, err)
+	assert.Equal(t, http.StatusOK, resp.StatusCode)
+	assert.Contains(t, string(body), "\ncc_proxy_vms 0\n")
+
+	resp, err = client.Get("http://cc-proxy/foo")
+	assert.Nil(t, err)
+	resp.Body.Close()
+	assert.Equal(t, http.StatusNotFound, resp.StatusCode)
+}
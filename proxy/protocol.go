@@ -24,7 +24,7 @@ import (
 )
 
 // XXX: could do with its own package to remove that ugly namespacing
-type protocolHandler func([]byte, interface{}, *handlerResponse)
+type protocolHandler func(*api.Request, interface{}, *handlerResponse)
 
 // Encapsulates the different parts of what a handler can return.
 type handlerResponse struct {
@@ -92,7 +92,7 @@ func (proto *protocol) handleRequest(ctx *clientCtx, req *api.Request, hr *handl
 		}
 	}
 
-	handler(req.Data, ctx.userData, hr)
+	handler(req, ctx.userData, hr)
 	if hr.err != nil {
 		return &api.Response{
 			Success: false,
@@ -128,8 +128,9 @@ func (proto *protocol) Serve(conn net.Conn, userData interface{}) error {
 		// Execute the corresponding handler
 		resp := proto.handleRequest(ctx, &req, &hr)
 
-		// Send the response back to the client.
-		if err = api.WriteMessage(conn, resp); err != nil {
+		// Send the response back to the client, using the encoding
+		// of the request.
+		if err = api.WriteMessageAs(conn, resp, req.Binary()); err != nil {
 			// Something made us unable to write the response back
 			// to the client (could be a disconnection, ...).
 			return err
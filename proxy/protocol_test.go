@@ -25,6 +25,7 @@ import (
 	"sync"
 	"testing"
 
+	"github.com/01org/cc-oci-runtime/proxy/api"
 	"github.com/stretchr/testify/assert"
 )
 
@@ -98,14 +99,20 @@ func writeMessage(writer io.Writer, data []byte) error {
 }
 
 func readMessage(reader io.Reader) ([]byte, error) {
+	data, _, err := readMessageWithFlags(reader)
+	return data, err
+}
+
+func readMessageWithFlags(reader io.Reader) ([]byte, uint32, error) {
 	buf := make([]byte, headerLength)
 	n, err := reader.Read(buf)
 	if err != nil {
-		return nil, err
+		return nil, 0, err
 	}
 	if n != headerLength {
-		return nil, errors.New("couldn't read the full header")
+		return nil, 0, errors.New("couldn't read the full header")
 	}
+	flags := binary.BigEndian.Uint32(buf[4:8])
 
 	received := 0
 	need := int(binary.BigEndian.Uint32(buf[0:4]))
@@ -113,13 +120,13 @@ func readMessage(reader io.Reader) ([]byte, error) {
 	for received < need {
 		n, err := reader.Read(data[received:need])
 		if err != nil {
-			return nil, err
+			return nil, 0, err
 		}
 
 		received += n
 	}
 
-	return data, nil
+	return data, flags, nil
 }
 
 // Test that we correctly give back the user data to handlers
@@ -130,7 +137,7 @@ type myUserData struct {
 
 var testUserData myUserData
 
-func userDataHandler(data []byte, userData interface{}, response *handlerResponse) {
+func userDataHandler(req *api.Request, userData interface{}, response *handlerResponse) {
 	p := userData.(*myUserData)
 	assert.Equal(p.t, p, &testUserData)
 
@@ -155,29 +162,29 @@ func TestUserData(t *testing.T) {
 }
 
 // Tests various behaviours of the protocol main loop and handler dispatching
-func simpleHandler(data []byte, userData interface{}, response *handlerResponse) {
+func simpleHandler(req *api.Request, userData interface{}, response *handlerResponse) {
 }
 
 type Echo struct {
 	Arg string
 }
 
-func echoHandler(data []byte, userData interface{}, response *handlerResponse) {
+func echoHandler(req *api.Request, userData interface{}, response *handlerResponse) {
 	echo := Echo{}
-	json.Unmarshal(data, &echo)
+	req.DecodeData(&echo)
 
 	response.AddResult("result", echo.Arg)
 }
 
-func returnDataHandler(data []byte, userData interface{}, response *handlerResponse) {
+func returnDataHandler(req *api.Request, userData interface{}, response *handlerResponse) {
 	response.AddResult("foo", "bar")
 }
 
-func returnErrorHandler(data []byte, userData interface{}, response *handlerResponse) {
+func returnErrorHandler(req *api.Request, userData interface{}, response *handlerResponse) {
 	response.SetErrorMsg("This is an error")
 }
 
-func returnDataErrorHandler(data []byte, userData interface{}, response *handlerResponse) {
+func returnDataErrorHandler(req *api.Request, userData interface{}, response *handlerResponse) {
 	response.AddResult("foo", "bar")
 	response.SetErrorMsg("This is an error")
 }
@@ -224,6 +231,76 @@ func TestProtocol(t *testing.T) {
 	}
 }
 
+// Binary requests are decoded and answered in the binary encoding, unless
+// the response holds results that can only be sent as JSON
+func allocateIoEchoHandler(req *api.Request, userData interface{}, response *handlerResponse) {
+	allocateIo := api.AllocateIo{}
+	if err := req.DecodeData(&allocateIo); err != nil {
+		response.SetError(err)
+		return
+	}
+
+	response.AddResult("nStreams", allocateIo.NStreams)
+}
+
+func hyperEchoHandler(req *api.Request, userData interface{}, response *handlerResponse) {
+	hyper := api.Hyper{}
+	if err := req.DecodeData(&hyper); err != nil {
+		response.SetError(err)
+		return
+	}
+
+	response.AddResult("hyperName", hyper.HyperName)
+}
+
+func TestProtocolBinary(t *testing.T) {
+	proto := newProtocol()
+	proto.Handle("allocateIO", allocateIoEchoHandler)
+	proto.Handle("hyper", hyperEchoHandler)
+
+	client, _ := setupMockServer(t, proto)
+
+	// binary request, binary response
+	req := api.NewBinaryRequest(&api.AllocateIo{NStreams: 2})
+	err := api.WriteMessageAs(client, req, true)
+	assert.Nil(t, err)
+
+	buf, flags, err := readMessageWithFlags(client)
+	assert.Nil(t, err)
+	assert.Equal(t, uint32(api.FlagBinary), flags)
+
+	resp := api.Response{}
+	assert.Nil(t, resp.UnmarshalBinary(buf))
+	assert.True(t, resp.Success)
+	assert.Equal(t, float64(2), resp.Data["nStreams"])
+
+	// binary request, string result: JSON response
+	req = api.NewBinaryRequest(&api.Hyper{
+		HyperName: "ping",
+		Data:      []byte(`{"foo":"bar"}`),
+	})
+	err = api.WriteMessageAs(client, req, true)
+	assert.Nil(t, err)
+
+	buf, flags, err = readMessageWithFlags(client)
+	assert.Nil(t, err)
+	assert.Equal(t, uint32(0), flags)
+
+	resp = api.Response{}
+	assert.Nil(t, json.Unmarshal(buf, &resp))
+	assert.True(t, resp.Success)
+	assert.Equal(t, "ping", resp.Data["hyperName"])
+
+	// JSON requests still work on the same connection
+	err = writeMessage(client, []byte(`{"id":"allocateIO","data":{"nStreams":1}}`))
+	assert.Nil(t, err)
+
+	buf, flags, err = readMessageWithFlags(client)
+	assert.Nil(t, err)
+	assert.Equal(t, uint32(0), flags)
+	assert.Equal(t, `{"success":true,"data":{"nStreams":1}}`, string(buf))
+}
+
 // Make sure the server closes the connection when encountering an error
 func TestCloseOnError(t *testing.T) {
 	proto := newProtocol()
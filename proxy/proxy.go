@@ -15,7 +15,6 @@
 package main
 
 import (
-	"encoding/json"
 	"flag"
 	"fmt"
 	"io"
@@ -26,6 +25,7 @@ import (
 	"path/filepath"
 	"sync"
 	"sync/atomic"
+	"time"
 
 	"github.com/01org/cc-oci-runtime/proxy/api"
 
@@ -34,15 +34,15 @@ import (
 
 // Main struct holding the proxy state
 type proxy struct {
-	// Protect concurrent accesses from separate client goroutines to this
-	// structure fields
-	sync.Mutex
+	// Number of VMs lost since the proxy started. Accessed atomically, first
+	// in the struct to be 64-bit aligned.
+	vmLost uint64
 
 	// proxy socket
 	listener net.Listener
 
 	// vms are hashed by their containerID
-	vms map[string]*vm
+	vms *vmTable
 
 	// Output the VM console on stderr
 	enableVMConsole bool
@@ -78,11 +78,11 @@ func (c *client) infof(lvl glog.Level, fmt string, a ...interface{}) {
 }
 
 // "hello"
-func helloHandler(data []byte, userData interface{}, response *handlerResponse) {
+func helloHandler(req *api.Request, userData interface{}, response *handlerResponse) {
 	client := userData.(*client)
 	hello := api.Hello{}
 
-	if err := json.Unmarshal(data, &hello); err != nil {
+	if err := req.DecodeData(&hello); err != nil {
 		response.SetError(err)
 		return
 	}
@@ -92,10 +92,8 @@ func helloHandler(data []byte, userData interface{}, response *handlerResponse)
 	}
 
 	proxy := client.proxy
-	proxy.Lock()
-	if _, ok := proxy.vms[hello.ContainerID]; ok {
-
-		proxy.Unlock()
+	vm := newVM(hello.ContainerID, hello.CtlSerial, hello.IoSerial)
+	if !proxy.vms.add(vm) {
 		response.SetErrorf("%s: container already registered",
 			hello.ContainerID)
 		return
@@ -104,18 +102,12 @@ func helloHandler(data []byte, userData interface{}, response *handlerResponse)
 	client.infof(1, "hello(containerId=%s,ctlSerial=%s,ioSerial=%s,console=%s)", hello.ContainerID,
 		hello.CtlSerial, hello.IoSerial, hello.Console)
 
-	vm := newVM(hello.ContainerID, hello.CtlSerial, hello.IoSerial)
-	proxy.vms[hello.ContainerID] = vm
-	proxy.Unlock()
-
 	if hello.Console != "" && proxy.enableVMConsole {
 		vm.setConsole(hello.Console)
 	}
 
 	if err := vm.Connect(); err != nil {
-		proxy.Lock()
-		delete(proxy.vms, hello.ContainerID)
-		proxy.Unlock()
+		proxy.vms.remove(hello.ContainerID)
 		response.SetError(err)
 		return
 	}
@@ -128,25 +120,24 @@ func helloHandler(data []byte, userData interface{}, response *handlerResponse)
 	proxy.wg.Add(1)
 	go func() {
 		<-vm.OnVMLost()
+		atomic.AddUint64(&proxy.vmLost, 1)
 		vm.Close()
 		proxy.wg.Done()
 	}()
 }
 
 // "attach"
-func attachHandler(data []byte, userData interface{}, response *handlerResponse) {
+func attachHandler(req *api.Request, userData interface{}, response *handlerResponse) {
 	client := userData.(*client)
 	proxy := client.proxy
 
 	attach := api.Attach{}
-	if err := json.Unmarshal(data, &attach); err != nil {
+	if err := req.DecodeData(&attach); err != nil {
 		response.SetError(err)
 		return
 	}
 
-	proxy.Lock()
-	vm := proxy.vms[attach.ContainerID]
-	proxy.Unlock()
+	vm := proxy.vms.get(attach.ContainerID)
 
 	if vm == nil {
 		response.SetErrorf("unknown containerID: %s", attach.ContainerID)
@@ -161,8 +152,8 @@ func attachHandler(data []byte, userData interface{}, response *handlerResponse)
 }
 
 // "bye"
-func byeHandler(data []byte, userData interface{}, response *handlerResponse) {
-	// Bye only affects the proxy.vms map and so removes the VM from the
+func byeHandler(req *api.Request, userData interface{}, response *handlerResponse) {
+	// Bye only affects the proxy.vms table and so removes the VM from the
 	// client visible API.
 	// vm.Close(), which tears down the VM object, is done at the end of
 	// the VM life cycle, when  we detect the qemu process is effectively
@@ -172,14 +163,12 @@ func byeHandler(data []byte, userData interface{}, response *handlerResponse) {
 	proxy := client.proxy
 
 	bye := api.Bye{}
-	if err := json.Unmarshal(data, &bye); err != nil {
+	if err := req.DecodeData(&bye); err != nil {
 		response.SetError(err)
 		return
 	}
 
-	proxy.Lock()
-	vm := proxy.vms[bye.ContainerID]
-	proxy.Unlock()
+	vm := proxy.vms.get(bye.ContainerID)
 
 	if vm == nil {
 		response.SetErrorf("unknown containerID: %s", bye.ContainerID)
@@ -188,20 +177,18 @@ func byeHandler(data []byte, userData interface{}, response *handlerResponse) {
 
 	client.info(1, "bye()")
 
-	proxy.Lock()
-	delete(proxy.vms, vm.containerID)
-	proxy.Unlock()
+	proxy.vms.remove(vm.containerID)
 
 	client.vm = nil
 }
 
 // "allocateIO"
-func allocateIoHandler(data []byte, userData interface{}, response *handlerResponse) {
+func allocateIoHandler(req *api.Request, userData interface{}, response *handlerResponse) {
 	client := userData.(*client)
 	vm := client.vm
 
 	allocateIo := api.AllocateIo{}
-	if err := json.Unmarshal(data, &allocateIo); err != nil {
+	if err := req.DecodeData(&allocateIo); err != nil {
 		response.SetError(err)
 		return
 	}
@@ -216,6 +203,15 @@ func allocateIoHandler(data []byte, userData interface{}, response *handlerRespo
 		return
 	}
 
+	policy, err := parseIoPolicy(allocateIo.OutputPolicy)
+	if allocateIo.OutputPolicy == "" {
+		policy, err = parseIoPolicy(*ArgIoOutputPolicy)
+	}
+	if err != nil {
+		response.SetError(err)
+		return
+	}
+
 	client.infof(1, "allocateIo(nStreams=%d)", allocateIo.NStreams)
 
 	// We'll send c0 to the client, keep c1
@@ -231,7 +227,7 @@ func allocateIoHandler(data []byte, userData interface{}, response *handlerRespo
 		return
 	}
 
-	ioBase := vm.AllocateIo(allocateIo.NStreams, client.id, c1)
+	ioBase := vm.AllocateIo(allocateIo.NStreams, client.id, c1, policy)
 
 	client.infof(1, "-> %d streams allocated, ioBase=%d", allocateIo.NStreams, ioBase)
 
@@ -244,12 +240,12 @@ func allocateIoHandler(data []byte, userData interface{}, response *handlerRespo
 }
 
 // "hyper"
-func hyperHandler(data []byte, userData interface{}, response *handlerResponse) {
+func hyperHandler(req *api.Request, userData interface{}, response *handlerResponse) {
 	client := userData.(*client)
 	hyper := api.Hyper{}
 	vm := client.vm
 
-	if err := json.Unmarshal(data, &hyper); err != nil {
+	if err := req.DecodeData(&hyper); err != nil {
 		response.SetError(err)
 		return
 	}
@@ -267,7 +263,7 @@ func hyperHandler(data []byte, userData interface{}, response *handlerResponse)
 
 func newProxy() *proxy {
 	return &proxy{
-		vms: make(map[string]*vm),
+		vms: newVMTable(),
 	}
 }
 
@@ -278,6 +274,21 @@ var DefaultSocketPath string
 // ArgSocketPath is populated at runtime from the option -socket-path
 var ArgSocketPath = flag.String("socket-path", "", "specify path to socket file")
 
+// ArgCtlTimeout is populated at runtime from the option -ctl-timeout
+var ArgCtlTimeout = flag.Duration("ctl-timeout", 30*time.Second,
+	"time after which a command sent to hyperstart is considered failed")
+
+// ArgIoOutputPolicy is populated at runtime from the option -io-output-policy
+var ArgIoOutputPolicy = flag.String("io-output-policy", api.OutputPolicyDropOldest,
+	"what to do when a client doesn't read its output fast enough: "+
+		api.OutputPolicyBlock+", "+api.OutputPolicyDropOldest+" or "+
+		api.OutputPolicyDisconnect)
+
+// ArgMetricsSocketPath is populated at runtime from the option
+// -metrics-socket-path
+var ArgMetricsSocketPath = flag.String("metrics-socket-path", "",
+	"serve metrics over HTTP on that unix socket")
+
 func (proxy *proxy) init() error {
 	var l net.Listener
 	var err error
@@ -286,6 +297,10 @@ func (proxy *proxy) init() error {
 	v := flag.Lookup("v").Value.(flag.Getter).Get().(glog.Level)
 	proxy.enableVMConsole = v >= 3
 
+	if _, err = parseIoPolicy(*ArgIoOutputPolicy); err != nil {
+		return err
+	}
+
 	// Open the proxy socket
 	fds := listenFds()
 
@@ -330,6 +345,12 @@ func (proxy *proxy) init() error {
 
 	proxy.listener = l
 
+	if len(*ArgMetricsSocketPath) != 0 {
+		if err = proxy.serveMetrics(*ArgMetricsSocketPath); err != nil {
+			return err
+		}
+	}
+
 	return nil
 }
 
@@ -225,9 +225,7 @@ func TestHello(t *testing.T) {
 
 	// Hello should register a new vm object
 	proxy := rig.proxy
-	proxy.Lock()
-	vm := proxy.vms[testContainerID]
-	proxy.Unlock()
+	vm := proxy.vms.get(testContainerID)
 
 	assert.NotNil(t, vm)
 	assert.Equal(t, testContainerID, vm.containerID)
@@ -266,9 +264,7 @@ func TestBye(t *testing.T) {
 
 	// Bye should unregister the vm object
 	proxy := rig.proxy
-	proxy.Lock()
-	vm := proxy.vms[testContainerID]
-	proxy.Unlock()
+	vm := proxy.vms.get(testContainerID)
 	assert.Nil(t, vm)
 
 	// This test shouldn't send anything to hyperstart
@@ -438,9 +434,13 @@ func TestAllocateIo(t *testing.T) {
 	_, err := rig.Client.Hello(testContainerID, ctlSocketPath, ioSocketPath, nil)
 	assert.Nil(t, err)
 
+	// The output policy makes it to the proxy
+	_, _, err = rig.Client.AllocateIo(2, "foo")
+	assert.NotNil(t, err)
+
 	// Allocate 2 seq numbers and verify we can use the fd passed from
 	// allocate I/O to send and receive data.
-	ioBase, ioFile, err := rig.Client.AllocateIo(2)
+	ioBase, ioFile, err := rig.Client.AllocateIo(2, "")
 	assert.Nil(t, err)
 
 	// we always start our allocations from 1
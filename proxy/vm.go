@@ -21,8 +21,10 @@ import (
 	"net"
 	"os"
 	"sync"
+	"sync/atomic"
+	"time"
 
-	"github.com/containers/virtcontainers/hyperstart"
+	"github.com/01org/cc-oci-runtime/proxy/api"
 	"github.com/golang/glog"
 )
 
@@ -32,7 +34,15 @@ type vm struct {
 
 	containerID string
 
-	hyperHandler *hyperstart.Hyperstart
+	// Paths to the qemu chardevs of the hyperstart ctl and I/O channels
+	ctlSerial, ioSerial string
+
+	// hyperstart I/O channel. Frames are forwarded on it directly, see
+	// ioframe.go
+	io net.Conn
+
+	// Multiplexes the clients' commands on the hyperstart ctl channel
+	ctl *ctlChannel
 
 	// Socket to the VM console
 	console struct {
@@ -46,17 +56,63 @@ type vm struct {
 	// ios are hashed by their sequence numbers. If 2 sequence numbers are
 	// allocated for one process (stdin/stdout and stderr) both sequence
 	// numbers appear in this map.
-	ioSessions map[uint64]*ioSession
+	//
+	// The map is looked up for every frame coming from hyperstart, so it's
+	// never modified in place: updates are done on a copy, under the vm
+	// lock, then stored back. Lookups don't need any lock.
+	ioSessions atomic.Value // map[uint64]*ioSession
 
 	// Used to wait for all VM-global goroutines to finish on Close()
 	wg sync.WaitGroup
 
 	// Channel to signal qemu has terminated.
 	vmLost chan interface{}
+
+	metrics *vmMetrics
+}
+
+// What to do with the output of a client that doesn't read it fast enough,
+// once its queue is full
+type ioPolicy int
+
+const (
+	// Wait for the client, stalling the other sessions of the VM
+	ioPolicyBlock ioPolicy = iota
+	// Drop the oldest queued frame
+	ioPolicyDropOldest
+	// Close the client connection
+	ioPolicyDisconnect
+)
+
+func parseIoPolicy(policy string) (ioPolicy, error) {
+	switch policy {
+	case api.OutputPolicyBlock:
+		return ioPolicyBlock, nil
+	case api.OutputPolicyDropOldest:
+		return ioPolicyDropOldest, nil
+	case api.OutputPolicyDisconnect:
+		return ioPolicyDisconnect, nil
+	}
+
+	return ioPolicyBlock, fmt.Errorf("unknown output policy '%s'", policy)
 }
 
+// Number of output frames queued for a client, that's up to 640KB
+const ioSessionQueueSize = 64
+
 // A set of I/O streams between a client and a process running inside the VM
 type ioSession struct {
+	// Payload bytes received, indexed by direction (see metrics.go).
+	// Accessed atomically, first in the struct to be 64-bit aligned.
+	ioBytes [2]uint64
+
+	// Output frames that couldn't be written to the client. Accessed
+	// atomically.
+	dropped uint64
+
+	// Set once the client is gone
+	closed int32
+
 	nStreams int
 	ioBase   uint64
 
@@ -66,21 +122,31 @@ type ioSession struct {
 	// socket connected to the fd sent over to the client
 	client net.Conn
 
-	// Used to wait for per-ioSession goroutines. Currently there's only
-	// one such goroutine, the one reading stdin data from client socket.
+	// Output frames, queued by ioHyperToClients() and written to the
+	// client by ioSessionToClient()
+	out    chan *ioFrame
+	policy ioPolicy
+
+	// Set by ioHyperToClients() when applying ioPolicyDisconnect
+	disconnected bool
+
+	// Used to wait for per-ioSession goroutines: the one reading stdin data
+	// from the client socket and the one writing output to it.
 	wg sync.WaitGroup
 }
 
 func newVM(id, ctlSerial, ioSerial string) *vm {
-	h := hyperstart.NewHyperstart(ctlSerial, ioSerial, "unix")
-
-	return &vm{
-		containerID:  id,
-		hyperHandler: h,
-		nextIoBase:   1,
-		ioSessions:   make(map[uint64]*ioSession),
-		vmLost:       make(chan interface{}),
+	vm := &vm{
+		containerID: id,
+		ctlSerial:   ctlSerial,
+		ioSerial:    ioSerial,
+		nextIoBase:  1,
+		vmLost:      make(chan interface{}),
+		metrics:     newVMMetrics(),
 	}
+	vm.ioSessions.Store(make(map[uint64]*ioSession))
+
+	return vm
 }
 
 // setConsole() will make the proxy output the console data on stderr
@@ -121,11 +187,12 @@ func (vm *vm) dump(lvl glog.Level, data []byte) {
 	glog.Infof("\n%s", hex.Dump(data))
 }
 
-func (vm *vm) findSession(seq uint64) *ioSession {
-	vm.Lock()
-	defer vm.Unlock()
+func (vm *vm) sessions() map[uint64]*ioSession {
+	return vm.ioSessions.Load().(map[uint64]*ioSession)
+}
 
-	return vm.ioSessions[seq]
+func (vm *vm) findSession(seq uint64) *ioSession {
+	return vm.sessions()[seq]
 }
 
 // This function runs in a goroutine, reading data from the io channel and
@@ -133,28 +200,30 @@ func (vm *vm) findSession(seq uint64) *ioSession {
 // There's only one instance of this goroutine per-VM
 func (vm *vm) ioHyperToClients() {
 	for {
-		msg, err := vm.hyperHandler.ReadIoMessage()
+		frame, err := readIoFrame(vm.io)
 		if err != nil {
 			break
 		}
 
-		session := vm.findSession(msg.Session)
+		vm.metrics.addIo(ioOut, len(frame.payload()))
+
+		session := vm.findSession(frame.session())
 		if session == nil {
 			fmt.Fprintf(os.Stderr,
-				"couldn't find client with seq number %d\n", msg.Session)
+				"couldn't find client with seq number %d\n", frame.session())
+			frame.release()
 			continue
 		}
 
-		vm.infof(1, "io", "<- writing to client #%d", session.clientID)
-		vm.dump(2, msg.Message)
+		atomic.AddUint64(&session.ioBytes[ioOut], uint64(len(frame.payload())))
 
-		err = hyperstart.SendIoMessageWithConn(session.client, msg)
-		if err != nil {
-			// When the shim is forcefully killed, it's possible we
-			// still have data to write. Ignore errors for that case.
-			vm.infof(1, "io", "error writing I/O data to client:", err)
-			continue
+		// Don't box the arguments of every frame when not logging
+		if glog.V(1) {
+			vm.infof(1, "io", "<- queuing for client #%d", session.clientID)
+			vm.dump(2, frame.payload())
 		}
+
+		vm.queueOutput(session, frame)
 	}
 
 	// Having an error on the IO channel read is interpreted as having lost
@@ -163,6 +232,79 @@ func (vm *vm) ioHyperToClients() {
 	vm.wg.Done()
 }
 
+func (vm *vm) dropOutput(session *ioSession, frame *ioFrame) {
+	frame.release()
+	atomic.AddUint64(&session.dropped, 1)
+	atomic.AddUint64(&vm.metrics.ioDropped, 1)
+}
+
+// queueOutput hands frame over to the session writer, applying the session
+// policy if the client is lagging behind
+func (vm *vm) queueOutput(session *ioSession, frame *ioFrame) {
+	select {
+	case session.out <- frame:
+		return
+	default:
+	}
+
+	switch session.policy {
+	case ioPolicyBlock:
+		session.out <- frame
+	case ioPolicyDropOldest:
+		// We're the only producer, there's room once a frame is taken
+		// out, be it by us or by the writer
+		for {
+			select {
+			case session.out <- frame:
+				return
+			default:
+			}
+
+			select {
+			case oldest := <-session.out:
+				vm.dropOutput(session, oldest)
+			default:
+			}
+		}
+	case ioPolicyDisconnect:
+		vm.dropOutput(session, frame)
+		if !session.disconnected {
+			session.disconnected = true
+			fmt.Fprintf(os.Stderr,
+				"disconnecting client #%d, not reading its output\n",
+				session.clientID)
+			session.client.Close()
+		}
+	}
+}
+
+// This function runs in a goroutine, writing the output queued for a client.
+// There's one instance of this goroutine per client having done an allocateIO,
+// so a slow client only holds up its own output.
+func (vm *vm) ioSessionToClient(session *ioSession) {
+	var err error
+
+	for frame := range session.out {
+		if err == nil {
+			err = frame.write(session.client)
+			if err == nil {
+				frame.release()
+				continue
+			}
+
+			// When the shim is forcefully killed, it's possible we
+			// still have data to write. Keep consuming the queue so
+			// ioHyperToClients() never waits on this session.
+			vm.infof(1, "io", "error writing I/O data to client #%d: %v",
+				session.clientID, err)
+		}
+
+		vm.dropOutput(session, frame)
+	}
+
+	session.wg.Done()
+}
+
 // Stream the VM console to stderr
 func (vm *vm) consoleToLog() {
 	reader := bufio.NewReader(vm.console.conn)
@@ -191,15 +333,34 @@ func (vm *vm) Connect() error {
 		go vm.consoleToLog()
 	}
 
-	if err := vm.hyperHandler.OpenSockets(); err != nil {
+	// The qemu chardevs only take a single connection each, used
+	// directly by vm.ctl and the I/O goroutines
+	ctlConn, err := net.Dial("unix", vm.ctlSerial)
+	if err != nil {
+		return err
+	}
+
+	ioConn, err := net.Dial("unix", vm.ioSerial)
+	if err != nil {
+		ctlConn.Close()
 		return err
 	}
 
-	if err := vm.hyperHandler.WaitForReady(); err != nil {
-		vm.hyperHandler.CloseSockets()
+	ctl := newCtlChannel(ctlConn, ctlMaxPending, *ArgCtlTimeout)
+	if err := ctl.waitForReady(); err != nil {
+		ctlConn.Close()
+		ioConn.Close()
 		return err
 	}
 
+	vm.ctl = ctl
+	vm.io = ioConn
+	vm.wg.Add(1)
+	go func() {
+		vm.ctl.serve()
+		vm.wg.Done()
+	}()
+
 	vm.wg.Add(1)
 	go vm.ioHyperToClients()
 
@@ -207,7 +368,9 @@ func (vm *vm) Connect() error {
 }
 
 func (vm *vm) SendMessage(cmd string, data []byte) error {
-	_, err := vm.hyperHandler.SendCtlMessage(cmd, data)
+	start := time.Now()
+	_, err := vm.ctl.send(cmd, data)
+	vm.metrics.addCtl(cmd, time.Since(start))
 	return err
 }
 
@@ -216,22 +379,29 @@ func (vm *vm) SendMessage(cmd string, data []byte) error {
 // There's one instance of this goroutine per client having done an allocateIO.
 func (vm *vm) ioClientToHyper(session *ioSession) {
 	for {
-		msg, err := hyperstart.ReadIoMessageWithConn(session.client)
+		frame, err := readIoFrame(session.client)
 		if err != nil {
 			// client process is gone
 			break
 		}
 
-		if msg.Session != session.ioBase {
-			fmt.Fprintf(os.Stderr, "stdin seq %d not matching ioBase %d\n", msg.Session, session.ioBase)
+		if frame.session() != session.ioBase {
+			fmt.Fprintf(os.Stderr, "stdin seq %d not matching ioBase %d\n", frame.session(), session.ioBase)
+			frame.release()
 			session.client.Close()
 			break
 		}
 
-		vm.infof(1, "io", "-> writing to hyper from #%d", session.clientID)
-		vm.dump(2, msg.Message)
+		vm.metrics.addIo(ioIn, len(frame.payload()))
+		atomic.AddUint64(&session.ioBytes[ioIn], uint64(len(frame.payload())))
+
+		if glog.V(1) {
+			vm.infof(1, "io", "-> writing to hyper from #%d", session.clientID)
+			vm.dump(2, frame.payload())
+		}
 
-		err = vm.hyperHandler.SendIoMessage(msg)
+		err = frame.write(vm.io)
+		frame.release()
 		if err != nil {
 			fmt.Fprintf(os.Stderr,
 				"error writing I/O data to hyperstart: %v\n", err)
@@ -239,10 +409,12 @@ func (vm *vm) ioClientToHyper(session *ioSession) {
 		}
 	}
 
+	atomic.StoreInt32(&session.closed, 1)
+	atomic.AddInt64(&vm.metrics.ioSessions, -1)
 	session.wg.Done()
 }
 
-func (vm *vm) AllocateIo(n int, clientID uint64, c net.Conn) uint64 {
+func (vm *vm) AllocateIo(n int, clientID uint64, c net.Conn, policy ioPolicy) uint64 {
 	// Allocate ioBase
 	vm.Lock()
 	ioBase := vm.nextIoBase
@@ -253,45 +425,71 @@ func (vm *vm) AllocateIo(n int, clientID uint64, c net.Conn) uint64 {
 		ioBase:   ioBase,
 		clientID: clientID,
 		client:   c,
+		out:      make(chan *ioFrame, ioSessionQueueSize),
+		policy:   policy,
 	}
 
+	old := vm.sessions()
+	sessions := make(map[uint64]*ioSession, len(old)+n)
+	for seq, s := range old {
+		sessions[seq] = s
+	}
 	for i := 0; i < n; i++ {
-		vm.ioSessions[ioBase+uint64(i)] = session
+		sessions[ioBase+uint64(i)] = session
 	}
+	vm.ioSessions.Store(sessions)
 	vm.Unlock()
 
-	// Starts stdin forwarding between client and hyper
-	session.wg.Add(1)
+	atomic.AddInt64(&vm.metrics.ioSessions, 1)
+
+	// Starts stdin and output forwarding between client and hyper
+	session.wg.Add(2)
 	go vm.ioClientToHyper(session)
+	go vm.ioSessionToClient(session)
 
 	return ioBase
 }
 
+// Close needs to be called once nothing queues output for the session anymore
 func (session *ioSession) Close() {
 	session.client.Close()
+	close(session.out)
 	session.wg.Wait()
 }
 
 func (vm *vm) Close() {
-	vm.hyperHandler.CloseSockets()
+	if vm.ctl != nil {
+		vm.ctl.conn.Close()
+	}
+	if vm.io != nil {
+		vm.io.Close()
+	}
 	if vm.console.conn != nil {
 		vm.console.conn.Close()
 	}
 
-	// Wait for per-client goroutines
 	vm.Lock()
-	for seq, session := range vm.ioSessions {
-		delete(vm.ioSessions, seq)
+	sessions := vm.sessions()
+	vm.ioSessions.Store(make(map[uint64]*ioSession))
+	vm.Unlock()
+
+	// Closing the clients makes their output queues drain, in case
+	// ioHyperToClients() is blocked on one of them
+	for _, session := range sessions {
+		session.client.Close()
+	}
+
+	// Wait for VM global goroutines
+	vm.wg.Wait()
+
+	// Wait for per-client goroutines
+	for seq, session := range sessions {
 		if seq != session.ioBase {
 			continue
 		}
 
 		session.Close()
 	}
-	vm.Unlock()
-
-	// Wait for VM global goroutines
-	vm.wg.Wait()
 }
 
 // OnVmLost returns a channel can be waited on to signal the end of the qemu
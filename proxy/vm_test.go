@@ -0,0 +1,159 @@
+// Copyright (c) 2017 Intel Corporation
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+package main
+
+import (
+	"net"
+	"sync/atomic"
+	"testing"
+	"time"
+
+	"github.com/stretchr/testify/assert"
+)
+
+func TestParseIoPolicy(t *testing.T) {
+	for _, policy := range []string{"block", "drop-oldest", "disconnect"} {
+		_, err := parseIoPolicy(policy)
+		assert.Nil(t, err)
+	}
+
+	_, err := parseIoPolicy("foo")
+	assert.NotNil(t, err)
+}
+
+// A VM with two sessions: one whose client never reads its output and one
+// reading it as it comes
+type policyRig struct {
+	t               *testing.T
+	vm              *vm
+	hyper, proxyEnd net.Conn
+
+	slow, fast             *ioSession
+	slowClient, fastClient net.Conn
+}
+
+func newPolicyRig(t *testing.T, policy ioPolicy) *policyRig {
+	var err error
+
+	rig := &policyRig{t: t}
+	rig.hyper, rig.proxyEnd, err = Socketpair()
+	assert.Nil(t, err)
+
+	rig.vm = newVM("foo", "", "")
+	rig.vm.io = rig.proxyEnd
+
+	// Writes on a net.Pipe() block until the other end reads
+	c0, c1 := net.Pipe()
+	rig.slowClient = c0
+	rig.slow = rig.vm.findSession(rig.vm.AllocateIo(1, 1, c1, policy))
+
+	c2, c3, err := Socketpair()
+	assert.Nil(t, err)
+	rig.fastClient = c2
+	rig.fast = rig.vm.findSession(rig.vm.AllocateIo(1, 2, c3, policy))
+
+	rig.vm.wg.Add(1)
+	go rig.vm.ioHyperToClients()
+
+	return rig
+}
+
+func (rig *policyRig) send(session *ioSession, n int) {
+	frame := newIoFrameData(session.ioBase, ioFrameHeaderSize+3, []byte("foo"))
+	for i := 0; i < n; i++ {
+		_, err := rig.hyper.Write(frame)
+		assert.Nil(rig.t, err)
+	}
+}
+
+// received returns whether the fast client got a frame within timeout
+func (rig *policyRig) received(timeout time.Duration) bool {
+	rig.fastClient.SetReadDeadline(time.Now().Add(timeout))
+	frame, err := readIoFrame(rig.fastClient)
+	if err != nil {
+		return false
+	}
+	frame.release()
+	return true
+}
+
+func (rig *policyRig) close() {
+	rig.hyper.Close()
+	rig.proxyEnd.Close()
+	rig.vm.Close()
+	rig.slowClient.Close()
+	rig.fastClient.Close()
+}
+
+// The slow client's writer holds one frame, ioSessionQueueSize more are
+// queued
+const slowBacklog = ioSessionQueueSize + 1
+
+func TestIoPolicyBlock(t *testing.T) {
+	rig := newPolicyRig(t, ioPolicyBlock)
+
+	rig.send(rig.slow, slowBacklog+1)
+	rig.send(rig.fast, 1)
+	assert.False(t, rig.received(100*time.Millisecond))
+
+	// Nothing is lost once the slow client catches up
+	for i := 0; i < slowBacklog+1; i++ {
+		frame, err := readIoFrame(rig.slowClient)
+		assert.Nil(t, err)
+		frame.release()
+	}
+	assert.True(t, rig.received(time.Minute))
+	assert.Equal(t, uint64(0), atomic.LoadUint64(&rig.slow.dropped))
+
+	rig.close()
+}
+
+func TestIoPolicyDropOldest(t *testing.T) {
+	rig := newPolicyRig(t, ioPolicyDropOldest)
+
+	rig.send(rig.slow, slowBacklog+10)
+	rig.send(rig.fast, 1)
+	assert.True(t, rig.received(time.Minute))
+
+	// One more frame is dropped if the writer didn't get to the first one
+	// before the queue filled up
+	dropped := atomic.LoadUint64(&rig.slow.dropped)
+	assert.True(t, dropped == 10 || dropped == 11)
+	assert.Equal(t, dropped, atomic.LoadUint64(&rig.vm.metrics.ioDropped))
+	assert.Equal(t, uint64(0), atomic.LoadUint64(&rig.fast.dropped))
+
+	rig.close()
+}
+
+func TestIoPolicyDisconnect(t *testing.T) {
+	rig := newPolicyRig(t, ioPolicyDisconnect)
+
+	rig.send(rig.slow, slowBacklog+1)
+	rig.send(rig.fast, 1)
+	assert.True(t, rig.received(time.Minute))
+	assert.NotEqual(t, uint64(0), atomic.LoadUint64(&rig.slow.dropped))
+
+	// The slow client gets disconnected
+	var err error
+	for err == nil {
+		var frame *ioFrame
+		frame, err = readIoFrame(rig.slowClient)
+		if err == nil {
+			frame.release()
+		}
+	}
+
+	rig.close()
+}
@@ -0,0 +1,106 @@
+// Copyright (c) 2017 Intel Corporation
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+package main
+
+import (
+	"sort"
+	"sync"
+)
+
+// Number of independently locked parts of a vmTable. Must be a power of 2.
+const vmTableShards = 32
+
+type vmTableShard struct {
+	sync.Mutex
+	vms map[string]*vm
+}
+
+// vmTable holds the VMs known to the proxy, hashed by their containerID. It's
+// split in shards so clients registering or looking up different VMs don't
+// contend on a single lock.
+type vmTable struct {
+	shards [vmTableShards]vmTableShard
+}
+
+func newVMTable() *vmTable {
+	table := &vmTable{}
+	for i := range table.shards {
+		table.shards[i].vms = make(map[string]*vm)
+	}
+	return table
+}
+
+// FNV-1a, inlined as hash/fnv would allocate for every lookup
+func (table *vmTable) shard(containerID string) *vmTableShard {
+	hash := uint32(2166136261)
+	for i := 0; i < len(containerID); i++ {
+		hash ^= uint32(containerID[i])
+		hash *= 16777619
+	}
+	return &table.shards[hash&(vmTableShards-1)]
+}
+
+// add registers vm, unless a VM with the same containerID already is.
+func (table *vmTable) add(vm *vm) bool {
+	shard := table.shard(vm.containerID)
+	shard.Lock()
+	defer shard.Unlock()
+
+	if _, ok := shard.vms[vm.containerID]; ok {
+		return false
+	}
+	shard.vms[vm.containerID] = vm
+	return true
+}
+
+// get returns the VM registered for containerID, nil if there's none.
+func (table *vmTable) get(containerID string) *vm {
+	shard := table.shard(containerID)
+	shard.Lock()
+	defer shard.Unlock()
+
+	return shard.vms[containerID]
+}
+
+func (table *vmTable) remove(containerID string) {
+	shard := table.shard(containerID)
+	shard.Lock()
+	defer shard.Unlock()
+
+	delete(shard.vms, containerID)
+}
+
+type vmsByContainerID []*vm
+
+func (a vmsByContainerID) Len() int           { return len(a) }
+func (a vmsByContainerID) Swap(i, j int)      { a[i], a[j] = a[j], a[i] }
+func (a vmsByContainerID) Less(i, j int) bool { return a[i].containerID < a[j].containerID }
+
+// list returns the registered VMs, sorted by containerID.
+func (table *vmTable) list() []*vm {
+	var vms []*vm
+
+	for i := range table.shards {
+		shard := &table.shards[i]
+		shard.Lock()
+		for _, vm := range shard.vms {
+			vms = append(vms, vm)
+		}
+		shard.Unlock()
+	}
+	sort.Sort(vmsByContainerID(vms))
+
+	return vms
+}
@@ -0,0 +1,128 @@
+// Copyright (c) 2017 Intel Corporation
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+package main
+
+import (
+	"fmt"
+	"net"
+	"sync/atomic"
+	"testing"
+
+	"github.com/stretchr/testify/assert"
+)
+
+func TestVMTable(t *testing.T) {
+	table := newVMTable()
+	vms := make([]*vm, 2*vmTableShards)
+
+	for i := range vms {
+		vms[i] = newVM(fmt.Sprintf("vm-%d", i), "", "")
+		assert.True(t, table.add(vms[i]))
+	}
+
+	// containerIDs are unique
+	assert.False(t, table.add(newVM("vm-0", "", "")))
+
+	for i := range vms {
+		assert.Equal(t, vms[i], table.get(vms[i].containerID))
+	}
+	assert.Nil(t, table.get("foo"))
+
+	table.remove(vms[0].containerID)
+	assert.Nil(t, table.get(vms[0].containerID))
+	assert.Equal(t, vms[1], table.get(vms[1].containerID))
+	assert.True(t, table.add(vms[0]))
+}
+
+func TestVMSessions(t *testing.T) {
+	vm := newVM("foo", "", "")
+
+	c0, c1 := net.Pipe()
+	ioBase := vm.AllocateIo(2, 1, c1, ioPolicyBlock)
+	session := vm.findSession(ioBase)
+	assert.NotNil(t, session)
+	assert.Equal(t, session, vm.findSession(ioBase+1))
+	assert.Nil(t, vm.findSession(ioBase+2))
+
+	// A session allocated later doesn't alter the previous ones
+	c2, c3 := net.Pipe()
+	assert.Equal(t, ioBase+2, vm.AllocateIo(1, 2, c3, ioPolicyBlock))
+	assert.Equal(t, session, vm.findSession(ioBase))
+	assert.NotNil(t, vm.findSession(ioBase+2))
+
+	vm.Close()
+	assert.Nil(t, vm.findSession(ioBase))
+	assert.Nil(t, vm.findSession(ioBase+2))
+
+	c0.Close()
+	c2.Close()
+}
+
+// BenchmarkContention looks up I/O sessions of running VMs, as done for every
+// frame coming from hyperstart, while 1 in 64 iterations goes through the
+// life cycle of another VM: hello, allocateIO, attach and bye.
+func BenchmarkContention(b *testing.B) {
+	const nVMs = 16
+	const nSessions = 16
+
+	proxy := newProxy()
+	running := make([]*vm, nVMs)
+	var conns []net.Conn
+	for i := range running {
+		running[i] = newVM(fmt.Sprintf("running-%d", i), "", "")
+		proxy.vms.add(running[i])
+		for j := 0; j < nSessions; j++ {
+			c0, c1 := net.Pipe()
+			running[i].AllocateIo(2, uint64(j), c1, ioPolicyBlock)
+			conns = append(conns, c0)
+		}
+	}
+
+	var nextID uint64
+	b.ReportAllocs()
+	b.ResetTimer()
+
+	b.RunParallel(func(pb *testing.PB) {
+		id := atomic.AddUint64(&nextID, 1)
+		containerID := fmt.Sprintf("transient-%d", id)
+
+		for n := 0; pb.Next(); n++ {
+			if n%64 == 63 {
+				vm := newVM(containerID, "", "")
+				proxy.vms.add(vm)
+				c0, c1 := net.Pipe()
+				vm.AllocateIo(1, id, c1, ioPolicyBlock)
+				proxy.vms.get(containerID)
+				proxy.vms.remove(containerID)
+				vm.Close()
+				c0.Close()
+				continue
+			}
+
+			vm := running[n%nVMs]
+			if vm.findSession(uint64(n%(2*nSessions))+1) == nil {
+				b.Fatal("session not found")
+			}
+		}
+	})
+
+	b.StopTimer()
+	for _, vm := range running {
+		vm.Close()
+	}
+	for _, c := range conns {
+		c.Close()
+	}
+}
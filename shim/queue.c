@@ -0,0 +1,351 @@
+// Copyright (c) 2016 Intel Corporation
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <unistd.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/socket.h>
+
+#include "log.h"
+#include "queue.h"
+
+/*!
+ * Initialise an output queue for a file descriptor.
+ *
+ * Unless the fd is a socket (written with \c MSG_DONTWAIT), it is made
+ * non-blocking. Its original status flags are restored by
+ * \ref shim_queue_free.
+ *
+ * \param q Queue to initialise
+ * \param fd File descriptor the queued data is written to
+ */
+void
+shim_queue_init(struct shim_queue *q, int fd)
+{
+	struct stat st;
+	int         flags;
+
+	if (! q) {
+		return;
+	}
+
+	memset(q, 0, sizeof(*q));
+	q->fd = -1;
+	q->saved_flags = -1;
+
+	if (fd < 0 || fstat(fd, &st) == -1) {
+		shim_warning("Not queueing output for invalid fd %d\n", fd);
+		return;
+	}
+
+	q->fd = fd;
+	q->is_socket = S_ISSOCK(st.st_mode);
+	q->pollable = ! (S_ISREG(st.st_mode) || S_ISDIR(st.st_mode));
+
+	if (q->is_socket || ! q->pollable) {
+		return;
+	}
+
+	flags = fcntl(fd, F_GETFL);
+	if (flags == -1) {
+		shim_warning("Error getting status flags for fd %d: %s\n",
+				fd, strerror(errno));
+		return;
+	}
+
+	if (! (flags & O_NONBLOCK)) {
+		if (fcntl(fd, F_SETFL, flags | O_NONBLOCK) == -1) {
+			shim_warning("Error setting fd %d as nonblocking: %s\n",
+					fd, strerror(errno));
+			return;
+		}
+		q->saved_flags = flags;
+	}
+}
+
+/*!
+ * Discard all queued data.
+ *
+ * \param q Queue
+ */
+static void
+shim_queue_clear(struct shim_queue *q)
+{
+	struct shim_buf *b;
+
+	while (q->head) {
+		b = q->head;
+		q->head = b->next;
+		free(b->data);
+		free(b);
+	}
+
+	q->tail = NULL;
+	q->bytes = 0;
+}
+
+/*!
+ * Append data to an output queue and try to write it.
+ *
+ * Data for fds that cannot be polled is written synchronously.
+ *
+ * \param q Queue
+ * \param data Buffer allocated with malloc(3), owned by the queue
+ *  from now on
+ * \param offset Offset in \p data of the first byte to write
+ * \param len Length of \p data
+ *
+ * \return false if writing to the fd failed, true otherwise
+ */
+bool
+shim_queue_push(struct shim_queue *q, char *data, size_t offset, size_t len)
+{
+	struct shim_buf *b;
+
+	if (! (q && data)) {
+		free(data);
+		return false;
+	}
+
+	if (q->fd < 0 || offset >= len) {
+		free(data);
+		return q->fd >= 0;
+	}
+
+	b = calloc(1, sizeof(*b));
+	if (! b) {
+		abort();
+	}
+
+	b->data = data;
+	b->offset = offset;
+	b->len = len;
+
+	if (q->tail) {
+		q->tail->next = b;
+	} else {
+		q->head = b;
+	}
+	q->tail = b;
+	q->bytes += len - offset;
+
+	if (! q->pollable) {
+		shim_queue_drain(q);
+		return shim_queue_empty(q);
+	}
+
+	return shim_queue_flush(q);
+}
+
+/*!
+ * Write data gathered from several buffers, queueing a copy of
+ * whatever cannot be written without blocking.
+ *
+ * The buffers are written with a single writev(2) if nothing is queued
+ * already, so data is only copied when the fd is not keeping up.
+ *
+ * \param q Queue
+ * \param iov Buffers to write, still owned by the caller
+ * \param iovcnt Number of elements in \p iov
+ *
+ * \return false if writing to the fd failed, true otherwise
+ */
+bool
+shim_queue_writev(struct shim_queue *q, const struct iovec *iov, int iovcnt)
+{
+	struct msghdr  msg = { 0 };
+	ssize_t        ret = 0;
+	size_t         total = 0;
+	size_t         skip;
+	size_t         len;
+	char          *data;
+	char          *p;
+
+	if (! (q && iov) || iovcnt <= 0) {
+		return false;
+	}
+
+	if (q->fd < 0) {
+		return false;
+	}
+
+	for (int i = 0; i < iovcnt; i++) {
+		total += iov[i].iov_len;
+	}
+
+	if (shim_queue_empty(q)) {
+		msg.msg_iov = (struct iovec *)iov;
+		msg.msg_iovlen = (size_t)iovcnt;
+
+		do {
+			if (q->is_socket) {
+				ret = sendmsg(q->fd, &msg,
+						MSG_DONTWAIT | MSG_NOSIGNAL);
+			} else {
+				ret = writev(q->fd, iov, iovcnt);
+			}
+		} while (ret == -1 && errno == EINTR);
+
+		if (ret == -1) {
+			if (errno != EAGAIN && errno != EWOULDBLOCK) {
+				shim_warning("Error writing to fd %d: %s\n",
+						q->fd, strerror(errno));
+				return false;
+			}
+			ret = 0;
+		}
+	}
+
+	if ((size_t)ret == total) {
+		return true;
+	}
+
+	data = malloc(total - (size_t)ret);
+	if (! data) {
+		abort();
+	}
+
+	/* copy the part that was not written */
+	skip = (size_t)ret;
+	p = data;
+	for (int i = 0; i < iovcnt; i++) {
+		len = iov[i].iov_len;
+		if (skip >= len) {
+			skip -= len;
+			continue;
+		}
+		memcpy(p, (char *)iov[i].iov_base + skip, len - skip);
+		p += len - skip;
+		skip = 0;
+	}
+
+	return shim_queue_push(q, data, 0, total - (size_t)ret);
+}
+
+/*!
+ * Write as much queued data as possible without blocking.
+ *
+ * On error, the queued data is discarded.
+ *
+ * \param q Queue
+ *
+ * \return false if writing to the fd failed, true otherwise
+ */
+bool
+shim_queue_flush(struct shim_queue *q)
+{
+	struct shim_buf *b;
+	ssize_t          ret;
+	size_t           want;
+
+	if (! q) {
+		return false;
+	}
+
+	while (q->head) {
+		b = q->head;
+		want = b->len - b->offset;
+
+		if (q->is_socket) {
+			ret = send(q->fd, b->data + b->offset, want,
+					MSG_DONTWAIT | MSG_NOSIGNAL);
+		} else {
+			ret = write(q->fd, b->data + b->offset, want);
+		}
+
+		if (ret == -1) {
+			if (errno == EINTR) {
+				continue;
+			}
+			if (errno == EAGAIN || errno == EWOULDBLOCK) {
+				return true;
+			}
+			shim_warning("Error writing to fd %d: %s\n",
+					q->fd, strerror(errno));
+			shim_queue_clear(q);
+			return false;
+		}
+
+		b->offset += (size_t)ret;
+		q->bytes -= (size_t)ret;
+
+		if (b->offset == b->len) {
+			q->head = b->next;
+			if (! q->head) {
+				q->tail = NULL;
+			}
+			free(b->data);
+			free(b);
+		}
+	}
+
+	return true;
+}
+
+/*!
+ * Write all queued data, waiting for the fd to become writable
+ * as needed.
+ *
+ * \param q Queue
+ */
+void
+shim_queue_drain(struct shim_queue *q)
+{
+	struct pollfd pfd = { 0 };
+
+	if (! q) {
+		return;
+	}
+
+	pfd.fd = q->fd;
+	pfd.events = POLLOUT;
+
+	while (shim_queue_flush(q) && ! shim_queue_empty(q)) {
+		if (poll(&pfd, 1, -1) == -1 && errno != EINTR) {
+			shim_warning("Error polling fd %d: %s\n",
+					q->fd, strerror(errno));
+			shim_queue_clear(q);
+			return;
+		}
+	}
+}
+
+/*!
+ * Discard queued data and restore the original status flags of
+ * the fd.
+ *
+ * \param q Queue
+ */
+void
+shim_queue_free(struct shim_queue *q)
+{
+	if (! q) {
+		return;
+	}
+
+	shim_queue_clear(q);
+
+	if (q->fd >= 0 && q->saved_flags != -1) {
+		if (fcntl(q->fd, F_SETFL, q->saved_flags) == -1) {
+			shim_warning("Error restoring status flags for fd %d: %s\n",
+					q->fd, strerror(errno));
+		}
+		q->saved_flags = -1;
+	}
+}
@@ -0,0 +1,61 @@
+// Copyright (c) 2016 Intel Corporation
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <sys/uio.h>
+
+/* A chunk of data waiting to be written */
+struct shim_buf {
+	struct shim_buf  *next;
+	char             *data;
+	size_t            offset;
+	size_t            len;
+};
+
+/* Data waiting to be written to a file descriptor, in order */
+struct shim_queue {
+	int               fd;
+
+	/* Sockets are written with send(MSG_DONTWAIT) */
+	bool              is_socket;
+
+	/* false if the fd cannot be watched with epoll (regular files),
+	 * in which case data is written synchronously */
+	bool              pollable;
+
+	/* Status flags of the fd before it was made non-blocking */
+	int               saved_flags;
+
+	struct shim_buf  *head;
+	struct shim_buf  *tail;
+
+	/* Number of bytes queued */
+	size_t            bytes;
+};
+
+void shim_queue_init(struct shim_queue *q, int fd);
+bool shim_queue_push(struct shim_queue *q, char *data, size_t offset, size_t len);
+bool shim_queue_writev(struct shim_queue *q, const struct iovec *iov, int iovcnt);
+bool shim_queue_flush(struct shim_queue *q);
+void shim_queue_drain(struct shim_queue *q);
+void shim_queue_free(struct shim_queue *q);
+
+static inline bool
+shim_queue_empty(const struct shim_queue *q)
+{
+	return q->head == NULL;
+}
@@ -18,6 +18,7 @@
 #include <errno.h>
 #include <string.h>
 #include <sys/un.h>
+#include <sys/epoll.h>
 #include <poll.h>
 #include <assert.h>
 #include <stdarg.h>
@@ -39,13 +40,13 @@
 
 /* globals */
 
-struct pollfd poll_fds[MAX_POLL_FDS] = {{-1}};
-
-// File descriptors are added at specific index in the poll_fds array
+// File descriptors are added at specific index in the watches array
 #define SIGNAL_FD_INDEX 0
 #define PROXY_IO_INDEX 1
 #define PROXY_CTL_INDEX 2
 #define STDIN_INDEX 3
+#define STDOUT_INDEX 4
+#define STDERR_INDEX 5
 
 /* Pipe used for capturing signal occurence */
 int signal_pipe_fd[2] = { -1, -1 };
@@ -54,25 +55,183 @@ static char *program_name;
 
 struct termios *saved_term_settings;
 
+/* Shim whose stdout/stderr flags are restored on exit */
+static struct cc_shim *active_shim;
+
 /*!
- * Add file descriptor to the array of polled descriptors
+ * Add file descriptor to the array of watched descriptors.
+ * The fd is only registered with epoll once events are set
+ * for it with \ref set_watch_events.
  *
- * \param poll_fds Array of polled fds
+ * \param shim \ref cc_shim
  * \param index Index at which the fd is added
  * \param fd File descriptor to add
- * \param events Events for the fd that should be polled
  */
-void add_pollfd(struct pollfd *poll_fds, nfds_t index, int fd,  short events) {
-	struct pollfd pfd = { 0 };
-
-	if ( !poll_fds || fd < 0 || index >= MAX_POLL_FDS) {
-		shim_warning("Not able to add fd to poll_fds array\n");
+void
+add_watch(struct cc_shim *shim, int index, int fd) {
+	if ( !shim || fd < 0 || index < 0 || index >= MAX_POLL_FDS) {
+		shim_warning("Not able to add fd to watches array\n");
 		return;
 	}
 
-	pfd.fd = fd;
-	pfd.events = events;
-	poll_fds[index] = pfd;
+	shim->watches[index].fd = fd;
+	shim->watches[index].events = 0;
+	shim->watches[index].pollable = true;
+}
+
+/*!
+ * Update the events watched for a file descriptor
+ *
+ * \param shim \ref cc_shim
+ * \param index Index of the fd in the watches array
+ * \param events Events for the fd that should be polled,
+ *  0 to stop watching the fd
+ *
+ * \return false if the fd could not be registered, true otherwise
+ */
+bool
+set_watch_events(struct cc_shim *shim, int index, uint32_t events)
+{
+	struct shim_watch  *w;
+	struct epoll_event  ev = { 0 };
+	int                 op;
+
+	if ( !shim || index < 0 || index >= MAX_POLL_FDS) {
+		return false;
+	}
+
+	w = &shim->watches[index];
+
+	if (w->fd < 0 || ! w->pollable) {
+		return false;
+	}
+
+	if (w->events == events) {
+		return true;
+	}
+
+	if (! w->events) {
+		op = EPOLL_CTL_ADD;
+	} else if (! events) {
+		op = EPOLL_CTL_DEL;
+	} else {
+		op = EPOLL_CTL_MOD;
+	}
+
+	ev.events = events;
+	ev.data.u32 = (uint32_t)index;
+
+	if (epoll_ctl(shim->epoll_fd, op, w->fd, &ev) == -1) {
+		if (errno == EPERM) {
+			/* regular files and the like are always ready */
+			w->pollable = false;
+		} else {
+			shim_warning("Error watching fd %d: %s\n", w->fd,
+					strerror(errno));
+		}
+		return false;
+	}
+
+	w->events = events;
+	return true;
+}
+
+/*!
+ * Stop watching a file descriptor
+ *
+ * \param shim \ref cc_shim
+ * \param index Index of the fd in the watches array
+ */
+void
+remove_watch(struct cc_shim *shim, int index)
+{
+	set_watch_events(shim, index, 0);
+	shim->watches[index].fd = -1;
+}
+
+/*!
+ * Watch for output on stdout/stderr, or write it synchronously
+ * if the fd cannot be polled.
+ *
+ * \param shim \ref cc_shim
+ * \param index Index of the fd in the watches array
+ * \param q Output queue for the fd
+ */
+static void
+watch_output(struct cc_shim *shim, int index, struct shim_queue *q)
+{
+	uint32_t events = shim_queue_empty(q) ? 0 : EPOLLOUT;
+
+	if (! set_watch_events(shim, index, events) &&
+			! shim->watches[index].pollable) {
+		q->pollable = false;
+		shim_queue_drain(q);
+	}
+}
+
+/*!
+ * Check whether reading stdin must wait for data already read from
+ * it to be sent to the proxy.
+ *
+ * \param shim \ref cc_shim
+ *
+ * \return true if stdin should not be read, false otherwise
+ */
+static bool
+stdin_blocked(const struct cc_shim *shim)
+{
+	/* a spliced frame must be complete before the next one starts */
+	return shim->input_throttled || shim->splice_pending;
+}
+
+/*!
+ * Compute the events to watch for each fd from the state of the
+ * output queues, applying backpressure once too much data is queued.
+ *
+ * \param shim \ref cc_shim
+ */
+void
+update_watches(struct cc_shim *shim)
+{
+	size_t    queued;
+	uint32_t  events;
+
+	queued = shim->stdout_q.bytes + shim->stderr_q.bytes;
+	if (queued > SHIM_QUEUE_HIGH_WATERMARK) {
+		shim->output_throttled = true;
+	} else if (queued < SHIM_QUEUE_LOW_WATERMARK) {
+		shim->output_throttled = false;
+	}
+
+	queued = shim->proxy_io_q.bytes + shim->splice_pending;
+	if (queued > SHIM_QUEUE_HIGH_WATERMARK) {
+		shim->input_throttled = true;
+	} else if (queued < SHIM_QUEUE_LOW_WATERMARK) {
+		shim->input_throttled = false;
+	}
+
+	set_watch_events(shim, SIGNAL_FD_INDEX, EPOLLIN);
+
+	/* Stop reading from the proxy while stdout/stderr are not keeping
+	 * up. Data then accumulates in the proxy rather than in the shim.
+	 */
+	events = shim->output_throttled ? 0 : EPOLLIN;
+	if (! shim_queue_empty(&shim->proxy_io_q) || shim->splice_pending) {
+		events |= EPOLLOUT;
+	}
+	set_watch_events(shim, PROXY_IO_INDEX, events);
+
+	events = EPOLLIN;
+	if (! shim_queue_empty(&shim->proxy_ctl_q)) {
+		events |= EPOLLOUT;
+	}
+	set_watch_events(shim, PROXY_CTL_INDEX, events);
+
+	set_watch_events(shim, STDIN_INDEX,
+			stdin_blocked(shim) ? 0 : EPOLLIN);
+
+	watch_output(shim, STDOUT_INDEX, &shim->stdout_q);
+	watch_output(shim, STDERR_INDEX, &shim->stderr_q);
 }
 
 /*!
@@ -129,6 +288,36 @@ void restore_terminal(void) {
 	}
 }
 
+/*!
+ * Restore the status flags of stdout/stderr, which are made
+ * non-blocking by their output queues.
+ */
+static void
+restore_output_fds(void)
+{
+	if (! active_shim) {
+		return;
+	}
+
+	shim_queue_free(&active_shim->stdout_q);
+	shim_queue_free(&active_shim->stderr_q);
+}
+
+/*!
+ * Write all output still queued for stdout/stderr and exit
+ *
+ * \param shim \ref cc_shim
+ * \param code Exit code
+ */
+static void
+shim_exit(struct cc_shim *shim, int code)
+{
+	shim_queue_drain(&shim->stdout_q);
+	shim_queue_drain(&shim->stderr_q);
+	restore_terminal();
+	exit(code);
+}
+
 /*!
  * Print formatted message to stderr and exit with EXIT_FAILURE
  *
@@ -191,16 +380,16 @@ get_proxy_ctl_msg(const char *json, size_t *len) {
 /*!
  * Send "hyper" payload to cc-proxy. This will be forwarded to hyperstart.
  *
- * \param fd File descriptor to send the message to(should be proxy ctl socket fd)
+ * \param q Queue to send the message to (should be the proxy ctl socket queue)
  * \param Hyperstart cmd id
  * \param json Json payload
  */
 void
-send_proxy_hyper_message(int fd, const char *hyper_cmd, const char *json) {
+send_proxy_hyper_message(struct shim_queue *q, const char *hyper_cmd, const char *json) {
 	char      *proxy_payload = NULL;
 	char      *proxy_command_id = "hyper";
 	char      *proxy_ctl_msg = NULL;
-	size_t     len = 0, offset = 0;
+	size_t     len = 0;
 	ssize_t    ret;
 
 	/* cc-proxy has the following format for "hyper" payload:
@@ -213,7 +402,7 @@ send_proxy_hyper_message(int fd, const char *hyper_cmd, const char *json) {
 	 * }
 	*/
 
-	if ( !json || fd < 0) {
+	if ( !json || !q) {
 		return;
 	}
 
@@ -229,19 +418,11 @@ send_proxy_hyper_message(int fd, const char *hyper_cmd, const char *json) {
 	proxy_ctl_msg = get_proxy_ctl_msg(proxy_payload, &len);
 	free(proxy_payload);
 
-	while (offset < len) {
-		ret = write(fd, proxy_ctl_msg + offset, len-offset);
-		if (ret == EINTR) {
-			continue;
-		}
-		if (ret <= 0 ) {
-			free(proxy_ctl_msg);
-			shim_error("Error writing to proxy: %s\n", strerror(errno));
-			return;
-		}
-		offset += (size_t)ret;
+	/* written once the socket is writable, so that a busy proxy
+	 * does not stall the shim */
+	if (! shim_queue_push(q, proxy_ctl_msg, 0, len)) {
+		shim_error("Error writing to proxy\n");
 	}
-	free(proxy_ctl_msg);
 }
 
 /*!
@@ -287,196 +468,312 @@ handle_signals(struct cc_shim *shim) {
 			abort();
 		}
 
-		send_proxy_hyper_message(shim->proxy_sock_fd, cmd, buf);
+		send_proxy_hyper_message(&shim->proxy_ctl_q, cmd, buf);
 		free(buf);
         }
 }
 
 /*!
- * Read data from stdin(with tty set in raw mode)
- * and send it to proxy I/O channel
- * Reference : https://github.com/hyperhq/runv/blob/master/hypervisor/tty.go#L448
+ * Stop splicing stdin, falling back to reading it.
+ *
+ * Any data left in the pipe is read and queued for the proxy so that
+ * the current frame is completed.
  *
  * \param shim \ref cc_shim
  */
-void
-handle_stdin(struct cc_shim *shim)
+static void
+stop_stdin_splice(struct cc_shim *shim)
 {
-	ssize_t        nread;
-	int            ret;
-	ssize_t        len;
-	static uint8_t buf[BUFSIZ+STREAM_HEADER_SIZE];
+	char     *buf;
+	ssize_t   ret;
+	size_t    len = 0;
 
-	if (! shim || shim->proxy_io_fd < 0) {
-		return;
+	if (shim->splice_pending) {
+		buf = malloc(shim->splice_pending);
+		if (! buf) {
+			abort();
+		}
+
+		while (len < shim->splice_pending) {
+			ret = read(shim->stdin_pipe[0], buf + len,
+					shim->splice_pending - len);
+			if (ret <= 0) {
+				break;
+			}
+			len += (size_t)ret;
+		}
+
+		shim_queue_push(&shim->proxy_io_q, buf, 0, len);
+		shim->splice_pending = 0;
 	}
 
-	nread = read(STDIN_FILENO , buf+STREAM_HEADER_SIZE, BUFSIZ);
-	if (nread < 0) {
-		shim_warning("Error while reading stdin char :%s\n", strerror(errno));
+	close(shim->stdin_pipe[0]);
+	close(shim->stdin_pipe[1]);
+	shim->stdin_pipe[0] = shim->stdin_pipe[1] = -1;
+}
+
+/*!
+ * Move the payload of the current stdin frame from the pipe to the
+ * proxy I/O fd, once its header has been written.
+ *
+ * \param shim \ref cc_shim
+ */
+void
+flush_stdin_splice(struct cc_shim *shim)
+{
+	ssize_t ret;
+
+	if (! shim_queue_empty(&shim->proxy_io_q)) {
 		return;
-	} else if (nread == 0) {
-		/* EOF received on stdin, send eof to hyperstart and remove stdin fd from
-		 * the polled descriptors to prevent further eof events
-		 */
-		poll_fds[STDIN_INDEX].fd = -1;
 	}
 
-	len = nread + STREAM_HEADER_SIZE;
-	set_big_endian_64 (buf, shim->io_seq_no);
-	set_big_endian_32 (buf + STREAM_HEADER_LENGTH_OFFSET, (uint32_t)len);
+	while (shim->splice_pending) {
+		ret = splice(shim->stdin_pipe[0], NULL, shim->proxy_io_fd, NULL,
+				shim->splice_pending,
+				SPLICE_F_MOVE | SPLICE_F_NONBLOCK);
+		if (ret == -1) {
+			if (errno == EINTR) {
+				continue;
+			}
+			if (errno == EAGAIN) {
+				return;
+			}
+			shim_warning("Error splicing stdin to the proxy: %s\n",
+					strerror(errno));
+			stop_stdin_splice(shim);
+			return;
+		}
 
-	// TODO: handle write in the poll loop to account for write blocking
-	ret = (int)write(shim->proxy_io_fd, buf, (size_t)len);
-	if (ret == -1) {
-		shim_warning("Error writing from fd %d to fd %d: %s\n",
-			     STDIN_FILENO, shim->proxy_io_fd, strerror(errno));
-		return;
+		shim->splice_pending -= (size_t)ret;
 	}
 }
 
 /*!
- * Read and parse I/O message on proxy I/O fd
+ * Forward stdin to the proxy I/O channel without copying it through
+ * the shim: the data is spliced into a pipe and from there to the
+ * proxy, after the frame header.
  *
  * \param shim \ref cc_shim
- * \param[out] seq Seqence number of the I/O stream
- * \param[out] stream_len Length of the data received
  *
- * \return newly allocated string on success, else \c NULL.
+ * \return true if stdin was handled, false if it should be read instead
+ * (on EOF, or if stdin cannot be spliced)
  */
-char*
-read_IO_message(struct cc_shim *shim, uint64_t *seq, ssize_t *stream_len) {
-	char *buf = NULL;
-	ssize_t need_read = STREAM_HEADER_SIZE;
-	ssize_t bytes_read = 0, want, ret;
-	ssize_t max_bytes = HYPERSTART_MAX_RECV_BYTES;
+static bool
+handle_stdin_splice(struct cc_shim *shim)
+{
+	ssize_t   nread;
+	uint8_t  *hdr;
 
-	if (! (shim && seq && stream_len)) {
-		return NULL;
+	if (shim->splice_pending) {
+		return true;
 	}
 
-	*stream_len = 0;
+	nread = splice(STDIN_FILENO, NULL, shim->stdin_pipe[1], NULL,
+			SHIM_SPLICE_CHUNK_SIZE, SPLICE_F_MOVE | SPLICE_F_NONBLOCK);
+	if (nread == -1) {
+		if (errno == EAGAIN || errno == EINTR) {
+			return true;
+		}
+		shim_debug("Not splicing stdin: %s\n", strerror(errno));
+		stop_stdin_splice(shim);
+		return false;
+	} else if (nread == 0) {
+		/* EOF, sent as an empty frame by handle_stdin() */
+		return false;
+	}
 
-	buf = calloc(STREAM_HEADER_SIZE, 1);
-	if (! buf ) {
+	hdr = malloc(STREAM_HEADER_SIZE);
+	if (! hdr) {
 		abort();
 	}
 
-	while (bytes_read < need_read) {
-		want = need_read - bytes_read;
-		if (want > BUFSIZ)  {
-			want = BUFSIZ;
-		}
+	set_big_endian_64 (hdr, shim->io_seq_no);
+	set_big_endian_32 (hdr + STREAM_HEADER_LENGTH_OFFSET,
+			(uint32_t)nread + STREAM_HEADER_SIZE);
 
-		ret = read(shim->proxy_io_fd, buf+bytes_read, (size_t)want);
-		if (ret == -1) {
-			free(buf);
-			err_exit("Error reading from proxy I/O fd: %s\n", strerror(errno));
-		} else if (ret == 0) {
-			/* EOF received on proxy I/O fd*/
-			free(buf);
-			err_exit("EOF received on proxy I/O fd\n");
-		}
+	shim->splice_pending = (size_t)nread;
 
-		bytes_read += ret;
+	if (! shim_queue_push(&shim->proxy_io_q, (char *)hdr, 0,
+				STREAM_HEADER_SIZE)) {
+		shim_warning("Error writing from fd %d to fd %d\n",
+			     STDIN_FILENO, shim->proxy_io_fd);
+	}
 
-		if (*stream_len == 0 && bytes_read >= STREAM_HEADER_SIZE) {
-			*stream_len = get_big_endian_32((uint8_t*)(buf+STREAM_HEADER_LENGTH_OFFSET));
+	flush_stdin_splice(shim);
 
-			// length is 12 when hyperstart sends eof before sending exit code
-			if (*stream_len == STREAM_HEADER_SIZE) {
-				break;
-			}
+	return true;
+}
 
-			/* Ensure amount of data is within expected bounds */
-			if (*stream_len > max_bytes) {
-				shim_warning("message too big (limit is %lu, but proxy returned %lu)",
-						(unsigned long int)max_bytes,
-						(unsigned long int)stream_len);
-				goto err;
-			}
+/*!
+ * Read data from stdin(with tty set in raw mode)
+ * and send it to proxy I/O channel
+ * Reference : https://github.com/hyperhq/runv/blob/master/hypervisor/tty.go#L448
+ *
+ * \param shim \ref cc_shim
+ */
+void
+handle_stdin(struct cc_shim *shim)
+{
+	ssize_t        nread;
+	size_t         len;
+	uint8_t       *buf;
 
-			if (*stream_len > STREAM_HEADER_SIZE) {
-				need_read = *stream_len;
-				buf = realloc(buf, (size_t)*stream_len);
-				if (! buf) {
-					abort();
-				}
-			}
+	if (! shim || shim->proxy_io_fd < 0) {
+		return;
+	}
+
+	if (shim->stdin_pipe[0] != -1 && handle_stdin_splice(shim)) {
+		return;
+	}
+
+	buf = malloc(BUFSIZ+STREAM_HEADER_SIZE);
+	if (! buf) {
+		abort();
+	}
+
+	nread = read(STDIN_FILENO , buf+STREAM_HEADER_SIZE, BUFSIZ);
+	if (nread < 0) {
+		if (errno != EAGAIN && errno != EINTR) {
+			shim_warning("Error while reading stdin char :%s\n", strerror(errno));
 		}
+		free(buf);
+		return;
+	} else if (nread == 0) {
+		/* EOF received on stdin, send eof to hyperstart and remove stdin fd from
+		 * the watched descriptors to prevent further eof events
+		 */
+		remove_watch(shim, STDIN_INDEX);
 	}
-	*seq = get_big_endian_64((uint8_t*)buf);
-	return buf;
 
-err:
-	free(buf);
-	return NULL;
+	len = (size_t)nread + STREAM_HEADER_SIZE;
+	set_big_endian_64 (buf, shim->io_seq_no);
+	set_big_endian_32 (buf + STREAM_HEADER_LENGTH_OFFSET, (uint32_t)len);
+
+	/* anything that cannot be written now is sent once the proxy
+	 * I/O fd becomes writable */
+	if (! shim_queue_push(&shim->proxy_io_q, (char *)buf, 0, len)) {
+		shim_warning("Error writing from fd %d to fd %d\n",
+			     STDIN_FILENO, shim->proxy_io_fd);
+	}
 }
 
 /*!
  * Handle output on the proxy I/O fd
  *
+ * All the data available (up to the free space in the I/O buffer) is
+ * read at once and every complete frame is handled in place.
+ * Consecutive frames for the same stream are written with a single
+ * writev(2), straight from the I/O buffer.
+ *
  *\param shim \ref cc_shim
  */
 void
 handle_proxy_output(struct cc_shim *shim)
 {
-	uint64_t  seq;
-	char     *buf = NULL;
-	int       outfd;
-	ssize_t   stream_len = 0;
-	ssize_t   ret;
-	ssize_t   offset;
-	int       code = 0;
+	uint64_t            seq;
+	uint8_t            *frame;
+	uint32_t            frame_len;
+	size_t              avail;
+	ssize_t             ret;
+	struct shim_queue  *q;
+	struct shim_queue  *outq = NULL;
+	struct iovec        iov[SHIM_MAX_IOV];
+	int                 iovcnt = 0;
+	int                 code = 0;
 
 	if (shim == NULL) {
 		return;
 	}
 
-	buf = read_IO_message(shim, &seq, &stream_len);
-	if ((! buf) || (stream_len <= 0) || (stream_len > HYPERSTART_MAX_RECV_BYTES)) {
-		/*TODO: is exiting here more appropriate, since this denotes
-		 * error communicating with proxy or proxy has exited
-		 */
-		goto out;
+	ret = read(shim->proxy_io_fd, shim->io_buf + shim->io_end,
+			sizeof(shim->io_buf) - shim->io_end);
+	if (ret == -1) {
+		if (errno == EINTR || errno == EAGAIN || errno == EWOULDBLOCK) {
+			return;
+		}
+		err_exit("Error reading from proxy I/O fd: %s\n", strerror(errno));
+	} else if (ret == 0) {
+		/* EOF received on proxy I/O fd*/
+		err_exit("EOF received on proxy I/O fd\n");
 	}
 
-	if (seq == shim->io_seq_no) {
-		outfd = STDOUT_FILENO;
-	} else if (seq == shim->io_seq_no + 1) {//proxy allocates errseq 1 higher
-		outfd = STDERR_FILENO;
-	} else {
-		shim_warning("Seq no %"PRIu64 " received from proxy does not match with\
-				 shim seq %"PRIu64 "\n", seq, shim->io_seq_no);
-		goto out;
-	}
+	shim->io_end += (size_t)ret;
 
-	if (!shim->exiting && stream_len == STREAM_HEADER_SIZE) {
-		shim->exiting = true;
-		goto out;
-	} else if (shim->exiting && stream_len == (STREAM_HEADER_SIZE+1)) {
-		code = *(buf + STREAM_HEADER_SIZE); 	// hyperstart has sent the exit status
-		shim_debug("Exit status for container: %d\n", code);
-		free(buf);
-		restore_terminal();
-		exit(code);
+	while ((avail = shim->io_end - shim->io_start) >= STREAM_HEADER_SIZE) {
+		frame = shim->io_buf + shim->io_start;
+		frame_len = get_big_endian_32(frame + STREAM_HEADER_LENGTH_OFFSET);
+
+		/* Ensure amount of data is within expected bounds */
+		if (frame_len < STREAM_HEADER_SIZE ||
+				frame_len > HYPERSTART_MAX_RECV_BYTES) {
+			err_exit("Invalid message length (limit is %lu, but proxy returned %lu)\n",
+					(unsigned long int)HYPERSTART_MAX_RECV_BYTES,
+					(unsigned long int)frame_len);
+		}
+
+		if (avail < frame_len) {
+			/* wait for the rest of the frame */
+			break;
+		}
+
+		shim->io_start += frame_len;
+		seq = get_big_endian_64(frame);
+
+		if (seq == shim->io_seq_no) {
+			q = &shim->stdout_q;
+		} else if (seq == shim->io_seq_no + 1) {//proxy allocates errseq 1 higher
+			q = &shim->stderr_q;
+		} else {
+			shim_warning("Seq no %"PRIu64 " received from proxy does not match with\
+					 shim seq %"PRIu64 "\n", seq, shim->io_seq_no);
+			continue;
+		}
+
+		// length is 12 when hyperstart sends eof before sending exit code
+		if (!shim->exiting && frame_len == STREAM_HEADER_SIZE) {
+			shim->exiting = true;
+			continue;
+		} else if (shim->exiting && frame_len == (STREAM_HEADER_SIZE+1)) {
+			code = frame[STREAM_HEADER_SIZE]; 	// hyperstart has sent the exit status
+			shim_debug("Exit status for container: %d\n", code);
+			if (iovcnt) {
+				shim_queue_writev(outq, iov, iovcnt);
+			}
+			shim_exit(shim, code);
+		}
+
+		if (frame_len == STREAM_HEADER_SIZE) {
+			continue;
+		}
+
+		if (q != outq || iovcnt == SHIM_MAX_IOV) {
+			if (iovcnt) {
+				shim_queue_writev(outq, iov, iovcnt);
+			}
+			outq = q;
+			iovcnt = 0;
+		}
+
+		iov[iovcnt].iov_base = frame + STREAM_HEADER_SIZE;
+		iov[iovcnt].iov_len = frame_len - STREAM_HEADER_SIZE;
+		iovcnt++;
 	}
 
-	/* TODO: what if writing to stdout/err blocks? Add this to the poll loop
-	 * to watch out for EPOLLOUT
+	/* Whatever cannot be written now is copied to the output queue and
+	 * written once the fd becomes writable.
 	 */
-	offset = STREAM_HEADER_SIZE;
-	while (offset < stream_len) {
-		ret = write(outfd, buf+offset, (size_t)(stream_len-offset));
-		if (ret <= 0 ) {
-			goto out;
-		}
-		offset += (ssize_t)ret;
+	if (iovcnt) {
+		shim_queue_writev(outq, iov, iovcnt);
 	}
 
-out:
-	if (buf) {
-		free (buf);
+	/* keep the partial frame, if any, at the start of the buffer */
+	if (shim->io_start == shim->io_end) {
+		shim->io_start = shim->io_end = 0;
+	} else if (shim->io_start) {
+		memmove(shim->io_buf, shim->io_buf + shim->io_start,
+				shim->io_end - shim->io_start);
+		shim->io_end -= shim->io_start;
+		shim->io_start = 0;
 	}
 }
 
@@ -553,12 +850,16 @@ main(int argc, char **argv)
 		.io_seq_no      =  0,
 		.err_seq_no     =  0,
 		.exiting        =  false,
+		.stdin_pipe     = { -1, -1 },
 	};
 	int                ret;
 	struct sigaction   sa;
 	int                c;
 	bool               debug = false;
 	long long          val;
+	struct epoll_event events[MAX_POLL_FDS];
+	uint32_t           revents[MAX_POLL_FDS];
+	int                timeout;
 
 	program_name = argv[0];
 
@@ -646,6 +947,15 @@ main(int argc, char **argv)
 		exit(EXIT_FAILURE);
 	}
 
+	shim.epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+	if (shim.epoll_fd == -1) {
+		err_exit("Error creating epoll instance: %s\n", strerror(errno));
+	}
+
+	for (int i = 0; i < MAX_POLL_FDS; i++) {
+		shim.watches[i].fd = -1;
+	}
+
 	/* Using self pipe trick to handle signals in the main loop, other strategy
 	 * would be to clock signals and use signalfd()/ to handle signals synchronously
 	 */
@@ -653,8 +963,8 @@ main(int argc, char **argv)
 		err_exit("Error creating pipe\n");
 	}
 
-	// Add read end of pipe to pollfd list and make it non-bocking
-	add_pollfd(poll_fds, SIGNAL_FD_INDEX, signal_pipe_fd[0], POLLIN | POLLPRI);
+	// Add read end of pipe to the watched fds and make it non-bocking
+	add_watch(&shim, SIGNAL_FD_INDEX, signal_pipe_fd[0]);
 	if (! set_fd_nonblocking(signal_pipe_fd[0])) {
 		exit(EXIT_FAILURE);
 	}
@@ -671,9 +981,11 @@ main(int argc, char **argv)
 		err_exit("sigaction");
 	}
 
-	add_pollfd(poll_fds, PROXY_IO_INDEX, shim.proxy_io_fd, POLLIN | POLLPRI);
+	add_watch(&shim, PROXY_IO_INDEX, shim.proxy_io_fd);
+	shim_queue_init(&shim.proxy_io_q, shim.proxy_io_fd);
 
-	add_pollfd(poll_fds, PROXY_CTL_INDEX, shim.proxy_sock_fd, POLLIN | POLLPRI);
+	add_watch(&shim, PROXY_CTL_INDEX, shim.proxy_sock_fd);
+	shim_queue_init(&shim.proxy_ctl_q, shim.proxy_sock_fd);
 
 	/* Add stdin only if it is attached to a terminal.
 	 * If we add stdin in the non-interactive case, since stdin is closed by docker
@@ -696,43 +1008,108 @@ main(int argc, char **argv)
 		cfmakeraw(&term_settings);
 		tcsetattr(STDIN_FILENO, TCSAFLUSH, &term_settings);
 
-		add_pollfd(poll_fds, STDIN_INDEX, STDIN_FILENO, POLLIN | POLLPRI);
+		add_watch(&shim, STDIN_INDEX, STDIN_FILENO);
 	} else if (fcntl(STDIN_FILENO, F_GETFD) != -1) {
 		set_fd_nonblocking(STDIN_FILENO);
-		add_pollfd(poll_fds, STDIN_INDEX, STDIN_FILENO, POLLIN | POLLPRI);
+		add_watch(&shim, STDIN_INDEX, STDIN_FILENO);
+
+		/* Bulk input (a pipe or a file) is spliced to the proxy.
+		 * Splicing to the proxy I/O fd must not block, but it
+		 * is only read when data is available anyway.
+		 */
+		if (pipe2(shim.stdin_pipe, O_CLOEXEC | O_NONBLOCK) == -1) {
+			shim_warning("Error creating stdin pipe: %s\n", strerror(errno));
+			shim.stdin_pipe[0] = shim.stdin_pipe[1] = -1;
+		} else if (! set_fd_nonblocking(shim.proxy_io_fd)) {
+			stop_stdin_splice(&shim);
+		}
+	}
+
+	/* Output to stdout/stderr is queued and written as the fds become
+	 * writable, so that a slow reader does not stall the shim.
+	 */
+	shim_queue_init(&shim.stdout_q, STDOUT_FILENO);
+	if (shim.stdout_q.fd != -1) {
+		add_watch(&shim, STDOUT_INDEX, shim.stdout_q.fd);
+	}
+	shim_queue_init(&shim.stderr_q, STDERR_FILENO);
+	if (shim.stderr_q.fd != -1) {
+		add_watch(&shim, STDERR_INDEX, shim.stderr_q.fd);
 	}
 
+	active_shim = &shim;
+
 	ret = atexit(restore_terminal);
 	if (ret) {
 		shim_debug("Could not register function for atexit");
 	}
 
+	ret = atexit(restore_output_fds);
+	if (ret) {
+		shim_debug("Could not register function for atexit");
+	}
+
 	while (1) {
-		ret = poll(poll_fds, MAX_POLL_FDS, -1);
-		if (ret == -1 && errno != EINTR) {
-			shim_error("Error in poll : %s\n", strerror(errno));
+		update_watches(&shim);
+
+		/* stdin cannot be watched if it is a regular file, in which
+		 * case it is always ready to be read */
+		timeout = -1;
+		if (shim.watches[STDIN_INDEX].fd != -1 &&
+				! shim.watches[STDIN_INDEX].pollable &&
+				! stdin_blocked(&shim)) {
+			timeout = 0;
+		}
+
+		ret = epoll_wait(shim.epoll_fd, events, MAX_POLL_FDS, timeout);
+		if (ret == -1) {
+			if (errno == EINTR) {
+				continue;
+			}
+			shim_error("Error in epoll_wait : %s\n", strerror(errno));
 			break;
 		}
 
+		memset(revents, 0, sizeof(revents));
+		for (int i = 0; i < ret; i++) {
+			revents[events[i].data.u32] |= events[i].events;
+		}
+
 		/* check if signal was received first */
-		if (poll_fds[SIGNAL_FD_INDEX].revents != 0) {
+		if (revents[SIGNAL_FD_INDEX] != 0) {
 			handle_signals(&shim);
 		}
 
 		//check proxy_io_fd
-		if (poll_fds[PROXY_IO_INDEX].revents != 0) {
+		if (revents[PROXY_IO_INDEX] & (EPOLLOUT | EPOLLERR)) {
+			shim_queue_flush(&shim.proxy_io_q);
+			flush_stdin_splice(&shim);
+		}
+		if ((revents[PROXY_IO_INDEX] & (EPOLLIN | EPOLLHUP | EPOLLERR)) &&
+				(shim.watches[PROXY_IO_INDEX].events & EPOLLIN)) {
 			handle_proxy_output(&shim);
 		}
 
 		// check for proxy sockfd
-		if (poll_fds[PROXY_CTL_INDEX].revents != 0) {
+		if (revents[PROXY_CTL_INDEX] & (EPOLLOUT | EPOLLERR)) {
+			shim_queue_flush(&shim.proxy_ctl_q);
+		}
+		if (revents[PROXY_CTL_INDEX] & (EPOLLIN | EPOLLHUP | EPOLLERR)) {
 			handle_proxy_ctl(&shim);
 		}
 
 		// check stdin fd
-		if (poll_fds[STDIN_INDEX].revents != 0) {
+		if (revents[STDIN_INDEX] != 0 || timeout == 0) {
 			handle_stdin(&shim);
 		}
+
+		// drain stdout/stderr
+		if (revents[STDOUT_INDEX] != 0) {
+			shim_queue_flush(&shim.stdout_q);
+		}
+		if (revents[STDERR_INDEX] != 0) {
+			shim_queue_flush(&shim.stderr_q);
+		}
 	}
 
 	free(shim.container_id);
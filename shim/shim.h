@@ -14,11 +14,48 @@
 
 #include <stdio.h>
 
+#include "queue.h"
+
 /* The shim would be handling fixed number of predefined fds.
- * This would be signal fd, stdin fd, proxy socket fd and an I/O
- * fd passed by the runtime
+ * This would be signal fd, stdin fd, proxy socket fd, an I/O
+ * fd passed by the runtime and the stdout and stderr fds.
+ */
+#define MAX_POLL_FDS 6
+
+/*
+ * Once more than SHIM_QUEUE_HIGH_WATERMARK bytes are queued for
+ * stdout/stderr, the shim stops reading from the proxy I/O fd (and
+ * once as much is queued for the proxy, it stops reading stdin)
+ * until the queue drops below SHIM_QUEUE_LOW_WATERMARK bytes.
+ */
+#define SHIM_QUEUE_HIGH_WATERMARK       (1024 * 1024)
+#define SHIM_QUEUE_LOW_WATERMARK        (256 * 1024)
+
+/*
+ * Size of the buffer the proxy I/O fd is read into. It must hold at
+ * least one complete frame (HYPERSTART_MAX_RECV_BYTES).
+ */
+#define SHIM_IO_BUF_SIZE                (64 * 1024)
+
+/* Maximum number of frames written with a single writev(2) */
+#define SHIM_MAX_IOV                    64
+
+/*
+ * Largest amount of stdin data sent in a single frame when stdin is
+ * spliced to the proxy: hyperstart does not accept larger frames.
  */
-#define MAX_POLL_FDS 4
+#define SHIM_SPLICE_CHUNK_SIZE          (HYPERSTART_MAX_RECV_BYTES - STREAM_HEADER_SIZE)
+
+/* A file descriptor watched by the epoll loop */
+struct shim_watch {
+	int         fd;
+
+	/* Events currently watched (0 if not registered) */
+	uint32_t    events;
+
+	/* false if the fd cannot be watched with epoll */
+	bool        pollable;
+};
 
 struct cc_shim {
 	char       *container_id;
@@ -27,6 +64,35 @@ struct cc_shim {
 	uint64_t    io_seq_no;
 	uint64_t    err_seq_no;
 	bool        exiting;
+
+	int                 epoll_fd;
+	struct shim_watch   watches[MAX_POLL_FDS];
+
+	/* Output waiting for the fds to become writable */
+	struct shim_queue   stdout_q;
+	struct shim_queue   stderr_q;
+	struct shim_queue   proxy_io_q;
+	struct shim_queue   proxy_ctl_q;
+
+	/* Reading from the proxy I/O fd (resp. stdin) is suspended */
+	bool                output_throttled;
+	bool                input_throttled;
+
+	/* Data read from the proxy I/O fd. Frames are parsed in place,
+	 * from io_start to io_end, and a trailing partial frame is moved
+	 * back to the start of the buffer once the others are handled.
+	 */
+	uint8_t             io_buf[SHIM_IO_BUF_SIZE];
+	size_t              io_start;
+	size_t              io_end;
+
+	/* Pipe stdin data is spliced through to the proxy I/O fd
+	 * ({-1, -1} when stdin is read and copied instead)
+	 */
+	int                 stdin_pipe[2];
+
+	/* Bytes of the current frame still in stdin_pipe */
+	size_t              splice_pending;
 };
 
 /*
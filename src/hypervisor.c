@@ -153,57 +153,343 @@ cc_oci_append_network_args(struct cc_oci_config *config,
         }
 }
 
+/** Names of the \ref cc_oci_vm_args_tag placeholders. */
+static const gchar *cc_oci_vm_args_tags[CC_OCI_VM_ARGS_TAG_COUNT] = {
+	[CC_OCI_VM_ARGS_WORKLOAD_DIR]      = "@WORKLOAD_DIR@",
+	[CC_OCI_VM_ARGS_KERNEL]            = "@KERNEL@",
+	[CC_OCI_VM_ARGS_KERNEL_PARAMS]     = "@KERNEL_PARAMS@",
+	[CC_OCI_VM_ARGS_KERNEL_NET_PARAMS] = "@KERNEL_NET_PARAMS@",
+	[CC_OCI_VM_ARGS_IMAGE]             = "@IMAGE@",
+	[CC_OCI_VM_ARGS_SIZE]              = "@SIZE@",
+	[CC_OCI_VM_ARGS_COMMS_SOCKET]      = "@COMMS_SOCKET@",
+	[CC_OCI_VM_ARGS_PROCESS_SOCKET]    = "@PROCESS_SOCKET@",
+	[CC_OCI_VM_ARGS_CONSOLE_DEVICE]    = "@CONSOLE_DEVICE@",
+	[CC_OCI_VM_ARGS_NAME]              = "@NAME@",
+	[CC_OCI_VM_ARGS_UUID]              = "@UUID@",
+	[CC_OCI_VM_ARGS_AGENT_CTL_SOCKET]  = "@AGENT_CTL_SOCKET@",
+	[CC_OCI_VM_ARGS_AGENT_TTY_SOCKET]  = "@AGENT_TTY_SOCKET@",
+};
+
+/** Values of the \ref cc_oci_vm_args_tag placeholders for a
+ * particular hypervisor launch.
+ */
+struct cc_oci_vm_args_values {
+	/** Value of each placeholder (\c NULL if it should not be
+	 * expanded).
+	 */
+	const gchar  *value[CC_OCI_VM_ARGS_TAG_COUNT];
+
+	/** Length of each value. */
+	gsize         len[CC_OCI_VM_ARGS_TAG_COUNT];
+
+	/* Storage for the generated values */
+	gchar        *size;
+	gchar        *console_device;
+	gchar        *procsock_device;
+	gchar        *kernel_net_params;
+	gchar         uuid[UUID_MAX];
+};
+
 /*!
- * Replace any special tokens found in \p args with their expanded
- * values.
+ * Free a \ref cc_oci_vm_args_line.
  *
- * \param config \ref cc_oci_config.
- * \param[in, out] args Command-line to expand.
+ * \param line \ref cc_oci_vm_args_line.
+ */
+private void
+cc_oci_vm_args_line_free (struct cc_oci_vm_args_line *line)
+{
+	if (! line) {
+		return;
+	}
+
+	g_free_if_set (line->text);
+
+	if (line->segments) {
+		g_array_free (line->segments, true);
+	}
+
+	g_free (line);
+}
+
+/*!
+ * Add a segment to a \ref cc_oci_vm_args_line.
+ *
+ * \param line \ref cc_oci_vm_args_line.
+ * \param tag \ref cc_oci_vm_args_tag, or \ref CC_OCI_VM_ARGS_LITERAL.
+ * \param text Literal text.
+ * \param len Length of \p text.
+ */
+static void
+cc_oci_vm_args_line_add (struct cc_oci_vm_args_line *line,
+		gint tag, const gchar *text, gsize len)
+{
+	struct cc_oci_vm_args_segment segment = { tag, text, len };
+
+	if (tag == CC_OCI_VM_ARGS_LITERAL) {
+		if (! len) {
+			return;
+		}
+		line->literal_len += len;
+	}
+
+	g_array_append_val (line->segments, segment);
+}
+
+/*!
+ * Compile a line of \ref CC_OCI_HYPERVISOR_CMDLINE_FILE into literal
+ * and placeholder segments.
+ *
+ * Comments (lines starting with '#', or text following a '#' that
+ * is preceded by whitespace) are removed.
+ *
+ * \param text Line to compile.
+ * \param first \c true if \p text is the first line (the command to
+ * run), which is looked up in \c PATH if it is not absolute.
+ *
+ * \return Newly-allocated \ref cc_oci_vm_args_line.
+ */
+private struct cc_oci_vm_args_line *
+cc_oci_vm_args_line_compile (const gchar *text, gboolean first)
+{
+	struct cc_oci_vm_args_line  *line;
+	const gchar                 *literal;
+	gchar                       *p;
+
+	line = g_new0 (struct cc_oci_vm_args_line, 1);
+	line->segments = g_array_new (false, false,
+			sizeof (struct cc_oci_vm_args_segment));
+
+	line->text = NULL;
+
+	if (first && ! g_path_is_absolute (text)) {
+		/* command must be the first entry */
+		line->text = g_find_program_in_path (text);
+	}
+
+	if (! line->text) {
+		line->text = g_strdup (text);
+	}
+
+	/* when first character is '#' line is a comment and must be ignored */
+	if (*line->text == '#') {
+		*line->text = '\0';
+	}
+
+	/* if '[:space:]#' then replace '#' with '\0' (EOL) */
+	for (p = strchr (line->text, '#'); p; p = strchr (p + 1, '#')) {
+		if (g_ascii_isspace (*(p-1))) {
+			*p = '\0';
+			break;
+		}
+	}
+
+	literal = line->text;
+
+	for (p = strchr (line->text, '@'); p; ) {
+		gint  tag;
+		gsize len = 0;
+
+		for (tag = 0; tag < CC_OCI_VM_ARGS_TAG_COUNT; tag++) {
+			len = strlen (cc_oci_vm_args_tags[tag]);
+			if (! strncmp (p, cc_oci_vm_args_tags[tag], len)) {
+				break;
+			}
+		}
+
+		if (tag == CC_OCI_VM_ARGS_TAG_COUNT) {
+			p = strchr (p + 1, '@');
+			continue;
+		}
+
+		cc_oci_vm_args_line_add (line, CC_OCI_VM_ARGS_LITERAL,
+				literal, (gsize)(p - literal));
+		cc_oci_vm_args_line_add (line, tag, NULL, 0);
+
+		literal = p + len;
+		p = strchr (literal, '@');
+	}
+
+	cc_oci_vm_args_line_add (line, CC_OCI_VM_ARGS_LITERAL,
+			literal, strlen (literal));
+
+	return line;
+}
+
+/*!
+ * Expand a \ref cc_oci_vm_args_line.
  *
- * \warning this is not very efficient.
+ * \param line \ref cc_oci_vm_args_line.
+ * \param values \ref cc_oci_vm_args_values.
+ *
+ * \return Newly-allocated string.
+ */
+private gchar *
+cc_oci_vm_args_line_expand (const struct cc_oci_vm_args_line *line,
+		const struct cc_oci_vm_args_values *values)
+{
+	const struct cc_oci_vm_args_segment  *segment;
+	gchar                                *expanded;
+	gchar                                *p;
+	gsize                                 len;
+	guint                                 i;
+
+	len = line->literal_len;
+
+	for (i = 0; i < line->segments->len; i++) {
+		segment = &g_array_index (line->segments,
+				struct cc_oci_vm_args_segment, i);
+
+		if (segment->tag == CC_OCI_VM_ARGS_LITERAL) {
+			continue;
+		}
+
+		if (values->value[segment->tag]) {
+			len += values->len[segment->tag];
+		} else {
+			/* placeholders without a value are left as-is */
+			len += strlen (cc_oci_vm_args_tags[segment->tag]);
+		}
+	}
+
+	expanded = g_malloc (len + 1);
+
+	for (i = 0, p = expanded; i < line->segments->len; i++) {
+		const gchar  *text;
+		gsize         text_len;
+
+		segment = &g_array_index (line->segments,
+				struct cc_oci_vm_args_segment, i);
+
+		if (segment->tag == CC_OCI_VM_ARGS_LITERAL) {
+			text = segment->text;
+			text_len = segment->len;
+		} else if (values->value[segment->tag]) {
+			text = values->value[segment->tag];
+			text_len = values->len[segment->tag];
+		} else {
+			text = cc_oci_vm_args_tags[segment->tag];
+			text_len = strlen (text);
+		}
+
+		memcpy (p, text, text_len);
+		p += text_len;
+	}
+
+	*p = '\0';
+
+	return expanded;
+}
+
+/*!
+ * Free a \ref cc_oci_vm_args_template.
+ *
+ * \param template \ref cc_oci_vm_args_template.
+ */
+private void
+cc_oci_vm_args_template_free (struct cc_oci_vm_args_template *template)
+{
+	if (! template) {
+		return;
+	}
+
+	if (template->lines) {
+		g_ptr_array_free (template->lines, true);
+	}
+
+	g_free (template);
+}
+
+/*!
+ * Read and compile a \ref CC_OCI_HYPERVISOR_CMDLINE_FILE.
+ *
+ * \param path Full path to the file.
+ *
+ * \return Newly-allocated \ref cc_oci_vm_args_template on success,
+ * else \c NULL.
+ */
+private struct cc_oci_vm_args_template *
+cc_oci_vm_args_template_new (const gchar *path)
+{
+	struct cc_oci_vm_args_template  *template = NULL;
+	gchar                          **lines = NULL;
+	guint                            i;
+
+	if (! path) {
+		return NULL;
+	}
+
+	if (! cc_oci_file_to_strv (path, &lines)) {
+		return NULL;
+	}
+
+	template = g_new0 (struct cc_oci_vm_args_template, 1);
+	template->lines = g_ptr_array_new_full (g_strv_length (lines),
+			(GDestroyNotify)cc_oci_vm_args_line_free);
+
+	for (i = 0; lines[i]; i++) {
+		g_ptr_array_add (template->lines,
+				cc_oci_vm_args_line_compile (lines[i], i == 0));
+	}
+
+	g_strfreev (lines);
+
+	return template;
+}
+
+/*!
+ * Free the generated values of a \ref cc_oci_vm_args_values.
+ *
+ * \param values \ref cc_oci_vm_args_values.
+ */
+static void
+cc_oci_vm_args_values_clear (struct cc_oci_vm_args_values *values)
+{
+	g_free_if_set (values->size);
+	g_free_if_set (values->console_device);
+	g_free_if_set (values->procsock_device);
+	g_free_if_set (values->kernel_net_params);
+}
+
+/*!
+ * Determine the values of the placeholders in
+ * \ref CC_OCI_HYPERVISOR_CMDLINE_FILE, and set the proxy socket
+ * paths.
+ *
+ * \param config \ref cc_oci_config.
+ * \param[out] values \ref cc_oci_vm_args_values, which must be
+ * cleared with \ref cc_oci_vm_args_values_clear.
  *
  * \return \c true on success, else \c false.
  */
-gboolean
-cc_oci_expand_cmdline (struct cc_oci_config *config,
-		gchar **args)
+static gboolean
+cc_oci_vm_args_values_get (struct cc_oci_config *config,
+		struct cc_oci_vm_args_values *values)
 {
 	struct stat       st;
-	gchar           **arg;
-	gchar            *bytes = NULL;
-	gchar            *console_device = NULL;
 	gchar            *workload_dir;
 	gchar		 *hypervisor_console = NULL;
-	g_autofree gchar *procsock_device = NULL;
-
-	gboolean          ret = false;
-	gint              count;
 	uuid_t            uuid;
 	/* uuid pattern */
 	const char        uuid_pattern[UUID_MAX] = "00000000-0000-0000-0000-000000000000";
-	char              uuid_str[UUID_MAX] = { 0 };
 	gint              uuid_index = 0;
-
-	gchar            *kernel_net_params = NULL;
 	struct cc_proxy  *proxy;
+	gint              tag;
 
-	if (! (config && args)) {
-		return false;
-	}
+	memset (values, 0, sizeof (*values));
 
 	if (! config->vm) {
 		g_critical ("No vm configuration");
-		goto out;
+		return false;
 	}
 
 	if (! config->bundle_path) {
 		g_critical ("No bundle path");
-		goto out;
+		return false;
 	}
 
 	if (! config->proxy) {
 		g_critical ("No proxy");
-		goto out;
+		return false;
 	}
 
 	/* We're about to launch the hypervisor so validate paths.*/
@@ -211,7 +497,7 @@ cc_oci_expand_cmdline (struct cc_oci_config *config,
 	workload_dir = cc_oci_get_workload_dir(config);
 	if (! workload_dir) {
 		g_critical ("No workload");
-		goto out;
+		return false;
 	}
 
 	if ((!config->vm->image_path[0])
@@ -238,27 +524,27 @@ cc_oci_expand_cmdline (struct cc_oci_config *config,
 	uuid_generate_random(uuid);
 	for(size_t i=0; i<sizeof(uuid_t) && uuid_index < sizeof(uuid_pattern); ++i) {
 		/* hex to char */
-		uuid_index += g_snprintf(uuid_str+uuid_index,
+		uuid_index += g_snprintf(values->uuid+uuid_index,
 		                  sizeof(uuid_pattern)-(gulong)uuid_index,
 		                  "%02x", uuid[i]);
 
 		/* copy separator '-' */
 		if (uuid_pattern[uuid_index] == '-') {
-			uuid_index += g_snprintf(uuid_str+uuid_index,
+			uuid_index += g_snprintf(values->uuid+uuid_index,
 			                  sizeof(uuid_pattern)-(gulong)uuid_index, "-");
 		}
 	}
 
-	bytes = g_strdup_printf ("%lu", (unsigned long int)st.st_size);
+	values->size = g_strdup_printf ("%lu", (unsigned long int)st.st_size);
 
 	hypervisor_console = g_build_path ("/", config->state.runtime_path,
 			CC_OCI_CONSOLE_SOCKET, NULL);
 
-	console_device = g_strdup_printf (
+	values->console_device = g_strdup_printf (
 			"socket,path=%s,server,nowait,id=charconsole0,signal=off",
 			hypervisor_console);
 
-	procsock_device = g_strdup_printf ("socket,id=procsock,path=%s,server,nowait", config->state.procsock_path);
+	values->procsock_device = g_strdup_printf ("socket,id=procsock,path=%s,server,nowait", config->state.procsock_path);
 
 	proxy = config->proxy;
 
@@ -274,76 +560,71 @@ cc_oci_expand_cmdline (struct cc_oci_config *config,
 
 	g_debug("guest agent tty socket: %s", proxy->agent_tty_socket);
 
-	kernel_net_params = cc_oci_expand_net_cmdline(config);
+	values->kernel_net_params = cc_oci_expand_net_cmdline(config);
 
 	/* Note: @NETDEV@: For multiple network we need to have a way to append
 	 * args to the hypervisor command line vs substitution
 	 */
-	struct special_tag {
-		const gchar* name;
-		const gchar* value;
-	} special_tags[] = {
-		{ "@WORKLOAD_DIR@"      , workload_dir               },
-		{ "@KERNEL@"            , config->vm->kernel_path    },
-		{ "@KERNEL_PARAMS@"     , config->vm->kernel_params  },
-		{ "@KERNEL_NET_PARAMS@" , kernel_net_params          },
-		{ "@IMAGE@"             , config->vm->image_path     },
-		{ "@SIZE@"              , bytes                      },
-		{ "@COMMS_SOCKET@"      , config->state.comms_path   },
-		{ "@PROCESS_SOCKET@"    , procsock_device            },
-		{ "@CONSOLE_DEVICE@"    , console_device             },
-		{ "@NAME@"              , g_strrstr(uuid_str, "-")+1 },
-		{ "@UUID@"              , uuid_str                   },
-		{ "@AGENT_CTL_SOCKET@"  , proxy->agent_ctl_socket    },
-		{ "@AGENT_TTY_SOCKET@"  , proxy->agent_tty_socket    },
-		{ NULL }
-	};
-
-	for (arg = args, count = 0; arg && *arg; arg++, count++) {
-		if (! count) {
-			/* command must be the first entry */
-			if (! g_path_is_absolute (*arg)) {
-				gchar *cmd = g_find_program_in_path (*arg);
-
-				if (cmd) {
-					g_free (*arg);
-					*arg = cmd;
-				}
-			}
+	values->value[CC_OCI_VM_ARGS_WORKLOAD_DIR] = workload_dir;
+	values->value[CC_OCI_VM_ARGS_KERNEL] = config->vm->kernel_path;
+	values->value[CC_OCI_VM_ARGS_KERNEL_PARAMS] = config->vm->kernel_params;
+	values->value[CC_OCI_VM_ARGS_KERNEL_NET_PARAMS] = values->kernel_net_params;
+	values->value[CC_OCI_VM_ARGS_IMAGE] = config->vm->image_path;
+	values->value[CC_OCI_VM_ARGS_SIZE] = values->size;
+	values->value[CC_OCI_VM_ARGS_COMMS_SOCKET] = config->state.comms_path;
+	values->value[CC_OCI_VM_ARGS_PROCESS_SOCKET] = values->procsock_device;
+	values->value[CC_OCI_VM_ARGS_CONSOLE_DEVICE] = values->console_device;
+	values->value[CC_OCI_VM_ARGS_NAME] = g_strrstr(values->uuid, "-")+1;
+	values->value[CC_OCI_VM_ARGS_UUID] = values->uuid;
+	values->value[CC_OCI_VM_ARGS_AGENT_CTL_SOCKET] = proxy->agent_ctl_socket;
+	values->value[CC_OCI_VM_ARGS_AGENT_TTY_SOCKET] = proxy->agent_tty_socket;
+
+	for (tag = 0; tag < CC_OCI_VM_ARGS_TAG_COUNT; tag++) {
+		if (values->value[tag]) {
+			values->len[tag] = strlen (values->value[tag]);
 		}
+	}
 
-		/* when first character is '#' line is a comment and must be ignored */
-		if (**arg == '#') {
-			g_strlcpy(*arg, "\0", LINE_MAX);
-			continue;
-		}
+	return true;
+}
 
-		/* looking for '#' */
-		gchar* ptr = g_strstr_len(*arg, LINE_MAX, "#");
-		while (ptr) {
-			/* if '[:space:]#' then replace '#' with '\0' (EOL) */
-			if (g_ascii_isspace(*(ptr-1))) {
-				g_strlcpy(ptr, "\0", LINE_MAX);
-				break;
-			}
-			ptr = g_strstr_len(ptr+1, LINE_MAX, "#");
-		}
+/*!
+ * Replace any special tokens found in \p args with their expanded
+ * values.
+ *
+ * \param config \ref cc_oci_config.
+ * \param[in, out] args Command-line to expand.
+ *
+ * \return \c true on success, else \c false.
+ */
+gboolean
+cc_oci_expand_cmdline (struct cc_oci_config *config,
+		gchar **args)
+{
+	struct cc_oci_vm_args_values   values;
+	struct cc_oci_vm_args_line    *line;
+	gchar                        **arg;
 
-		for (struct special_tag* tag=special_tags; tag && tag->name; tag++) {
-			if (! cc_oci_replace_string(arg, tag->name, tag->value)) {
-				goto out;
-			}
-		}
+	if (! (config && args)) {
+		return false;
 	}
 
-	ret = true;
+	if (! cc_oci_vm_args_values_get (config, &values)) {
+		return false;
+	}
 
-out:
-	g_free_if_set (bytes);
-	g_free_if_set (console_device);
-	g_free_if_set (kernel_net_params);
+	for (arg = args; *arg; arg++) {
+		line = cc_oci_vm_args_line_compile (*arg, arg == args);
 
-	return ret;
+		g_free (*arg);
+		*arg = cc_oci_vm_args_line_expand (line, &values);
+
+		cc_oci_vm_args_line_free (line);
+	}
+
+	cc_oci_vm_args_values_clear (&values);
+
+	return true;
 }
 
 /*!
@@ -409,10 +690,10 @@ out:
 }
 
 /*!
- * Generate the unexpanded list of hypervisor arguments to use.
+ * Generate the expanded list of hypervisor arguments to use.
  *
  * \param config \ref cc_oci_config.
- * \param[out] args Command-line to expand.
+ * \param[out] args Command-line to use.
  * \param hypervisor_extra_args Additional args to be appended
  *
  * \return \c true on success, else \c false.
@@ -422,12 +703,14 @@ cc_oci_vm_args_get (struct cc_oci_config *config,
 		gchar ***args,
 		GPtrArray *hypervisor_extra_args)
 {
-	gboolean  ret;
-	gchar    *args_file = NULL;
-	guint     line_count = 0;
-	gchar   **arg;
-	gchar   **new_args;
-	guint       extra_args_len = 0;
+	struct cc_oci_vm_args_template        *template = NULL;
+	struct cc_oci_vm_args_values           values;
+	gboolean                               ret = false;
+	gchar                                 *args_file = NULL;
+	guint                                  line_count = 0;
+	gchar                                **new_args;
+	guint                                  extra_args_len = 0;
+	guint                                  i;
 
 	if (! (config && args)) {
 		return false;
@@ -439,59 +722,52 @@ cc_oci_vm_args_get (struct cc_oci_config *config,
 				CC_OCI_HYPERVISOR_CMDLINE_FILE);
 	}
 
-	ret = cc_oci_file_to_strv (args_file, args);
-	if (! ret) {
+	template = cc_oci_vm_args_template_new (args_file);
+	if (! template) {
 		goto out;
 	}
 
-	ret = cc_oci_expand_cmdline (config, *args);
-	if (! ret) {
+	if (! cc_oci_vm_args_values_get (config, &values)) {
 		goto out;
 	}
 
-	/* count non-empty lines */
-	for (arg = *args; arg && *arg; arg++) {
-		if (**arg != '\0') {
-			line_count++;
-		}
-	}
-
 	if (hypervisor_extra_args) {
 		extra_args_len = hypervisor_extra_args->len;
 	}
 
-	new_args = g_malloc0(sizeof(gchar*) * (line_count + extra_args_len + 1));
+	new_args = g_malloc0(sizeof(gchar*) * (template->lines->len + extra_args_len + 1));
+
+	for (i = 0; i < template->lines->len; i++) {
+		gchar *arg;
+
+		arg = cc_oci_vm_args_line_expand (
+				g_ptr_array_index (template->lines, i),
+				&values);
 
-	/* copy non-empty lines */
-	for (arg = *args, line_count = 0; arg && *arg; arg++) {
 		/* *do not* add empty lines */
-		if (**arg != '\0') {
+		if (*arg != '\0') {
 			/* container fails if arg contains spaces */
-			g_strstrip(*arg);
-			new_args[line_count] = *arg;
-			line_count++;
+			new_args[line_count++] = g_strstrip(arg);
 		} else {
-			/* free empty lines */
-			g_free(*arg);
+			g_free(arg);
 		}
 	}
 
 	/*  append additional args array */
-	for (int i = 0; i < extra_args_len; i++) {
+	for (i = 0; i < extra_args_len; i++) {
 		const gchar* arg = g_ptr_array_index(hypervisor_extra_args, i);
 		if (arg != '\0') {
 			new_args[line_count++] = g_strstrip(g_strdup(arg));
 		}
 	}
 
-	/* only free pointer to gchar* */
-	g_free(*args);
+	cc_oci_vm_args_values_clear (&values);
 
-	/* copy new args */
 	*args = new_args;
 
 	ret = true;
 out:
+	cc_oci_vm_args_template_free (template);
 	g_free_if_set (args_file);
 	return ret;
 }
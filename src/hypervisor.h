@@ -21,9 +21,65 @@
 #ifndef _CC_OCI_HYPERVISOR_H
 #define _CC_OCI_HYPERVISOR_H
 
+#include <glib.h>
+
 /** Name of file containing hypervisor arguments (one per line) */
 #define CC_OCI_HYPERVISOR_CMDLINE_FILE "hypervisor.args"
 
+/** Placeholders which may appear in
+ * \ref CC_OCI_HYPERVISOR_CMDLINE_FILE.
+ */
+enum cc_oci_vm_args_tag {
+	CC_OCI_VM_ARGS_WORKLOAD_DIR,
+	CC_OCI_VM_ARGS_KERNEL,
+	CC_OCI_VM_ARGS_KERNEL_PARAMS,
+	CC_OCI_VM_ARGS_KERNEL_NET_PARAMS,
+	CC_OCI_VM_ARGS_IMAGE,
+	CC_OCI_VM_ARGS_SIZE,
+	CC_OCI_VM_ARGS_COMMS_SOCKET,
+	CC_OCI_VM_ARGS_PROCESS_SOCKET,
+	CC_OCI_VM_ARGS_CONSOLE_DEVICE,
+	CC_OCI_VM_ARGS_NAME,
+	CC_OCI_VM_ARGS_UUID,
+	CC_OCI_VM_ARGS_AGENT_CTL_SOCKET,
+	CC_OCI_VM_ARGS_AGENT_TTY_SOCKET,
+
+	CC_OCI_VM_ARGS_TAG_COUNT
+};
+
+/** Value of \ref cc_oci_vm_args_segment.tag for literal text. */
+#define CC_OCI_VM_ARGS_LITERAL		(-1)
+
+/** Part of a compiled hypervisor argument. */
+struct cc_oci_vm_args_segment {
+	/** \ref cc_oci_vm_args_tag, or \ref CC_OCI_VM_ARGS_LITERAL. */
+	gint          tag;
+
+	/** Literal text (below \ref cc_oci_vm_args_line.text). */
+	const gchar  *text;
+
+	/** Length of \p text. */
+	gsize         len;
+};
+
+/** A compiled line of \ref CC_OCI_HYPERVISOR_CMDLINE_FILE. */
+struct cc_oci_vm_args_line {
+	/** Line with any comment removed. */
+	gchar   *text;
+
+	/** Array of \ref cc_oci_vm_args_segment. */
+	GArray  *segments;
+
+	/** Total length of the literal segments. */
+	gsize    literal_len;
+};
+
+/** A compiled \ref CC_OCI_HYPERVISOR_CMDLINE_FILE. */
+struct cc_oci_vm_args_template {
+	/** Array of \ref cc_oci_vm_args_line. */
+	GPtrArray  *lines;
+};
+
 gboolean cc_oci_vm_args_get (struct cc_oci_config *config,
 		gchar ***args, GPtrArray *hypervisor_extra_args);
 gboolean cc_oci_expand_cmdline (struct cc_oci_config *config,
@@ -19,125 +19,561 @@
  */
 
 #include <stdbool.h>
-#include <stdio.h>
+#include <string.h>
 
-#include <json-glib/json-glib.h>
+#include <glib.h>
+
+#include "json.h"
+#include "util.h"
 
 /**
  * Buffer which must be large enough to hold the string representation
- * of any JSON node type (\c GType).
+ * of any JSON number.
  */
 #define NODE_BUF_SIZE 64
 
+/** Maximum nesting of JSON objects and arrays. */
+#define CC_OCI_JSON_MAX_DEPTH 128
+
 /*!
- * Convert the specified \c JsonNode into a string.
+ * State of the parser.
  *
- * \param node \c JsonNode.
- * \return Newly-allocated string on success, else \c NULL.
+ * The JSON text is parsed in a single pass, appending the nodes
+ * to the tree as it goes.
  */
-static gchar *
-cc_oci_json_string (JsonNode* node) {
-	gchar buffer[NODE_BUF_SIZE];
-	GType valueType = json_node_get_value_type(node);
+struct cc_oci_json_parser {
+	/** Start of the JSON text. */
+	const gchar  *start;
 
-	switch (valueType) {
-	case G_TYPE_STRING:
-		return json_node_dup_string(node);
+	/** Next character to parse. */
+	const gchar  *p;
 
-	case G_TYPE_DOUBLE:
-	case G_TYPE_FLOAT:
-		g_snprintf(buffer, NODE_BUF_SIZE, "%f", json_node_get_double(node));
-		break;
+	/** End of the JSON text. */
+	const gchar  *end;
 
-	case G_TYPE_INT:
-	case G_TYPE_INT64:
-		g_snprintf(buffer, NODE_BUF_SIZE, "%ld", json_node_get_int(node));
-		break;
+	/** Current nesting level. */
+	guint         depth;
+
+	/** Path of file being parsed (for error messages). */
+	const gchar  *filename;
+};
 
-	case G_TYPE_BOOLEAN:
-		if (json_node_get_boolean(node)) {
-			g_snprintf(buffer, NODE_BUF_SIZE, "%s", "true");
-		} else {
-			g_snprintf(buffer, NODE_BUF_SIZE, "%s", "false");
+static gboolean cc_oci_json_parse_value (struct cc_oci_json_parser *parser,
+		GNode *node, bool parsing_array);
+
+/*!
+ * Log a parse error.
+ *
+ * \param parser \ref cc_oci_json_parser.
+ * \param reason Description of the error.
+ *
+ * \return \c false.
+ */
+static gboolean
+cc_oci_json_error (const struct cc_oci_json_parser *parser,
+		const char *reason)
+{
+	g_debug ("Error parsing '%s': %s at offset %ld",
+			parser->filename, reason,
+			(long)(parser->p - parser->start));
+	return false;
+}
+
+/*!
+ * Skip whitespace.
+ *
+ * \param parser \ref cc_oci_json_parser.
+ *
+ * \return \c true if there is more text to parse, else \c false.
+ */
+static inline gboolean
+cc_oci_json_skip_space (struct cc_oci_json_parser *parser)
+{
+	while (parser->p < parser->end) {
+		switch (*parser->p) {
+		case ' ':
+		case '\t':
+		case '\n':
+		case '\r':
+			parser->p++;
+			break;
+		default:
+			return true;
 		}
-		break;
+	}
 
-	default:
-		g_snprintf(buffer, NODE_BUF_SIZE, "%s", "Unknown type");
-		break;
+	return false;
+}
+
+/*!
+ * Parse the 4 hex digits of a "\u" escape.
+ *
+ * \param parser \ref cc_oci_json_parser, positioned after the "\u".
+ * \param[out] value Code unit.
+ *
+ * \return \c true on success, else \c false.
+ */
+static gboolean
+cc_oci_json_parse_hex4 (struct cc_oci_json_parser *parser,
+		gunichar *value)
+{
+	gint  digit;
+	gint  i;
+
+	if (parser->end - parser->p < 4) {
+		return false;
+	}
+
+	*value = 0;
+
+	for (i = 0; i < 4; i++) {
+		digit = g_ascii_xdigit_value (*parser->p++);
+		if (digit < 0) {
+			return false;
+		}
+		*value = (*value << 4) | (gunichar)digit;
 	}
 
-	return g_strdup(buffer);
+	return true;
 }
 
 /*!
- * Recursive function that handles converging \c JsonNode's to \c
- * GNode's.
+ * Parse a string.
  *
- * \param root \c Root JsonNode to convert.
- * \param node \c GNode.
- * \param parsing_array \c true if handling an array, else \c false.
+ * \param parser \ref cc_oci_json_parser, positioned on the opening
+ *   quote.
+ * \param[out] out Newly-allocated unescaped string (or \c NULL to
+ *   skip the string).
+ *
+ * \return \c true on success, else \c false.
  */
-static void
-cc_oci_json_parse_aux(JsonNode* root, GNode* node, bool parsing_array) {
-	guint i;
+static gboolean
+cc_oci_json_parse_string (struct cc_oci_json_parser *parser, gchar **out)
+{
+	const gchar  *start;
+	GString      *str = NULL;
+	gunichar      c;
+	gunichar      low;
 
-	g_assert (root);
-	g_assert (node);
+	start = ++parser->p;
 
-	if (JSON_NODE_TYPE(root) == JSON_NODE_OBJECT) {
-		JsonObject *object = json_node_get_object(root);
+	/* most strings have no escapes, so can be copied in one go */
+	while (parser->p < parser->end
+			&& *parser->p != '"'
+			&& *parser->p != '\\'
+			&& (guchar)*parser->p >= 0x20) {
+		parser->p++;
+	}
 
-		if (object) {
-			guint j;
-			guint size;
-			GList* keys, *key = NULL;
-			GList* values, *value = NULL;
+	if (parser->p < parser->end && *parser->p == '"') {
+		if (out) {
+			*out = g_strndup (start, (gsize)(parser->p - start));
+		}
+		parser->p++;
+		return true;
+	}
+
+	str = g_string_new_len (start, parser->p - start);
 
-			size = json_object_get_size(object);
-			keys = json_object_get_members(object);
-			values = json_object_get_values(object);
-			node = g_node_append(node, g_node_new(NULL));
+	while (parser->p < parser->end && *parser->p != '"') {
+		if ((guchar)*parser->p < 0x20) {
+			goto err;
+		}
 
-			for (j = 0, key = keys, value = values; j < size; j++) {
-				if (key) {
-					node = g_node_append(node->parent, g_node_new(g_strdup(key->data)));
+		if (*parser->p != '\\') {
+			g_string_append_c (str, *parser->p++);
+			continue;
+		}
+
+		if (++parser->p == parser->end) {
+			goto err;
+		}
+
+		switch (*parser->p++) {
+		case '"':  g_string_append_c (str, '"');  break;
+		case '\\': g_string_append_c (str, '\\'); break;
+		case '/':  g_string_append_c (str, '/');  break;
+		case 'b':  g_string_append_c (str, '\b'); break;
+		case 'f':  g_string_append_c (str, '\f'); break;
+		case 'n':  g_string_append_c (str, '\n'); break;
+		case 'r':  g_string_append_c (str, '\r'); break;
+		case 't':  g_string_append_c (str, '\t'); break;
+		case 'u':
+			if (! cc_oci_json_parse_hex4 (parser, &c)) {
+				goto err;
+			}
+
+			if (c >= 0xd800 && c < 0xdc00) {
+				/* surrogate pair */
+				if (parser->end - parser->p < 2
+						|| parser->p[0] != '\\'
+						|| parser->p[1] != 'u') {
+					goto err;
 				}
-				if (value) {
-					cc_oci_json_parse_aux(value->data, node, false);
+				parser->p += 2;
+
+				if (! cc_oci_json_parse_hex4 (parser, &low)
+						|| low < 0xdc00 || low >= 0xe000) {
+					goto err;
 				}
 
-				key = g_list_next(key);
-				value = g_list_next(value);
+				c = 0x10000 + ((c - 0xd800) << 10) + (low - 0xdc00);
+			} else if (c >= 0xdc00 && c < 0xe000) {
+				goto err;
 			}
 
-			if (keys) {
-				g_list_free(keys);
-			}
-			if (values) {
-				g_list_free(values);
+			/* would truncate the string */
+			if (! c) {
+				goto err;
 			}
+
+			g_string_append_unichar (str, c);
+			break;
+		default:
+			goto err;
 		}
-	} else if (JSON_NODE_TYPE(root) == JSON_NODE_ARRAY) {
-		JsonArray* array = json_node_get_array(root);
-		guint array_size = json_array_get_length (array);
+	}
+
+	if (parser->p == parser->end) {
+		goto err;
+	}
+
+	parser->p++;
+
+	if (out) {
+		*out = g_string_free (str, false);
+	} else {
+		g_string_free (str, true);
+	}
+
+	return true;
+
+err:
+	g_string_free (str, true);
+	return cc_oci_json_error (parser, "invalid string");
+}
+
+/*!
+ * Parse a number and convert it to its string representation.
+ *
+ * Integers are represented as such, other numbers as doubles.
+ *
+ * \param parser \ref cc_oci_json_parser, positioned on the first
+ *   character of the number.
+ * \param[out] out Newly-allocated string (or \c NULL to skip the
+ *   number).
+ *
+ * \return \c true on success, else \c false.
+ */
+static gboolean
+cc_oci_json_parse_number (struct cc_oci_json_parser *parser, gchar **out)
+{
+	gchar         buffer[NODE_BUF_SIZE];
+	const gchar  *start = parser->p;
+	gboolean      is_double = false;
+	gsize         len;
 
-		for (i = 0; i < array_size; i++) {
-			JsonNode *array_element = json_array_get_element(array, i);
-			cc_oci_json_parse_aux(array_element, node, true);
+	if (parser->p < parser->end && *parser->p == '-') {
+		parser->p++;
+	}
+
+	if (parser->p == parser->end || ! g_ascii_isdigit (*parser->p)) {
+		return cc_oci_json_error (parser, "invalid number");
+	}
+
+	/* no leading zeros */
+	if (*parser->p == '0') {
+		parser->p++;
+	} else {
+		while (parser->p < parser->end && g_ascii_isdigit (*parser->p)) {
+			parser->p++;
 		}
-	} else if (JSON_NODE_TYPE(root) == JSON_NODE_VALUE) {
-		node = g_node_append(node, g_node_new(cc_oci_json_string(root)));
+	}
 
-		if (parsing_array) {
-			node = g_node_append(node, g_node_new(NULL));
+	if (parser->p < parser->end && *parser->p == '.') {
+		is_double = true;
+		parser->p++;
+
+		if (parser->p == parser->end || ! g_ascii_isdigit (*parser->p)) {
+			return cc_oci_json_error (parser, "invalid number");
+		}
+
+		while (parser->p < parser->end && g_ascii_isdigit (*parser->p)) {
+			parser->p++;
 		}
 	}
+
+	if (parser->p < parser->end
+			&& (*parser->p == 'e' || *parser->p == 'E')) {
+		is_double = true;
+		parser->p++;
+
+		if (parser->p < parser->end
+				&& (*parser->p == '+' || *parser->p == '-')) {
+			parser->p++;
+		}
+
+		if (parser->p == parser->end || ! g_ascii_isdigit (*parser->p)) {
+			return cc_oci_json_error (parser, "invalid number");
+		}
+
+		while (parser->p < parser->end && g_ascii_isdigit (*parser->p)) {
+			parser->p++;
+		}
+	}
+
+	if (! out) {
+		return true;
+	}
+
+	len = (gsize)(parser->p - start);
+	if (len >= sizeof (buffer)) {
+		return cc_oci_json_error (parser, "number too long");
+	}
+
+	memcpy (buffer, start, len);
+	buffer[len] = '\0';
+
+	if (is_double) {
+		*out = g_strdup_printf ("%f", g_ascii_strtod (buffer, NULL));
+	} else {
+		*out = g_strdup_printf ("%" G_GINT64_FORMAT,
+				g_ascii_strtoll (buffer, NULL, 10));
+	}
+
+	return true;
+}
+
+/*!
+ * Check for a literal ("true", "false" or "null").
+ *
+ * \param parser \ref cc_oci_json_parser.
+ * \param literal Literal expected.
+ *
+ * \return \c true if \p literal was consumed, else \c false.
+ */
+static gboolean
+cc_oci_json_parse_literal (struct cc_oci_json_parser *parser,
+		const char *literal)
+{
+	gsize len = strlen (literal);
+
+	if ((gsize)(parser->end - parser->p) < len
+			|| memcmp (parser->p, literal, len)) {
+		return cc_oci_json_error (parser, "invalid literal");
+	}
+
+	parser->p += len;
+
+	return true;
+}
+
+/*!
+ * Parse an object.
+ *
+ * An empty node is appended to \p node, followed by a node for each
+ * member name holding its value.
+ *
+ * \param parser \ref cc_oci_json_parser, positioned on the opening
+ *   brace.
+ * \param node \c GNode to append to (or \c NULL to skip the object).
+ *
+ * \return \c true on success, else \c false.
+ */
+static gboolean
+cc_oci_json_parse_object (struct cc_oci_json_parser *parser, GNode *node)
+{
+	GNode  *member = NULL;
+	gchar  *name;
+
+	parser->p++;
+
+	if (node) {
+		g_node_append_data (node, NULL);
+	}
+
+	if (! cc_oci_json_skip_space (parser)) {
+		return cc_oci_json_error (parser, "unterminated object");
+	}
+
+	if (*parser->p == '}') {
+		parser->p++;
+		return true;
+	}
+
+	while (true) {
+		if (! cc_oci_json_skip_space (parser) || *parser->p != '"') {
+			return cc_oci_json_error (parser, "expected member name");
+		}
+
+		if (! cc_oci_json_parse_string (parser, node ? &name : NULL)) {
+			return false;
+		}
+
+		if (node) {
+			member = g_node_append_data (node, name);
+		}
+
+		if (! cc_oci_json_skip_space (parser) || *parser->p != ':') {
+			return cc_oci_json_error (parser, "expected ':'");
+		}
+		parser->p++;
+
+		if (! cc_oci_json_parse_value (parser, member, false)) {
+			return false;
+		}
+
+		if (! cc_oci_json_skip_space (parser)) {
+			return cc_oci_json_error (parser, "unterminated object");
+		}
+
+		if (*parser->p == '}') {
+			parser->p++;
+			return true;
+		}
+
+		if (*parser->p != ',') {
+			return cc_oci_json_error (parser, "expected ',' or '}'");
+		}
+		parser->p++;
+	}
+}
+
+/*!
+ * Parse an array.
+ *
+ * The elements are appended to \p node.
+ *
+ * \param parser \ref cc_oci_json_parser, positioned on the opening
+ *   bracket.
+ * \param node \c GNode to append to (or \c NULL to skip the array).
+ *
+ * \return \c true on success, else \c false.
+ */
+static gboolean
+cc_oci_json_parse_array (struct cc_oci_json_parser *parser, GNode *node)
+{
+	parser->p++;
+
+	if (! cc_oci_json_skip_space (parser)) {
+		return cc_oci_json_error (parser, "unterminated array");
+	}
+
+	if (*parser->p == ']') {
+		parser->p++;
+		return true;
+	}
+
+	while (true) {
+		if (! cc_oci_json_parse_value (parser, node, true)) {
+			return false;
+		}
+
+		if (! cc_oci_json_skip_space (parser)) {
+			return cc_oci_json_error (parser, "unterminated array");
+		}
+
+		if (*parser->p == ']') {
+			parser->p++;
+			return true;
+		}
+
+		if (*parser->p != ',') {
+			return cc_oci_json_error (parser, "expected ',' or ']'");
+		}
+		parser->p++;
+	}
+}
+
+/*!
+ * Parse a JSON value, appending it to the tree.
+ *
+ * Scalars are converted to strings and appended to \p node (followed
+ * by an empty node if \p parsing_array is \c true); objects and
+ * arrays are handled by \ref cc_oci_json_parse_object() and
+ * \ref cc_oci_json_parse_array(); nulls are ignored.
+ *
+ * \param parser \ref cc_oci_json_parser.
+ * \param node \c GNode (or \c NULL to skip the value).
+ * \param parsing_array \c true if handling an array, else \c false.
+ *
+ * \return \c true on success, else \c false.
+ */
+static gboolean
+cc_oci_json_parse_value (struct cc_oci_json_parser *parser,
+		GNode *node, bool parsing_array)
+{
+	gboolean   ret;
+	gchar     *value = NULL;
+	gchar    **out = node ? &value : NULL;
+
+	if (! cc_oci_json_skip_space (parser)) {
+		return cc_oci_json_error (parser, "expected value");
+	}
+
+	switch (*parser->p) {
+	case '{':
+	case '[':
+		if (++parser->depth > CC_OCI_JSON_MAX_DEPTH) {
+			return cc_oci_json_error (parser, "too deeply nested");
+		}
+
+		ret = *parser->p == '{'
+			? cc_oci_json_parse_object (parser, node)
+			: cc_oci_json_parse_array (parser, node);
+
+		parser->depth--;
+		return ret;
+
+	case '"':
+		if (! cc_oci_json_parse_string (parser, out)) {
+			return false;
+		}
+		break;
+
+	case 't':
+		if (! cc_oci_json_parse_literal (parser, "true")) {
+			return false;
+		}
+		value = out ? g_strdup ("true") : NULL;
+		break;
+
+	case 'f':
+		if (! cc_oci_json_parse_literal (parser, "false")) {
+			return false;
+		}
+		value = out ? g_strdup ("false") : NULL;
+		break;
+
+	case 'n':
+		return cc_oci_json_parse_literal (parser, "null");
+
+	default:
+		if (! cc_oci_json_parse_number (parser, out)) {
+			return false;
+		}
+		break;
+	}
+
+	if (! node) {
+		return true;
+	}
+
+	node = g_node_append_data (node, value);
+
+	if (parsing_array) {
+		g_node_append_data (node, NULL);
+	}
+
+	return true;
 }
 
 /*!
  * Convert a JSON file into a tree of nodes.
  *
+ * The file is parsed in a single pass, without building an
+ * intermediate representation.
+ *
  * \param[out] node Tree representation of \p filename.
  * \param filename Absolute path to JSON file to parse.
  *
@@ -145,17 +581,18 @@ cc_oci_json_parse_aux(JsonNode* root, GNode* node, bool parsing_array) {
  */
 bool
 cc_oci_json_parse (GNode** node, const gchar* filename) {
-	bool result = false;
-	GError* error = NULL;
-	JsonParser* parser = NULL;
-	JsonNode *root = NULL;
+	struct cc_oci_json_parser   parser = { 0 };
+	GError                     *error = NULL;
+	gchar                      *contents = NULL;
+	gsize                       len;
+	GNode                      *root = NULL;
+	bool                        result = false;
 
 	if ((!node) || (!filename) || (!(*filename))) {
 		return false;
 	}
 
-	parser = json_parser_new();
-	if (! json_parser_load_from_file(parser, filename, &error)) {
+	if (! g_file_get_contents (filename, &contents, &len, &error)) {
 		g_debug("unable to parse '%s'", filename);
 		if (error) {
 			g_debug("Error parsing '%s': %s", filename, error->message);
@@ -164,17 +601,193 @@ cc_oci_json_parse (GNode** node, const gchar* filename) {
 		goto exit;
 	}
 
-	root = json_parser_get_root (parser);
-	if (! root) {
+	/* also rejects embedded nulls */
+	if (! g_utf8_validate (contents, (gssize)len, NULL)) {
+		g_debug("Error parsing '%s': invalid UTF-8", filename);
+		goto exit;
+	}
+
+	parser.start = contents;
+	parser.p = contents;
+	parser.end = contents + len;
+	parser.filename = filename;
+
+	if (! cc_oci_json_skip_space (&parser)) {
+		g_debug("Error parsing '%s': empty file", filename);
+		goto exit;
+	}
+
+	root = g_node_new(g_strdup(filename));
+
+	if (! cc_oci_json_parse_value (&parser, root, false)) {
+		goto exit;
+	}
+
+	if (cc_oci_json_skip_space (&parser)) {
+		(void)cc_oci_json_error (&parser, "trailing data");
 		goto exit;
 	}
 
-	*node = g_node_new(g_strdup(filename));
-	cc_oci_json_parse_aux(root, *node, false);
+	*node = root;
+	root = NULL;
 
 	result = true;
 
 exit:
-	g_object_unref(parser);
+	g_free_node (root);
+	g_free (contents);
 	return result;
 }
+
+/*!
+ * Find a member of an object.
+ *
+ * \param parser \ref cc_oci_json_parser, positioned before the
+ *   object.
+ * \param path \c NULL-terminated names of the member and the objects
+ *   containing it.
+ * \param[out] start Start of the value of the member.
+ *
+ * \return \c true if the member was found (in which case \p parser is
+ * positioned after its value), else \c false.
+ */
+static gboolean
+cc_oci_json_find_member (struct cc_oci_json_parser *parser,
+		const gchar * const *path, const gchar **start)
+{
+	gchar     *name = NULL;
+	gboolean   found;
+
+	if (! cc_oci_json_skip_space (parser) || *parser->p != '{') {
+		return false;
+	}
+	parser->p++;
+
+	if (! cc_oci_json_skip_space (parser) || *parser->p == '}') {
+		return false;
+	}
+
+	while (true) {
+		if (! cc_oci_json_skip_space (parser) || *parser->p != '"') {
+			return cc_oci_json_error (parser, "expected member name");
+		}
+
+		if (! cc_oci_json_parse_string (parser, &name)) {
+			return false;
+		}
+
+		found = ! g_strcmp0 (name, *path);
+		g_free (name);
+
+		if (! cc_oci_json_skip_space (parser) || *parser->p != ':') {
+			return cc_oci_json_error (parser, "expected ':'");
+		}
+		parser->p++;
+
+		if (found && path[1]) {
+			return cc_oci_json_find_member (parser, path + 1, start);
+		}
+
+		if (! cc_oci_json_skip_space (parser)) {
+			return cc_oci_json_error (parser, "expected value");
+		}
+
+		*start = parser->p;
+
+		if (! cc_oci_json_parse_value (parser, NULL, false)) {
+			return false;
+		}
+
+		if (found) {
+			return true;
+		}
+
+		if (! cc_oci_json_skip_space (parser) || *parser->p != ',') {
+			/* end of the object (or invalid) */
+			return false;
+		}
+		parser->p++;
+	}
+}
+
+/*!
+ * Find the value of a member in a JSON document, without parsing the
+ * rest of the document.
+ *
+ * \param json JSON text.
+ * \param len Length of \p json.
+ * \param path \c NULL-terminated names of the member and the objects
+ *   containing it, starting from the top-level object (for example
+ *   { "vm", "pid", NULL }).
+ * \param[out] offset Offset of the value in \p json.
+ * \param[out] length Length of the value in \p json.
+ *
+ * \return \c true if the member was found, else \c false.
+ */
+gboolean
+cc_oci_json_member_find (const gchar *json, gsize len,
+		const gchar * const *path, gsize *offset, gsize *length)
+{
+	struct cc_oci_json_parser  parser = { 0 };
+	const gchar               *start = NULL;
+
+	if (! (json && path && *path && offset && length)) {
+		return false;
+	}
+
+	parser.start = json;
+	parser.p = json;
+	parser.end = json + len;
+	parser.filename = "JSON document";
+
+	if (! cc_oci_json_find_member (&parser, path, &start)) {
+		return false;
+	}
+
+	*offset = (gsize)(start - json);
+	*length = (gsize)(parser.p - start);
+
+	return true;
+}
+
+/*!
+ * Convert a string to a JSON string value.
+ *
+ * \param str String to convert.
+ *
+ * \return Newly-allocated quoted and escaped string.
+ */
+gchar *
+cc_oci_json_quote (const gchar *str)
+{
+	GString      *quoted;
+	const gchar  *p;
+
+	quoted = g_string_sized_new (str ? strlen (str) + 2 : 2);
+
+	g_string_append_c (quoted, '"');
+
+	for (p = str; p && *p; p++) {
+		switch (*p) {
+		case '"':  g_string_append (quoted, "\\\""); break;
+		case '\\': g_string_append (quoted, "\\\\"); break;
+		case '\b': g_string_append (quoted, "\\b");  break;
+		case '\f': g_string_append (quoted, "\\f");  break;
+		case '\n': g_string_append (quoted, "\\n");  break;
+		case '\r': g_string_append (quoted, "\\r");  break;
+		case '\t': g_string_append (quoted, "\\t");  break;
+		default:
+			if ((guchar)*p < 0x20) {
+				g_string_append_printf (quoted, "\\u%04x",
+						(guint)*p);
+			} else {
+				g_string_append_c (quoted, *p);
+			}
+			break;
+		}
+	}
+
+	g_string_append_c (quoted, '"');
+
+	return g_string_free (quoted, false);
+}
@@ -26,5 +26,8 @@
 #include <json-glib/json-glib.h>
 
 bool cc_oci_json_parse (GNode** node, const gchar* filename);
+gboolean cc_oci_json_member_find (const gchar *json, gsize len,
+		const gchar * const *path, gsize *offset, gsize *length);
+gchar *cc_oci_json_quote (const gchar *str);
 
 #endif /* _CC_OCI_JSON_H */
@@ -26,6 +26,7 @@
 #include <sys/stat.h>
 #include <fcntl.h>
 #include <syslog.h>
+#include <unistd.h>
 
 #include <glib.h>
 #include <glib/gprintf.h>
@@ -60,6 +61,46 @@
 #define HYPERVISOR_STDOUT_FILE "hypervisor.stdout"
 #define HYPERVISOR_STDERR_FILE "hypervisor.stderr"
 
+/** Amount of buffered log data above which it is written out. */
+#define CC_OCI_LOG_FLUSH_SIZE (16 * 1024)
+
+/** Age (in microseconds) of buffered log data above which it is
+ * written out (checked when a message is logged).
+ */
+#define CC_OCI_LOG_FLUSH_USEC (G_USEC_PER_SEC / 10)
+
+/** A log file written by \ref cc_oci_log_handler(). */
+struct cc_oci_log_file
+{
+	/** Full path to the file (\c NULL if unused). */
+	gchar    *filename;
+
+	/** File descriptor open on \c filename, or -1. */
+	int       fd;
+
+	/** Messages not yet written. */
+	GString  *buffer;
+
+	/** Monotonic time at which the oldest buffered message was
+	 * logged.
+	 */
+	gint64    since;
+};
+
+/** Main log file (\ref cc_log_options.filename). */
+static struct cc_oci_log_file cc_oci_log_main = { NULL, -1, NULL, 0 };
+
+/** Global log file (\ref cc_log_options.global_logfile). */
+static struct cc_oci_log_file cc_oci_log_global = { NULL, -1, NULL, 0 };
+
+/** Process which buffered messages belong to. */
+static pid_t cc_oci_log_pid;
+
+/** Protects the log files, which may be written by several threads
+ * (see cc_oci_state_files_read()).
+ */
+G_LOCK_DEFINE_STATIC (cc_oci_log_files);
+
 static gchar* hypervisor_log_dir;
 
 /*!
@@ -221,81 +262,257 @@ cc_oci_msg_fmt (const gchar *log_domain,
 }
 
 /*!
- * Write a log message.
+ * Write a buffer to a file descriptor.
  *
  * \warning Note that this function should not call any glib log
  * handling functions (g_debug(), etc) to avoid going recursive.
  *
- * \param filename Full path of file to write message to.
- * \param message Text to write to \p filename.
+ * \param fd File descriptor.
+ * \param data Data to write.
+ * \param len Length of \p data.
  *
  * \return \c true on success, else \c false.
  */
 static gboolean
-cc_oci_log_msg_write (const char *filename, const char *message)
+cc_oci_log_write_all (int fd, const char *data, gsize len)
 {
-	GIOChannel  *channel = NULL;
-	GError      *err = NULL;
-	GIOStatus    status;
-	gboolean     ret = false;
-	int          fd;
-	int          flags = (O_CREAT | O_APPEND | O_WRONLY | O_CLOEXEC);
+	ssize_t  ret;
+
+	while (len) {
+		ret = write (fd, data, len);
+		if (ret < 0 && errno == EINTR) {
+			continue;
+		} else if (ret < 0) {
+			CC_OCI_ERROR ("failed to write to logfile: %s",
+					strerror (errno));
+			return false;
+		}
 
-	g_assert (filename);
-	g_assert (message);
+		data += ret;
+		len -= (gsize)ret;
+	}
+
+	return true;
+}
+
+/*!
+ * Open a log file for appending.
+ *
+ * \param filename Full path of file to open.
+ *
+ * \return File descriptor on success, else -1.
+ */
+static int
+cc_oci_log_open (const char *filename)
+{
+	int fd;
+	int flags = (O_CREAT | O_APPEND | O_WRONLY | O_CLOEXEC);
 
 	fd = open (filename, flags, CC_OCI_LOGFILE_MODE);
 	if (fd < 0) {
 		CC_OCI_ERROR ("failed to open logfile %s for writing: %s",
 				filename, strerror (errno));
-		goto out;
 	}
 
-	/* append to file if it already exists */
-	channel = g_io_channel_unix_new (fd);
-	if (! channel) {
-		CC_OCI_ERROR ("failed to create I/O channel");
-		goto out;
+	return fd;
+}
+
+/*!
+ * Write out the messages buffered for a log file.
+ *
+ * All buffered messages are written with a single \c write(2) to
+ * the file, opened in append mode, so that messages from concurrent
+ * runtime processes are never interleaved. The file is reopened if
+ * it has been removed or replaced (for example by log rotation) since
+ * it was opened.
+ *
+ * \warning Note that this function should not call any glib log
+ * handling functions (g_debug(), etc) to avoid going recursive.
+ *
+ * \param file \ref cc_oci_log_file.
+ *
+ * \return \c true on success, else \c false.
+ */
+static gboolean
+cc_oci_log_file_flush (struct cc_oci_log_file *file)
+{
+	struct stat  path_st;
+	struct stat  fd_st;
+	gboolean     ret;
+
+	if (! (file->buffer && file->buffer->len)) {
+		return true;
 	}
 
-	status = g_io_channel_write_chars (
-			channel,
-			message,
-			-1, /* signify it's a string */
-			NULL, /* bytes written */
-			&err);
+	if (file->fd != -1) {
+		if (stat (file->filename, &path_st) < 0
+				|| fstat (file->fd, &fd_st) < 0
+				|| path_st.st_dev != fd_st.st_dev
+				|| path_st.st_ino != fd_st.st_ino) {
+			close (file->fd);
+			file->fd = -1;
+		}
+	}
 
-	if (status != G_IO_STATUS_NORMAL) {
-		CC_OCI_ERROR ("failed to write to I/O channel: %s",
-				err->message);
-		g_error_free (err);
-		goto out;
+	if (file->fd == -1) {
+		file->fd = cc_oci_log_open (file->filename);
 	}
 
-	status = g_io_channel_shutdown (channel,
-			TRUE, /* flush */
-			&err);
-	if (status != G_IO_STATUS_NORMAL) {
-		CC_OCI_ERROR ("failed to close I/O channel: %s",
-				err->message);
-		g_error_free (err);
-		goto out;
+	if (file->fd == -1) {
+		ret = false;
+	} else {
+		ret = cc_oci_log_write_all (file->fd, file->buffer->str,
+				file->buffer->len);
 	}
 
-	ret = true;
+	g_string_truncate (file->buffer, 0);
 
-out:
-	if (channel) {
-		g_io_channel_unref (channel);
+	return ret;
+}
+
+/*!
+ * Forget a log file without writing out its buffered messages.
+ *
+ * \param file \ref cc_oci_log_file.
+ */
+static void
+cc_oci_log_file_discard (struct cc_oci_log_file *file)
+{
+	if (file->buffer) {
+		g_string_truncate (file->buffer, 0);
+	}
+
+	if (file->fd != -1) {
+		close (file->fd);
+		file->fd = -1;
 	}
+}
 
-	if (fd != -1) {
+/*!
+ * Flush and close a log file.
+ *
+ * \param file \ref cc_oci_log_file.
+ */
+static void
+cc_oci_log_file_close (struct cc_oci_log_file *file)
+{
+	(void)cc_oci_log_file_flush (file);
+
+	if (file->fd != -1) {
+		close (file->fd);
+		file->fd = -1;
+	}
+
+	g_free_if_set (file->filename);
+
+	if (file->buffer) {
+		g_string_free (file->buffer, true);
+		file->buffer = NULL;
+	}
+}
+
+/*!
+ * Write a log message.
+ *
+ * Messages are buffered and written out in batches, when more than
+ * \ref CC_OCI_LOG_FLUSH_SIZE bytes are buffered, when the oldest
+ * buffered message is older than \ref CC_OCI_LOG_FLUSH_USEC, when
+ * \p flush is set or when \ref cc_oci_log_flush() is called (which
+ * happens on exit).
+ *
+ * Forked children of the process which set up logging write their
+ * messages immediately since they may exec or \c _exit() at any time
+ * and must not write the messages they inherited.
+ *
+ * \warning Note that this function should not call any glib log
+ * handling functions (g_debug(), etc) to avoid going recursive.
+ *
+ * \param file \ref cc_oci_log_file.
+ * \param filename Full path of file to write message to.
+ * \param message Text to write to \p filename.
+ * \param flush If \c true, write \p message (and any buffered
+ *   message) immediately.
+ *
+ * \return \c true on success, else \c false.
+ */
+static gboolean
+cc_oci_log_msg_write (struct cc_oci_log_file *file,
+		const char *filename,
+		const char *message,
+		gboolean flush)
+{
+	gboolean  ret;
+	gint64    now;
+	int       fd;
+
+	g_assert (file);
+	g_assert (filename);
+	g_assert (message);
+
+	if (getpid () != cc_oci_log_pid) {
+		fd = cc_oci_log_open (filename);
+		if (fd < 0) {
+			return false;
+		}
+
+		ret = cc_oci_log_write_all (fd, message, strlen (message));
 		close (fd);
+
+		return ret;
 	}
 
+	G_LOCK (cc_oci_log_files);
+
+	if (g_strcmp0 (file->filename, filename)) {
+		cc_oci_log_file_close (file);
+		file->filename = g_strdup (filename);
+	}
+
+	if (! file->buffer) {
+		file->buffer = g_string_sized_new (CC_OCI_LOG_FLUSH_SIZE);
+	}
+
+	now = g_get_monotonic_time ();
+
+	if (! file->buffer->len) {
+		file->since = now;
+	}
+
+	g_string_append (file->buffer, message);
+
+	ret = true;
+
+	if (flush
+			|| file->buffer->len >= CC_OCI_LOG_FLUSH_SIZE
+			|| now - file->since >= CC_OCI_LOG_FLUSH_USEC) {
+		ret = cc_oci_log_file_flush (file);
+	}
+
+	G_UNLOCK (cc_oci_log_files);
+
 	return ret;
 }
 
+/*!
+ * Write out all buffered log messages.
+ *
+ * This must be called before forking so that messages are not
+ * reordered (or lost if the parent exits abnormally).
+ */
+void
+cc_oci_log_flush (void)
+{
+	if (getpid () != cc_oci_log_pid) {
+		/* the buffers belong to the parent */
+		return;
+	}
+
+	G_LOCK (cc_oci_log_files);
+	(void)cc_oci_log_file_flush (&cc_oci_log_global);
+	(void)cc_oci_log_file_flush (&cc_oci_log_main);
+	G_UNLOCK (cc_oci_log_files);
+}
+
 /*!
  * glib log handler (for \c g_debug(), \c g_message(), \c g_warning(),
  * \c g_critical(), etc).
@@ -332,6 +549,7 @@ cc_oci_log_handler (const gchar *log_domain,
 	gchar                        *timestamp = NULL;
 	const struct cc_log_options  *options;
 	gboolean                      ret;
+	gboolean                      flush;
 
 	g_assert (message);
 
@@ -384,6 +602,14 @@ cc_oci_log_handler (const gchar *log_domain,
 		break;
 	}
 
+	/* Warnings and errors are written immediately so that they are
+	 * not lost should the runtime crash or abort.
+	 */
+	flush = log_level & (G_LOG_LEVEL_ERROR |
+			G_LOG_LEVEL_CRITICAL |
+			G_LOG_LEVEL_WARNING |
+			G_LOG_FLAG_FATAL);
+
 	timestamp = cc_oci_get_iso8601_timestamp ();
 	if (! timestamp) {
 		goto out;
@@ -410,8 +636,8 @@ cc_oci_log_handler (const gchar *log_domain,
 				goto out;
 			}
 		}
-		ret = cc_oci_log_msg_write (options->global_logfile,
-				final);
+		ret = cc_oci_log_msg_write (&cc_oci_log_global,
+				options->global_logfile, final, flush);
 		if (! ret) {
 			goto out;
 		}
@@ -436,7 +662,8 @@ cc_oci_log_handler (const gchar *log_domain,
 	}
 
 	if (options->filename) {
-		ret = cc_oci_log_msg_write (options->filename, final);
+		ret = cc_oci_log_msg_write (&cc_oci_log_main,
+				options->filename, final, flush);
 		if (! ret) {
 			goto out;
 		}
@@ -480,6 +707,19 @@ cc_oci_log_init (const struct cc_log_options *options)
 
 	hypervisor_log_dir = options->hypervisor_log_dir;
 
+	if (! cc_oci_log_pid && atexit (cc_oci_log_flush)) {
+		return false;
+	}
+
+	if (cc_oci_log_pid && getpid () != cc_oci_log_pid) {
+		/* forked child: the buffers belong to the parent */
+		cc_oci_log_file_discard (&cc_oci_log_global);
+		cc_oci_log_file_discard (&cc_oci_log_main);
+	}
+
+	cc_oci_log_flush ();
+	cc_oci_log_pid = getpid ();
+
 	(void)g_log_set_handler (G_LOG_DOMAIN,
 			(GLogLevelFlags)CC_OCI_LOG_FLAGS,
 			cc_oci_log_handler,
@@ -581,6 +821,13 @@ cc_oci_log_free (struct cc_log_options *options)
 		return;
 	}
 
+	if (getpid () == cc_oci_log_pid) {
+		G_LOCK (cc_oci_log_files);
+		cc_oci_log_file_close (&cc_oci_log_global);
+		cc_oci_log_file_close (&cc_oci_log_main);
+		G_UNLOCK (cc_oci_log_files);
+	}
+
 	g_free_if_set (options->filename);
 	g_free_if_set (options->global_logfile);
 	g_free_if_set (options->hypervisor_log_dir);
@@ -30,6 +30,7 @@
 #include "command.h"
 #include "oci-config.h"
 #include "priv.h"
+#include "timing.h"
 
 #define KVM_PATH "/dev/kvm"
 
@@ -48,11 +49,23 @@ static gboolean systemd_cgroup;
 /** Path to create state under */
 static gchar *root_dir;
 
+/** Path to append per-command phase timings to */
+static gchar *timing_log;
+
+/** Remove container runtime directories in the background */
+static gboolean async_delete;
+
 struct start_data start_data;
 
 /** Global options (available to all sub-commands) */
 static GOptionEntry options_global[] =
 {
+	{
+		"async-delete", 0, G_OPTION_FLAG_NONE,
+		G_OPTION_ARG_NONE, &async_delete,
+		"remove container state in the background on delete",
+		NULL
+	},
 	{
 		"criu", 0, G_OPTION_FLAG_NONE,
 		G_OPTION_ARG_STRING, &criu,
@@ -104,6 +117,12 @@ static GOptionEntry options_global[] =
 		"not implemented",
 		NULL
 	},
+	{
+		"timing-log", 0, G_OPTION_FLAG_NONE,
+		G_OPTION_ARG_STRING, &timing_log,
+		"append per-phase command timings (JSON lines) to file",
+		NULL
+	},
 	{
 		"version", 'v', G_OPTION_FLAG_NONE,
 		G_OPTION_ARG_NONE, &show_version,
@@ -356,6 +375,8 @@ handle_arguments (int argc, char **argv)
 		config->root_dir = g_strdup (root_dir);
 	}
 
+	config->async_delete = async_delete;
+
 	cmd = argv[0];
 
 	/* Find the options for the specific sub-command */
@@ -400,11 +421,18 @@ handle_arguments (int argc, char **argv)
 		g_free (str);
 	}
 
+	/* Time all phases of the sub-command */
+	config->timings = cc_oci_timings_new (sub->name);
+
 	/* Now, deal with the sub-commands
 	 * (and their corresponding options)
 	 */
 	ret = handle_sub_commands (argc, argv, sub, config);
 
+	if (timing_log) {
+		(void)cc_oci_timings_trace (config, timing_log, ret);
+	}
+
 	if (! ret) {
 		goto out;
 	}
@@ -443,6 +471,7 @@ cleanup (struct cc_log_options *options)
 	cc_oci_log_free (options);
 	g_free_if_set (criu);
 	g_free_if_set (root_dir);
+	g_free_if_set (timing_log);
 	g_free_if_set (start_data.shim_path);
 	g_free_if_set (start_data.proxy_socket_path);
 }
@@ -32,6 +32,8 @@
 
 #include <libmnl/libmnl.h>
 #include <net/if.h>
+#include <net/if_arp.h>
+#include <netinet/in.h>
 #include <linux/if_link.h>
 #include <linux/rtnetlink.h>
 
@@ -89,87 +91,288 @@ netlink_close(struct netlink_handle *const hndl) {
 	}
 }
 
+/** Size of the buffer netlink dumps are received in. */
+#define NETLINK_DUMP_BUFFER_SIZE 32768
+
+/** Data passed to the route dump callback handler. */
+struct netlink_routes_data {
+	/** Configuration routes are added to. */
+	struct cc_oci_config *config;
+
+	/** Table of \ref netlink_link by index (or \c NULL). */
+	GHashTable *links;
+};
+
+/** Maximum size of the messages sent at once by a \ref netlink_batch. */
+#define NETLINK_BATCH_LIMIT MNL_SOCKET_BUFFER_SIZE
+
+/**
+ * Netlink requests which are sent together, with a single
+ * round trip to the kernel.
+ */
+struct netlink_batch {
+	/** Handle the requests are sent with. */
+	struct netlink_handle *hndl;
+
+	/** Messages not yet sent. */
+	struct mnl_nlmsg_batch *batch;
+
+	/** Sequence number of the first message not yet sent. */
+	guint seq;
+
+	/** Number of messages not yet sent (including any which
+	 * did not fit in \ref batch).
+	 */
+	guint count;
+
+	/** Set if sending messages when the batch became full failed. */
+	gboolean failed;
+
+	/** Buffer used by \ref batch (the last message may overflow
+	 * \ref NETLINK_BATCH_LIMIT).
+	 */
+	guint8 buf[NETLINK_BATCH_LIMIT * 2];
+};
+
+/*!
+ * Create a netlink batch.
+ *
+ * \param hndl handle returned from a call to \ref netlink_init().
+ *
+ * \return Newly-allocated \ref netlink_batch on success,
+ * else \c NULL.
+ */
+struct netlink_batch *
+netlink_batch_new(struct netlink_handle *const hndl) {
+	struct netlink_batch *batch = NULL;
+
+	if ((hndl == NULL) || (hndl->nl == NULL)) {
+		g_critical("%s NULL parameter", __func__);
+		return NULL;
+	}
+
+	batch = g_malloc0(sizeof(*batch));
+	batch->hndl = hndl;
+	batch->batch = mnl_nlmsg_batch_start(batch->buf,
+			NETLINK_BATCH_LIMIT);
+
+	return batch;
+}
+
 /*!
- * Execute a netlink transaction and check the result.
+ * Free a netlink batch, discarding any messages not yet sent.
  *
- * This method can be used for any transaction where
- * only the success or failure of the transaction needs
- * to be known (i.e. no data is send back).
+ * \param batch \ref netlink_batch.
+ */
+void
+netlink_batch_free(struct netlink_batch *batch) {
+	if (batch == NULL) {
+		return;
+	}
+
+	mnl_nlmsg_batch_stop(batch->batch);
+	g_free(batch);
+}
+
+/*!
+ * Wait for the kernel to acknowledge a range of requests.
+ *
+ * The kernel processes every request sent, so all the
+ * acknowledgements are read even if a request failed.
  *
  * \param hndl handle returned from a call to \ref netlink_init().
- * \param nlh pre created netlink message.
+ * \param seq sequence number of the first request.
+ * \param count number of requests.
  *
- * \return \c true on success, else \c false.
+ * \return \c true if all requests succeeded, else \c false.
  */
 static gboolean
-netlink_execute(struct netlink_handle *const hndl,
-		struct nlmsghdr *const nlh) {
+netlink_batch_ack(struct netlink_handle *const hndl,
+		guint seq, guint count) {
 	guint8 buf[MNL_SOCKET_BUFFER_SIZE];
-	ssize_t ret = -1;
-	gboolean status = false;
-	guint  portid, seq;
+	const struct nlmsghdr *nlh = NULL;
+	const struct nlmsgerr *err = NULL;
+	gboolean status = true;
+	guint portid, acked = 0;
+	int len;
 
-	if ((hndl == NULL) || (nlh == NULL)) {
-		g_critical("%s NULL parameter", __func__);
-		return false;
+	portid = mnl_socket_get_portid(hndl->nl);
+
+	while (acked < count) {
+		len = (int)mnl_socket_recvfrom(hndl->nl, buf, sizeof(buf));
+		if (len == -1) {
+			g_critical("mnl_socket_recvfrom failed %s",
+					strerror(errno));
+			return false;
+		}
+
+		for (nlh = (const struct nlmsghdr *)buf;
+				mnl_nlmsg_ok(nlh, len);
+				nlh = mnl_nlmsg_next(nlh, &len)) {
+			if (! mnl_nlmsg_portid_ok(nlh, portid)) {
+				continue;
+			}
+
+			/* not one of ours */
+			if (nlh->nlmsg_seq - seq >= count) {
+				continue;
+			}
+
+			if (nlh->nlmsg_type != NLMSG_ERROR) {
+				continue;
+			}
+
+			if (nlh->nlmsg_len < mnl_nlmsg_size(sizeof(*err))) {
+				g_critical("netlink error message truncated");
+				return false;
+			}
+
+			acked++;
+
+			err = mnl_nlmsg_get_payload(nlh);
+			if (err->error) {
+				g_critical("netlink request %u failed: %s",
+						nlh->nlmsg_seq - seq,
+						strerror(-err->error));
+				status = false;
+			}
+		}
 	}
 
-	if (hndl->nl == NULL) {
-		g_critical("%s NULL parameter", __func__);
-		return false;
+	return status;
+}
+
+/*!
+ * Send the first \p count messages of a batch and wait for them
+ * to be acknowledged.
+ *
+ * \param batch \ref netlink_batch.
+ * \param count number of messages to send.
+ *
+ * \return \c true on success, else \c false.
+ */
+static gboolean
+netlink_batch_send(struct netlink_batch *const batch, guint count) {
+	if (! count) {
+		return true;
 	}
 
-	nlh->nlmsg_seq = seq = hndl->seq++;
-	portid = mnl_socket_get_portid(hndl->nl);
+	g_debug("netlink_batch_send %u requests", count);
 
-	if (mnl_socket_sendto(hndl->nl, nlh, nlh->nlmsg_len) < 0) {
+	if (mnl_socket_sendto(batch->hndl->nl,
+				mnl_nlmsg_batch_head(batch->batch),
+				mnl_nlmsg_batch_size(batch->batch)) < 0) {
 		g_critical("mnl_socket_sendto %s", strerror(errno));
-		goto out;
+		return false;
 	}
 
-	ret = mnl_socket_recvfrom(hndl->nl, buf, sizeof(buf));
-	if (ret == -1) {
-		g_critical("mnl_socket_recvfrom failed %s", strerror(errno));
-		goto out;
+	return netlink_batch_ack(batch->hndl, batch->seq, count);
+}
+
+/*!
+ * Start a new request in a batch.
+ *
+ * \param batch \ref netlink_batch.
+ * \param type netlink message type.
+ * \param flags netlink message flags (in addition to
+ *   \c NLM_F_REQUEST and \c NLM_F_ACK).
+ *
+ * \return netlink message, to be completed then added with
+ * \ref netlink_batch_add().
+ */
+static struct nlmsghdr *
+netlink_batch_put_header(struct netlink_batch *const batch,
+		guint16 type, guint16 flags) {
+	struct nlmsghdr *nlh = NULL;
+
+	nlh = mnl_nlmsg_put_header(mnl_nlmsg_batch_current(batch->batch));
+	nlh->nlmsg_type = type;
+	nlh->nlmsg_flags = (guint16)(NLM_F_REQUEST | NLM_F_ACK | flags);
+	nlh->nlmsg_seq = batch->hndl->seq++;
+
+	if (! batch->count) {
+		batch->seq = nlh->nlmsg_seq;
 	}
 
-	while (ret > 0) {
-		ret = mnl_cb_run(buf, (size_t)ret, seq, portid, NULL, NULL);
-		if (ret <= 0) {
-			break;
-		}
-		ret = mnl_socket_recvfrom(hndl->nl, buf, sizeof(buf));
+	return nlh;
+}
+
+/*!
+ * Add the request started by \ref netlink_batch_put_header()
+ * to a batch, sending the previous requests if the batch is full.
+ *
+ * \param batch \ref netlink_batch.
+ *
+ * \return \c true on success, else \c false.
+ */
+static gboolean
+netlink_batch_add(struct netlink_batch *const batch) {
+	batch->count++;
+
+	if (mnl_nlmsg_batch_next(batch->batch)) {
+		return true;
 	}
 
-	if (ret == -1) {
-		g_critical("netlink error");
-		goto out;
+	/* The request did not fit: send the others, then
+	 * start again with it.
+	 */
+	if (! netlink_batch_send(batch, batch->count - 1)) {
+		batch->failed = true;
 	}
 
-	status = true;
-out:
+	mnl_nlmsg_batch_reset(batch->batch);
+	batch->seq += batch->count - 1;
+	batch->count = 1;
+
+	return ! batch->failed;
+}
+
+/*!
+ * Send all the requests in a batch and check the results.
+ *
+ * The batch is empty afterwards and can be reused.
+ *
+ * \param batch \ref netlink_batch.
+ *
+ * \return \c true if all requests added since the batch was
+ * created (or last executed) succeeded, else \c false.
+ */
+gboolean
+netlink_batch_execute(struct netlink_batch *const batch) {
+	gboolean status;
+
+	if (batch == NULL) {
+		g_critical("%s NULL parameter", __func__);
+		return false;
+	}
+
+	status = netlink_batch_send(batch, batch->count) && ! batch->failed;
+
+	mnl_nlmsg_batch_reset(batch->batch);
+	batch->count = 0;
+	batch->failed = false;
+
 	return status;
 }
 
 /*!
- * Netlink command equivalent to
- * "ip link set dev \<interface\> \<up|down\>".
+ * Add a netlink request equivalent to
+ * "ip link set dev \<interface\> \<up|down\>" to a batch.
  *
- * \param hndl handle returned from a call to \ref netlink_init().
+ * \param batch \ref netlink_batch.
  * \param interface device name to enable/disable.
  * \param enable if \c true device will enabled, else disabled.
  *
  * \return \c true on success, else \c false.
  */
 gboolean
-netlink_link_enable(struct netlink_handle *const hndl,
-		    const gchar *const interface, gboolean enable)  {
-	guint8 buf[MNL_SOCKET_BUFFER_SIZE];
+netlink_batch_link_enable(struct netlink_batch *const batch,
+			  const gchar *const interface, gboolean enable)  {
 	struct nlmsghdr *nlh = NULL;
 	struct ifinfomsg *ifm = NULL;
 	guint change = 0, flags = 0;
 
-	if ((hndl == NULL) || (interface == NULL)) {
+	if ((batch == NULL) || (interface == NULL)) {
 		g_critical("%s NULL parameter", __func__);
 		return false;
 	}
@@ -184,9 +387,7 @@ netlink_link_enable(struct netlink_handle *const hndl,
 		flags &= (guint)~IFF_UP;
 	}
 
-	nlh = mnl_nlmsg_put_header(buf);
-	nlh->nlmsg_type = RTM_NEWLINK;
-	nlh->nlmsg_flags = NLM_F_REQUEST | NLM_F_ACK;
+	nlh = netlink_batch_put_header(batch, RTM_NEWLINK, 0);
 	ifm = mnl_nlmsg_put_extra_header(nlh, sizeof(*ifm));
 	ifm->ifi_family = AF_UNSPEC;
 	ifm->ifi_change = change;
@@ -194,36 +395,34 @@ netlink_link_enable(struct netlink_handle *const hndl,
 
 	mnl_attr_put_str(nlh, IFLA_IFNAME, interface);
 
-	return netlink_execute(hndl, nlh);
+	return netlink_batch_add(batch);
 }
 
 /*!
- * Netlink command equivalent to
- * "ip link add name ${bridge name} type bridge".
+ * Add a netlink request equivalent to
+ * "ip link add name ${bridge name} type bridge" to a batch.
  *
- * \param hndl handle returned from a call to \ref netlink_init().
+ * \param batch \ref netlink_batch.
  * \param name of the bridge to create.
  *
  * \return \c true on success, else \c false.
  */
 gboolean
-netlink_link_add_bridge(struct netlink_handle *const hndl,
-			const gchar *const name)  {
-	guint8 buf[MNL_SOCKET_BUFFER_SIZE];
+netlink_batch_link_add_bridge(struct netlink_batch *const batch,
+			      const gchar *const name)  {
 	struct nlmsghdr *nlh = NULL;
 	struct ifinfomsg *ifm = NULL;
 	struct nlattr* link_attr = NULL;
 
-	if ((hndl == NULL) || (name == NULL)) {
+	if ((batch == NULL) || (name == NULL)) {
 		g_critical("%s NULL parameter", __func__);
 		return false;
 	}
 
 	g_debug("netlink_link_add_bridge %s", name);
 
-	nlh = mnl_nlmsg_put_header(buf);
-	nlh->nlmsg_type = RTM_NEWLINK;
-	nlh->nlmsg_flags = NLM_F_REQUEST | NLM_F_CREATE | NLM_F_EXCL | NLM_F_ACK;
+	nlh = netlink_batch_put_header(batch, RTM_NEWLINK,
+			NLM_F_CREATE | NLM_F_EXCL);
 	ifm = mnl_nlmsg_put_extra_header(nlh, sizeof(*ifm));
 	ifm->ifi_family = AF_UNSPEC;
 
@@ -232,50 +431,48 @@ netlink_link_add_bridge(struct netlink_handle *const hndl,
 	mnl_attr_put_str(nlh, IFLA_INFO_KIND, "bridge");
 	mnl_attr_nest_end(nlh, link_attr);
 
-	return netlink_execute(hndl, nlh);
+	return netlink_batch_add(batch);
 }
 
 /*!
- * Netlink command equivalent to
- * "ip link set dev ${interface name} master ${bridge name}".
+ * Add a netlink request equivalent to
+ * "ip link set dev ${interface name} master ${bridge name}"
+ * to a batch.
  *
- * \param hndl handle returned from a call to \ref netlink_init().
+ * \param batch \ref netlink_batch.
  * \param dev index of the device to add to the bridge.
  * \param master index of the bridge.
  *
  * \return \c true on success, else \c false.
  */
 gboolean
-netlink_link_set_master(struct netlink_handle *const hndl,
-			guint dev, guint master)  {
-	guint8 buf[MNL_SOCKET_BUFFER_SIZE];
+netlink_batch_link_set_master(struct netlink_batch *const batch,
+			      guint dev, guint master)  {
 	struct nlmsghdr *nlh = NULL;
 	struct ifinfomsg *ifm = NULL;
 
-	if (hndl == NULL) {
+	if (batch == NULL) {
 		g_critical("%s NULL parameter", __func__);
 		return false;
 	}
 
 	g_debug("netlink_link_set_master %d %d", dev, master);
 
-	nlh = mnl_nlmsg_put_header(buf);
-	nlh->nlmsg_type = RTM_SETLINK;
-	nlh->nlmsg_flags = NLM_F_REQUEST | NLM_F_ACK;
+	nlh = netlink_batch_put_header(batch, RTM_SETLINK, 0);
 	ifm = mnl_nlmsg_put_extra_header(nlh, sizeof(*ifm));
 	ifm->ifi_family = AF_UNSPEC;
 	ifm->ifi_index = (gint)dev;
 
 	mnl_attr_put_u32(nlh, IFLA_MASTER, master);
 
-	return netlink_execute(hndl, nlh);
+	return netlink_batch_add(batch);
 }
 
 /*!
- * Netlink command equivalent to
- * "ip link set dev ${interface name} address ${address}".
+ * Add a netlink request equivalent to
+ * "ip link set dev ${interface name} address ${address}" to a batch.
  *
- * \param hndl handle returned from a call to \ref netlink_init().
+ * \param batch \ref netlink_batch.
  * \param interface name of the device.
  * \param size size of the address in bytes.
  * \param hwaddr link layer address of the device.
@@ -283,14 +480,13 @@ netlink_link_set_master(struct netlink_handle *const hndl,
  * \return \c true on success, else \c false.
  */
 gboolean
-netlink_link_set_addr(struct netlink_handle *const hndl,
-		      const gchar *const interface, gulong size,
-		      const guint8 *const hwaddr)  {
-	guint8 buf[MNL_SOCKET_BUFFER_SIZE];
+netlink_batch_link_set_addr(struct netlink_batch *const batch,
+			    const gchar *const interface, gulong size,
+			    const guint8 *const hwaddr)  {
 	struct nlmsghdr *nlh = NULL;
 	struct ifinfomsg *ifm = NULL;
 
-	if ((hndl == NULL) || (interface == NULL) || (hwaddr == NULL)) {
+	if ((batch == NULL) || (interface == NULL) || (hwaddr == NULL)) {
 		g_critical("%s NULL parameter", __func__);
 		return false;
 	}
@@ -307,16 +503,338 @@ netlink_link_set_addr(struct netlink_handle *const hndl,
 				hwaddr[3], hwaddr[4], hwaddr[5]);
 	}
 
-	nlh = mnl_nlmsg_put_header(buf);
-	nlh->nlmsg_type = RTM_SETLINK;
-	nlh->nlmsg_flags = NLM_F_REQUEST | NLM_F_ACK;
+	nlh = netlink_batch_put_header(batch, RTM_SETLINK, 0);
 	ifm = mnl_nlmsg_put_extra_header(nlh, sizeof(*ifm));
 	ifm->ifi_family = AF_UNSPEC;
 
 	mnl_attr_put_str(nlh, IFLA_IFNAME, interface);
 	mnl_attr_put(nlh, IFLA_ADDRESS, size, hwaddr);
 
-	return netlink_execute(hndl, nlh);
+	return netlink_batch_add(batch);
+}
+
+/*!
+ * Add a netlink request equivalent to
+ * "ip link set dev ${interface name} mtu ${mtu}" to a batch.
+ *
+ * \param batch \ref netlink_batch.
+ * \param interface name of the device.
+ * \param mtu MTU to set.
+ *
+ * \return \c true on success, else \c false.
+ */
+gboolean
+netlink_batch_link_set_mtu(struct netlink_batch *const batch,
+			   const gchar *const interface, guint mtu)  {
+	struct nlmsghdr *nlh = NULL;
+	struct ifinfomsg *ifm = NULL;
+
+	if ((batch == NULL) || (interface == NULL)) {
+		g_critical("%s NULL parameter", __func__);
+		return false;
+	}
+
+	g_debug("netlink_link_set_mtu %s %u", interface, mtu);
+
+	nlh = netlink_batch_put_header(batch, RTM_SETLINK, 0);
+	ifm = mnl_nlmsg_put_extra_header(nlh, sizeof(*ifm));
+	ifm->ifi_family = AF_UNSPEC;
+
+	mnl_attr_put_str(nlh, IFLA_IFNAME, interface);
+	mnl_attr_put_u32(nlh, IFLA_MTU, mtu);
+
+	return netlink_batch_add(batch);
+}
+
+/*!
+ * Request a netlink dump and pass each message received to a
+ * callback.
+ *
+ * \param hndl handle returned from a call to \ref netlink_init().
+ * \param type netlink message type (\c RTM_GET*).
+ * \param hdrlen size of the family-specific header of \p type,
+ *   whose first byte is the address family.
+ * \param family address family to dump.
+ * \param cb callback handler called for each message.
+ * \param data data passed to \p cb.
+ *
+ * \return \c true on success, else \c false.
+ */
+static gboolean
+netlink_dump(struct netlink_handle *const hndl, guint16 type,
+	     gsize hdrlen, guchar family, mnl_cb_t cb, gpointer data) {
+	guint8 buf[NETLINK_DUMP_BUFFER_SIZE];
+	struct nlmsghdr *nlh = NULL;
+	guchar *hdr = NULL;
+	glong ret;
+	guint seq, portid;
+
+	if ((hndl == NULL) || (hndl->nl == NULL)) {
+		g_critical("%s NULL parameter", __func__);
+		return false;
+	}
+
+	nlh = mnl_nlmsg_put_header(buf);
+	nlh->nlmsg_type = type;
+	nlh->nlmsg_flags = NLM_F_REQUEST | NLM_F_DUMP;
+	nlh->nlmsg_seq = seq = hndl->seq++;
+	hdr = mnl_nlmsg_put_extra_header(nlh, hdrlen);
+	*hdr = family;
+
+	portid = mnl_socket_get_portid(hndl->nl);
+
+	if (mnl_socket_sendto(hndl->nl, nlh, nlh->nlmsg_len) < 0) {
+		g_critical("mnl_socket_sendto %s", strerror(errno));
+		return false;
+	}
+
+	ret = mnl_socket_recvfrom(hndl->nl, buf, sizeof(buf));
+	while (ret > 0) {
+		ret = mnl_cb_run(buf, (size_t)ret, seq, portid, cb, data);
+		if (ret <= MNL_CB_STOP) {
+			break;
+		}
+		ret = mnl_socket_recvfrom(hndl->nl, buf, sizeof(buf));
+	}
+	if (ret == -1) {
+		g_critical("netlink dump %u failed: %s", type, strerror(errno));
+		return false;
+	}
+	return true;
+}
+
+/*!
+ * Callback handler that validates link attributes.
+ *
+ * \param attr the netlink attribute to parse.
+ * \param data [in, out] table of parsed netlink attributes.
+ *
+ * \return \c MNL_CB_OK on success, \c MNL_CB_ERROR on error.
+ */
+static gint
+data_link_attr_cb(const struct nlattr *attr, void *data)
+{
+	const struct nlattr **tb = data;
+	gint type = 0;
+
+	if (mnl_attr_type_valid(attr, IFLA_MAX) < 0) {
+		return MNL_CB_OK;
+	}
+
+	type = mnl_attr_get_type(attr);
+
+	switch(type) {
+	case IFLA_IFNAME:
+		if (mnl_attr_validate(attr, MNL_TYPE_NUL_STRING) < 0) {
+			g_critical("mnl_attr_validate %s", strerror(errno));
+			return MNL_CB_ERROR;
+		}
+		break;
+	case IFLA_MTU:
+		if (mnl_attr_validate(attr, MNL_TYPE_U32) < 0) {
+			g_critical("mnl_attr_validate %s", strerror(errno));
+			return MNL_CB_ERROR;
+		}
+		break;
+	}
+	tb[type] = attr;
+	return MNL_CB_OK;
+}
+
+/*!
+ * Callback handler that adds a \ref netlink_link to a table
+ * for each link dumped.
+ *
+ * \param nlh netlink response buffer.
+ * \param data [in, out] \c GHashTable of \ref netlink_link
+ *   indexed by interface index.
+ *
+ * \return \c MNL_CB_OK on success, \c MNL_CB_ERROR on error.
+ */
+static gint
+process_link(const struct nlmsghdr *nlh, void *data)
+{
+	struct nlattr *tb[IFLA_MAX+1] = {0};
+	struct ifinfomsg *ifm = NULL;
+	struct netlink_link *link = NULL;
+	GHashTable *links = data;
+	gint ret;
+
+	ifm = mnl_nlmsg_get_payload(nlh);
+
+	ret = mnl_attr_parse(nlh, sizeof(*ifm), data_link_attr_cb, tb);
+	if (ret != MNL_CB_OK) {
+		return ret;
+	}
+
+	if (!tb[IFLA_IFNAME]) {
+		return MNL_CB_OK;
+	}
+
+	link = g_malloc0(sizeof(*link));
+	link->index = (guint)ifm->ifi_index;
+	link->name = g_strdup(mnl_attr_get_str(tb[IFLA_IFNAME]));
+
+	if (tb[IFLA_MTU]) {
+		link->mtu = mnl_attr_get_u32(tb[IFLA_MTU]);
+	}
+
+	if (ifm->ifi_type == ARPHRD_ETHER && tb[IFLA_ADDRESS]
+			&& mnl_attr_get_payload_len(tb[IFLA_ADDRESS]) == 6) {
+		guint8 *hwaddr = mnl_attr_get_payload(tb[IFLA_ADDRESS]);
+
+		link->mac_address = g_strdup_printf(
+				"%.2x:%.2x:%.2x:%.2x:%.2x:%.2x",
+				hwaddr[0], hwaddr[1], hwaddr[2],
+				hwaddr[3], hwaddr[4], hwaddr[5]);
+	}
+
+	g_debug("link %u: %s mtu %u", link->index, link->name, link->mtu);
+
+	g_hash_table_replace(links, GUINT_TO_POINTER(link->index), link);
+
+	return MNL_CB_OK;
+}
+
+/*!
+ * Free the specified \ref netlink_link.
+ *
+ * \param link \ref netlink_link.
+ */
+static void
+netlink_link_free(struct netlink_link *link)
+{
+	if (link == NULL) {
+		return;
+	}
+
+	g_free_if_set(link->name);
+	g_free_if_set(link->mac_address);
+	g_free(link);
+}
+
+/*!
+ * Obtain the details of all network links
+ * (equivalent to "ip link show").
+ *
+ * \param hndl handle returned from a call to \ref netlink_init().
+ *
+ * \return \c GHashTable of \ref netlink_link indexed by interface
+ * index on success, else \c NULL.
+ */
+GHashTable *
+netlink_get_links(struct netlink_handle *const hndl)
+{
+	GHashTable *links = NULL;
+
+	links = g_hash_table_new_full(g_direct_hash, g_direct_equal,
+			NULL, (GDestroyNotify)netlink_link_free);
+
+	if (! netlink_dump(hndl, RTM_GETLINK, sizeof(struct ifinfomsg),
+				AF_UNSPEC, process_link, links)) {
+		g_hash_table_destroy(links);
+		return NULL;
+	}
+
+	return links;
+}
+
+/*!
+ * Callback handler that validates address attributes.
+ *
+ * \param attr the netlink attribute to parse.
+ * \param data [in, out] table of parsed netlink attributes.
+ *
+ * \return \c MNL_CB_OK.
+ */
+static gint
+data_addr_attr_cb(const struct nlattr *attr, void *data)
+{
+	const struct nlattr **tb = data;
+
+	if (mnl_attr_type_valid(attr, IFA_MAX) < 0) {
+		return MNL_CB_OK;
+	}
+
+	tb[mnl_attr_get_type(attr)] = attr;
+	return MNL_CB_OK;
+}
+
+/*!
+ * Callback handler that adds a \ref netlink_addr to an array
+ * for each IPv4 and IPv6 address dumped.
+ *
+ * \param nlh netlink response buffer.
+ * \param data [in, out] \c GPtrArray of \ref netlink_addr.
+ *
+ * \return \c MNL_CB_OK on success, \c MNL_CB_ERROR on error.
+ */
+static gint
+process_addr(const struct nlmsghdr *nlh, void *data)
+{
+	struct nlattr *tb[IFA_MAX+1] = {0};
+	struct ifaddrmsg *ifa = NULL;
+	struct netlink_addr *addr = NULL;
+	const struct nlattr *attr = NULL;
+	GPtrArray *addrs = data;
+	gsize len;
+	gint ret;
+
+	ifa = mnl_nlmsg_get_payload(nlh);
+
+	if (ifa->ifa_family == AF_INET) {
+		len = sizeof(struct in_addr);
+	} else if (ifa->ifa_family == AF_INET6) {
+		len = sizeof(struct in6_addr);
+	} else {
+		return MNL_CB_OK;
+	}
+
+	ret = mnl_attr_parse(nlh, sizeof(*ifa), data_addr_attr_cb, tb);
+	if (ret != MNL_CB_OK) {
+		return ret;
+	}
+
+	/* For point-to-point links, IFA_ADDRESS is the peer's */
+	attr = tb[IFA_LOCAL] ? tb[IFA_LOCAL] : tb[IFA_ADDRESS];
+	if (!attr || mnl_attr_get_payload_len(attr) != len) {
+		return MNL_CB_OK;
+	}
+
+	addr = g_malloc0(sizeof(*addr));
+	addr->index = ifa->ifa_index;
+	addr->family = ifa->ifa_family;
+	addr->prefixlen = ifa->ifa_prefixlen;
+	memcpy(addr->address, mnl_attr_get_payload(attr), len);
+
+	g_ptr_array_add(addrs, addr);
+
+	return MNL_CB_OK;
+}
+
+/*!
+ * Obtain all IPv4 and IPv6 addresses
+ * (equivalent to "ip address show").
+ *
+ * \param hndl handle returned from a call to \ref netlink_init().
+ *
+ * \return \c GPtrArray of \ref netlink_addr (IPv4 addresses first,
+ * each in the order the kernel lists them) on success, else \c NULL.
+ */
+GPtrArray *
+netlink_get_addrs(struct netlink_handle *const hndl)
+{
+	GPtrArray *addrs = NULL;
+
+	addrs = g_ptr_array_new_with_free_func(g_free);
+
+	if (! netlink_dump(hndl, RTM_GETADDR, sizeof(struct ifaddrmsg),
+				AF_UNSPEC, process_addr, addrs)) {
+		g_ptr_array_free(addrs, true);
+		return NULL;
+	}
+
+	return addrs;
 }
 
 /*!
@@ -377,9 +895,8 @@ data_ipv4_attr_cb(const struct nlattr *attr, void *data)
  * detect routes and add them.
  *
  * \param nlh netlink response buffer.
- * \param data [in, out] is the data sent to the callback handler
- *   from caller data points to cc_oci_config object to which routes
- *   are added
+ * \param data [in, out] \ref netlink_routes_data, whose
+ *   \ref cc_oci_config routes are added to.
  *
  * \return \c MNL_CB_OK on success.
  */
@@ -393,13 +910,15 @@ process_ipv4_routes(const struct nlmsghdr *nlh, void *data)
 	struct cc_oci_net_cfg *net = NULL;
 	uint32_t table;
 
-	struct cc_oci_config *config = data;
+	struct netlink_routes_data *routes = data;
+	struct cc_oci_config *config = NULL;
 
 	if ((nlh == NULL) || (data == NULL)) {
 		g_critical("%s NULL parameter", __func__);
 		return false;
 	}
 
+	config = routes->config;
 	rm = mnl_nlmsg_get_payload(nlh);
 
 	if (rm->rtm_family != AF_INET) {
@@ -451,7 +970,17 @@ process_ipv4_routes(const struct nlmsghdr *nlh, void *data)
 	if (tb[RTA_OIF]) {
 		uint ifindex = mnl_attr_get_u32(tb[RTA_OIF]);
 		char ifname[IF_NAMESIZE];
-		if (if_indextoname(ifindex, ifname)) {
+		struct netlink_link *link = NULL;
+
+		if (routes->links) {
+			link = g_hash_table_lookup(routes->links,
+					GUINT_TO_POINTER(ifindex));
+		}
+
+		if (link) {
+			route->ifname = g_strdup(link->name);
+			g_debug("ifname=%s", link->name);
+		} else if (if_indextoname(ifindex, ifname)) {
 			route->ifname = g_strdup(ifname);
 			g_debug("ifname=%s", ifname);
 		}
@@ -466,19 +995,17 @@ process_ipv4_routes(const struct nlmsghdr *nlh, void *data)
  * \param config \ref cc_oci_config.
  * \param hndl handle returned from a call to \ref netlink_init().
  * \param family INET family.
+ * \param links \c GHashTable returned by \ref netlink_get_links()
+ *   used to name the interface of each route (or \c NULL).
  *
  * \return true on success, false otherwise.
  */
 gboolean
 netlink_get_routes(struct cc_oci_config *config,
 		struct netlink_handle *const hndl,
-		guchar family)
+		guchar family, GHashTable *links)
 {
-	guint8 buf[MNL_SOCKET_BUFFER_SIZE];
-	struct nlmsghdr *nlh = NULL;
-	struct rtmsg *rtm = NULL;
-	glong ret;
-	guint seq, portid;
+	struct netlink_routes_data routes = { config, links };
 
 	if ( ! (hndl && config)) {
 		g_critical("%s NULL parameter", __func__);
@@ -487,34 +1014,6 @@ netlink_get_routes(struct cc_oci_config *config,
 
 	g_debug("netlink_get_default_gw");
 
-	nlh = mnl_nlmsg_put_header(buf);
-	nlh->nlmsg_type = RTM_GETROUTE;
-	nlh->nlmsg_flags = NLM_F_REQUEST | NLM_F_DUMP;
-	nlh->nlmsg_seq = seq = (guint)time(NULL);
-	rtm = mnl_nlmsg_put_extra_header(nlh, sizeof(struct rtmsg));
-
-	rtm->rtm_family = family;
-
-	portid = mnl_socket_get_portid(hndl->nl);
-
-	if (mnl_socket_sendto(hndl->nl, nlh, nlh->nlmsg_len) < 0) {
-		g_critical("mnl_socket_sendto %s", strerror(errno));
-		return false;
-	}
-
-	ret = mnl_socket_recvfrom(hndl->nl, buf, sizeof(buf));
-	while (ret > 0) {
-		ret = mnl_cb_run(buf, (size_t)ret, seq, portid,
-				 process_ipv4_routes, config);
-
-		if (ret <= MNL_CB_STOP) {
-			break;
-		}
-		ret = mnl_socket_recvfrom(hndl->nl, buf, sizeof(buf));
-	}
-	if (ret == -1) {
-		g_critical("mnl_socket_recvfrom %s", strerror(errno));
-		return false;
-	}
-	return true;
+	return netlink_dump(hndl, RTM_GETROUTE, sizeof(struct rtmsg),
+			family, process_ipv4_routes, &routes);
 }
@@ -28,25 +28,71 @@ struct netlink_handle {
 	struct mnl_socket *nl;
 };
 
+/** Details of a network link, from \ref netlink_get_links(). */
+struct netlink_link {
+	/** Interface index. */
+	guint index;
+
+	/** Interface name. */
+	gchar *name;
+
+	/** MAC address (\c NULL unless an ethernet link). */
+	gchar *mac_address;
+
+	/** Maximum transmission unit. */
+	guint mtu;
+};
+
+/** An IPv4 or IPv6 address, from \ref netlink_get_addrs(). */
+struct netlink_addr {
+	/** Index of the interface the address belongs to. */
+	guint index;
+
+	/** \c AF_INET or \c AF_INET6. */
+	guchar family;
+
+	/** Length of the subnet prefix in bits. */
+	guchar prefixlen;
+
+	/** \c struct in_addr or \c struct in6_addr. */
+	guint8 address[16];
+};
+
 struct netlink_handle * netlink_init(void);
 
 void netlink_close(struct netlink_handle *const hndl);
 
-gboolean netlink_link_enable(struct netlink_handle *const hndl,
-				const gchar *const interface, gboolean enable);
+struct netlink_batch;
+
+struct netlink_batch * netlink_batch_new(struct netlink_handle *const hndl);
+
+void netlink_batch_free(struct netlink_batch *batch);
+
+gboolean netlink_batch_execute(struct netlink_batch *const batch);
+
+gboolean netlink_batch_link_enable(struct netlink_batch *const batch,
+				   const gchar *const interface,
+				   gboolean enable);
+
+gboolean netlink_batch_link_add_bridge(struct netlink_batch *const batch,
+				       const gchar *const name);
+
+gboolean netlink_batch_link_set_master(struct netlink_batch *const batch,
+				       guint dev, guint master);
+
+gboolean netlink_batch_link_set_addr(struct netlink_batch *const batch,
+				     const gchar *const interface, gulong size,
+				     const guchar *const hwaddr);
 
-gboolean netlink_link_add_bridge(struct netlink_handle *const hndl,
-				 const gchar *const name);
+gboolean netlink_batch_link_set_mtu(struct netlink_batch *const batch,
+				    const gchar *const interface, guint mtu);
 
-gboolean netlink_link_set_master(struct netlink_handle *const hndl,
-				 guint dev, guint master);
+GHashTable *netlink_get_links(struct netlink_handle *const hndl);
 
-gboolean netlink_link_set_addr(struct netlink_handle *const hndl,
-			       const gchar *const interface, gulong size, 
-			       const guchar *const hwaddr);
+GPtrArray *netlink_get_addrs(struct netlink_handle *const hndl);
 
 gboolean netlink_get_routes(struct cc_oci_config *config, 
 				struct netlink_handle *const hndl,
-				guchar family);
+				guchar family, GHashTable *links);
 
 #endif /* _CC_OCI_NETLINK_H */
@@ -64,7 +64,6 @@
 #include <sys/socket.h>
 #include <sys/stat.h>
 #include <linux/if_tun.h>
-#include <ifaddrs.h>
 #include <arpa/inet.h>
 #include <net/if_arp.h>
 #include <net/if.h>
@@ -209,105 +208,23 @@ out:
 	return ret;
 }
 
-/*!
- * Helper function for setting/getting MTU for network interface.
- *
- * \param ifname Interface name.
- * \param mtu MTU to be set/retrieved for the interface.
- * \param set Flag indicating if the mtu needs to be set/retrieved.
- *
- * \return \c true on success, else \c false.
- */
-gboolean
-cc_oci_handle_interface_mtu(char *ifname, unsigned int *mtu, gboolean set)
-{
-	int socket_fd = -1;
-	gboolean ret = false;
-	struct ifreq ifr;
-
-	if (! (ifname && mtu)) {
-		return false;
-	}
-
-	socket_fd = socket(AF_INET, SOCK_DGRAM, 0);
-	if (socket_fd < 0) {
-		g_critical("Error opening socket: %s", strerror(errno));
-		goto out;
-	}
-
-	memset(&ifr, 0, sizeof(ifr));
-	ifr.ifr_addr.sa_family = AF_INET;
-	g_strlcpy(ifr.ifr_name, ifname, IFNAMSIZ);
-
-	if (set) {
-		ifr.ifr_mtu = (int)(*mtu);
-
-		if (ioctl(socket_fd, SIOCSIFMTU, (caddr_t)&ifr) < 0) {
-			g_critical("ioctl SIOCSIFMTU (set mtu) error for interface %s" \
-					"with mtu %d :%s", 
-					ifname, *mtu, strerror(errno));
-			goto out;
-		}
-		g_debug("MTU set for interface %s as %d\n", ifname, ifr.ifr_mtu);
-	} else {
-		if (ioctl(socket_fd, SIOCGIFMTU, (caddr_t)&ifr) < 0) {
-			g_critical("ioctl get mtu error for interface %s :%s",
-				ifname, strerror(errno));
-			goto out;
-		}
-		*mtu = (unsigned int)ifr.ifr_mtu;
-		g_debug("MTU for interface %s: %d\n", ifname, *mtu);
-	}
-
-	ret = true;
-out:
-	if (socket_fd >= 0) {
-		close (socket_fd);
-	}
-	return ret;
-}
-
-/*!
- * Set MTU for network interface.
- *
- * \param[in] ifname Interface name.
- * \param mtu MTU to be set for the interface.
- *
- * \return \c true on success, else \c false.
- */
-gboolean
-cc_oci_set_interface_mtu(char *ifname, unsigned int mtu)
-{
-	return cc_oci_handle_interface_mtu(ifname, &mtu, true);
-}
-
-/*!
- * Get MTU of the network interface.
- *
- * \param[in] ifname Interface name.
- * \param[out] mtu MTU retrieved for the interface.
- *
- * \return \c true on success, else \c false.
- */
-gboolean
-cc_oci_get_interface_mtu(char *ifname, unsigned int *mtu)
-{
-	return cc_oci_handle_interface_mtu(ifname, mtu, false);
-}
-
 /*!
  * Request to create the networking framework
  * that will be used to connect the specified
  * container network (veth) to the VM
  *
  * The container may be associated with multiple
- * networks and function has to be invoked for
- * each of those networks
+ * networks and the framework is created for all
+ * of them.
  *
  * Once the OCI spec supports the creation of
  * VM compatible tap interfaces in the network
  * plugin, this setup will not be required
  *
+ * The netlink requests for all interfaces are sent in two
+ * batches: the bridges must exist before their index can be
+ * determined to add interfaces to them.
+ *
  * \param config \ref cc_oci_config.
  * \param hndl handle returned from a call to \ref netlink_init().
  *
@@ -317,68 +234,96 @@ gboolean
 cc_oci_network_create(const struct cc_oci_config *const config,
 		      struct netlink_handle *const hndl) {
 	struct cc_oci_net_if_cfg *if_cfg = NULL;
+	struct netlink_batch *batch = NULL;
+	gboolean ret = false;
 	guint index = 0;
+	GSList *l;
 
 	if (config == NULL) {
 		return false;
 	}
 
-	for (index=0; index<g_slist_length(config->net.interfaces); index++) {
+	if (! config->net.interfaces) {
+		return true;
+	}
+
+	batch = netlink_batch_new(hndl);
+	if (! batch) {
+		goto out;
+	}
+
+	for (l = config->net.interfaces, index = 0; l;
+			l = g_slist_next(l), index++) {
 		/* Each container has its own name space. Hence we use the
 		 * same mac address prefix for tap interfaces on the host
 		 * side. This method scales to support upto 2^16 networks
 		 */
 		guint8 mac[6] = {0x02, 0x00, 0xCA, 0xFE,
 				(guint8)(index >> 8), (guint8)index};
-		guint tap_index, veth_index, bridge_index;
-		tap_index = veth_index = bridge_index = 0;
 
-		if_cfg = (struct cc_oci_net_if_cfg *)
-			g_slist_nth_data(config->net.interfaces, index);
+		if_cfg = (struct cc_oci_net_if_cfg *)l->data;
 
+		/* tap devices cannot be created using netlink */
 		if (!cc_oci_tap_create(if_cfg->tap_device)) {
 			goto out;
 		}
 
-		/* Set the MTU for the tap interface.
-		 */
-		if (! cc_oci_set_interface_mtu(if_cfg->tap_device, if_cfg->mtu)) {
+		if (!netlink_batch_link_set_mtu(batch, if_cfg->tap_device,
+						if_cfg->mtu)) {
 			goto out;
 		}
 
-		if (!netlink_link_add_bridge(hndl, if_cfg->bridge)) {
+		if (!netlink_batch_link_add_bridge(batch, if_cfg->bridge)) {
 			goto out;
 		}
 
-		if (!netlink_link_set_addr(hndl, if_cfg->ifname,
-					   sizeof(mac), mac)) {
+		if (!netlink_batch_link_set_addr(batch, if_cfg->ifname,
+						 sizeof(mac), mac)) {
 			goto out;
 		}
+	}
+
+	if (!netlink_batch_execute(batch)) {
+		goto out;
+	}
+
+	for (l = config->net.interfaces; l; l = g_slist_next(l)) {
+		guint tap_index, veth_index, bridge_index;
+
+		if_cfg = (struct cc_oci_net_if_cfg *)l->data;
 
 		bridge_index = if_nametoindex(if_cfg->bridge);
 		tap_index = if_nametoindex(if_cfg->tap_device);
 		veth_index = if_nametoindex(if_cfg->ifname);
 
-		if (!netlink_link_set_master(hndl, tap_index, bridge_index)) {
+		if (!netlink_batch_link_set_master(batch, tap_index,
+						   bridge_index)) {
 			goto out;
 		}
-		if (!netlink_link_set_master(hndl, veth_index, bridge_index)) {
+		if (!netlink_batch_link_set_master(batch, veth_index,
+						   bridge_index)) {
 			goto out;
 		}
-		if (!netlink_link_enable(hndl, if_cfg->tap_device, true)) {
+		if (!netlink_batch_link_enable(batch, if_cfg->tap_device,
+					       true)) {
 			goto out;
 		}
-		if (!netlink_link_enable(hndl, if_cfg->ifname, true)) {
+		if (!netlink_batch_link_enable(batch, if_cfg->ifname, true)) {
 			goto out;
 		}
-		if (!netlink_link_enable(hndl, if_cfg->bridge, true)) {
+		if (!netlink_batch_link_enable(batch, if_cfg->bridge, true)) {
 			goto out;
 		}
 	}
 
-	return true;
+	if (!netlink_batch_execute(batch)) {
+		goto out;
+	}
+
+	ret = true;
 out:
-	return false;
+	netlink_batch_free(batch);
+	return ret;
 }
 
 /*!
@@ -408,139 +353,6 @@ cc_net_get_ip_address(const gint family, const void *const sin_addr)
 	return g_strdup(addrBuf);
 }
 
-/*!
- * Count the number of valid bits in the subnet prefix
- * Copied over from BSD
- *
- * \param val \c the subnet
- * \param size \c size of the subnet value in bytes
- *
- * \return \c prefix length if valid else \c 0
- */
-static guint
-prefix(guint8 *val, guint size)
-{
-        guint8 *addr = val;
-        guint byte, bit, plen = 0;
-
-        for (byte = 0; byte < size; byte++, plen += 8) {
-                if (addr[byte] != 0xff) {
-                        break;
-		}
-	}
-
-	if (byte == size) {
-		return (plen);
-	}
-
-	for (bit = 7; bit != 0; bit--, plen++) {
-                if (!(addr[byte] & (1 << bit))) {
-                        break;
-		}
-	}
-
-	/* Handle errors */
-        for (; bit != 0; bit--) {
-                if (addr[byte] & (1 << bit)) {
-                        return(0);
-		}
-	}
-        byte++;
-        for (; byte < size; byte++) {
-                if (addr[byte]) {
-                        return(0);
-		}
-	}
-        return (plen);
-}
-
-/*!
- * Obtain the Subnet prefix from subnet address
- *
- * \param family \c inetfamily
- * \param sin_addr \c inet address
- *
- * \return \c string containing subnet prefix
- */
-static gchar *
-subnet_to_prefix(const gint family, const void *const sin_addr) {
-	guint pfix = 0;
-	guint8 *addr = (guint8 *)sin_addr;
-
-	if (!addr) {
-		return g_strdup_printf("%d", pfix);
-	}
-
-	switch(family) {
-	case AF_INET6:
-		pfix = prefix(addr, 16);
-		break;
-	case AF_INET:
-		pfix = prefix(addr, 4);
-		break;
-	default:
-		g_warning("invalid prefix family %d", family);
-		pfix = 0;
-	}
-
-	return g_strdup_printf("%d", pfix);
-}
-
-/*!
- * Obtain the string representation of the mac address
- * of an interface
- *
- * \param ifname \c interface name
- *
- * \return \c string containing MAC address, else \c ""
- */
-static gchar *
-get_mac_address(const gchar *const ifname)
-{
-	struct ifreq ifr;
-	int fd = -1;
-	gchar *macaddr;
-	guint8 *data;
-
-	if (ifname == NULL) {
-		g_critical("NULL interface name");
-		return g_strdup("");
-	}
-
-	fd = socket(AF_INET, SOCK_DGRAM, IPPROTO_IP);
-	if (fd < 0) {
-		g_critical("socket() failed with errno =  %d %s\n",
-			errno, strerror(errno));
-		return g_strdup("");
-	}
-
-	memset(&ifr, 0, sizeof(ifr));
-	g_strlcpy(ifr.ifr_name, ifname, IFNAMSIZ);
-
-	if (ioctl(fd, SIOCGIFHWADDR, &ifr) < 0) {
-		g_critical("ioctl() failed with errno =  %d %s\n",
-			errno, strerror(errno));
-		macaddr = g_strdup("");
-		goto out;
-	}
-
-	if (ifr.ifr_hwaddr.sa_family != ARPHRD_ETHER) {
-		g_critical("invalid interface  %s\n", ifname);
-		macaddr = g_strdup("");
-		goto out;
-	}
-
-	data = (guint8 *)ifr.ifr_hwaddr.sa_data;
-	macaddr = g_strdup_printf("%.2x:%.2x:%.2x:%.2x:%.2x:%.2x",
-				(guint8)data[0], (guint8)data[1],
-				(guint8)data[2], (guint8)data[3],
-				(guint8)data[4], (guint8)data[5]);
-
-out:
-	close(fd);
-	return macaddr;
-}
-
 /*
  * Return the predicatable interface name based on pcie address
  * Reference:
@@ -557,30 +369,15 @@ get_pcie_ifname(guint index)
 	return g_strdup_printf("enp0s%d", index + PCI_OFFSET);
 }
 
-/*!
- * GCompareFunc for searching through the list 
- * of existing network interfaces
- *
- * \param[in] a \c a element from the list
- * \param[in] b \c a value to compare with
- *
- * \return negative value if a < b ; zero if a = b ; positive value if a > b
- */
-gint static
-compare_interface(gconstpointer a,
-		  gconstpointer b) {
-	const struct cc_oci_net_if_cfg *if_cfg = a;
-	const gchar *ifname = b;
-
-	return g_strcmp0(ifname, if_cfg->ifname);
-}
-
 /*!
  * Obtain the network configuration of the container
  * Currently done by by scanned the namespace
  * Ideally the OCI spec should be modified such that
  * these parameters are sent to the runtime
  *
+ * The links, addresses and routes are each obtained with
+ * a single netlink dump.
+ *
  * \param[in,out] config \ref cc_oci_config.
  * \param hndl handle returned from a call to \ref netlink_init().
  *
@@ -590,13 +387,13 @@ gboolean
 cc_oci_network_discover(struct cc_oci_config *const config,
 			struct netlink_handle *hndl)
 {
-	struct ifaddrs *ifa = NULL;
-	struct ifaddrs *ifaddrs = NULL;
 	struct cc_oci_net_if_cfg *if_cfg = NULL;
 	struct cc_oci_net_cfg *net = NULL;
-	gint family;
-	gchar *ifname;
-	unsigned int mtu;
+	GHashTable *links = NULL;
+	GHashTable *if_cfgs = NULL;
+	GPtrArray *addrs = NULL;
+	gboolean ret = false;
+	guint i;
 
 	if (!config) {
 		return false;
@@ -604,99 +401,102 @@ cc_oci_network_discover(struct cc_oci_config *const config,
 
 	net = &(config->net);
 
-	if (getifaddrs(&ifaddrs) == -1) {
-		g_critical("getifaddrs() failed with errno =  %d %s\n",
-			errno, strerror(errno));
-		return false;
-	}
-
 	g_debug("Discovering container interfaces");
 
-	/* For now add the interfaces with a valid IPv4 address */
-	for (ifa = ifaddrs; ifa != NULL; ifa = ifa->ifa_next) {
-		GSList *elem;
+	links = netlink_get_links(hndl);
+	if (!links) {
+		goto out;
+	}
 
-		if (!ifa->ifa_addr) {
-			continue;
-		}
+	addrs = netlink_get_addrs(hndl);
+	if (!addrs) {
+		goto out;
+	}
 
-		g_debug("Interface := [%s]", ifa->ifa_name);
+	/* interfaces discovered, by index */
+	if_cfgs = g_hash_table_new(g_direct_hash, g_direct_equal);
 
-		family = ifa->ifa_addr->sa_family;
-		if (!((family == AF_INET) || (family == AF_INET6)))  {
+	/* For now add the interfaces with a valid IP address */
+	for (i = 0; i < addrs->len; i++) {
+		struct netlink_addr *addr = g_ptr_array_index(addrs, i);
+		struct netlink_link *link = NULL;
+
+		link = g_hash_table_lookup(links,
+				GUINT_TO_POINTER(addr->index));
+		if (!link) {
 			continue;
 		}
 
-		if (!g_strcmp0(ifa->ifa_name, "lo")) {
+		g_debug("Interface := [%s]", link->name);
+
+		if (!g_strcmp0(link->name, "lo")) {
 			continue;
 		}
 
-		ifname = ifa->ifa_name;
-		elem = g_slist_find_custom(net->interfaces,
-					   ifname,
-					   compare_interface);
+		if_cfg = g_hash_table_lookup(if_cfgs,
+				GUINT_TO_POINTER(addr->index));
 
-		if (elem == NULL) {
+		if (if_cfg == NULL) {
 			if_cfg = g_malloc0(sizeof(*if_cfg));
-			if_cfg->ifname = g_strdup(ifname);
-			if_cfg->mac_address = get_mac_address(ifname);
-			if_cfg->tap_device = g_strdup_printf("c%s", ifname);
-			if_cfg->bridge = g_strdup_printf("b%s", ifname);
+			if_cfg->ifname = g_strdup(link->name);
+			if (link->mac_address) {
+				if_cfg->mac_address = g_strdup(link->mac_address);
+			} else {
+				g_critical("invalid interface  %s\n", link->name);
+				if_cfg->mac_address = g_strdup("");
+			}
+			if_cfg->tap_device = g_strdup_printf("c%s", link->name);
+			if_cfg->bridge = g_strdup_printf("b%s", link->name);
+
+			/* The mtu set for the interface is set later for
+			 * the tap interface sent to the VM and the
+			 * interface within the VM
+			 */
+			if_cfg->mtu = link->mtu;
+
 			net->interfaces = g_slist_append(net->interfaces, if_cfg);
-		} else {
-			if_cfg = (struct cc_oci_net_if_cfg  *) elem->data;
+			g_hash_table_insert(if_cfgs,
+					GUINT_TO_POINTER(addr->index), if_cfg);
 		}
 
-		if (family == AF_INET) {
+		if (addr->family == AF_INET) {
 			struct cc_oci_net_ipv4_cfg *ipv4_cfg;
+			struct in_addr mask = { 0 };
+
 			ipv4_cfg = g_malloc0(sizeof(*ipv4_cfg));
 
 			if_cfg->ipv4_addrs = g_slist_append(
 				if_cfg->ipv4_addrs, ipv4_cfg);
 
-			ipv4_cfg->ip_address = cc_net_get_ip_address(family,
-				&((struct sockaddr_in *)ifa->ifa_addr)->sin_addr);
-			ipv4_cfg->subnet_mask = cc_net_get_ip_address(family,
-				&((struct sockaddr_in *)ifa->ifa_netmask)->sin_addr);
-
-			/* Retrieve the mtu set for the interface to be set
-			 * later for the tap interface sent to the VM and 
-			 * the interface within the VM
-			 */
-			if (if_cfg->mtu == 0) {
-				if ( cc_oci_get_interface_mtu(if_cfg->ifname, &mtu)) {
-					if_cfg->mtu = mtu;
-				} else {
-					freeifaddrs(ifaddrs);
-					/* Free all interfaces */
-					g_slist_free_full(config->net.interfaces,
-						(GDestroyNotify)cc_oci_net_interface_free);
-					config->net.interfaces = NULL;
-					return false;
-				}
+			if (addr->prefixlen) {
+				mask.s_addr = htonl(0xffffffffU <<
+						(32 - MIN(addr->prefixlen, 32)));
 			}
-		} else if (family == AF_INET6) {
+
+			ipv4_cfg->ip_address = cc_net_get_ip_address(
+				addr->family, addr->address);
+			ipv4_cfg->subnet_mask = cc_net_get_ip_address(
+				addr->family, &mask);
+		} else {
 			struct cc_oci_net_ipv6_cfg *ipv6_cfg;
 			ipv6_cfg = g_malloc0(sizeof(*ipv6_cfg));
 			if_cfg->ipv6_addrs = g_slist_append(
 				if_cfg->ipv6_addrs, ipv6_cfg);
 
-			ipv6_cfg->ipv6_address = cc_net_get_ip_address(family,
-				&((struct sockaddr_in6 *)ifa->ifa_addr)->sin6_addr);
-			ipv6_cfg->ipv6_prefix = subnet_to_prefix(family,
-				&((struct sockaddr_in6 *)ifa->ifa_netmask)->sin6_addr);
+			ipv6_cfg->ipv6_address = cc_net_get_ip_address(
+				addr->family, addr->address);
+			ipv6_cfg->ipv6_prefix = g_strdup_printf("%d",
+				addr->prefixlen);
 		}
 	}
 
-	freeifaddrs(ifaddrs);
-
 	if (config->oci.hostname){
 		net->hostname = g_strdup(config->oci.hostname);
 	} else {
 		net->hostname = g_strdup("");
 	}
 
-	netlink_get_routes(config, hndl, AF_INET);
+	netlink_get_routes(config, hndl, AF_INET, links);
 
 	/* TODO: Need to see if this needed, does resolv.conf handle this */
 	net->dns_ip1 = g_strdup("");
@@ -704,5 +504,18 @@ cc_oci_network_discover(struct cc_oci_config *const config,
 
 	g_debug("[%d] networks discovered", g_slist_length(net->interfaces));
 
-	return true;
+	ret = true;
+
+out:
+	if (if_cfgs) {
+		g_hash_table_destroy(if_cfgs);
+	}
+	if (addrs) {
+		g_ptr_array_free(addrs, true);
+	}
+	if (links) {
+		g_hash_table_destroy(links);
+	}
+
+	return ret;
 }
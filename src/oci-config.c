@@ -34,6 +34,7 @@
 #include "oci-config.h"
 #include "networking.h"
 #include "proxy.h"
+#include "timing.h"
 
 /*!
  * Free all resources associated with \p h hook object.
@@ -216,6 +217,9 @@ cc_oci_config_free (struct cc_oci_config *config)
 
 	cc_proxy_free (config->proxy);
 
+	cc_oci_timings_free (config->timings);
+	cc_oci_timings_free_all (config->state.timings);
+
 	g_free (config);
 }
 
@@ -59,6 +59,8 @@
 #include "proxy.h"
 #include "pod.h"
 #include "namespace.h"
+#include "timing.h"
+#include "registry.h"
 
 extern struct start_data start_data;
 
@@ -244,8 +246,8 @@ cc_oci_kill (struct cc_oci_config *config,
 		config->state.status = OCI_STATUS_STOPPED;
 
 		/* update state file */
-		if (! cc_oci_state_file_create (config, state->create_time)) {
-			g_critical ("failed to recreate state file");
+		if (! cc_oci_state_file_update (config, state->create_time)) {
+			g_critical ("failed to update state file");
 			goto error;
 		}
 
@@ -256,8 +258,8 @@ cc_oci_kill (struct cc_oci_config *config,
 	config->state.status = OCI_STATUS_STOPPING;
 
 	/* update state file */
-	if (! cc_oci_state_file_create (config, state->create_time)) {
-		g_critical ("failed to recreate state file");
+	if (! cc_oci_state_file_update (config, state->create_time)) {
+		g_critical ("failed to update state file");
 		goto error;
 	}
 
@@ -272,8 +274,8 @@ cc_oci_kill (struct cc_oci_config *config,
 				strerror (errno));
 		/* revert container status */
 		config->state.status = last_status;
-		if (! cc_oci_state_file_create (config, state->create_time)) {
-			g_critical ("failed to recreate state file");
+		if (! cc_oci_state_file_update (config, state->create_time)) {
+			g_critical ("failed to update state file");
 		}
 		return false;
 	}
@@ -296,8 +298,8 @@ cc_oci_kill (struct cc_oci_config *config,
 	config->state.status = OCI_STATUS_STOPPED;
 
 	/* update state file */
-	if (! cc_oci_state_file_create (config, state->create_time)) {
-		g_critical ("failed to recreate state file");
+	if (! cc_oci_state_file_update (config, state->create_time)) {
+		g_critical ("failed to update state file");
 		goto error;
 	}
 
@@ -657,6 +659,7 @@ cc_oci_start (struct cc_oci_config *config,
 	int            shim_flock_fd = -1;
 	char          *shim_flock_path = NULL;
 	GMainLoop     *loop = NULL;
+	struct cc_oci_state_bin bin;
 
 	if (! config || ! state) {
 		return false;
@@ -736,6 +739,8 @@ cc_oci_start (struct cc_oci_config *config,
 		}
 	}
 
+	cc_oci_timing_mark (config->timings, "setup");
+
 	if (! config->pod) {
 		if (! cc_proxy_hyper_new_container (config)) {
 			ret = false;
@@ -764,21 +769,27 @@ cc_oci_start (struct cc_oci_config *config,
 	 */
 	kill(state->pid, SIGCONT);
 
+	cc_oci_timing_mark (config->timings, "new-container");
+
 	/* Now the VM is running */
 	config->state.status = OCI_STATUS_RUNNING;
 
 	/* update state file after run container */
-	if (! cc_oci_state_file_create (config, state->create_time)) {
-		g_critical ("failed to recreate state file");
+	if (! cc_oci_state_file_update (config, state->create_time)) {
+		g_critical ("failed to update state file");
 		ret = false;
 		goto out;
 	}
 
+	cc_oci_timing_mark (config->timings, "state-file-update");
+
 	/* If a hook returns a non-zero exit code, then an error is
 	logged and the remaining hooks are executed. */
 	cc_run_hooks (config->oci.hooks.poststart,
 	              config->state.state_file_path, false);
 
+	cc_oci_timing_mark (config->timings, "poststart-hooks");
+
 	if (wait) {
 		if (loop) {
 			/* waiting for CC_OCI_PROCESS_SOCKET
@@ -803,11 +814,18 @@ cc_oci_start (struct cc_oci_config *config,
 			goto out;
 		}
 
-		/* Read state file to detect if the VM was stopped */
-		ret = cc_oci_get_config_and_state (&config_file, config,
-				&state);
-		if (! ret) {
-			goto out;
+		/* Read state file to detect if the VM was stopped,
+		 * using the binary state file if it is current.
+		 */
+		if (cc_oci_state_bin_read (config->state.runtime_path,
+					&bin)) {
+			config->state.status = (enum oci_status)bin.status;
+		} else {
+			ret = cc_oci_get_config_and_state (&config_file,
+					config, &state);
+			if (! ret) {
+				goto out;
+			}
 		}
 
 		/*FIXME: should start delete the container? */
@@ -905,16 +923,21 @@ gboolean
 cc_oci_stop (struct cc_oci_config *config,
 		struct oci_state *state)
 {
+	gboolean ret;
+
 	if (! (config && state)){
 		return false;
 	}
 
+	cc_oci_timing_mark (config->timings, "setup");
+
 	if (cc_oci_vm_running (state)) {
-		gboolean ret;
 		ret = cc_proxy_hyper_destroy_pod(config);
 		if (! ret) {
 			return false;
 		}
+
+		cc_oci_timing_mark (config->timings, "destroy-pod");
 	} else {
 		/* This isn't a fatal condition since:
 		 *
@@ -945,6 +968,8 @@ cc_oci_stop (struct cc_oci_config *config,
 		return false;
 	}
 
+	cc_oci_timing_mark (config->timings, "proxy-bye");
+
 	/* The post-stop hooks are called after the container process is
 	 * stopped. Cleanup or debugging could be performed in such a
 	 * hook. If a hook returns a non-zero exit code, then an error
@@ -953,7 +978,13 @@ cc_oci_stop (struct cc_oci_config *config,
 	cc_run_hooks (config->oci.hooks.poststop,
 	              config->state.state_file_path, false);
 
-	return cc_oci_cleanup (config);
+	cc_oci_timing_mark (config->timings, "poststop-hooks");
+
+	ret = cc_oci_cleanup (config);
+
+	cc_oci_timing_mark (config->timings, "cleanup");
+
+	return ret;
 }
 
 /*!
@@ -995,7 +1026,7 @@ cc_oci_toggle (struct cc_oci_config *config,
 
 	config->state.status = dest_status;
 
-	return cc_oci_state_file_create (config, state->create_time);
+	return cc_oci_state_file_update (config, state->create_time);
 }
 /*!
  * Parse the \c GNode representation of \c process_json file
@@ -1196,59 +1227,6 @@ cc_oci_list_vm (const struct oci_state *state,
 	json_array_add_object_element (options->array, obj);
 }
 
-/*!
- * Get the state of a VM.
- *
- * \param name Name of VM.
- * \param root_dir Root directory to use for runtime.
- *
- * Note that error checking has to be lax here since:
- *
- * - the VM may be destroyed as this function runs.
- *
- * \return \ref oci_state on success, else \c NULL.
- */
-static struct oci_state *
-cc_oci_vm_get_state (const gchar *name, const char *root_dir)
-{
-	struct cc_oci_config  *config = NULL;
-	struct oci_state      *state = NULL;
-	gchar                 *config_file = NULL;
-
-	if (! (name && root_dir)) {
-		return NULL;
-	}
-
-	config = cc_oci_config_create ();
-	if (! config) {
-		return NULL;
-	}
-
-	config->optarg_container_id = name;
-
-	if (root_dir) {
-		config->root_dir = g_strdup (root_dir);
-	}
-
-	if (! cc_oci_runtime_path_get (config)) {
-		goto out;
-	}
-
-	if (! cc_oci_state_file_get (config)) {
-		goto out;
-	}
-
-	state = cc_oci_state_file_read (config->state.state_file_path);
-
-out:
-	g_free_if_set (config_file);
-	if (config) {
-		cc_oci_config_free (config);
-	}
-
-	return state;
-}
-
 /*!
  * Update the widths required to display a VM.
  *
@@ -1300,6 +1278,11 @@ cc_oci_update_options (const struct oci_state *state,
 	options->created_width = CC_OCI_MAX (options->created_width,
 			(int)str->len);
 
+	if (! options->show_all) {
+		/* the VM paths are only displayed (and read) in all mode */
+		goto out;
+	}
+
 	g_string_assign(str, state->vm->hypervisor_path);
 	options->hypervisor_width = CC_OCI_MAX (options->hypervisor_width,
 			(int)str->len);
@@ -1312,6 +1295,7 @@ cc_oci_update_options (const struct oci_state *state,
 	options->kernel_width = CC_OCI_MAX (options->kernel_width,
 			(int)str->len);
 
+out:
 	g_string_free(str, true);
 }
 
@@ -1334,11 +1318,8 @@ gboolean
 cc_oci_list (struct cc_oci_config *config, const gchar *format,
         gboolean show_all)
 {
-	GDir                   *dir;
 	const gchar            *dirname;
-	const gchar            *name;
 	GSList                 *vms = NULL;
-	struct oci_state       *state = NULL;
 	gchar                  *str = NULL;
 	struct format_options   options = { 0 };
 
@@ -1361,43 +1342,18 @@ cc_oci_list (struct cc_oci_config *config, const gchar *format,
 
 	options.show_all = show_all;
 
-	dir = g_dir_open (dirname, 0x0, NULL);
-	if (! dir) {
-		/* No containers yet, so not an error */
-		goto no_vms;
-	}
-
-	/* Read all VM state files and add to a list */
-	while ((name = g_dir_read_name (dir)) != NULL) {
-		gboolean ret;
-		gchar *path;
-
-		path = g_build_path ("/", dirname, name, NULL);
-
-		ret = g_file_test (path, G_FILE_TEST_IS_DIR);
-		if (! ret) {
-			g_free (path);
-			continue;
-		}
-
-		g_free (path);
-
-		state = cc_oci_vm_get_state (name, dirname);
-		if (! state) {
-			continue;
-		}
-
-		if (! options.use_json) {
-			/* calculate the maximum field widths
-			 * to display the state values.
-			 */
-			cc_oci_update_options (state, &options);
-		}
+	/* Read the details of all VMs from the registry (only reading
+	 * their state files in all mode).
+	 */
+	(void)cc_oci_registry_list (dirname, show_all, &vms);
 
-		vms = g_slist_append (vms, state);
+	if (! options.use_json) {
+		/* calculate the maximum field widths
+		 * to display the state values.
+		 */
+		g_slist_foreach (vms, (GFunc)cc_oci_update_options, &options);
 	}
 
-no_vms:
 	if (options.use_json) {
 		if (! vms) {
 			/* List is empty */
@@ -1458,9 +1414,6 @@ no_vms:
 	g_slist_free_full (vms, (GDestroyNotify)cc_oci_state_free);
 
 out:
-	if (dir) {
-		g_dir_close (dir);
-	}
 	g_free_if_set (str);
 
 	return true;
@@ -1522,6 +1475,12 @@ cc_oci_config_update (struct cc_oci_config *config,
 		state->pod = NULL;
 	}
 
+	if (state->timings) {
+		cc_oci_timings_free_all (config->state.timings);
+		config->state.timings = state->timings;
+		state->timings = NULL;
+	}
+
 	if (state->procsock_path) {
 		/* No need to do a full transfer */
 		g_strlcpy (config->state.procsock_path,
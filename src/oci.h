@@ -78,6 +78,18 @@
  */
 #define CC_OCI_STATE_FILE		"state.json"
 
+/** Binary summary of \ref CC_OCI_STATE_FILE, written alongside it,
+ * which allows the most frequently used fields to be read without
+ * parsing JSON (see \ref cc_oci_state_bin).
+ */
+#define CC_OCI_STATE_BIN_FILE		"state.bin"
+
+/** Identifies a \ref CC_OCI_STATE_BIN_FILE ("CCSB"). */
+#define CC_OCI_STATE_BIN_MAGIC		0x43435342
+
+/** Version of the \ref CC_OCI_STATE_BIN_FILE format. */
+#define CC_OCI_STATE_BIN_VERSION	1
+
 /** Directory below which container-specific directory will be created.
  */
 #define CC_OCI_RUNTIME_DIR_PREFIX	LOCALSTATEDIR \
@@ -410,6 +422,30 @@ struct cc_oci_map {
 	const gchar  *name;
 };
 
+/** Time spent in a single phase of a runtime command. */
+struct cc_oci_timing {
+	/** Name of the phase. */
+	gchar   *phase;
+
+	/** Duration of the phase in microseconds. */
+	gint64   duration;
+};
+
+/** Phase timings recorded by a runtime command. */
+struct cc_oci_timings {
+	/** Name of the command the timings were recorded for. */
+	gchar      *command;
+
+	/** Monotonic time (in microseconds) the command started. */
+	gint64      start;
+
+	/** Monotonic time (in microseconds) the last phase ended. */
+	gint64      mark;
+
+	/** Array of \ref cc_oci_timing in the order recorded. */
+	GPtrArray  *phases;
+};
+
 /** OCI State, read from \ref CC_OCI_STATE_FILE.
  *
  * \see https://github.com/opencontainers/runtime-spec/blob/master/runtime.md#state
@@ -458,6 +494,9 @@ struct oci_state {
 
 	/* Needed by start to create a new container workload  */
 	struct oci_cfg_process *process;
+
+	/** List of \ref cc_oci_timings recorded by earlier commands. */
+	GSList          *timings;
 };
 
 /** clr-specific state fields. */
@@ -494,6 +533,47 @@ struct cc_oci_container_state {
 
 	/** OCI status of container. */
 	enum oci_status status;
+
+	/** List of \ref cc_oci_timings recorded by earlier commands
+	 * (read from \ref CC_OCI_STATE_FILE).
+	 */
+	GSList *timings;
+};
+
+/** Contents of \ref CC_OCI_STATE_BIN_FILE.
+ *
+ * All fields are at fixed offsets so that the file can be mapped and
+ * used directly.
+ */
+struct cc_oci_state_bin {
+	/** \ref CC_OCI_STATE_BIN_MAGIC. */
+	guint32  magic;
+
+	/** \ref CC_OCI_STATE_BIN_VERSION. */
+	guint32  version;
+
+	/** Size of this structure. */
+	guint32  size;
+
+	/** \ref oci_status. */
+	gint32   status;
+
+	/** Workload (shim) process ID. */
+	gint32   pid;
+
+	/** Hypervisor process ID. */
+	gint32   vm_pid;
+
+	/** Inode, size and modification time of the
+	 * \ref CC_OCI_STATE_FILE these values were taken from.
+	 */
+	guint64  state_ino;
+	gint64   state_size;
+	gint64   state_mtime_sec;
+	gint64   state_mtime_nsec;
+
+	/** Path to the hypervisor control socket. */
+	gchar    comms_path[PATH_MAX];
 };
 
 /** clr-specific mount details. */
@@ -544,6 +624,11 @@ struct cc_proxy {
 	 * from hyperstart when asked for it.
 	 */
 	gchar *vm_console_socket;
+
+	/** \c true if the proxy supports the binary message
+	 * encoding (negotiated by the "hello" and "attach" commands).
+	 */
+	gboolean binary;
 };
 
 /**
@@ -619,7 +704,15 @@ struct cc_oci_config {
 	/** If \c true, don't wait for hypervisor process to finish. */
 	gboolean detached_mode;
 
+	/** If \c true, remove the runtime directory in the background
+	 * when the container is deleted.
+	 */
+	gboolean async_delete;
+
 	struct cc_proxy *proxy;
+
+	/** Phase timings for the command currently running. */
+	struct cc_oci_timings *timings;
 };
 
 gchar *cc_oci_config_file_path (const gchar *bundle_path);
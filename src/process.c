@@ -68,6 +68,7 @@
 #include "pod.h"
 #include "proxy.h"
 #include "command.h"
+#include "timing.h"
 
 extern struct start_data start_data;
 
@@ -135,11 +136,13 @@ cc_oci_close_fds (GArray *fds) {
 /*! Perform setup on spawned child process.
  *
  * \param config \ref cc_oci_config.
+ * \param fds Array of file descriptors that should not be closed
+ *   (may be \c NULL).
  *
  * \return \c true on success, else \c false.
  */
 private gboolean
-cc_oci_setup_child (struct cc_oci_config *config)
+cc_oci_setup_child (struct cc_oci_config *config, GArray *fds)
 {
 	if (! config) {
 		return false;
@@ -150,7 +153,7 @@ cc_oci_setup_child (struct cc_oci_config *config)
 
 	/* Do not close fds when VM runs in detached mode*/
 	if (! config->detached_mode) {
-		if (! cc_oci_close_fds (NULL)) {
+		if (! cc_oci_close_fds (fds)) {
 			return false;
 		}
 	}
@@ -307,6 +310,8 @@ cc_run_hook(struct oci_cfg_hook* hook, const gchar* state,
 		goto fail3;
 	}
 
+	cc_oci_log_flush ();
+
 	pid = fork ();
 	if (pid < 0) {
 		g_critical ("failed to fork parent: %s", strerror(errno));
@@ -549,6 +554,8 @@ cc_shim_launch (struct cc_oci_config *config,
 		goto out;
 	}
 
+	cc_oci_log_flush ();
+
 	/* Inform caller of workload PID */
 	config->state.workload_pid = pid = fork ();
 
@@ -771,6 +778,7 @@ cc_oci_vm_launch (struct cc_oci_config *config)
 	GPid               pid = -1;
 	ssize_t            bytes;
 	char               buffer[2] = { '\0' };
+	GArray            *child_fds = NULL;
 	int                hypervisor_args_pipe[2] = {-1, -1};
 	int                child_err_pipe[2] = {-1, -1};
 	gchar            **args = NULL;
@@ -813,6 +821,8 @@ cc_oci_vm_launch (struct cc_oci_config *config)
 
 	config->state.status = OCI_STATUS_CREATED;
 
+	cc_oci_timing_mark (config->timings, "setup");
+
 	/* Connect to the proxy before launching the shim so that the
 	 * proxy socket fd can be passed to the shim.
 	 */
@@ -820,6 +830,8 @@ cc_oci_vm_launch (struct cc_oci_config *config)
 		return false;
 	}
 
+	cc_oci_timing_mark (config->timings, "proxy-connect");
+
 	/* Set up comms channels to the child:
 	 *
 	 * - one to pass the full list of expanded hypervisor arguments.
@@ -841,6 +853,8 @@ cc_oci_vm_launch (struct cc_oci_config *config)
 		goto out;
 	}
 
+	cc_oci_log_flush ();
+
 	pid = config->vm->pid = fork ();
 	if (pid < 0) {
 		g_critical ("failed to create child: %s",
@@ -862,6 +876,20 @@ cc_oci_vm_launch (struct cc_oci_config *config)
 			goto child_failed;
 		}
 
+		/* Perform the setup that does not depend on the
+		 * hypervisor arguments now, so that it overlaps with
+		 * the parent launching the shim, running the hooks and
+		 * creating the network. Only the comms channels to the
+		 * parent need to survive.
+		 */
+		child_fds = g_array_sized_new (FALSE, FALSE, sizeof (int), 2);
+		g_array_append_val (child_fds, hypervisor_args_pipe[0]);
+		g_array_append_val (child_fds, child_err_pipe[1]);
+
+		if (! cc_oci_setup_child (config, child_fds)) {
+			goto child_failed;
+		}
+
 		/* first - read hypervisor args length */
 		g_debug ("reading hypervisor command-line length from pipe");
 		bytes = read (hypervisor_args_pipe[0], &hypervisor_args_len,
@@ -913,10 +941,6 @@ cc_oci_vm_launch (struct cc_oci_config *config)
 			g_debug ("arg: '%s'", *p);
 		}
 
-		if (! cc_oci_setup_child (config)) {
-			goto child_failed;
-		}
-
 		if (execvp (args[0], args) < 0) {
 			g_critical ("failed to exec child %s: %s",
 					args[0],
@@ -936,6 +960,8 @@ child_failed:
 
 	g_debug ("hypervisor child pid is %u", (unsigned)pid);
 
+	cc_oci_timing_mark (config->timings, "fork");
+
 	/* Before fork this process again
 	 * we have to close unused file descriptors
 	 */
@@ -957,6 +983,37 @@ child_failed:
 		goto out;
 	}
 
+	/* The proxy connection already exists, so hand it to the shim
+	 * now rather than after the pod has been created: the shim
+	 * child can then progress as far as waiting for the ioBase
+	 * whilst the hooks run and the VM boots.
+	 */
+	proxy_fd = g_socket_get_fd (config->proxy->socket);
+	if (proxy_fd < 0) {
+		g_critical ("invalid proxy fd: %d", proxy_fd);
+		goto out;
+	}
+
+	bytes = write (shim_args_fd, &proxy_fd, sizeof (proxy_fd));
+	if (bytes < 0) {
+		g_critical ("failed to send proxy fd to shim child: %s",
+			strerror (errno));
+		goto out;
+	}
+
+	cc_oci_timing_mark (config->timings, "shim-launch");
+
+	/* The netlink socket does not depend on the network
+	 * configuration the hooks perform, so open it up front.
+	 */
+	if (setup_networking) {
+		hndl = netlink_init();
+		if (hndl == NULL) {
+			g_critical("failed to setup netlink socket");
+			goto out;
+		}
+	}
+
 	/* Create state file before hooks run.
 	 *
 	 * Required since the hooks must be passed the runtime state.
@@ -973,6 +1030,8 @@ child_failed:
 		goto out;
 	}
 
+	cc_oci_timing_mark (config->timings, "state-file-create");
+
 	/* Run the pre-start hooks.
 	 *
 	 * Note that one of these hooks will configure the networking
@@ -990,6 +1049,8 @@ child_failed:
 		g_critical ("failed to run prestart hooks");
 	}
 
+	cc_oci_timing_mark (config->timings, "prestart-hooks");
+
 	g_debug ("building hypervisor command-line");
 
 	// FIXME: add network config bits to following functions:
@@ -1001,12 +1062,6 @@ child_failed:
 	ret = false;
 
 	if (setup_networking) {
-		hndl = netlink_init();
-		if (hndl == NULL) {
-			g_critical("failed to setup netlink socket");
-			goto out;
-		}
-
 		if (! cc_oci_vm_netcfg_get (config, hndl)) {
 			g_critical("failed to discover network configuration");
 			goto out;
@@ -1018,6 +1073,7 @@ child_failed:
 		}
 		g_debug ("network configuration complete");
 
+		cc_oci_timing_mark (config->timings, "network");
 	}
 
 	cc_oci_populate_extra_args(config, additional_args);
@@ -1052,9 +1108,11 @@ child_failed:
 		goto out;
 	}
 
+	cc_oci_timing_mark (config->timings, "hypervisor-args");
+
 	g_debug ("checking child setup (blocking)");
 
-	/* block reading child error state */
+	/* block reading child error state: the pipe is closed on exec */
 	bytes = read (child_err_pipe[0],
 			buffer,
 			sizeof (buffer));
@@ -1066,40 +1124,18 @@ child_failed:
 
 	g_debug ("child setup successful");
 
-	/* Wait for the proxy to signal readiness.
-	 *
-	 * This can only happen once the agent details have been added
-	 * to the proxy object.
-	 */
-	if (! cc_proxy_wait_until_ready (config)) {
-		g_critical ("failed to wait for proxy %s", CC_OCI_PROXY);
-		goto out;
-	}
+	cc_oci_timing_mark (config->timings, "child-setup");
 
-	/* At this point ctl and tty sockets already exist,
-	 * is time to communicate with the proxy
+	/* Wait for the agent sockets to be created, then register the
+	 * VM with the proxy, create the pod and allocate the workload
+	 * I/O streams in a single round trip.
 	 */
-	if (! cc_proxy_hyper_pod_create (config)) {
+	if (! cc_proxy_hyper_pod_start (config, &proxy_io_fd, &ioBase)) {
+		g_critical ("failed to start pod via proxy %s", CC_OCI_PROXY);
 		goto out;
 	}
 
-	proxy_fd = g_socket_get_fd (config->proxy->socket);
-	if (proxy_fd < 0) {
-		g_critical ("invalid proxy fd: %d", proxy_fd);
-		goto out;
-	}
-
-	bytes = write (shim_args_fd, &proxy_fd, sizeof (proxy_fd));
-	if (bytes < 0) {
-		g_critical ("failed to send proxy fd to shim child: %s",
-			strerror (errno));
-		goto out;
-	}
-
-	if (! cc_proxy_cmd_allocate_io(config->proxy,
-			&proxy_io_fd, &ioBase, config->oci.process.terminal)) {
-		goto out;
-	}
+	cc_oci_timing_mark (config->timings, "pod-start");
 
 	bytes = write (shim_args_fd, &ioBase, sizeof (ioBase));
 	if (bytes < 0) {
@@ -1123,6 +1159,8 @@ child_failed:
 		goto out;
 	}
 
+	cc_oci_timing_mark (config->timings, "allocate-io");
+
 	/* save ioBase */
 	config->oci.process.stdio_stream = ioBase;
 	if ( config->oci.process.terminal) {
@@ -1148,8 +1186,13 @@ child_failed:
 		goto out;
 	}
 
+	cc_oci_timing_mark (config->timings, "shim-setup");
+
 	/* Recreate the state file now that all information is
 	 * available.
+	 *
+	 * Note that the state file only includes timings for the
+	 * phases up to this point.
 	 */
 	g_debug ("recreating state file");
 
@@ -1159,6 +1202,8 @@ child_failed:
 		goto out;
 	}
 
+	cc_oci_timing_mark (config->timings, "state-file-update");
+
 	/* wait for child to receive the expected SIGTRAP caused
 	 * by it calling exec() whilst under PTRACE control.
 	 */
@@ -1197,6 +1242,8 @@ child_failed:
 	 */
 	ret = cc_proxy_disconnect (config->proxy);
 
+	cc_oci_timing_mark (config->timings, "shim-detach");
+
 	/* Before create pid file!
 	 *
 	 * Docker provides a cgroup path that MUST be created before pid file
@@ -1227,6 +1274,8 @@ child_failed:
 				strerror(errno));
 			goto out;
 		}
+
+		cc_oci_timing_mark (config->timings, "cgroups");
 	}
 
 	/* Finally, create the pid file.
@@ -1241,6 +1290,8 @@ child_failed:
 		if (! ret) {
 			goto out;
 		}
+
+		cc_oci_timing_mark (config->timings, "pidfile");
 	}
 out:
 	if (hypervisor_args_pipe[0] != -1) close (hypervisor_args_pipe[0]);
@@ -1497,24 +1548,26 @@ cc_oci_vm_connect (struct cc_oci_config *config)
 		goto out;
 	}
 
+	cc_oci_timing_mark (config->timings, "setup");
+
 	if (! cc_proxy_connect (config->proxy)) {
 		goto out;
 	}
 
+	cc_oci_timing_mark (config->timings, "proxy-connect");
+
 	container_id = cc_pod_container_id(config);
 	if (! container_id) {
 		goto out;
 	}
 
-	if (! cc_proxy_attach (config->proxy, container_id)) {
-		goto out;
-	}
-
-	if (! cc_proxy_cmd_allocate_io(config->proxy,
+	if (! cc_proxy_attach_allocate_io (config->proxy, container_id,
 			&proxy_io_fd, &ioBase, config->oci.process.terminal)) {
 		goto out;
 	}
 
+	cc_oci_timing_mark (config->timings, "allocate-io");
+
 	/* save ioBase */
 	config->oci.process.stdio_stream = ioBase;
 	if ( config->oci.process.terminal) {
@@ -1531,10 +1584,14 @@ cc_oci_vm_connect (struct cc_oci_config *config)
 		goto out;
 	}
 
+	cc_oci_timing_mark (config->timings, "exec-command");
+
 	if (! cc_oci_exec_shim (config, ioBase, proxy_io_fd, false)) {
 		goto out;
 	}
 
+	cc_oci_timing_mark (config->timings, "shim-launch");
+
 	if (cc_oci_is_attach_mode(config)) {
 		main_loop = g_main_loop_new (NULL, 0);
 		if (! main_loop) {
@@ -20,7 +20,10 @@
 
 #include <string.h>
 #include <errno.h>
+#include <poll.h>
+#include <unistd.h>
 #include <sys/stat.h>
+#include <sys/uio.h>
 #include <arpa/inet.h>
 #include <gio/gunixsocketaddress.h>
 #include "oci.h"
@@ -34,30 +37,35 @@
 
 extern struct start_data start_data;
 
-struct watcher_proxy_data
+/** A request queued on the connection to \ref CC_OCI_PROXY. */
+struct cc_proxy_request
 {
-	GMainLoop   *loop;
-	GIOChannel  *channel;
+	/** Message payload to send (JSON or binary). */
 	gchar       *msg_to_send;
+
+	/** Length of \c msg_to_send in bytes. */
+	gsize        msg_len;
+
+	/** Header flags of the message (\ref PROXY_MSG_FLAG_BINARY). */
+	guint32      flags;
+
+	/** Raw reply payload. */
 	GString     *msg_received;
-	int          socket_fd;
+
+	/** Header flags of the reply. */
+	guint32      reply_flags;
+
 	/**
-	 * Indicates that we expect an out-of-band file descriptor
-	 * from proxy socket.
+	 * If set, an out-of-band file descriptor is expected from
+	 * the proxy socket once the request has succeeded.
 	 */
 	int         *oob_fd;
-};
-
-/** Format of a proxy message */
-struct proxy_msg {
-	/** Number of bytes in payload. */
-	guint32  length;
-
-	/** Not used. */
-	guint32  reserved;
 
-	/** Message payload (JSON). */
-	gchar   *data;
+	/**
+	 * The reply holds the proxy protocol version, which determines
+	 * whether the binary encoding can be used.
+	 */
+	gboolean     negotiate;
 };
 
 /**
@@ -221,6 +229,40 @@ out:
 	return ret;
 }
 
+/**
+ * Wait for the proxy socket to become readable or writable.
+ *
+ * The \c GSocket used to talk to the proxy is non-blocking.
+ *
+ * \param fd Proxy socket fd.
+ * \param events \c POLLIN or \c POLLOUT.
+ *
+ * \return \c true when the socket is ready, else \c false.
+ */
+static gboolean
+cc_proxy_wait_fd (int fd, short events)
+{
+	struct pollfd pfd = { .fd = fd, .events = events };
+	int ret;
+
+	do {
+		ret = poll (&pfd, 1, -1);
+	} while (ret < 0 && errno == EINTR);
+
+	if (ret < 0) {
+		g_critical ("failed to poll proxy socket: %s",
+				strerror (errno));
+		return false;
+	}
+
+	if (pfd.revents & (POLLERR | POLLNVAL)) {
+		g_critical ("proxy socket error");
+		return false;
+	}
+
+	return true;
+}
+
 /**
  * Read a file descriptor from the proxy's socket.
  *
@@ -252,7 +294,13 @@ cc_proxy_receive_fd(int proxy_fd, int *fd)
 
 	while (1) {
 		bytes_read = recvmsg(proxy_fd, &msg, 0);
-		if (bytes_read < 0 && (errno == EAGAIN || errno == EINTR)) {
+		if (bytes_read < 0 && errno == EAGAIN) {
+			if (! cc_proxy_wait_fd (proxy_fd, POLLIN)) {
+				return false;
+			}
+			continue;
+		}
+		if (bytes_read < 0 && errno == EINTR) {
 			continue;
 		}
 		break;
@@ -294,35 +342,69 @@ cc_proxy_receive_fd(int proxy_fd, int *fd)
 }
 
 /**
- * Read a message from proxy's socket.
+ * Read exactly \p len bytes from the proxy socket.
  *
- * \param source GIOChannel.
- * \param condition GIOCondition.
- * \param proxy_data struct watcher_proxy_data.
+ * \param fd Proxy socket fd.
+ * \param buf Buffer to fill.
+ * \param len Number of bytes to read.
  *
  * \return \c true on success, else \c false.
  */
 static gboolean
-cc_proxy_msg_read (GIOChannel *source, GIOCondition condition,
-	struct watcher_proxy_data *proxy_data)
+cc_proxy_read_all (int fd, void *buf, size_t len)
+{
+	size_t   total = 0;
+	ssize_t  bytes;
+
+	while (total < len) {
+		bytes = read (fd, (guint8 *)buf + total, len - total);
+		if (bytes < 0 && errno == EINTR) {
+			continue;
+		}
+		if (bytes < 0 && errno == EAGAIN) {
+			if (! cc_proxy_wait_fd (fd, POLLIN)) {
+				return false;
+			}
+			continue;
+		}
+		if (bytes <= 0) {
+			g_critical ("lost proxy connection: %s",
+					bytes ? strerror (errno) : "EOF");
+			return false;
+		}
+		total += (size_t)bytes;
+	}
+
+	return true;
+}
+
+/**
+ * Read a message from proxy's socket.
+ *
+ * \param fd Proxy socket fd.
+ * \param msg_received \c GString to append the message payload to.
+ * \param[out] flags Header flags of the message.
+ *
+ * \return \c true on success, else \c false.
+ */
+private gboolean
+cc_proxy_msg_read (int fd, GString *msg_received, guint32 *flags)
 {
-	ssize_t bytes_read, total_bytes_read = 0;
-	size_t payload_length;
-	guint8 header[MESSAGE_HEADER_LENGTH] = { 0 };
-	gchar buf[LINE_MAX];
+	guint8  header[MESSAGE_HEADER_LENGTH] = { 0 };
+	gchar   buf[LINE_MAX];
+	size_t  payload_length;
 
 	/*
 	 * Start by reading the message header and the payload length.
 	 */
-	bytes_read = read(proxy_data->socket_fd, header, sizeof(header));
-	if (bytes_read <= 0) {
-		g_critical("couldn't read header from proxy: %s",
-			   strerror(errno));
-		goto out;
+	if (! cc_proxy_read_all (fd, header, sizeof (header))) {
+		g_critical ("couldn't read header from proxy");
+		return false;
 	}
 
 	payload_length = cc_oci_get_big_endian_32 (header);
-	g_debug ("proxy msg length: %ld", payload_length);
+	*flags = cc_oci_get_big_endian_32 (header + HEADER_MESSAGE_LENGTH);
+	g_debug ("proxy msg length: %ld, flags: 0x%x", payload_length, *flags);
 
 	/*
 	 * The proxy sends back very small messages usually just a:
@@ -332,128 +414,95 @@ cc_proxy_msg_read (GIOChannel *source, GIOCondition condition,
 	 */
 	if (payload_length > 1024) {
 		g_critical("received bogus payload length");
-		goto out;
+		return false;
 	}
 
-	/*
-	 * Read the payload
-	 */
-	while(total_bytes_read < payload_length) {
-		bytes_read = read(proxy_data->socket_fd, buf,
-				  payload_length - (size_t)total_bytes_read);
-		if (bytes_read <= 0) {
-			/* Continue if we're missing some bytes */
-			if (errno == EAGAIN || errno == EINTR) {
-				continue;
-			}
-			g_critical("lost proxy connection: %s",
-				   strerror(errno));
-			break;
-		}
-
-		g_string_append_len(proxy_data->msg_received, buf, bytes_read);
-
-		total_bytes_read += bytes_read;
+	if (! cc_proxy_read_all (fd, buf, payload_length)) {
+		return false;
 	}
 
-	if (proxy_data->msg_received->len > 0) {
+	g_string_append_len (msg_received, buf, (gssize)payload_length);
+
+	if (! (*flags & PROXY_MSG_FLAG_BINARY)) {
 		g_debug("message read from proxy socket: %s",
-			proxy_data->msg_received->str);
+				msg_received->str);
 	}
 
-out:
-	g_main_loop_quit (proxy_data->loop);
-
-	/* Unregister this watcher */
-	return false;
+	return true;
 }
 
 /**
  * Write down a message into proxy's socket.
  *
- * \param source GIOChannel.
- * \param condition GIOCondition.
- * \param proxy_data struct watcher_proxy_data.
+ * The header and payload are sent with a single \c writev(2).
+ *
+ * \param fd Proxy socket fd.
+ * \param flags Header flags.
+ * \param msg_to_send Message payload.
+ * \param len Length of \p msg_to_send in bytes.
  *
  * \return \c true on success, else \c false.
  */
-static gboolean
-cc_proxy_msg_write (GIOChannel *source, GIOCondition condition,
-	struct watcher_proxy_data *proxy_data)
+private gboolean
+cc_proxy_msg_write (int fd, guint32 flags, const gchar *msg_to_send,
+		gsize len)
 {
-	gsize bytes_written = 0;
-	gsize len = 0;
-	GIOStatus status;
-	GError *error = NULL;
-	struct proxy_msg msg = { 0 };
-
-	if (condition == G_IO_HUP) {
-		g_io_channel_unref(source);
-		goto out;
-	}
-
-	len = (gsize)g_utf8_strlen(proxy_data->msg_to_send, -1);
-
-	msg.length = htonl ((guint32)len);
-	msg.data = proxy_data->msg_to_send;
-
-	g_debug ("sending message (length %lu) to proxy socket",
-			(unsigned long int)len);
-
-	do {
-		status = g_io_channel_write_chars(source,
-				(const gchar *)&msg,
-				(gssize)sizeof (msg.length) +
-				sizeof (msg.reserved),
-				&bytes_written,
-				&error);
-	} while (status == G_IO_STATUS_AGAIN);
-
-	if (status == G_IO_STATUS_ERROR) {
-		g_debug ("proxy message length write failed: %s",
-				error->message);
-		g_error_free (error);
-		goto out;
-	}
-
-	g_debug("writing message data to proxy socket: %s",
-			proxy_data->msg_to_send);
-
-	do {
-		status = g_io_channel_write_chars(source,
-				proxy_data->msg_to_send,
-				(gssize)len,
-				&bytes_written,
-				&error);
-	} while (status == G_IO_STATUS_AGAIN);
-
-	if (status == G_IO_STATUS_ERROR) {
-		g_debug ("proxy write failed: %s", error->message);
-		g_error_free (error);
-		goto out;
+	guint8        header[MESSAGE_HEADER_LENGTH] = { 0 };
+	struct iovec  iov[2];
+	struct iovec *v = iov;
+	int           count = 2;
+	guint32       value;
+	ssize_t       bytes;
+
+	value = htonl ((guint32)len);
+	memcpy (header, &value, sizeof (value));
+	value = htonl (flags);
+	memcpy (header + HEADER_MESSAGE_LENGTH, &value, sizeof (value));
+
+	iov[0].iov_base = header;
+	iov[0].iov_len = sizeof (header);
+	iov[1].iov_base = (void *)msg_to_send;
+	iov[1].iov_len = len;
+
+	if (flags & PROXY_MSG_FLAG_BINARY) {
+		g_debug("writing binary message (length %lu) to proxy socket",
+				(unsigned long int)len);
+	} else {
+		g_debug("writing message data to proxy socket: %s",
+				msg_to_send);
 	}
 
-	do {
-		status = g_io_channel_flush (source, &error);
-	} while (status == G_IO_STATUS_AGAIN);
+	while (count) {
+		bytes = writev (fd, v, count);
+		if (bytes < 0 && errno == EINTR) {
+			continue;
+		}
+		if (bytes < 0 && errno == EAGAIN) {
+			if (! cc_proxy_wait_fd (fd, POLLOUT)) {
+				return false;
+			}
+			continue;
+		}
+		if (bytes < 0) {
+			g_critical ("proxy write failed: %s", strerror (errno));
+			return false;
+		}
 
-	if (status == G_IO_STATUS_ERROR) {
-		g_debug ("proxy flush failed: %s",
-		    error->message);
-		g_error_free (error);
-		goto out;
+		/* skip whatever has been fully written */
+		while (count && (size_t)bytes >= v->iov_len) {
+			bytes -= (ssize_t)v->iov_len;
+			v++;
+			count--;
+		}
+		if (count) {
+			v->iov_base = (guint8 *)v->iov_base + bytes;
+			v->iov_len -= (size_t)bytes;
+		}
 	}
 
-	/* Now we've sent the initial negotiation message,
-	 * register a handler to wait for a reply.
-	 */
-	g_io_add_watch(source, G_IO_IN | G_IO_HUP,
-	    (GIOFunc)cc_proxy_msg_read, proxy_data);
-
-out:
-	/* unregister this watcher */
-	return false;
+	return true;
 }
+
 /**
  * Callback used to monitor CTL socket creation
  *
@@ -540,479 +589,834 @@ out:
 }
 
 /**
- * Run any command via the \ref CC_OCI_PROXY.
+ * Read a big endian integer of \p size bytes from a binary
+ * message.
  *
- * \param proxy \ref cc_proxy.
- * \param msg_to_send gchar.
- * \param msg_received GString.
- * \param oob_fd int.
+ * \param msg Binary message.
+ * \param[in,out] offset Current position in \p msg.
+ * \param size Size of the integer in bytes.
+ * \param[out] value Integer read.
  *
  * \return \c true on success, else \c false.
  */
 static gboolean
-cc_proxy_run_cmd(struct cc_proxy *proxy,
-		gchar *msg_to_send,
-		GString* msg_received,
-		int *oob_fd)
+cc_proxy_bin_get (const GString *msg, gsize *offset, gsize size,
+		guint64 *value)
 {
-	GIOChannel        *channel = NULL;
-	struct watcher_proxy_data proxy_data;
-	gboolean ret = false;
-	gboolean hyper_result = false;
-
-	if (! (proxy && msg_to_send && msg_received)) {
+	if (msg->len - *offset < size) {
 		return false;
 	}
 
-	if (! proxy->socket) {
-		g_critical ("no proxy connection");
-		return false;
+	*value = 0;
+	for (gsize i = 0; i < size; i++) {
+		*value = (*value << 8) | (guint8)msg->str[*offset + i];
 	}
 
-	proxy_data.loop = g_main_loop_new (NULL, false);
+	*offset += size;
 
-	proxy_data.msg_to_send = msg_to_send;
-
-	proxy_data.oob_fd = oob_fd;
+	return true;
+}
 
-	proxy_data.socket_fd = g_socket_get_fd (proxy->socket);
+/**
+ * Parse a binary reply from the proxy, of the form:
+ *
+ *     success (u8), error (string), count (u8),
+ *     count * (name (string), value (i64))
+ *
+ * where strings are a u16 length followed by the string bytes.
+ *
+ * \param response Raw proxy reply.
+ * \param[out] proxy_success \c true if the command was successful.
+ * \param[out] error Error message (may be \c NULL).
+ * \param name Name of the result to return (may be \c NULL).
+ * \param[out] value Value of result \p name.
+ *
+ * \return \c true if the reply could be parsed and, if \p name was
+ * specified, the result was found, else \c false.
+ */
+private gboolean
+cc_proxy_binary_response_parse (const GString *response,
+		gboolean *proxy_success,
+		gchar **error,
+		const gchar *name,
+		gint64 *value)
+{
+	gsize    offset = 0;
+	guint64  n;
+	guint64  len;
+	guint64  count;
+	gboolean found = false;
 
-	channel = g_io_channel_unix_new(proxy_data.socket_fd);
-	if (! channel) {
-		g_critical("failed to create I/O channel");
-		goto out;
+	if (! (response && proxy_success)) {
+		return false;
 	}
 
-	g_io_channel_set_encoding (channel, NULL, NULL);
-
-	proxy_data.msg_received = msg_received;
+	if (! cc_proxy_bin_get (response, &offset, 1, &n)) {
+		goto err;
+	}
+	*proxy_success = n != 0;
 
-	/* add a watcher for proxy's socket stdin */
-	g_io_add_watch(channel, G_IO_OUT | G_IO_HUP,
-	    (GIOFunc)cc_proxy_msg_write, &proxy_data);
+	if (! cc_proxy_bin_get (response, &offset, 2, &len)
+			|| response->len - offset < len) {
+		goto err;
+	}
+	if (error) {
+		*error = g_strndup (response->str + offset, len);
+	}
+	offset += len;
 
-	g_debug ("communicating with proxy");
+	if (! cc_proxy_bin_get (response, &offset, 1, &count)) {
+		goto err;
+	}
 
-	/* waiting for proxy response */
-	g_main_loop_run(proxy_data.loop);
+	for (guint64 i = 0; i < count; i++) {
+		const gchar *result;
 
-	if (! cc_proxy_hyper_check_response (msg_received,
-			&hyper_result)) {
-		g_critical ("failed to check proxy response");
-		ret = false;
-	} else {
-		ret = hyper_result;
-	}
+		if (! cc_proxy_bin_get (response, &offset, 2, &len)
+				|| response->len - offset < len) {
+			goto err;
+		}
+		result = response->str + offset;
+		offset += len;
 
-	/*
-	 * If we're asked for a fd out of the proxy and the command has
-	 * succeeded, we can now read it.
-	 */
-	if (oob_fd && ret == true) {
-		gboolean fd_received;
+		if (! cc_proxy_bin_get (response, &offset, 8, &n)) {
+			goto err;
+		}
 
-		fd_received = cc_proxy_receive_fd(proxy_data.socket_fd, oob_fd);
-		if (!fd_received) {
-			g_critical ("failed to receive fd");
-			ret = false;
+		if (name && strlen (name) == len
+				&& ! strncmp (result, name, len)) {
+			*value = (gint64)n;
+			found = true;
 		}
 	}
 
-out:
-	g_main_loop_unref (proxy_data.loop);
-	g_free (proxy_data.msg_to_send);
-	if (channel) {
-		g_io_channel_unref(channel);
+	return name ? found : true;
+
+err:
+	g_critical ("malformed binary proxy response");
+	if (error) {
+		g_free (*error);
+		*error = NULL;
 	}
-	return ret;
+	return false;
 }
 
 /**
- * Send the initial message to the proxy
- * which will block until it is ready. 
+ * Retrieve an integer result from the reply to a request.
  *
- * \param proxy \ref cc_proxy.
- * \param container_id container id.
+ * \param req \ref cc_proxy_request.
+ * \param name Name of the result.
+ * \param[out] value Value of the result.
  *
- * \return \c true on success, else \c false.
+ * \return \c true on success, else \c false (including when
+ * the reply does not hold \p name).
  */
 static gboolean
-cc_proxy_cmd_hello (struct cc_proxy *proxy, const char *container_id)
+cc_proxy_response_get_int (const struct cc_proxy_request *req,
+		const gchar *name, gint64 *value)
 {
-	JsonObject        *obj = NULL;
-	JsonObject        *data = NULL;
-	JsonNode          *root = NULL;
-	JsonGenerator     *generator = NULL;
-	gchar             *msg_to_send = NULL;
-	GString           *msg_received = NULL;
-	gboolean           ret = false;
-
-	/* The name of the command used to initiate communicate
-	 * with the proxy.
-	 */
-	const gchar       *proxy_cmd = "hello";
+	JsonParser        *parser = NULL;
+	JsonReader        *reader = NULL;
+	GError            *error = NULL;
+	gboolean           ret;
+	gboolean           success;
 
-	if (! (proxy && proxy->socket && container_id)) {
-		return false;
+	if (req->reply_flags & PROXY_MSG_FLAG_BINARY) {
+		return cc_proxy_binary_response_parse (req->msg_received,
+				&success, NULL, name, value);
 	}
 
-	obj = json_object_new ();
-	data = json_object_new ();
-
-	json_object_set_string_member (obj, "id", proxy_cmd);
-
-	json_object_set_string_member (data, "containerId",
-			container_id);
-
-	json_object_set_string_member (data, "ctlSerial",
-			proxy->agent_ctl_socket);
-
-	json_object_set_string_member (data, "ioSerial",
-			proxy->agent_tty_socket);
-
-	json_object_set_string_member (data, "console",
-			proxy->vm_console_socket);
-
-	json_object_set_object_member (obj, "data", data);
-
-	root = json_node_new (JSON_NODE_OBJECT);
-	generator = json_generator_new ();
-	json_node_take_object (root, obj);
-
-	json_generator_set_root (generator, root);
-	g_object_set (generator, "pretty", FALSE, NULL);
-
-	msg_to_send = json_generator_to_data (generator, NULL);
+	parser = json_parser_new();
+	ret = json_parser_load_from_data(parser,
+		req->msg_received->str,
+		(gssize) req->msg_received->len,
+		&error);
 
-	msg_received = g_string_new("");
+	if (! ret) {
+		g_critical ("failed to parse proxy response: %s",
+				error->message);
+		g_error_free (error);
+		goto out;
+	}
 
-	if (! msg_received ) {
+	reader = json_reader_new(json_parser_get_root(parser));
+	if (!reader) {
+		g_critical("failed to create reader");
+		ret = false;
 		goto out;
 	}
 
-	if (! cc_proxy_run_cmd(proxy, msg_to_send, msg_received, NULL)) {
-		g_critical("failed to run proxy command %s: %s",
-				proxy_cmd,
-				msg_received->str);
+	ret = json_reader_read_member (reader, "data")
+		&& json_reader_read_member (reader, name);
+	if (! ret) {
 		goto out;
 	}
 
-	ret = true;
+	*value = json_reader_get_int_value(reader);
 
-	g_debug("msg received: %s", msg_received->str);
+	json_reader_end_member (reader);
 
 out:
-	if (msg_received) {
-		g_string_free(msg_received, true);
+	if (reader) {
+		g_object_unref (reader);
 	}
-	if (obj) {
-		json_object_unref (obj);
+	if (parser) {
+		g_object_unref (parser);
 	}
 
 	return ret;
 }
 
 /**
- * Attach current proxy connection to a
- * previous registered VM (hello command)
+ * Check the reply to a request.
  *
  * \param proxy \ref cc_proxy.
- * \param container_id container id.
+ * \param req \ref cc_proxy_request.
+ * \param[out] proxy_success \c true if the command was successful.
  *
- * \return \c true on success, else \c false.
+ * \return \c true if the reply could be checked, else \c false.
  */
-gboolean
-cc_proxy_attach (struct cc_proxy *proxy, const char *container_id)
+static gboolean
+cc_proxy_check_response (struct cc_proxy *proxy,
+		const struct cc_proxy_request *req,
+		gboolean *proxy_success)
 {
+	gchar  *error = NULL;
+	gint64  version = 0;
 
-	JsonObject        *obj = NULL;
-	JsonObject        *data = NULL;
-	JsonNode          *root = NULL;
-	JsonGenerator     *generator = NULL;
-	gchar             *msg_to_send = NULL;
-	GString           *msg_received = NULL;
-	gboolean           ret = false;
-
-	/* The name of the command used to initiate communicate
-	 * with the proxy.
-	 */
-	const gchar       *proxy_cmd = "attach";
-
-	if (! (proxy && proxy->socket && container_id)) {
+	if (req->reply_flags & PROXY_MSG_FLAG_BINARY) {
+		if (! cc_proxy_binary_response_parse (req->msg_received,
+					proxy_success, &error, NULL, NULL)) {
+			return false;
+		}
+		if (! *proxy_success) {
+			g_critical ("proxy error: %s", error);
+		}
+		g_free (error);
+	} else if (! cc_proxy_hyper_check_response (req->msg_received,
+				proxy_success)) {
 		return false;
 	}
 
-	obj = json_object_new ();
-	data = json_object_new ();
-
-	json_object_set_string_member (obj, "id", proxy_cmd);
-
-	json_object_set_string_member (data, "containerId",
-			container_id);
-
-	json_object_set_object_member (obj, "data", data);
-
-	root = json_node_new (JSON_NODE_OBJECT);
-	generator = json_generator_new ();
-	json_node_take_object (root, obj);
+	if (*proxy_success && req->negotiate) {
+		/* older proxies may not report their version */
+		if (! cc_proxy_response_get_int (req, "version", &version)) {
+			version = 0;
+		}
 
-	json_generator_set_root (generator, root);
-	g_object_set (generator, "pretty", FALSE, NULL);
+		proxy->binary = version >= PROXY_BINARY_VERSION;
+		g_debug ("proxy protocol version %ld, binary encoding %s",
+				(long int)version,
+				proxy->binary ? "enabled" : "disabled");
+	}
 
-	msg_to_send = json_generator_to_data (generator, NULL);
+	return true;
+}
 
-	msg_received = g_string_new("");
+/**
+ * Run a batch of commands via the \ref CC_OCI_PROXY.
+ *
+ * All requests are written before any reply is read so that the batch
+ * costs a single round trip. The proxy handles the requests on a
+ * connection in order, so the replies (and any out-of-band fds) arrive
+ * in the same order as the requests. Every reply is consumed, even
+ * after a failure, to leave the connection usable.
+ *
+ * \param proxy \ref cc_proxy.
+ * \param requests Array of \ref cc_proxy_request.
+ * \param count Number of elements in \p requests.
+ *
+ * \return \c true if all commands succeeded, else \c false.
+ */
+static gboolean
+cc_proxy_run_cmds (struct cc_proxy *proxy,
+		struct cc_proxy_request *requests,
+		gsize count)
+{
+	struct cc_proxy_request *req;
+	gboolean  ret = true;
+	gboolean  hyper_result;
+	int       fd;
+	gsize     i;
 
-	if (! msg_received ) {
-		goto out;
+	if (! (proxy && requests && count)) {
+		return false;
 	}
 
-	if (! cc_proxy_run_cmd(proxy, msg_to_send, msg_received, NULL)) {
-		g_critical("failed to run proxy command %s: %s",
-				proxy_cmd,
-				msg_received->str);
-		goto out;
+	if (! proxy->socket) {
+		g_critical ("no proxy connection");
+		return false;
 	}
 
-	ret = true;
+	fd = g_socket_get_fd (proxy->socket);
 
-	g_debug("msg received: %s", msg_received->str);
+	g_debug ("communicating with proxy (%lu requests)",
+			(unsigned long int)count);
 
-out:
-	if (msg_received) {
-		g_string_free(msg_received, true);
+	for (i = 0; i < count; i++) {
+		req = &requests[i];
+
+		if (! (req->msg_to_send && req->msg_received)) {
+			return false;
+		}
+
+		if (! cc_proxy_msg_write (fd, req->flags, req->msg_to_send,
+					req->msg_len)) {
+			return false;
+		}
 	}
-	if (obj) {
-		json_object_unref (obj);
+
+	for (i = 0; i < count; i++) {
+		req = &requests[i];
+
+		if (! cc_proxy_msg_read (fd, req->msg_received,
+					&req->reply_flags)) {
+			return false;
+		}
+
+		hyper_result = false;
+
+		if (! cc_proxy_check_response (proxy, req, &hyper_result)) {
+			g_critical ("failed to check proxy response");
+			return false;
+		}
+
+		if (! hyper_result) {
+			ret = false;
+			continue;
+		}
+
+		/*
+		 * If we're asked for a fd out of the proxy and the command has
+		 * succeeded, we can now read it.
+		 */
+		if (req->oob_fd && ! cc_proxy_receive_fd (fd, req->oob_fd)) {
+			g_critical ("failed to receive fd");
+			return false;
+		}
 	}
 
 	return ret;
 }
 
 /**
- * Send the final message to the proxy.
+ * Free the resources held by a request.
  *
- * \param proxy \ref cc_proxy.
+ * \param req \ref cc_proxy_request.
+ */
+static void
+cc_proxy_request_clear (struct cc_proxy_request *req)
+{
+	g_free_if_set (req->msg_to_send);
+	if (req->msg_received) {
+		g_string_free (req->msg_received, true);
+		req->msg_received = NULL;
+	}
+}
+
+/**
+ * Set a JSON message of the form:
+ *
+ *     {"id": "<id>", "data": { ... }}
+ *
+ * as the payload of a request.
+ *
+ * \param req \ref cc_proxy_request.
+ * \param id Name of the proxy command.
+ * \param data \c JsonObject to send as message data
+ *   (ownership is transferred).
  *
  * \return \c true on success, else \c false.
  */
-gboolean
-cc_proxy_cmd_bye (struct cc_proxy *proxy, const char *container_id)
+static gboolean
+cc_proxy_request_set_json (struct cc_proxy_request *req,
+		const gchar *id, JsonObject *data)
 {
 	JsonObject        *obj = NULL;
-	JsonObject        *data = NULL;
 	JsonNode          *root = NULL;
 	JsonGenerator     *generator = NULL;
-	gchar             *msg_to_send = NULL;
-	GString           *msg_received = NULL;
-	gboolean           ret = false;
+	gsize              len = 0;
 
-	/* The name of the proxy command used to terminate
-	 * communications.
-	 */
-	const gchar       *proxy_cmd = "bye";
+	obj = json_object_new ();
 
-	if (! (proxy && container_id)) {
-		return false;
+	json_object_set_string_member (obj, "id", id);
+	json_object_set_object_member (obj, "data", data);
+
+	root = json_node_new (JSON_NODE_OBJECT);
+	generator = json_generator_new ();
+	json_node_take_object (root, obj);
+
+	json_generator_set_root (generator, root);
+	g_object_set (generator, "pretty", FALSE, NULL);
+
+	req->msg_to_send = json_generator_to_data (generator, &len);
+	req->msg_len = len;
+	req->flags = 0;
+	req->msg_received = g_string_new ("");
+
+	g_object_unref (generator);
+	json_node_free (root);
+
+	return req->msg_to_send != NULL;
+}
+
+/**
+ * Append a big endian integer of \p size bytes to a binary message.
+ *
+ * \param msg Binary message.
+ * \param value Value to append.
+ * \param size Size of the integer in bytes.
+ */
+static void
+cc_proxy_bin_put (GByteArray *msg, guint64 value, gsize size)
+{
+	guint8 buf[8];
+
+	for (gsize i = 0; i < size; i++) {
+		buf[i] = (guint8)(value >> (8 * (size - 1 - i)));
 	}
 
-	if (! cc_proxy_connect(proxy)) {
-		return ret;
+	g_byte_array_append (msg, buf, (guint)size);
+}
+
+/**
+ * Append a string (u16 length followed by the string bytes) to
+ * a binary message.
+ *
+ * \param msg Binary message.
+ * \param str String to append (may be \c NULL).
+ */
+static void
+cc_proxy_bin_put_string (GByteArray *msg, const gchar *str)
+{
+	gsize len = str ? strlen (str) : 0;
+
+	len = MIN (len, G_MAXUINT16);
+
+	cc_proxy_bin_put (msg, len, 2);
+	g_byte_array_append (msg, (const guint8 *)str, (guint)len);
+}
+
+/**
+ * Set a binary message as the payload of a request.
+ *
+ * \param req \ref cc_proxy_request.
+ * \param msg Binary message (freed by this function).
+ *
+ * \return \c true on success, else \c false.
+ */
+static gboolean
+cc_proxy_request_set_binary (struct cc_proxy_request *req, GByteArray *msg)
+{
+	req->msg_len = msg->len;
+	req->msg_to_send = (gchar *)g_byte_array_free (msg, false);
+	req->flags = PROXY_MSG_FLAG_BINARY;
+	req->msg_received = g_string_new ("");
+
+	return true;
+}
+
+/**
+ * Prepare the proxy "hello" request.
+ *
+ * The request is always sent as JSON as its reply determines
+ * whether the binary encoding can be used.
+ *
+ * \param proxy \ref cc_proxy.
+ * \param req \ref cc_proxy_request.
+ * \param container_id container id.
+ *
+ * \return \c true on success, else \c false.
+ */
+static gboolean
+cc_proxy_hello_request (struct cc_proxy *proxy,
+		struct cc_proxy_request *req,
+		const char *container_id)
+{
+	JsonObject *data = json_object_new ();
+
+	json_object_set_string_member (data, "containerId",
+			container_id);
+
+	json_object_set_string_member (data, "ctlSerial",
+			proxy->agent_ctl_socket);
+
+	json_object_set_string_member (data, "ioSerial",
+			proxy->agent_tty_socket);
+
+	json_object_set_string_member (data, "console",
+			proxy->vm_console_socket);
+
+	req->negotiate = true;
+
+	return cc_proxy_request_set_json (req, "hello", data);
+}
+
+/**
+ * Prepare the proxy "attach" request.
+ *
+ * Like "hello", the request is always sent as JSON.
+ *
+ * \param req \ref cc_proxy_request.
+ * \param container_id container id.
+ *
+ * \return \c true on success, else \c false.
+ */
+static gboolean
+cc_proxy_attach_request (struct cc_proxy_request *req,
+		const char *container_id)
+{
+	JsonObject *data = json_object_new ();
+
+	json_object_set_string_member (data, "containerId",
+			container_id);
+
+	req->negotiate = true;
+
+	return cc_proxy_request_set_json (req, "attach", data);
+}
+
+/**
+ * Prepare the proxy "bye" request.
+ *
+ * \param proxy \ref cc_proxy.
+ * \param req \ref cc_proxy_request.
+ * \param container_id container id.
+ *
+ * \return \c true on success, else \c false.
+ */
+static gboolean
+cc_proxy_bye_request (struct cc_proxy *proxy,
+		struct cc_proxy_request *req,
+		const char *container_id)
+{
+	JsonObject *data;
+	GByteArray *msg;
+
+	if (proxy->binary) {
+		msg = g_byte_array_new ();
+		cc_proxy_bin_put (msg, PROXY_BINARY_OP_BYE, 1);
+		cc_proxy_bin_put_string (msg, container_id);
+		return cc_proxy_request_set_binary (req, msg);
 	}
 
-	obj = json_object_new ();
 	data = json_object_new ();
 
-	json_object_set_string_member (obj, "id", proxy_cmd);
-
 	json_object_set_string_member (data, "containerId",
 			container_id);
 
-	json_object_set_object_member (obj, "data", data);
+	return cc_proxy_request_set_json (req, "bye", data);
+}
 
-	root = json_node_new (JSON_NODE_OBJECT);
-	generator = json_generator_new ();
-	json_node_take_object (root, obj);
+/**
+ * Prepare the proxy "allocateIO" request.
+ *
+ * \param proxy \ref cc_proxy.
+ * \param req \ref cc_proxy_request.
+ * \param tty \c true if the workload is run interactively.
+ *
+ * \return \c true on success, else \c false.
+ */
+static gboolean
+cc_proxy_allocate_io_request (struct cc_proxy *proxy,
+		struct cc_proxy_request *req,
+		bool tty)
+{
+	JsonObject *data;
+	GByteArray *msg;
 
-	json_generator_set_root (generator, root);
-	g_object_set (generator, "pretty", FALSE, NULL);
+	/* If run interactively, allocate just 1 stream since
+	 * stdout and stderr are both connected to the terminal
+	 */
+	gint64 n_streams = tty ? 1 : IO_STREAMS_NUMBER;
+
+	if (proxy->binary) {
+		msg = g_byte_array_new ();
+		cc_proxy_bin_put (msg, PROXY_BINARY_OP_ALLOCATE_IO, 1);
+		cc_proxy_bin_put (msg, (guint64)n_streams, 4);
+		return cc_proxy_request_set_binary (req, msg);
+	}
+
+	data = json_object_new ();
+
+	json_object_set_int_member (data, "nStreams", n_streams);
+
+	return cc_proxy_request_set_json (req, "allocateIO", data);
+}
+
+/**
+ * Prepare a proxy "hyper" request, used to run a command in
+ * pass-through mode.
+ *
+ * \param proxy \ref cc_proxy.
+ * \param req \ref cc_proxy_request.
+ * \param cmd Name of hyper command to run.
+ * \param payload \c JsonObject to send as message data
+ *   (ownership is transferred, may be \c NULL).
+ *
+ * \return \c true on success, else \c false.
+ */
+static gboolean
+cc_proxy_hyper_request (struct cc_proxy *proxy,
+		struct cc_proxy_request *req,
+		const char *cmd,
+		JsonObject *payload)
+{
+	JsonObject        *data;
+	JsonNode          *root;
+	JsonGenerator     *generator;
+	GByteArray        *msg;
+	gchar             *json;
+	gsize              len = 0;
+
+	if (proxy->binary) {
+		msg = g_byte_array_new ();
+		cc_proxy_bin_put (msg, PROXY_BINARY_OP_HYPER, 1);
+		cc_proxy_bin_put_string (msg, cmd);
+
+		/* the hyperstart data is passed through as JSON */
+		if (payload) {
+			root = json_node_new (JSON_NODE_OBJECT);
+			generator = json_generator_new ();
+			json_node_take_object (root, payload);
+
+			json_generator_set_root (generator, root);
+			g_object_set (generator, "pretty", FALSE, NULL);
+
+			json = json_generator_to_data (generator, &len);
+			g_byte_array_append (msg, (const guint8 *)json,
+					(guint)len);
+
+			g_free (json);
+			g_object_unref (generator);
+			json_node_free (root);
+		}
 
-	msg_to_send = json_generator_to_data (generator, NULL);
+		return cc_proxy_request_set_binary (req, msg);
+	}
+
+	data = json_object_new ();
+
+	/* add the hyper command name and the data to pass to the
+	 * command.
+	 */
+	json_object_set_string_member (data, "hyperName", cmd);
+	json_object_set_object_member (data, "data", payload);
+
+	/* tell the proxy to run in pass-through mode and forward
+	 * the request on to hyperstart in the VM.
+	 */
+	return cc_proxy_request_set_json (req, "hyper", data);
+}
 
-	msg_received = g_string_new ("");
+/**
+ * Run a single prepared request via the \ref CC_OCI_PROXY.
+ *
+ * \param proxy \ref cc_proxy.
+ * \param proxy_cmd Name of the proxy command (for diagnostics).
+ * \param req \ref cc_proxy_request (cleared by this function).
+ * \param prepared Result of preparing \p req.
+ *
+ * \return \c true on success, else \c false.
+ */
+static gboolean
+cc_proxy_run_cmd (struct cc_proxy *proxy, const gchar *proxy_cmd,
+		struct cc_proxy_request *req, gboolean prepared)
+{
+	gboolean ret = false;
 
-	if (! msg_received ) {
+	if (! prepared) {
 		goto out;
 	}
 
-	if (! cc_proxy_run_cmd(proxy, msg_to_send, msg_received, NULL)) {
-		g_critical ("failed to run proxy command %s: %s",
+	if (! cc_proxy_run_cmds (proxy, req, 1)) {
+		g_critical("failed to run proxy command %s: %s",
 				proxy_cmd,
-				msg_received->str);
+				req->flags & PROXY_MSG_FLAG_BINARY ?
+				"" : req->msg_received->str);
 		goto out;
 	}
 
 	ret = true;
 
-	g_debug("msg received: %s", msg_received->str);
-
 out:
-	if (msg_received) {
-		g_string_free(msg_received, true);
-	}
-	if (obj) {
-		json_object_unref (obj);
-	}
+	cc_proxy_request_clear (req);
 
 	return ret;
 }
 
 /**
- * Ask the proxy to allocate I/O stream "sequence numbers".
+ * Attach current proxy connection to a
+ * previous registered VM (hello command)
  *
  * \param proxy \ref cc_proxy.
+ * \param container_id container id.
  *
  * \return \c true on success, else \c false.
  */
 gboolean
-cc_proxy_cmd_allocate_io (struct cc_proxy *proxy,
-	int *proxy_io_fd,
-	int *ioBase,
-	bool tty)
+cc_proxy_attach (struct cc_proxy *proxy, const char *container_id)
 {
-	JsonObject        *obj = NULL;
-	JsonObject        *data = NULL;
-	JsonNode          *root = NULL;
-	JsonGenerator     *generator = NULL;
-	gchar             *msg_to_send = NULL;
-	GString           *msg_received = NULL;
-	gboolean           ret = false;
-	JsonParser        *parser = NULL;
-	GError            *error = NULL;
-	JsonReader        *reader = NULL;
+	struct cc_proxy_request req = { 0 };
 
-	const gchar       *proxy_cmd = "allocateIO";
-	int n_streams = IO_STREAMS_NUMBER;
-
-	if (! proxy) {
+	if (! (proxy && proxy->socket && container_id)) {
 		return false;
 	}
 
-	obj = json_object_new ();
-	data = json_object_new ();
+	return cc_proxy_run_cmd (proxy, "attach", &req,
+			cc_proxy_attach_request (&req, container_id));
+}
 
-	json_object_set_string_member (obj, "id", proxy_cmd);
+/**
+ * Send the final message to the proxy.
+ *
+ * \param proxy \ref cc_proxy.
+ *
+ * \return \c true on success, else \c false.
+ */
+gboolean
+cc_proxy_cmd_bye (struct cc_proxy *proxy, const char *container_id)
+{
+	struct cc_proxy_request req = { 0 };
 
-	/* If run interactively, allocate just 1 stream since
-	 * stdout and stderr are both connected to the terminal
-	 */
-	if (tty) {
-		json_object_set_int_member (data, "nStreams", 1);
-	} else {
-		json_object_set_int_member (data, "nStreams",
-			n_streams);
+	if (! (proxy && container_id)) {
+		return false;
 	}
 
-	json_object_set_object_member (obj, "data", data);
+	if (! cc_proxy_connect(proxy)) {
+		return false;
+	}
 
-	root = json_node_new (JSON_NODE_OBJECT);
-	generator = json_generator_new ();
-	json_node_take_object (root, obj);
+	return cc_proxy_run_cmd (proxy, "bye", &req,
+			cc_proxy_bye_request (proxy, &req, container_id));
+}
 
-	json_generator_set_root (generator, root);
-	g_object_set (generator, "pretty", FALSE, NULL);
+/**
+ * Ask the proxy to allocate I/O stream "sequence numbers".
+ *
+ * \param proxy \ref cc_proxy.
+ *
+ * \return \c true on success, else \c false.
+ */
+gboolean
+cc_proxy_cmd_allocate_io (struct cc_proxy *proxy,
+	int *proxy_io_fd,
+	int *ioBase,
+	bool tty)
+{
+	struct cc_proxy_request  req = { 0 };
+	gboolean                 ret = false;
+	gint64                   value;
 
-	msg_to_send = json_generator_to_data (generator, NULL);
+	if (! proxy) {
+		return false;
+	}
 
-	msg_received = g_string_new("");
+	req.oob_fd = proxy_io_fd;
 
-	if (! msg_received ) {
+	if (! cc_proxy_allocate_io_request (proxy, &req, tty)) {
 		goto out;
 	}
 
-	if (! cc_proxy_run_cmd(proxy, msg_to_send, msg_received, proxy_io_fd)) {
-		g_critical("failed to run proxy command %s: %s",
-				proxy_cmd,
-				msg_received->str);
+	if (! cc_proxy_run_cmds (proxy, &req, 1)) {
+		g_critical("failed to run proxy command allocateIO: %s",
+				req.flags & PROXY_MSG_FLAG_BINARY ?
+				"" : req.msg_received->str);
 		goto out;
 	}
 
-	g_debug("msg received: %s", msg_received->str);
-
 	if (!ioBase) {
 		ret = true;
 		goto out;
 	}
 
-	/* parse message received to get ioBase */
-	parser = json_parser_new();
-	ret = json_parser_load_from_data(parser,
-		msg_received->str,
-		(gssize) msg_received->len,
-		&error);
-
+	ret = cc_proxy_response_get_int (&req, "ioBase", &value);
 	if (! ret) {
-		g_critical ("failed to parse proxy response: %s",
-				error->message);
-		g_error_free (error);
+		g_critical ("failed to find ioBase in proxy response");
 		goto out;
 	}
 
-	reader = json_reader_new(json_parser_get_root(parser));
-	if (!reader) {
-		g_critical("failed to create reader");
+	*ioBase = (int)value;
+
+out:
+	cc_proxy_request_clear (&req);
+
+	return ret;
+}
+
+/**
+ * Attach to a VM and allocate its I/O streams in a single
+ * round trip to the proxy.
+ *
+ * \param proxy \ref cc_proxy.
+ * \param container_id container id.
+ * \param[out] proxy_io_fd I/O fd passed by the proxy.
+ * \param[out] ioBase First I/O stream sequence number.
+ * \param tty \c true if the workload is run interactively.
+ *
+ * \return \c true on success, else \c false.
+ */
+gboolean
+cc_proxy_attach_allocate_io (struct cc_proxy *proxy,
+		const char *container_id,
+		int *proxy_io_fd,
+		int *ioBase,
+		bool tty)
+{
+	struct cc_proxy_request requests[2] = { { 0 } };
+	gboolean ret = false;
+	gint64   value;
+
+	if (! (proxy && proxy->socket && container_id
+				&& proxy_io_fd && ioBase)) {
+		return false;
+	}
+
+	requests[1].oob_fd = proxy_io_fd;
+
+	if (! (cc_proxy_attach_request (&requests[0], container_id)
+			&& cc_proxy_allocate_io_request (proxy, &requests[1],
+				tty))) {
 		goto out;
 	}
 
-	ret = json_reader_read_member (reader, "data");
-	if (! ret) {
-		g_critical ("failed to find proxy data");
+	if (! cc_proxy_run_cmds (proxy, requests, G_N_ELEMENTS (requests))) {
+		g_critical ("failed to run proxy commands attach "
+				"and allocateIO");
 		goto out;
 	}
 
-	ret = json_reader_read_member (reader, "ioBase");
+	ret = cc_proxy_response_get_int (&requests[1], "ioBase", &value);
 	if (! ret) {
-		g_critical ("failed to find ioBase");
+		g_critical ("failed to find ioBase in proxy response");
 		goto out;
 	}
 
-	*ioBase = (int) json_reader_get_int_value(reader);
-
-	json_reader_end_member (reader);
-
-	ret = true;
+	*ioBase = (int)value;
 
 out:
-	if (reader) {
-		g_object_unref (reader);
-	}
-	if (parser) {
-		g_object_unref (parser);
-	}
-	if (msg_received) {
-		g_string_free(msg_received, true);
-	}
-	if (obj) {
-		json_object_unref (obj);
+	for (guint i = 0; i < G_N_ELEMENTS (requests); i++) {
+		cc_proxy_request_clear (&requests[i]);
 	}
 
 	return ret;
 }
 
 /**
- * Connect to \ref CC_OCI_PROXY and wait until it is ready.
+ * Wait for the agent CTL socket to be created by the hypervisor.
  *
  * \param config \ref cc_oci_config.
  *
  * \return \c true on success, else \c false.
  */
-gboolean
-cc_proxy_wait_until_ready (struct cc_oci_config *config)
+static gboolean
+cc_proxy_wait_for_agent (struct cc_oci_config *config)
 {
 	GFile             *ctl_file = NULL;
 	GFileMonitor      *monitor = NULL;
 	GMainLoop         *loop = NULL;
 	struct stat        st;
+	gboolean           ret = false;
 
 	if (! (config && config->proxy
 				&& config->proxy->agent_ctl_socket)) {
@@ -1044,9 +1448,8 @@ cc_proxy_wait_until_ready (struct cc_oci_config *config)
 		}
 	}
 
-	if (! cc_proxy_cmd_hello (config->proxy, config->optarg_container_id)) {
-		return false;
-	}
+	ret = true;
+
 out:
 	if (loop) {
 		g_main_loop_unref(loop);
@@ -1058,7 +1461,7 @@ out:
 		g_object_unref(monitor);
 	}
 
-	return true;
+	return ret;
 }
 
 /**
@@ -1076,87 +1479,30 @@ static gboolean
 cc_proxy_run_hyper_cmd (struct cc_oci_config *config,
 		const char *cmd, JsonObject *payload)
 {
-	JsonObject        *obj = NULL;
-	JsonObject        *data = NULL;
-	JsonNode          *root = NULL;
-	JsonGenerator     *generator = NULL;
-	gboolean           ret = false;
-	gchar             *msg_to_send = NULL;
-	GString           *msg_received = NULL;
+	struct cc_proxy_request req = { 0 };
 
 	/* data is optional */
-	if (! (config && cmd)) {
+	if (! (config && config->proxy && cmd)) {
 		return false;
 	}
 
-	obj = json_object_new ();
-	data = json_object_new ();
-
-	/* tell the proxy to run in pass-through mode and forward
-	 * the request on to hyperstart in the VM.
-	 */
-	json_object_set_string_member (obj, "id", "hyper");
-
-	/* add the hyper command name and the data to pass to the
-	 * command.
-	 */
-	json_object_set_string_member (data, "hyperName", cmd);
-	json_object_set_object_member (data, "data", payload);
-
-	json_object_set_object_member (obj, "data", data);
-
-	root = json_node_new (JSON_NODE_OBJECT);
-	generator = json_generator_new ();
-	json_node_take_object (root, obj);
-
-	json_generator_set_root (generator, root);
-	g_object_set (generator, "pretty", FALSE, NULL);
-
-	msg_to_send = json_generator_to_data (generator, NULL);
-
-	msg_received = g_string_new("");
-
-	if (! msg_received ) {
-		goto out;
-	}
-
-	if (! cc_proxy_run_cmd(config->proxy, msg_to_send, msg_received, NULL)) {
-		g_critical("failed to run hyper cmd %s: %s",
-				cmd,
-				msg_received->str);
-		goto out;
-	}
-
-	g_debug("msg received: %s", msg_received->str);
-
-	ret = true;
-
-out:
-	if (msg_received) {
-		g_string_free(msg_received, true);
-	}
-	if (obj) {
-		json_object_unref (obj);
-	}
-
-	return ret;
+	return cc_proxy_run_cmd (config->proxy, cmd, &req,
+			cc_proxy_hyper_request (config->proxy, &req,
+				cmd, payload));
 }
 
 /**
- * Request \ref CC_OCI_PROXY create a new POD (container group).
- *
- * \note Must already be connected to the proxy.
+ * Build the hyper "startpod" payload used to create a new POD.
  *
  * \param config \ref cc_oci_config.
  *
- * \return \c true on success, else \c false.
+ * \return \c JsonObject on success, else \c NULL.
  */
-gboolean
-cc_proxy_hyper_pod_create (struct cc_oci_config *config)
+static JsonObject *
+cc_proxy_pod_create_payload (struct cc_oci_config *config)
 {
 	JsonObject                   *data = NULL;
 	JsonArray                    *array = NULL;
-	gboolean                      ret = false;
 	JsonArray                    *iface_array = NULL;
 	JsonObject                   *iface_data = NULL;
 	struct cc_oci_net_if_cfg     *if_cfg = NULL;
@@ -1169,8 +1515,8 @@ cc_proxy_hyper_pod_create (struct cc_oci_config *config)
 	JsonObject                   *route_data = NULL;
 	struct cc_oci_net_ipv4_route *route = NULL;
 
-	if (! (config && config->proxy && config->net.hostname)) {
-		return false;
+	if (! (config && config->net.hostname)) {
+		return NULL;
 	}
 
 	/* json stanza for create pod (STARTPOD without containers)*/
@@ -1257,20 +1603,90 @@ cc_proxy_hyper_pod_create (struct cc_oci_config *config)
 
 	json_object_set_array_member(data, "routes", routes_array);
 
-	if (! cc_proxy_run_hyper_cmd (config, "startpod", data)) {
-		g_critical("failed to run pod create");
-		goto out;
+	g_strfreev(ifnames);
+
+	return data;
+}
+
+/**
+ * Wait for the VM agent, then register the VM with \ref CC_OCI_PROXY,
+ * create the POD and allocate the I/O streams of the initial workload.
+ *
+ * The "hello", "startpod" and "allocateIO" commands are pipelined so
+ * that they cost a single round trip to the proxy.
+ *
+ * \note Must already be connected to the proxy.
+ *
+ * \param config \ref cc_oci_config.
+ * \param[out] proxy_io_fd I/O fd passed by the proxy.
+ * \param[out] ioBase First I/O stream sequence number.
+ *
+ * \return \c true on success, else \c false.
+ */
+gboolean
+cc_proxy_hyper_pod_start (struct cc_oci_config *config,
+		int *proxy_io_fd,
+		int *ioBase)
+{
+	struct cc_proxy_request  requests[3] = { { 0 } };
+	struct cc_proxy         *proxy;
+	JsonObject              *data = NULL;
+	gboolean                 ret = false;
+	gint64                   value;
+
+	if (! (config && config->proxy && config->proxy->socket
+				&& proxy_io_fd && ioBase)) {
+		return false;
 	}
 
-	ret = true;
+	proxy = config->proxy;
 
-out:
-	if (data) {
+	data = cc_proxy_pod_create_payload (config);
+	if (! data) {
+		return false;
+	}
+
+	if (! cc_proxy_wait_for_agent (config)) {
+		json_object_unref (data);
+		return false;
+	}
+
+	/* The encoding is negotiated by hello, so the whole batch
+	 * uses whatever was in effect before it was sent.
+	 */
+	requests[2].oob_fd = proxy_io_fd;
+
+	if (! cc_proxy_hello_request (proxy, &requests[0],
+				config->optarg_container_id)) {
 		json_object_unref (data);
+		goto out;
+	}
+
+	/* data is now owned by the startpod request */
+	if (! (cc_proxy_hyper_request (proxy, &requests[1],
+				"startpod", data)
+			&& cc_proxy_allocate_io_request (proxy, &requests[2],
+				config->oci.process.terminal))) {
+		goto out;
+	}
+
+	if (! cc_proxy_run_cmds (proxy, requests, G_N_ELEMENTS (requests))) {
+		g_critical ("failed to run proxy commands hello, startpod "
+				"and allocateIO");
+		goto out;
 	}
 
-	if (ifnames) {
-		g_strfreev(ifnames);
+	ret = cc_proxy_response_get_int (&requests[2], "ioBase", &value);
+	if (! ret) {
+		g_critical ("failed to find ioBase in proxy response");
+		goto out;
+	}
+
+	*ioBase = (int)value;
+
+out:
+	for (guint i = 0; i < G_N_ELEMENTS (requests); i++) {
+		cc_proxy_request_clear (&requests[i]);
 	}
 
 	return ret;
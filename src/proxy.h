@@ -43,14 +43,32 @@
  */
 #define OOB_FD_FLAG 'F'
 
+/*
+ * Header flag set when the payload uses the compact binary
+ * encoding rather than JSON. The proxy only understands it
+ * from protocol version PROXY_BINARY_VERSION.
+ */
+#define PROXY_MSG_FLAG_BINARY 0x1
+#define PROXY_BINARY_VERSION  2
+
+/* Binary encoding request op codes */
+#define PROXY_BINARY_OP_HELLO       1
+#define PROXY_BINARY_OP_ATTACH      2
+#define PROXY_BINARY_OP_BYE         3
+#define PROXY_BINARY_OP_ALLOCATE_IO 4
+#define PROXY_BINARY_OP_HYPER       5
+
 gboolean cc_proxy_connect (struct cc_proxy *proxy);
 gboolean cc_proxy_disconnect (struct cc_proxy *proxy);
 gboolean cc_proxy_attach (struct cc_proxy *proxy, const char *container_id);
-gboolean cc_proxy_wait_until_ready (struct cc_oci_config *config);
-gboolean cc_proxy_hyper_pod_create (struct cc_oci_config *config);
+gboolean cc_proxy_hyper_pod_start (struct cc_oci_config *config,
+		int *proxy_io_fd, int *ioBase);
 gboolean cc_proxy_cmd_bye (struct cc_proxy *proxy, const char *container_id);
 gboolean cc_proxy_cmd_allocate_io (struct cc_proxy *proxy, int *proxy_io_fd,
 		int *ioBase, bool tty);
+gboolean cc_proxy_attach_allocate_io (struct cc_proxy *proxy,
+		const char *container_id, int *proxy_io_fd, int *ioBase,
+		bool tty);
 gboolean
 cc_proxy_hyper_kill_container (struct cc_oci_config *config, int signum);
 gboolean cc_proxy_hyper_destroy_pod (struct cc_oci_config *config);
@@ -0,0 +1,989 @@
+/*
+ * This file is part of cc-oci-runtime.
+ *
+ * Copyright (C) 2017 Intel Corporation
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+/**
+ * \file
+ *
+ * Container registry.
+ *
+ * The registry indexes the containers below a runtime root directory
+ * so that "list" can report on all of them by reading a single file
+ * rather than parsing every \ref CC_OCI_STATE_FILE.
+ *
+ * \ref CC_OCI_REGISTRY_FILE is a \ref cc_oci_registry_header followed
+ * by fixed-size \ref cc_oci_registry_record records. A state change
+ * only writes the record of the container concerned (and the header
+ * when records are added or removed) in place; the file is only
+ * replaced, atomically, when it is rebuilt. Writers serialise on an
+ * exclusive \c flock(2) of \ref CC_OCI_REGISTRY_DIR and readers take
+ * a shared one, so that they never see a partial update.
+ *
+ * The state files remain authoritative: the registry is rebuilt from
+ * them whenever it is missing or invalid, or when the root directory
+ * has been modified since the registry was last written (for example
+ * if a container directory was removed by hand).
+ */
+
+#include <stdbool.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/file.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include <glib.h>
+#include <glib/gstdio.h>
+
+#include "oci.h"
+#include "state.h"
+#include "registry.h"
+#include "common.h"
+
+/** A mapped \ref CC_OCI_REGISTRY_FILE. */
+struct cc_oci_registry_map {
+	/** Start of mapping. */
+	gpointer                              addr;
+
+	/** Size of mapping. */
+	gsize                                 size;
+
+	const struct cc_oci_registry_header  *header;
+	const struct cc_oci_registry_record  *records;
+};
+
+/*!
+ * Determine whether the registry was written against the current
+ * contents of the root directory.
+ *
+ * \param header \ref cc_oci_registry_header.
+ * \param st Status of the root directory.
+ *
+ * \return \c true if \p header matches \p st, else \c false.
+ */
+static gboolean
+cc_oci_registry_matches (const struct cc_oci_registry_header *header,
+		const struct stat *st)
+{
+	return header->root_mtime_sec == (gint64)st->st_mtim.tv_sec
+		&& header->root_mtime_nsec == (gint64)st->st_mtim.tv_nsec;
+}
+
+/*!
+ * Lock the registry.
+ *
+ * \param root_dir Runtime root directory.
+ * \param create If \c true, create \ref CC_OCI_REGISTRY_DIR if it does
+ *   not exist.
+ * \param operation \c LOCK_EX to write the registry, \c LOCK_SH to
+ *   read it.
+ *
+ * \return Locked file descriptor to close to unlock on success,
+ * else -1.
+ */
+static int
+cc_oci_registry_lock (const char *root_dir, gboolean create,
+		int operation)
+{
+	g_autofree gchar *dir = NULL;
+	int               fd;
+
+	dir = g_build_path ("/", root_dir, CC_OCI_REGISTRY_DIR, NULL);
+
+	if (create && g_mkdir (dir, CC_OCI_DIR_MODE) < 0
+			&& errno != EEXIST) {
+		g_debug ("failed to create directory %s: %s",
+				dir, strerror (errno));
+		return -1;
+	}
+
+	fd = open (dir, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+	if (fd < 0) {
+		g_debug ("failed to open %s: %s", dir, strerror (errno));
+		return -1;
+	}
+
+	while (flock (fd, operation) < 0) {
+		if (errno != EINTR) {
+			g_warning ("failed to lock %s: %s",
+					dir, strerror (errno));
+			close (fd);
+			return -1;
+		}
+	}
+
+	return fd;
+}
+
+/*!
+ * Map the registry.
+ *
+ * \param root_dir Runtime root directory.
+ * \param[out] map \ref cc_oci_registry_map.
+ *
+ * \return \c true if a valid registry was mapped, else \c false.
+ */
+static gboolean
+cc_oci_registry_map (const char *root_dir,
+		struct cc_oci_registry_map *map)
+{
+	g_autofree gchar                     *path = NULL;
+	const struct cc_oci_registry_header  *header;
+	struct stat                           st;
+	gpointer                              addr;
+	int                                   fd;
+
+	if (! (root_dir && map)) {
+		return false;
+	}
+
+	path = g_build_path ("/", root_dir, CC_OCI_REGISTRY_DIR,
+			CC_OCI_REGISTRY_FILE, NULL);
+
+	fd = open (path, O_RDONLY | O_CLOEXEC);
+	if (fd < 0) {
+		return false;
+	}
+
+	if (fstat (fd, &st) < 0
+			|| st.st_size < (off_t)sizeof (*header)) {
+		goto invalid;
+	}
+
+	addr = mmap (NULL, (size_t)st.st_size, PROT_READ, MAP_SHARED,
+			fd, 0);
+	if (addr == MAP_FAILED) {
+		goto invalid;
+	}
+
+	header = addr;
+
+	if (header->magic != CC_OCI_REGISTRY_MAGIC
+			|| header->version != CC_OCI_REGISTRY_VERSION
+			|| header->record_size != sizeof (struct cc_oci_registry_record)
+			|| (guint64)st.st_size != sizeof (*header) +
+			(guint64)header->count * header->record_size) {
+		munmap (addr, (size_t)st.st_size);
+		goto invalid;
+	}
+
+	close (fd);
+
+	map->addr = addr;
+	map->size = (gsize)st.st_size;
+	map->header = header;
+	map->records = (const struct cc_oci_registry_record *)(header + 1);
+
+	return true;
+
+invalid:
+	g_debug ("ignoring invalid registry %s", path);
+	close (fd);
+	return false;
+}
+
+/*!
+ * Unmap the registry.
+ *
+ * \param map \ref cc_oci_registry_map.
+ */
+static void
+cc_oci_registry_unmap (struct cc_oci_registry_map *map)
+{
+	munmap (map->addr, map->size);
+	memset (map, 0, sizeof (*map));
+}
+
+/*!
+ * Remove the registry, so that it is rebuilt next time it is used.
+ *
+ * \param root_dir Runtime root directory.
+ */
+static void
+cc_oci_registry_discard (const char *root_dir)
+{
+	g_autofree gchar *path = NULL;
+
+	path = g_build_path ("/", root_dir, CC_OCI_REGISTRY_DIR,
+			CC_OCI_REGISTRY_FILE, NULL);
+
+	(void)g_unlink (path);
+}
+
+/*!
+ * Write to the registry in place.
+ *
+ * \param fd File descriptor of \ref CC_OCI_REGISTRY_FILE.
+ * \param buf Data to write.
+ * \param len Size of \p buf.
+ * \param offset Offset in the file to write \p buf at.
+ *
+ * \return \c true on success, else \c false.
+ */
+static gboolean
+cc_oci_registry_pwrite (int fd, const void *buf, gsize len, off_t offset)
+{
+	const gchar  *p = buf;
+	ssize_t       ret;
+
+	while (len) {
+		ret = pwrite (fd, p, len, offset);
+		if (ret < 0 && errno == EINTR) {
+			continue;
+		}
+
+		if (ret <= 0) {
+			g_warning ("failed to write registry: %s",
+					ret < 0 ? strerror (errno) : "short write");
+			return false;
+		}
+
+		p += ret;
+		len -= (gsize)ret;
+		offset += ret;
+	}
+
+	return true;
+}
+
+/*!
+ * Determine the offset of a record in \ref CC_OCI_REGISTRY_FILE.
+ *
+ * \param i Index of the record.
+ *
+ * \return Offset of record \p i.
+ */
+static off_t
+cc_oci_registry_record_offset (guint32 i)
+{
+	return (off_t)(sizeof (struct cc_oci_registry_header) +
+			(gsize)i * sizeof (struct cc_oci_registry_record));
+}
+
+/*!
+ * Open the registry for writing, provided it is valid and
+ * corresponds to the specified root directory status.
+ *
+ * \note The registry must be locked.
+ *
+ * \param root_dir Runtime root directory.
+ * \param st Expected status of the root directory.
+ * \param[out] map \ref cc_oci_registry_map.
+ *
+ * \return File descriptor on success, else -1.
+ */
+static int
+cc_oci_registry_open (const char *root_dir, const struct stat *st,
+		struct cc_oci_registry_map *map)
+{
+	g_autofree gchar *path = NULL;
+	int               fd;
+
+	if (! cc_oci_registry_map (root_dir, map)) {
+		return -1;
+	}
+
+	if (! cc_oci_registry_matches (map->header, st)) {
+		cc_oci_registry_unmap (map);
+		return -1;
+	}
+
+	path = g_build_path ("/", root_dir, CC_OCI_REGISTRY_DIR,
+			CC_OCI_REGISTRY_FILE, NULL);
+
+	fd = open (path, O_WRONLY | O_CLOEXEC);
+	if (fd < 0) {
+		cc_oci_registry_unmap (map);
+		return -1;
+	}
+
+	return fd;
+}
+
+/*!
+ * Fill in a registry record.
+ *
+ * \param[out] record \ref cc_oci_registry_record.
+ * \param id Container id.
+ * \param bundle Bundle path.
+ * \param created ISO 8601 creation timestamp.
+ * \param pid Workload process ID.
+ * \param vm_pid Hypervisor process ID.
+ * \param status \ref oci_status.
+ *
+ * \return \c true on success, else \c false.
+ */
+static gboolean
+cc_oci_registry_record_set (struct cc_oci_registry_record *record,
+		const char *id,
+		const char *bundle,
+		const char *created,
+		GPid pid,
+		GPid vm_pid,
+		enum oci_status status)
+{
+	memset (record, 0, sizeof (*record));
+
+	if (! (id && *id)
+			|| g_strlcpy (record->id, id, sizeof (record->id))
+			>= sizeof (record->id)) {
+		return false;
+	}
+
+	if (g_strlcpy (record->bundle, bundle ? bundle : "",
+				sizeof (record->bundle)) >= sizeof (record->bundle)) {
+		record->flags |= CC_OCI_REGISTRY_RECORD_TRUNCATED;
+	}
+
+	if (g_strlcpy (record->created, created ? created : "",
+				sizeof (record->created)) >= sizeof (record->created)) {
+		record->flags |= CC_OCI_REGISTRY_RECORD_TRUNCATED;
+	}
+
+	record->pid = (gint32)pid;
+	record->vm_pid = (gint32)vm_pid;
+	record->status = (gint32)status;
+
+	return true;
+}
+
+/*!
+ * Read the state file of a container.
+ *
+ * \param root_dir Runtime root directory.
+ * \param id Container id.
+ *
+ * \return Newly-allocated \ref oci_state on success, else \c NULL.
+ */
+static struct oci_state *
+cc_oci_registry_state_read (const char *root_dir, const char *id)
+{
+	g_autofree gchar *path = NULL;
+
+	path = g_build_path ("/", root_dir, id, CC_OCI_STATE_FILE, NULL);
+
+	/* the container may be destroyed as this runs */
+	if (! g_file_test (path, G_FILE_TEST_EXISTS)) {
+		return NULL;
+	}
+
+	return cc_oci_state_file_read (path);
+}
+
+/*!
+ * Create the state of a container from its registry record.
+ *
+ * Only the values held by the record are set unless \p full is
+ * \c true (or the record is truncated), in which case the state file
+ * is read.
+ *
+ * \param root_dir Runtime root directory.
+ * \param record \ref cc_oci_registry_record.
+ * \param full If \c true, read the complete state.
+ *
+ * \return Newly-allocated \ref oci_state on success, else \c NULL.
+ */
+static struct oci_state *
+cc_oci_registry_record_to_state (const char *root_dir,
+		const struct cc_oci_registry_record *record,
+		gboolean full)
+{
+	struct oci_state  *state;
+	gchar             *id;
+
+	if (full || (record->flags & CC_OCI_REGISTRY_RECORD_TRUNCATED)) {
+		/* don't trust the mapped strings to be terminated */
+		id = g_strndup (record->id, sizeof (record->id));
+		state = cc_oci_registry_state_read (root_dir, id);
+		g_free (id);
+
+		return state;
+	}
+
+	state = g_new0 (struct oci_state, 1);
+	state->vm = g_new0 (struct cc_oci_vm_cfg, 1);
+
+	state->id = g_strndup (record->id, sizeof (record->id));
+	state->bundle_path = g_strndup (record->bundle,
+			sizeof (record->bundle));
+	state->create_time = g_strndup (record->created,
+			sizeof (record->created));
+	state->pid = (GPid)record->pid;
+	state->vm->pid = (GPid)record->vm_pid;
+	state->status = (enum oci_status)record->status;
+
+	return state;
+}
+
+/*!
+ * Create registry records from the state files below the root
+ * directory.
+ *
+ * The state files are read in parallel.
+ *
+ * \param root_dir Runtime root directory.
+ * \param[out] states If not \c NULL, set to a list of the
+ *   \ref oci_state read.
+ *
+ * \return Array of \ref cc_oci_registry_record on success,
+ * else \c NULL.
+ */
+static GArray *
+cc_oci_registry_scan (const char *root_dir, GSList **states)
+{
+	struct cc_oci_registry_record  record;
+	struct oci_state              *state;
+	GArray                        *records;
+	GPtrArray                     *names;
+	GPtrArray                     *files;
+	GPtrArray                     *read;
+	GDir                          *dir;
+	const gchar                   *name;
+	guint                          i;
+
+	dir = g_dir_open (root_dir, 0x0, NULL);
+	if (! dir) {
+		return NULL;
+	}
+
+	names = g_ptr_array_new_with_free_func (g_free);
+	files = g_ptr_array_new_with_free_func (g_free);
+
+	while ((name = g_dir_read_name (dir)) != NULL) {
+		/* CC_OCI_REGISTRY_DIR */
+		if (*name == '.') {
+			continue;
+		}
+
+		g_ptr_array_add (names, g_strdup (name));
+		g_ptr_array_add (files, g_build_path ("/", root_dir, name,
+					CC_OCI_STATE_FILE, NULL));
+	}
+
+	g_dir_close (dir);
+
+	read = cc_oci_state_files_read ((const gchar * const *)files->pdata,
+			files->len);
+
+	records = g_array_sized_new (false, false, sizeof (record),
+			read->len);
+
+	for (i = 0; i < read->len; i++) {
+		state = g_ptr_array_index (read, i);
+		if (! state) {
+			continue;
+		}
+
+		/* the state is now owned by the caller */
+		g_ptr_array_index (read, i) = NULL;
+
+		if (cc_oci_registry_record_set (&record,
+					g_ptr_array_index (names, i),
+					state->bundle_path,
+					state->create_time,
+					state->pid,
+					state->vm ? state->vm->pid : 0,
+					state->status)) {
+			g_array_append_val (records, record);
+		}
+
+		if (states) {
+			*states = g_slist_prepend (*states, state);
+		} else {
+			cc_oci_state_free (state);
+		}
+	}
+
+	g_ptr_array_free (read, true);
+	g_ptr_array_free (files, true);
+	g_ptr_array_free (names, true);
+
+	if (states) {
+		*states = g_slist_reverse (*states);
+	}
+
+	return records;
+}
+
+/*!
+ * Replace the registry.
+ *
+ * \param root_dir Runtime root directory.
+ * \param records Array of \ref cc_oci_registry_record.
+ * \param st Status of the root directory \p records correspond to.
+ *
+ * \return \c true on success, else \c false.
+ */
+static gboolean
+cc_oci_registry_write (const char *root_dir, const GArray *records,
+		const struct stat *st)
+{
+	struct cc_oci_registry_header   header = { 0 };
+	g_autofree gchar               *path = NULL;
+	g_autofree gchar               *data = NULL;
+	GError                         *err = NULL;
+	gsize                           len;
+
+	header.magic = CC_OCI_REGISTRY_MAGIC;
+	header.version = CC_OCI_REGISTRY_VERSION;
+	header.record_size = sizeof (struct cc_oci_registry_record);
+	header.count = records->len;
+	header.root_mtime_sec = (gint64)st->st_mtim.tv_sec;
+	header.root_mtime_nsec = (gint64)st->st_mtim.tv_nsec;
+
+	len = sizeof (header) + records->len * header.record_size;
+
+	data = g_malloc (len);
+	memcpy (data, &header, sizeof (header));
+	memcpy (data + sizeof (header), records->data,
+			records->len * header.record_size);
+
+	path = g_build_path ("/", root_dir, CC_OCI_REGISTRY_DIR,
+			CC_OCI_REGISTRY_FILE, NULL);
+
+	/* written to a temporary file, then renamed */
+	if (! g_file_set_contents (path, data, (gssize)len, &err)) {
+		g_warning ("failed to write registry %s: %s",
+				path, err->message);
+		g_error_free (err);
+
+		/* don't leave an out of date registry behind */
+		(void)g_unlink (path);
+
+		return false;
+	}
+
+	return true;
+}
+
+/*!
+ * Rebuild the registry from the state files.
+ *
+ * The registry must be locked if \p write is \c true.
+ *
+ * \param root_dir Runtime root directory.
+ * \param write If \c false, only read the state files.
+ * \param[out] states If not \c NULL, set to a list of the
+ *   \ref oci_state read.
+ *
+ * \return \c true on success, else \c false.
+ */
+static gboolean
+cc_oci_registry_rebuild (const char *root_dir, gboolean write,
+		GSList **states)
+{
+	GArray       *records;
+	struct stat   st;
+	gboolean      ret = true;
+
+	g_debug ("rebuilding registry for %s", root_dir);
+
+	/* taken before scanning so that changes made meanwhile
+	 * invalidate the new registry.
+	 */
+	if (stat (root_dir, &st) < 0) {
+		return false;
+	}
+
+	records = cc_oci_registry_scan (root_dir, states);
+	if (! records) {
+		return false;
+	}
+
+	if (write) {
+		ret = cc_oci_registry_write (root_dir, records, &st);
+	}
+
+	g_array_free (records, true);
+
+	return ret;
+}
+
+/*!
+ * Add, update or remove the record of a container.
+ *
+ * Only the record (and the header if the number of records changes)
+ * is written, in place. The registry is rebuilt if it does not match
+ * the root directory.
+ *
+ * \param config \ref cc_oci_config.
+ * \param record \ref cc_oci_registry_record to store,
+ *   or \c NULL to remove the record.
+ *
+ * \return \c true on success, else \c false.
+ */
+static gboolean
+cc_oci_registry_store (const struct cc_oci_config *config,
+		const struct cc_oci_registry_record *record)
+{
+	struct cc_oci_registry_map     map = { 0 };
+	struct cc_oci_registry_header  header;
+	g_autofree gchar              *root_dir = NULL;
+	g_autofree gchar              *id = NULL;
+	struct stat                    st;
+	gboolean                       ret = false;
+	guint32                        i;
+	int                            lock_fd;
+	int                            fd = -1;
+
+	if (config->state.runtime_path[0] != '/') {
+		return false;
+	}
+
+	root_dir = g_path_get_dirname (config->state.runtime_path);
+	id = g_path_get_basename (config->state.runtime_path);
+
+	lock_fd = cc_oci_registry_lock (root_dir, true, LOCK_EX);
+	if (lock_fd < 0) {
+		/* don't leave an out of date registry behind */
+		cc_oci_registry_discard (root_dir);
+		return false;
+	}
+
+	if (stat (root_dir, &st) < 0) {
+		goto out;
+	}
+
+	fd = cc_oci_registry_open (root_dir, &st, &map);
+	if (fd < 0) {
+		/* the state files already reflect this change */
+		ret = cc_oci_registry_rebuild (root_dir, true, NULL);
+		goto out;
+	}
+
+	header = *map.header;
+
+	for (i = 0; i < header.count; i++) {
+		if (! strncmp (map.records[i].id, id,
+					sizeof (map.records[i].id))) {
+			break;
+		}
+	}
+
+	if (record && i < header.count) {
+		ret = cc_oci_registry_pwrite (fd, record, sizeof (*record),
+				cc_oci_registry_record_offset (i));
+	} else if (record) {
+		/* a record beyond count makes the registry invalid
+		 * until the header is updated.
+		 */
+		header.count++;
+		ret = cc_oci_registry_pwrite (fd, record, sizeof (*record),
+				cc_oci_registry_record_offset (i))
+			&& cc_oci_registry_pwrite (fd, &header,
+					sizeof (header), 0);
+	} else if (i < header.count) {
+		struct cc_oci_registry_header invalid = header;
+
+		/* the last record replaces the one removed. Invalidate
+		 * the registry meanwhile, so that it is rebuilt if this
+		 * is interrupted.
+		 */
+		invalid.root_mtime_sec = -1;
+		header.count--;
+
+		ret = cc_oci_registry_pwrite (fd, &invalid,
+				sizeof (invalid), 0)
+			&& (i == header.count
+				|| cc_oci_registry_pwrite (fd,
+					&map.records[header.count],
+					sizeof (map.records[header.count]),
+					cc_oci_registry_record_offset (i)))
+			&& ftruncate (fd,
+				cc_oci_registry_record_offset (header.count)) == 0
+			&& cc_oci_registry_pwrite (fd, &header,
+					sizeof (header), 0);
+	} else {
+		ret = true;
+	}
+
+	if (! ret) {
+		cc_oci_registry_discard (root_dir);
+	}
+
+out:
+	if (fd >= 0) {
+		cc_oci_registry_unmap (&map);
+		close (fd);
+	}
+	close (lock_fd);
+
+	return ret;
+}
+
+/*!
+ * Add or update the registry record of a container.
+ *
+ * Called whenever the state file of the container is written.
+ *
+ * \param config \ref cc_oci_config.
+ * \param created_timestamp ISO 8601 timestamp for when VM Was created.
+ *
+ * \return \c true on success, else \c false.
+ */
+gboolean
+cc_oci_registry_update (const struct cc_oci_config *config,
+		const char *created_timestamp)
+{
+	struct cc_oci_registry_record  record;
+	g_autofree gchar              *id = NULL;
+
+	if (! (config && config->vm && created_timestamp)) {
+		return false;
+	}
+
+	id = g_path_get_basename (config->state.runtime_path);
+
+	if (! cc_oci_registry_record_set (&record, id,
+				config->bundle_path,
+				created_timestamp,
+				config->state.workload_pid,
+				config->vm->pid,
+				config->state.status)) {
+		return false;
+	}
+
+	return cc_oci_registry_store (config, &record);
+}
+
+/*!
+ * Remove the registry record of a container.
+ *
+ * Called when the state file of the container is deleted.
+ *
+ * \param config \ref cc_oci_config.
+ *
+ * \return \c true on success, else \c false.
+ */
+gboolean
+cc_oci_registry_remove (const struct cc_oci_config *config)
+{
+	if (! config) {
+		return false;
+	}
+
+	return cc_oci_registry_store (config, NULL);
+}
+
+/*!
+ * Record a change made by the runtime to the root directory
+ * (creating or removing a container directory) so that the registry
+ * is not considered out of date.
+ *
+ * Nothing is done if the registry did not match the root directory
+ * before the change.
+ *
+ * \param root_dir Runtime root directory.
+ * \param before Status of \p root_dir before the change.
+ */
+void
+cc_oci_registry_touch (const char *root_dir, const struct stat *before)
+{
+	struct cc_oci_registry_map     map = { 0 };
+	struct cc_oci_registry_header  header;
+	struct stat                    st;
+	int                            lock_fd;
+	int                            fd;
+
+	if (! (root_dir && before)) {
+		return;
+	}
+
+	lock_fd = cc_oci_registry_lock (root_dir, false, LOCK_EX);
+	if (lock_fd < 0) {
+		return;
+	}
+
+	if (stat (root_dir, &st) < 0
+			|| (st.st_mtim.tv_sec == before->st_mtim.tv_sec
+				&& st.st_mtim.tv_nsec == before->st_mtim.tv_nsec)) {
+		goto out;
+	}
+
+	fd = cc_oci_registry_open (root_dir, before, &map);
+	if (fd < 0) {
+		goto out;
+	}
+
+	header = *map.header;
+	header.root_mtime_sec = (gint64)st.st_mtim.tv_sec;
+	header.root_mtime_nsec = (gint64)st.st_mtim.tv_nsec;
+
+	if (! cc_oci_registry_pwrite (fd, &header, sizeof (header), 0)) {
+		cc_oci_registry_discard (root_dir);
+	}
+
+	cc_oci_registry_unmap (&map);
+	close (fd);
+
+out:
+	close (lock_fd);
+}
+
+/*!
+ * Determine the paths of the state files of all the containers in
+ * the registry.
+ *
+ * \param root_dir Runtime root directory.
+ * \param map Mapped registry.
+ *
+ * \return Array of newly-allocated paths.
+ */
+static GPtrArray *
+cc_oci_registry_state_paths (const char *root_dir,
+		const struct cc_oci_registry_map *map)
+{
+	GPtrArray  *files;
+	guint32     i;
+
+	files = g_ptr_array_new_full (map->header->count, g_free);
+
+	for (i = 0; i < map->header->count; i++) {
+		/* don't trust the mapped strings to be terminated */
+		g_autofree gchar *id = g_strndup (map->records[i].id,
+				sizeof (map->records[i].id));
+
+		g_ptr_array_add (files, g_build_path ("/", root_dir, id,
+					CC_OCI_STATE_FILE, NULL));
+	}
+
+	return files;
+}
+
+/*!
+ * Read state files in parallel.
+ *
+ * \param files Array of state file paths.
+ * \param[out] states List of \ref oci_state read, prepended to
+ *   (in reverse order).
+ */
+static void
+cc_oci_registry_list_full (const GPtrArray *files, GSList **states)
+{
+	GPtrArray  *read;
+	guint       i;
+
+	read = cc_oci_state_files_read ((const gchar * const *)files->pdata,
+			files->len);
+
+	for (i = 0; i < read->len; i++) {
+		if (g_ptr_array_index (read, i)) {
+			*states = g_slist_prepend (*states,
+					g_ptr_array_index (read, i));
+			g_ptr_array_index (read, i) = NULL;
+		}
+	}
+
+	g_ptr_array_free (read, true);
+}
+
+/*!
+ * List the containers below a runtime root directory.
+ *
+ * The registry is rebuilt if required.
+ *
+ * \param root_dir Runtime root directory.
+ * \param full If \c true, read the complete state of each container,
+ *   else only set the values held in the registry (\ref oci_state
+ *   id, pid, bundle_path, status, create_time and vm->pid).
+ * \param[out] states List of \ref oci_state.
+ *
+ * \return \c true on success, else \c false.
+ */
+gboolean
+cc_oci_registry_list (const char *root_dir, gboolean full,
+		GSList **states)
+{
+	struct cc_oci_registry_map  map;
+	struct oci_state           *state;
+	GPtrArray                  *files = NULL;
+	struct stat                 st;
+	gboolean                    matched = false;
+	guint32                     i;
+	int                         fd;
+
+	if (! (root_dir && states)) {
+		return false;
+	}
+
+	*states = NULL;
+
+	if (stat (root_dir, &st) < 0) {
+		/* No containers yet, so not an error */
+		return errno == ENOENT;
+	}
+
+	/* keeps writers from updating the registry as it is read. If
+	 * there's no registry yet, it is rebuilt below.
+	 */
+	fd = cc_oci_registry_lock (root_dir, false, LOCK_SH);
+
+	if (cc_oci_registry_map (root_dir, &map)) {
+		matched = cc_oci_registry_matches (map.header, &st);
+
+		if (matched && full) {
+			files = cc_oci_registry_state_paths (root_dir, &map);
+		} else if (matched) {
+			for (i = 0; i < map.header->count; i++) {
+				state = cc_oci_registry_record_to_state (root_dir,
+						&map.records[i], false);
+				if (state) {
+					*states = g_slist_prepend (*states,
+							state);
+				}
+			}
+		}
+
+		cc_oci_registry_unmap (&map);
+	}
+
+	if (fd >= 0) {
+		close (fd);
+	}
+
+	if (matched) {
+		/* the state files are read without holding the lock */
+		if (files) {
+			cc_oci_registry_list_full (files, states);
+			g_ptr_array_free (files, true);
+		}
+
+		*states = g_slist_reverse (*states);
+
+		return true;
+	}
+
+	/* if the registry can't be locked (say, the root directory is
+	 * read-only), simply read the state files.
+	 */
+	fd = cc_oci_registry_lock (root_dir, true, LOCK_EX);
+
+	/* the state files have been read even if the registry
+	 * couldn't be written.
+	 */
+	(void)cc_oci_registry_rebuild (root_dir, fd >= 0, states);
+
+	if (fd >= 0) {
+		close (fd);
+	}
+
+	return true;
+}
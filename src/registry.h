@@ -0,0 +1,113 @@
+/*
+ * This file is part of cc-oci-runtime.
+ *
+ * Copyright (C) 2017 Intel Corporation
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+#ifndef _CC_OCI_REGISTRY_H
+#define _CC_OCI_REGISTRY_H
+
+#include <limits.h>
+#include <sys/stat.h>
+
+#include <glib.h>
+
+#include "oci.h"
+
+/** Directory below the runtime root directory holding the
+ * container registry.
+ */
+#define CC_OCI_REGISTRY_DIR		".registry"
+
+/** Container registry index file, below \ref CC_OCI_REGISTRY_DIR. */
+#define CC_OCI_REGISTRY_FILE		"index"
+
+/** Identifies a \ref CC_OCI_REGISTRY_FILE ("CCRG"). */
+#define CC_OCI_REGISTRY_MAGIC		0x43435247
+
+/** Version of the \ref CC_OCI_REGISTRY_FILE format. */
+#define CC_OCI_REGISTRY_VERSION		1
+
+/** Space reserved for the bundle path in a registry record. */
+#define CC_OCI_REGISTRY_BUNDLE_LEN	512
+
+/** Space reserved for the creation timestamp in a registry record. */
+#define CC_OCI_REGISTRY_CREATED_LEN	64
+
+/** Set in \ref cc_oci_registry_record.flags if a value did not fit
+ * in the record, in which case the state file must be read.
+ */
+#define CC_OCI_REGISTRY_RECORD_TRUNCATED	(1 << 0)
+
+/** Header of \ref CC_OCI_REGISTRY_FILE.
+ *
+ * The header is followed by \c count records of
+ * \ref cc_oci_registry_record.
+ */
+struct cc_oci_registry_header {
+	/** \ref CC_OCI_REGISTRY_MAGIC. */
+	guint32  magic;
+
+	/** \ref CC_OCI_REGISTRY_VERSION. */
+	guint32  version;
+
+	/** Size of \ref cc_oci_registry_record. */
+	guint32  record_size;
+
+	/** Number of records. */
+	guint32  count;
+
+	/** Modification time of the runtime root directory the
+	 * records were last checked against.
+	 */
+	gint64   root_mtime_sec;
+	gint64   root_mtime_nsec;
+};
+
+/** Summary of a container, as displayed by "list". */
+struct cc_oci_registry_record {
+	/** Container id (also the runtime directory name). */
+	gchar    id[NAME_MAX+1];
+
+	/** Bundle path. */
+	gchar    bundle[CC_OCI_REGISTRY_BUNDLE_LEN];
+
+	/** ISO 8601 creation timestamp. */
+	gchar    created[CC_OCI_REGISTRY_CREATED_LEN];
+
+	/** Workload process ID. */
+	gint32   pid;
+
+	/** Hypervisor process ID. */
+	gint32   vm_pid;
+
+	/** \ref oci_status. */
+	gint32   status;
+
+	/** CC_OCI_REGISTRY_RECORD_* flags. */
+	guint32  flags;
+};
+
+gboolean cc_oci_registry_update (const struct cc_oci_config *config,
+		const char *created_timestamp);
+gboolean cc_oci_registry_remove (const struct cc_oci_config *config);
+void cc_oci_registry_touch (const char *root_dir,
+		const struct stat *before);
+gboolean cc_oci_registry_list (const char *root_dir, gboolean full,
+		GSList **states);
+
+#endif /* _CC_OCI_REGISTRY_H */
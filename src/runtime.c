@@ -21,6 +21,7 @@
 #include <stdbool.h>
 #include <string.h>
 #include <errno.h>
+#include <sys/stat.h>
 
 #include <glib.h>
 #include <glib/gstdio.h>
@@ -28,6 +29,7 @@
 #include "oci.h"
 #include "util.h"
 #include "runtime.h"
+#include "registry.h"
 
 /*!
  * Update the specified config with the runtime path.
@@ -68,6 +70,9 @@ gboolean
 cc_oci_runtime_dir_setup (struct cc_oci_config *config)
 {
 	g_autofree gchar *dirname = NULL;
+	struct stat       st;
+	gboolean          have_st;
+	gboolean          ret;
 
 	if (! config) {
 		return false;
@@ -107,18 +112,33 @@ cc_oci_runtime_dir_setup (struct cc_oci_config *config)
 
 	g_debug ("creating directory %s", config->state.runtime_path);
 
-	return ! g_mkdir_with_parents (config->state.runtime_path, CC_OCI_DIR_MODE);
+	have_st = stat (dirname, &st) == 0;
+
+	ret = ! g_mkdir_with_parents (config->state.runtime_path, CC_OCI_DIR_MODE);
+
+	if (ret && have_st) {
+		cc_oci_registry_touch (dirname, &st);
+	}
+
+	return ret;
 }
 
 /*!
  * Recursively delete the runtime directory specified by \p config.
  *
+ * If \ref cc_oci_config.async_delete is set, the directory is only
+ * moved out of the way and its contents are removed in the background.
+ *
  * \param config \ref cc_oci_config.
  * \return \c true on success, else \c false.
  */
 gboolean
 cc_oci_runtime_dir_delete (struct cc_oci_config *config)
 {
+	g_autofree gchar *dirname = NULL;
+	struct stat       st;
+	gboolean          have_st;
+
 	if (! config) {
 		return false;
 	}
@@ -126,5 +146,21 @@ cc_oci_runtime_dir_delete (struct cc_oci_config *config)
 		return false;
 	}
 
-	return cc_oci_rm_rf (config->state.runtime_path);
+	dirname = g_path_get_dirname (config->state.runtime_path);
+
+	have_st = stat (dirname, &st) == 0;
+
+	if (config->async_delete) {
+		if (! cc_oci_rm_rf_async (config->state.runtime_path)) {
+			return false;
+		}
+	} else if (! cc_oci_rm_rf (config->state.runtime_path)) {
+		return false;
+	}
+
+	if (have_st) {
+		cc_oci_registry_touch (dirname, &st);
+	}
+
+	return true;
 }
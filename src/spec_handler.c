@@ -23,7 +23,6 @@
 #include "json.h"
 #include "common.h"
 
-
 /*!
  * If the virtual machine attribute ("vm") in config is NULL,
  * this function will create create it using the json from
@@ -24,8 +24,14 @@
  * State-handling routines.
  */
 
+#include <stdlib.h>
 #include <string.h>
 #include <stdbool.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
 
 #include <glib.h>
 #include <glib/gstdio.h>
@@ -41,6 +47,13 @@
 #include "json.h"
 #include "config.h"
 #include "spec_handler.h"
+#include "timing.h"
+#include "registry.h"
+
+/** Maximum number of state files read without using threads by
+ * \ref cc_oci_state_files_read().
+ */
+#define CC_OCI_STATE_READ_SERIAL_MAX 8
 
 #define update_subelements_and_strdup(node, data, member) \
 	if (node && node->data) { \
@@ -66,41 +79,58 @@ static void handle_state_proxy_section(GNode*, struct handler_data*);
 static void handle_state_pod_section(GNode*, struct handler_data*);
 static void handle_state_annotations_section(GNode*, struct handler_data*);
 static void handle_state_process_section(GNode* node, struct handler_data* data);
+static void handle_state_timings_section(GNode*, struct handler_data*);
 
 /*! Used to handle each section in \ref CC_OCI_STATE_FILE. */
-static struct state_handler {
+static const struct state_handler {
 	/** Name of JSON element in \ref CC_OCI_STATE_FILE. */
 	const char* name;
 
 	/** Function to handle JSON element. */
 	void (*handle_section)(GNode* node, struct handler_data* state);
 
-	/** Set to zero if element is optional. */
-	const size_t subelements_needed;
-
-	/** A state handler is considered to have run successfully if
-	 * this value matches \ref subelements_needed.
+	/** Set to zero if element is optional. A state handler is
+	 * considered to have run successfully if the number of
+	 * subelements it found (\ref state_read_data.subelements_count)
+	 * matches this value.
 	 */
-	size_t subelements_count;
+	const size_t subelements_needed;
 } state_handlers[] = {
-	{ "ociVersion"  , handle_state_ociVersion_section  , 1 , 0 },
-	{ "id"          , handle_state_id_section          , 1 , 0 },
-	{ "pid"         , handle_state_pid_section         , 1 , 0 },
-	{ "bundlePath"  , handle_state_bundlePath_section  , 1 , 0 },
-	{ "commsPath"   , handle_state_commsPath_section   , 1 , 0 },
-	{ "processPath" , handle_state_processPath_section , 1 , 0 },
-	{ "status"      , handle_state_status_section      , 1 , 0 },
-	{ "created"     , handle_state_created_section     , 1 , 0 },
-	{ "mounts"      , handle_state_mounts_section      , 0 , 0 },
-	{ "console"     , handle_state_console_section     , 0 , 0 },
-	{ "vm"          , handle_state_vm_section          , 6 , 0 },
-	{ "proxy"       , handle_state_proxy_section       , 2 , 0 },
-	{ "pod"         , handle_state_pod_section         , 0 , 0 },
-	{ "annotations" , handle_state_annotations_section , 0 , 0 },
-	{ "namespaces"  , handle_state_namespaces_section  , 0 , 0 },
+	{ "ociVersion"  , handle_state_ociVersion_section  , 1 },
+	{ "id"          , handle_state_id_section          , 1 },
+	{ "pid"         , handle_state_pid_section         , 1 },
+	{ "bundlePath"  , handle_state_bundlePath_section  , 1 },
+	{ "commsPath"   , handle_state_commsPath_section   , 1 },
+	{ "processPath" , handle_state_processPath_section , 1 },
+	{ "status"      , handle_state_status_section      , 1 },
+	{ "created"     , handle_state_created_section     , 1 },
+	{ "mounts"      , handle_state_mounts_section      , 0 },
+	{ "console"     , handle_state_console_section     , 0 },
+	{ "vm"          , handle_state_vm_section          , 6 },
+	{ "proxy"       , handle_state_proxy_section       , 2 },
+	{ "pod"         , handle_state_pod_section         , 0 },
+	{ "annotations" , handle_state_annotations_section , 0 },
+	{ "namespaces"  , handle_state_namespaces_section  , 0 },
+	{ "timings"     , handle_state_timings_section     , 0 },
 
 	/* terminator */
-	{ NULL, NULL, 0, 0 }
+	{ NULL, NULL, 0 }
+};
+
+/*!
+ * Data used while reading a single \ref CC_OCI_STATE_FILE.
+ *
+ * This is kept separate from \ref state_handlers so that several
+ * state files can be read concurrently.
+ */
+struct state_read_data {
+	/** State being filled in. */
+	struct oci_state *state;
+
+	/** Number of subelements found by each of the
+	 * \ref state_handlers.
+	 */
+	size_t subelements_count[G_N_ELEMENTS (state_handlers)];
 };
 
 /*!
@@ -543,6 +573,32 @@ handle_state_process_section(GNode* node, struct handler_data* data)
 	*data->state->process = config.oci.process;
 }
 
+/*!
+ * handler for timings section
+ *
+ * \param node \c GNode.
+ * \param data \ref handler_data.
+ */
+static void
+handle_state_timings_section(GNode* node, struct handler_data* data)
+{
+	struct cc_oci_timings *timings;
+
+	if (! (node && node->data)) {
+		return;
+	}
+
+	g_assert(data->state);
+
+	timings = cc_oci_timings_from_node (node);
+	if (! timings) {
+		return;
+	}
+
+	data->state->timings = g_slist_append(data->state->timings,
+			timings);
+}
+
 /*!
  * process all sections in state.json using the right section handler
  *
@@ -550,9 +606,9 @@ handle_state_process_section(GNode* node, struct handler_data* data)
  * \param state \ref oci_state.
  */
 static void
-handle_state_sections(GNode* node, struct oci_state* state) {
-	struct state_handler* handler;
-	struct handler_data data = { .state=state };
+handle_state_sections(GNode* node, struct state_read_data* read_data) {
+	const struct state_handler* handler;
+	struct handler_data data = { .state=read_data->state };
 
 	if (! (node && node->data)) {
 		return;
@@ -560,7 +616,8 @@ handle_state_sections(GNode* node, struct oci_state* state) {
 
 	for (handler=state_handlers; handler->name; handler++) {
 		if (g_strcmp0(handler->name, node->data) == 0) {
-			data.subelements_count = &handler->subelements_count;
+			data.subelements_count =
+				&read_data->subelements_count[handler - state_handlers];
 			g_node_children_foreach(node, G_TRAVERSE_ALL,
 				(GNodeForeachFunc)handler->handle_section, &data);
 			return;
@@ -626,6 +683,171 @@ cc_oci_state_file_exists (struct cc_oci_config *config)
 			G_FILE_TEST_EXISTS);
 }
 
+/*!
+ * Write \ref CC_OCI_STATE_BIN_FILE for the state file just written.
+ *
+ * On failure, any existing file is removed so that it cannot be
+ * mistaken for the current state.
+ *
+ * \param config \ref cc_oci_config.
+ *
+ * \return \c true on success, else \c false.
+ */
+static gboolean
+cc_oci_state_bin_write (const struct cc_oci_config *config)
+{
+	struct cc_oci_state_bin  bin;
+	g_autofree gchar        *path = NULL;
+	struct stat              st;
+	GError                  *err = NULL;
+
+	path = g_build_path ("/", config->state.runtime_path,
+			CC_OCI_STATE_BIN_FILE, NULL);
+
+	/* identifies the state file the values correspond to */
+	if (stat (config->state.state_file_path, &st) < 0) {
+		goto err;
+	}
+
+	memset (&bin, 0, sizeof (bin));
+
+	bin.magic = CC_OCI_STATE_BIN_MAGIC;
+	bin.version = CC_OCI_STATE_BIN_VERSION;
+	bin.size = (guint32)sizeof (bin);
+	bin.status = (gint32)config->state.status;
+	bin.pid = (gint32)config->state.workload_pid;
+	bin.vm_pid = config->vm ? (gint32)config->vm->pid : 0;
+	bin.state_ino = (guint64)st.st_ino;
+	bin.state_size = (gint64)st.st_size;
+	bin.state_mtime_sec = (gint64)st.st_mtim.tv_sec;
+	bin.state_mtime_nsec = (gint64)st.st_mtim.tv_nsec;
+
+	g_strlcpy (bin.comms_path, config->state.comms_path,
+			sizeof (bin.comms_path));
+
+	if (! g_file_set_contents (path, (const gchar *)&bin,
+				(gssize)sizeof (bin), &err)) {
+		g_debug ("failed to create %s: %s", path, err->message);
+		g_error_free (err);
+		goto err;
+	}
+
+	return true;
+
+err:
+	(void)g_unlink (path);
+	return false;
+}
+
+/*!
+ * Update the binary state file and registry after the state file
+ * has been written.
+ *
+ * These are only caches of the state file, so failing to update them
+ * is not fatal.
+ *
+ * \param config \ref cc_oci_config.
+ * \param created_timestamp ISO 8601 timestamp of container creation.
+ */
+static void
+cc_oci_state_file_written (const struct cc_oci_config *config,
+		const char *created_timestamp)
+{
+	if (! cc_oci_state_bin_write (config)) {
+		g_warning ("failed to create %s for %s",
+				CC_OCI_STATE_BIN_FILE,
+				config->state.runtime_path);
+	}
+
+	if (! cc_oci_registry_update (config, created_timestamp)) {
+		g_warning ("failed to update registry for %s",
+				config->state.runtime_path);
+	}
+}
+
+/*!
+ * Read the hot fields of the state of a container (status, PIDs and
+ * comms path) from \ref CC_OCI_STATE_BIN_FILE, without parsing
+ * \ref CC_OCI_STATE_FILE.
+ *
+ * \param runtime_path Runtime directory of the container.
+ * \param[out] bin \ref cc_oci_state_bin.
+ *
+ * \return \c true on success, or \c false if the file does not exist,
+ * is invalid or does not correspond to the current state file (in
+ * which case \ref cc_oci_state_file_read() must be used instead).
+ */
+gboolean
+cc_oci_state_bin_read (const char *runtime_path,
+		struct cc_oci_state_bin *bin)
+{
+	const struct cc_oci_state_bin  *mapped = MAP_FAILED;
+	g_autofree gchar               *path = NULL;
+	g_autofree gchar               *state_path = NULL;
+	struct stat                     st;
+	gboolean                        ret = false;
+	int                             fd;
+
+	if (! (runtime_path && bin)) {
+		return false;
+	}
+
+	path = g_build_path ("/", runtime_path,
+			CC_OCI_STATE_BIN_FILE, NULL);
+
+	fd = open (path, O_RDONLY | O_CLOEXEC);
+	if (fd < 0) {
+		if (errno != ENOENT) {
+			g_debug ("failed to open %s: %s",
+					path, strerror (errno));
+		}
+		return false;
+	}
+
+	if (fstat (fd, &st) < 0
+			|| st.st_size != (off_t)sizeof (*bin)) {
+		goto out;
+	}
+
+	mapped = mmap (NULL, sizeof (*bin), PROT_READ, MAP_PRIVATE, fd, 0);
+	if (mapped == MAP_FAILED) {
+		goto out;
+	}
+
+	if (mapped->magic != CC_OCI_STATE_BIN_MAGIC
+			|| mapped->version != CC_OCI_STATE_BIN_VERSION
+			|| mapped->size != sizeof (*bin)) {
+		g_debug ("ignoring invalid %s", path);
+		goto out;
+	}
+
+	state_path = g_build_path ("/", runtime_path,
+			CC_OCI_STATE_FILE, NULL);
+
+	/* the state file may have been replaced since */
+	if (stat (state_path, &st) < 0
+			|| mapped->state_ino != (guint64)st.st_ino
+			|| mapped->state_size != (gint64)st.st_size
+			|| mapped->state_mtime_sec != (gint64)st.st_mtim.tv_sec
+			|| mapped->state_mtime_nsec != (gint64)st.st_mtim.tv_nsec) {
+		g_debug ("ignoring out of date %s", path);
+		goto out;
+	}
+
+	memcpy (bin, mapped, sizeof (*bin));
+	bin->comms_path[sizeof (bin->comms_path)-1] = '\0';
+
+	ret = true;
+
+out:
+	if (mapped != MAP_FAILED) {
+		munmap ((void *)mapped, sizeof (*bin));
+	}
+	close (fd);
+
+	return ret;
+}
+
 /*!
  * Read the state file.
  *
@@ -638,7 +860,8 @@ cc_oci_state_file_read (const char *file)
 {
 	GNode* node = NULL;
 	struct oci_state *state = NULL;
-	struct state_handler* handler;
+	const struct state_handler* handler;
+	struct state_read_data read_data = { 0 };
 
 	if (! file) {
 		return NULL;
@@ -670,16 +893,14 @@ cc_oci_state_file_read (const char *file)
 			goto out;
 		}
 
-		/* reset subelements_count */
-		for (handler=state_handlers; handler->name; ++handler) {
-			handler->subelements_count = 0;
-		}
+		read_data.state = state;
 
 		g_node_children_foreach(node, G_TRAVERSE_ALL,
-			(GNodeForeachFunc)handle_state_sections, state);
+			(GNodeForeachFunc)handle_state_sections, &read_data);
 
 		for (handler=state_handlers; handler->name; ++handler) {
-			if (handler->subelements_count < handler->subelements_needed) {
+			if (read_data.subelements_count[handler - state_handlers]
+					< handler->subelements_needed) {
 				g_critical("failed to run handler: %s", handler->name);
 				cc_oci_state_free(state);
 				state = NULL;
@@ -693,6 +914,101 @@ out:
 	return state;
 }
 
+/*!
+ * Data shared by the threads reading state files for
+ * \ref cc_oci_state_files_read().
+ */
+struct state_files_read_data {
+	/** Paths of the state files. */
+	const gchar * const  *files;
+
+	/** \ref oci_state read from each of \ref files. */
+	GPtrArray            *states;
+};
+
+/*!
+ * Thread pool function which reads a single state file.
+ *
+ * \param data Index of the file to read, plus one.
+ * \param user_data \ref state_files_read_data.
+ */
+static void
+cc_oci_state_files_read_one (gpointer data, gpointer user_data)
+{
+	struct state_files_read_data *read_data = user_data;
+	guint i = GPOINTER_TO_UINT (data) - 1;
+
+	/* the container may be destroyed as this runs */
+	if (! g_file_test (read_data->files[i], G_FILE_TEST_EXISTS)) {
+		return;
+	}
+
+	/* each thread only sets its own element */
+	g_ptr_array_index (read_data->states, i) =
+		cc_oci_state_file_read (read_data->files[i]);
+}
+
+/*!
+ * Read several state files.
+ *
+ * The files are read in parallel if there are more than
+ * \ref CC_OCI_STATE_READ_SERIAL_MAX of them.
+ *
+ * \param files Full paths to the state files.
+ * \param count Number of elements in \p files.
+ *
+ * \return Newly-allocated array of \p count \ref oci_state, in the
+ * same order as \p files (an element is \c NULL if its state file
+ * does not exist or could not be read).
+ */
+GPtrArray *
+cc_oci_state_files_read (const gchar * const *files, guint count)
+{
+	struct state_files_read_data   read_data;
+	GThreadPool                   *pool = NULL;
+	GError                        *err = NULL;
+	guint                          threads;
+	guint                          i;
+
+	read_data.files = files;
+	read_data.states = g_ptr_array_new_full (count,
+			(GDestroyNotify)cc_oci_state_free);
+	g_ptr_array_set_size (read_data.states, (gint)count);
+
+	if (! (files && count)) {
+		return read_data.states;
+	}
+
+	threads = MIN ((guint)g_get_num_processors (), count);
+
+	if (count > CC_OCI_STATE_READ_SERIAL_MAX && threads > 1) {
+		pool = g_thread_pool_new (cc_oci_state_files_read_one,
+				&read_data, (gint)threads, false, &err);
+		if (! pool) {
+			g_debug ("failed to create thread pool: %s",
+					err->message);
+			g_error_free (err);
+		}
+	}
+
+	for (i = 0; i < count; i++) {
+		if (pool) {
+			(void)g_thread_pool_push (pool,
+					GUINT_TO_POINTER (i + 1), NULL);
+		} else {
+			cc_oci_state_files_read_one (GUINT_TO_POINTER (i + 1),
+					&read_data);
+		}
+	}
+
+	if (pool) {
+		/* wait for all the files to be read */
+		g_thread_pool_free (pool, false, true);
+	}
+
+	return read_data.states;
+}
+
 /*!
  * Free all resources associated with the specified \ref oci_state.
  *
@@ -755,6 +1071,8 @@ cc_oci_state_free (struct oci_state *state)
 		g_free (state->pod);
 	}
 
+	cc_oci_timings_free_all (state->timings);
+
 	g_free (state);
 }
 
@@ -781,6 +1099,7 @@ cc_oci_state_file_create (struct cc_oci_config *config,
 	JsonArray   *namespaces = NULL;
 	JsonObject  *process = NULL;
 	JsonObject  *pod = NULL;
+	JsonObject  *timings = NULL;
 	gchar       *str = NULL;
 	gsize        str_len = 0;
 	GError      *err = NULL;
@@ -963,6 +1282,14 @@ cc_oci_state_file_create (struct cc_oci_config *config,
 		json_object_set_object_member(obj, "annotations", annotation_obj);
 	}
 
+	/* Add an object containing the phase timings of the commands
+	 * run against this container so far.
+	 */
+	timings = cc_oci_timings_to_json (config);
+	if (timings) {
+		json_object_set_object_member (obj, "timings", timings);
+	}
+
 	/* convert JSON to string */
 	str = cc_oci_json_obj_to_string (obj, true, &str_len);
 	if (! str) {
@@ -978,8 +1305,11 @@ cc_oci_state_file_create (struct cc_oci_config *config,
 		g_critical ("failed to create state file %s: %s",
 				config->state.state_file_path, err->message);
 		g_error_free (err);
+		goto out;
 	}
 
+	cc_oci_state_file_written (config, created_timestamp);
+
 	g_debug ("created state file %s", config->state.state_file_path);
 
 out:
@@ -991,6 +1321,185 @@ out:
 	return result;
 }
 
+/*! A member of the state file changed by
+ * \ref cc_oci_state_file_update().
+ */
+struct state_update {
+	/** Names of the member and the object containing it. */
+	const gchar  *path[3];
+
+	/** New JSON value. */
+	gchar        *value;
+
+	/** Location of the current value in the state file. */
+	gsize         offset;
+	gsize         length;
+};
+
+/*!
+ * Compare the location of two \ref state_update.
+ *
+ * \param a \ref state_update.
+ * \param b \ref state_update.
+ *
+ * \return negative, zero or positive as \p a is before, at or after
+ * \p b.
+ */
+static int
+cc_oci_state_update_cmp (const void *a, const void *b)
+{
+	const struct state_update *ua = a;
+	const struct state_update *ub = b;
+
+	return (ua->offset > ub->offset) - (ua->offset < ub->offset);
+}
+
+/*!
+ * Update the mutable fields of the state file (status, PIDs, proxy
+ * sockets and timings) after the state of a container has changed.
+ *
+ * Only the values of these fields are replaced in the existing state
+ * file, rather than regenerating all of it: if that is not possible
+ * (for example because the state file does not hold one of the
+ * fields), the state file is recreated with
+ * \ref cc_oci_state_file_create().
+ *
+ * \param config \ref cc_oci_config.
+ * \param created_timestamp ISO 8601 timestamp of container creation.
+ *
+ * \return \c true on success, else \c false.
+ */
+gboolean
+cc_oci_state_file_update (struct cc_oci_config *config,
+		const char *created_timestamp)
+{
+	struct state_update  updates[] = {
+		{ { "status", NULL }, NULL, 0, 0 },
+		{ { "pid", NULL }, NULL, 0, 0 },
+		{ { "vm", "pid", NULL }, NULL, 0, 0 },
+		{ { "proxy", "ctlSocket", NULL }, NULL, 0, 0 },
+		{ { "proxy", "ioSocket", NULL }, NULL, 0, 0 },
+		{ { "timings", NULL }, NULL, 0, 0 },
+	};
+	JsonObject          *timings = NULL;
+	gchar               *contents = NULL;
+	GString             *str = NULL;
+	GError              *err = NULL;
+	const gchar         *status;
+	gsize                len = 0;
+	gsize                pos = 0;
+	gsize                i;
+	gboolean             ret = false;
+	gboolean             recreate = false;
+
+	if (! (config && created_timestamp)) {
+		return false;
+	}
+
+	if (! (config->vm && config->proxy)) {
+		return false;
+	}
+
+	if (! cc_oci_state_file_get (config)) {
+		return false;
+	}
+
+	status = cc_oci_status_get (config);
+	if (! status) {
+		return false;
+	}
+
+	timings = cc_oci_timings_to_json (config);
+	if (! timings) {
+		return false;
+	}
+
+	updates[0].value = cc_oci_json_quote (status);
+	updates[1].value = g_strdup_printf ("%u",
+			(unsigned)config->state.workload_pid);
+	updates[2].value = g_strdup_printf ("%u",
+			(unsigned)config->vm->pid);
+	updates[3].value = cc_oci_json_quote (config->proxy->agent_ctl_socket);
+	updates[4].value = cc_oci_json_quote (config->proxy->agent_tty_socket);
+	updates[5].value = cc_oci_json_obj_to_string (timings, false, NULL);
+
+	if (! g_file_get_contents (config->state.state_file_path,
+				&contents, &len, &err)) {
+		g_debug ("failed to read state file %s: %s",
+				config->state.state_file_path, err->message);
+		g_error_free (err);
+		recreate = true;
+		goto out;
+	}
+
+	for (i = 0; i < G_N_ELEMENTS (updates); i++) {
+		if (! (updates[i].value
+				&& cc_oci_json_member_find (contents, len,
+					updates[i].path,
+					&updates[i].offset,
+					&updates[i].length))) {
+			g_debug ("state file %s has no member %s",
+					config->state.state_file_path,
+					updates[i].path[0]);
+			recreate = true;
+			goto out;
+		}
+	}
+
+	qsort (updates, G_N_ELEMENTS (updates), sizeof (*updates),
+			cc_oci_state_update_cmp);
+
+	str = g_string_sized_new (len + PATH_MAX);
+
+	for (i = 0; i < G_N_ELEMENTS (updates); i++) {
+		if (updates[i].offset < pos) {
+			/* duplicate members */
+			recreate = true;
+			goto out;
+		}
+
+		g_string_append_len (str, contents + pos,
+				(gssize)(updates[i].offset - pos));
+		g_string_append (str, updates[i].value);
+
+		pos = updates[i].offset + updates[i].length;
+	}
+
+	g_string_append_len (str, contents + pos, (gssize)(len - pos));
+
+	if (! g_file_set_contents (config->state.state_file_path,
+				str->str, (gssize)str->len, &err)) {
+		g_critical ("failed to update state file %s: %s",
+				config->state.state_file_path, err->message);
+		g_error_free (err);
+		goto out;
+	}
+
+	cc_oci_state_file_written (config, created_timestamp);
+
+	g_debug ("updated state file %s", config->state.state_file_path);
+
+	ret = true;
+
+out:
+	if (recreate) {
+		ret = cc_oci_state_file_create (config, created_timestamp);
+	}
+
+	for (i = 0; i < G_N_ELEMENTS (updates); i++) {
+		g_free (updates[i].value);
+	}
+
+	if (str) {
+		g_string_free (str, true);
+	}
+
+	g_free (contents);
+	json_object_unref (timings);
+
+	return ret;
+}
+
 /*!
  * Delete the state file for the specified \p config.
  *
@@ -1006,7 +1515,27 @@ cc_oci_state_file_delete (const struct cc_oci_config *config)
 
 	g_debug ("deleting state file %s", config->state.state_file_path);
 
-	return g_unlink (config->state.state_file_path) == 0;
+	if (g_unlink (config->state.state_file_path) < 0) {
+		return false;
+	}
+
+	if (config->state.runtime_path[0]) {
+		g_autofree gchar *path = g_build_path ("/",
+				config->state.runtime_path,
+				CC_OCI_STATE_BIN_FILE, NULL);
+
+		if (g_unlink (path) < 0 && errno != ENOENT) {
+			g_warning ("failed to delete %s: %s",
+					path, strerror (errno));
+		}
+
+		if (! cc_oci_registry_remove (config)) {
+			g_warning ("failed to update registry for %s",
+					config->state.runtime_path);
+		}
+	}
+
+	return true;
 }
 
 /**
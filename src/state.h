@@ -23,11 +23,16 @@
 
 gboolean cc_oci_state_file_get (struct cc_oci_config *config);
 struct oci_state *cc_oci_state_file_read (const char *file);
+GPtrArray *cc_oci_state_files_read (const gchar * const *files, guint count);
 void cc_oci_state_free (struct oci_state *state);
 gboolean cc_oci_state_file_create (struct cc_oci_config *config,
 		const char *created_timestamp);
+gboolean cc_oci_state_file_update (struct cc_oci_config *config,
+		const char *created_timestamp);
 gboolean cc_oci_state_file_delete (const struct cc_oci_config *config);
 gboolean cc_oci_state_file_exists (struct cc_oci_config *config);
+gboolean cc_oci_state_bin_read (const char *runtime_path,
+		struct cc_oci_state_bin *bin);
 const char *cc_oci_status_to_str (enum oci_status status);
 enum oci_status cc_oci_str_to_status (const char *str);
 int cc_oci_status_length (void);
@@ -0,0 +1,402 @@
+/*
+ * This file is part of cc-oci-runtime.
+ *
+ * Copyright (C) 2016 Intel Corporation
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+/**
+ * \file
+ *
+ * Phase timing routines.
+ *
+ * A command records the time spent in each of its phases using the
+ * monotonic clock. The timings are saved in \ref CC_OCI_STATE_FILE
+ * and can optionally be appended to a trace file as a single line of
+ * JSON per command.
+ */
+
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+#include "timing.h"
+#include "common.h"
+
+/** Permissions used when creating a timing trace file. */
+#define CC_OCI_TIMING_TRACE_MODE 0640
+
+/*!
+ * Free the specified timing.
+ *
+ * \param timing \ref cc_oci_timing.
+ */
+private void
+cc_oci_timing_free (struct cc_oci_timing *timing)
+{
+	if (! timing) {
+		return;
+	}
+
+	g_free_if_set (timing->phase);
+	g_free (timing);
+}
+
+/*!
+ * Add a phase to the specified timings.
+ *
+ * \param timings \ref cc_oci_timings.
+ * \param phase Name of phase.
+ * \param duration Duration of phase in microseconds.
+ */
+static void
+cc_oci_timing_add (struct cc_oci_timings *timings,
+		const gchar *phase,
+		gint64 duration)
+{
+	struct cc_oci_timing *timing;
+
+	g_assert (timings);
+	g_assert (phase);
+
+	timing = g_new0 (struct cc_oci_timing, 1);
+	timing->phase = g_strdup (phase);
+	timing->duration = duration;
+
+	g_ptr_array_add (timings->phases, timing);
+}
+
+/*!
+ * Create a new timings object and start timing the first phase.
+ *
+ * \param command Name of command being timed.
+ *
+ * \return Newly-allocated \ref cc_oci_timings on success,
+ * else \c NULL.
+ */
+struct cc_oci_timings *
+cc_oci_timings_new (const gchar *command)
+{
+	struct cc_oci_timings *timings;
+
+	if (! command) {
+		return NULL;
+	}
+
+	timings = g_new0 (struct cc_oci_timings, 1);
+	timings->command = g_strdup (command);
+	timings->phases = g_ptr_array_new_with_free_func
+		((GDestroyNotify)cc_oci_timing_free);
+	timings->start = timings->mark = g_get_monotonic_time ();
+
+	return timings;
+}
+
+/*!
+ * Free the specified timings.
+ *
+ * \param timings \ref cc_oci_timings.
+ */
+void
+cc_oci_timings_free (struct cc_oci_timings *timings)
+{
+	if (! timings) {
+		return;
+	}
+
+	g_free_if_set (timings->command);
+
+	if (timings->phases) {
+		g_ptr_array_free (timings->phases, true);
+	}
+
+	g_free (timings);
+}
+
+/*!
+ * Free all timings.
+ *
+ * \param timings List of \ref cc_oci_timings.
+ */
+void
+cc_oci_timings_free_all (GSList *timings)
+{
+	if (! timings) {
+		return;
+	}
+
+	g_slist_free_full (timings,
+			(GDestroyNotify)cc_oci_timings_free);
+}
+
+/*!
+ * Mark the end of a phase.
+ *
+ * The phase is considered to have started when the previous phase
+ * ended (or when the timings were created for the first phase).
+ *
+ * \param timings \ref cc_oci_timings (may be \c NULL, in which case
+ * nothing is recorded).
+ * \param phase Name of phase that has just ended.
+ */
+void
+cc_oci_timing_mark (struct cc_oci_timings *timings,
+		const gchar *phase)
+{
+	gint64 now;
+
+	if (! (timings && phase)) {
+		return;
+	}
+
+	now = g_get_monotonic_time ();
+
+	cc_oci_timing_add (timings, phase, now - timings->mark);
+
+	timings->mark = now;
+}
+
+/*!
+ * Create a timings object from the \c GNode representation of the
+ * timings recorded for a command in \ref CC_OCI_STATE_FILE.
+ *
+ * \param node \c GNode whose data is the command name and whose
+ * children are the phases.
+ *
+ * \return Newly-allocated \ref cc_oci_timings on success,
+ * else \c NULL.
+ */
+struct cc_oci_timings *
+cc_oci_timings_from_node (GNode *node)
+{
+	struct cc_oci_timings  *timings;
+	GNode                  *child;
+
+	if (! (node && node->data)) {
+		return NULL;
+	}
+
+	timings = cc_oci_timings_new ((const gchar *)node->data);
+	if (! timings) {
+		return NULL;
+	}
+
+	for (child = g_node_first_child (node);
+			child;
+			child = g_node_next_sibling (child)) {
+		gchar   *endptr = NULL;
+		gint64   duration;
+
+		if (! child->data) {
+			continue;
+		}
+
+		if (! (child->children && child->children->data)) {
+			g_critical ("%s missing value", (char *)child->data);
+			continue;
+		}
+
+		duration = g_ascii_strtoll ((char *)child->children->data,
+				&endptr, 10);
+		if (endptr == child->children->data) {
+			g_critical ("failed to convert '%s' to int",
+					(char *)child->children->data);
+			continue;
+		}
+
+		cc_oci_timing_add (timings, (const gchar *)child->data,
+				duration);
+	}
+
+	return timings;
+}
+
+/*!
+ * Convert the phases of the specified timings to a JSON object.
+ *
+ * \param timings \ref cc_oci_timings.
+ *
+ * \return \c JsonObject mapping phase names to total durations
+ * in microseconds.
+ */
+static JsonObject *
+cc_oci_timings_phases_to_json (const struct cc_oci_timings *timings)
+{
+	JsonObject  *obj;
+	guint        i;
+
+	g_assert (timings);
+
+	obj = json_object_new ();
+
+	for (i = 0; i < timings->phases->len; i++) {
+		const struct cc_oci_timing *timing;
+		gint64 duration;
+
+		timing = g_ptr_array_index (timings->phases, i);
+		duration = timing->duration;
+
+		/* Commands such as "run" may pass through a phase
+		 * more than once.
+		 */
+		if (json_object_has_member (obj, timing->phase)) {
+			duration += json_object_get_int_member (obj,
+					timing->phase);
+		}
+
+		json_object_set_int_member (obj, timing->phase, duration);
+	}
+
+	return obj;
+}
+
+/*!
+ * Convert all timings for a container to a JSON object.
+ *
+ * The timings of the current command replace any timings
+ * previously recorded for the same command.
+ *
+ * \param config \ref cc_oci_config.
+ *
+ * \return \c JsonObject mapping command names to phase timings
+ * on success, else \c NULL.
+ */
+JsonObject *
+cc_oci_timings_to_json (const struct cc_oci_config *config)
+{
+	const struct cc_oci_timings  *current;
+	JsonObject                   *obj;
+	GSList                       *l;
+
+	if (! config) {
+		return NULL;
+	}
+
+	current = config->timings;
+
+	obj = json_object_new ();
+
+	for (l = config->state.timings; l && l->data; l = g_slist_next (l)) {
+		const struct cc_oci_timings *timings = l->data;
+
+		if (current && ! g_strcmp0 (timings->command,
+					current->command)) {
+			continue;
+		}
+
+		json_object_set_object_member (obj, timings->command,
+				cc_oci_timings_phases_to_json (timings));
+	}
+
+	if (current && current->phases->len) {
+		json_object_set_object_member (obj, current->command,
+				cc_oci_timings_phases_to_json (current));
+	}
+
+	return obj;
+}
+
+/*!
+ * Append the timings of the current command to a trace file.
+ *
+ * Each command is written as a single line of JSON (in a single
+ * write) so that the file can be shared by concurrent instances
+ * of the runtime.
+ *
+ * \param config \ref cc_oci_config.
+ * \param path Full path to trace file.
+ * \param success \c true if the command succeeded, else \c false.
+ *
+ * \return \c true on success, else \c false.
+ */
+gboolean
+cc_oci_timings_trace (const struct cc_oci_config *config,
+		const gchar *path, gboolean success)
+{
+	const struct cc_oci_timings  *timings;
+	JsonObject                   *obj = NULL;
+	gchar                        *timestamp = NULL;
+	gchar                        *str = NULL;
+	gchar                        *line = NULL;
+	gsize                         str_len = 0;
+	int                           fd = -1;
+	gboolean                      ret = false;
+
+	if (! (config && config->timings && path)) {
+		return false;
+	}
+
+	timings = config->timings;
+
+	timestamp = cc_oci_get_iso8601_timestamp ();
+
+	obj = json_object_new ();
+
+	json_object_set_string_member (obj, "timestamp",
+			timestamp ? timestamp : "");
+
+	json_object_set_string_member (obj, "command",
+			timings->command);
+
+	json_object_set_string_member (obj, "id",
+			config->optarg_container_id ?
+			config->optarg_container_id : "");
+
+	json_object_set_boolean_member (obj, "success", success);
+
+	json_object_set_int_member (obj, "total",
+			g_get_monotonic_time () - timings->start);
+
+	json_object_set_object_member (obj, "phases",
+			cc_oci_timings_phases_to_json (timings));
+
+	str = cc_oci_json_obj_to_string (obj, false, &str_len);
+	if (! str) {
+		goto out;
+	}
+
+	line = g_strdup_printf ("%s\n", str);
+
+	fd = open (path, O_WRONLY | O_CREAT | O_APPEND | O_CLOEXEC,
+			CC_OCI_TIMING_TRACE_MODE);
+	if (fd < 0) {
+		g_warning ("failed to open timing trace file %s: %s",
+				path, strerror (errno));
+		goto out;
+	}
+
+	if (write (fd, line, strlen (line)) < 0) {
+		g_warning ("failed to write timing trace file %s: %s",
+				path, strerror (errno));
+		goto out;
+	}
+
+	ret = true;
+
+out:
+	if (fd != -1) {
+		close (fd);
+	}
+	if (obj) {
+		json_object_unref (obj);
+	}
+	g_free_if_set (timestamp);
+	g_free_if_set (str);
+	g_free_if_set (line);
+
+	return ret;
+}
@@ -0,0 +1,43 @@
+/*
+ * This file is part of cc-oci-runtime.
+ *
+ * Copyright (C) 2016 Intel Corporation
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+#ifndef _CC_OCI_TIMING_H
+#define _CC_OCI_TIMING_H
+
+#include <stdbool.h>
+
+#include <glib.h>
+#include <json-glib/json-glib.h>
+#include <json-glib/json-gobject.h>
+
+#include "util.h"
+#include "oci.h"
+
+struct cc_oci_timings *cc_oci_timings_new (const gchar *command);
+void cc_oci_timings_free (struct cc_oci_timings *timings);
+void cc_oci_timings_free_all (GSList *timings);
+void cc_oci_timing_mark (struct cc_oci_timings *timings,
+		const gchar *phase);
+struct cc_oci_timings *cc_oci_timings_from_node (GNode *node);
+JsonObject *cc_oci_timings_to_json (const struct cc_oci_config *config);
+gboolean cc_oci_timings_trace (const struct cc_oci_config *config,
+		const gchar *path, gboolean success);
+
+#endif /* _CC_OCI_TIMING_H */
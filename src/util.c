@@ -22,20 +22,20 @@
 #include <stdlib.h>
 #include <sys/types.h>
 #include <sys/stat.h>
+#include <sys/wait.h>
 #include <fcntl.h>
+#include <dirent.h>
 #include <unistd.h>
 #include <errno.h>
 #include <stdbool.h>
 
 #include <glib.h>
 #include <glib/gprintf.h>
+#include <glib/gstdio.h>
 
 #include "util.h"
 #include "config.h"
 
-/** Full path to \c rm(1) command. */
-#define CC_OCI_RM_CMD "/bin/rm"
-
 #define make_table_entry(value) \
 { value, #value }
 
@@ -213,7 +213,111 @@ out:
 }
 
 /*!
- * Recursively delete a directory.
+ * Recursively delete the contents of a directory.
+ *
+ * Symbolic links are removed rather than followed and directories
+ * on a different filesystem to \p dev (which could only be mount
+ * points) are not entered.
+ *
+ * \param dfd File descriptor of directory (closed by this function).
+ * \param dev Device of directory.
+ * \param path Full path to directory (for messages).
+ *
+ * \return \c true on success, else \c false.
+ */
+static gboolean
+cc_oci_rm_rf_at (int dfd, dev_t dev, const gchar *path)
+{
+	DIR            *dir;
+	struct dirent  *ent;
+	gboolean        ret = true;
+
+	dir = fdopendir (dfd);
+	if (! dir) {
+		g_critical ("failed to open directory %s: %s",
+				path, strerror (errno));
+		close (dfd);
+		return false;
+	}
+
+	while ((ent = readdir (dir)) != NULL) {
+		struct stat  st;
+		gboolean     is_dir;
+		int          fd;
+
+		if (! g_strcmp0 (ent->d_name, ".")
+				|| ! g_strcmp0 (ent->d_name, "..")) {
+			continue;
+		}
+
+		if (ent->d_type != DT_UNKNOWN) {
+			is_dir = ent->d_type == DT_DIR;
+		} else if (fstatat (dfd, ent->d_name, &st,
+					AT_SYMLINK_NOFOLLOW) == 0) {
+			is_dir = S_ISDIR (st.st_mode);
+		} else {
+			is_dir = false;
+		}
+
+		if (! is_dir) {
+			if (unlinkat (dfd, ent->d_name, 0) < 0
+					&& errno != ENOENT) {
+				g_critical ("failed to remove %s/%s: %s",
+						path, ent->d_name,
+						strerror (errno));
+				ret = false;
+			}
+			continue;
+		}
+
+		fd = openat (dfd, ent->d_name,
+				O_RDONLY | O_DIRECTORY | O_NOFOLLOW | O_CLOEXEC);
+		if (fd < 0) {
+			if (errno != ENOENT) {
+				g_critical ("failed to open %s/%s: %s",
+						path, ent->d_name,
+						strerror (errno));
+				ret = false;
+			}
+			continue;
+		}
+
+		if (fstat (fd, &st) < 0 || st.st_dev != dev) {
+			g_critical ("not removing %s/%s: "
+					"different filesystem",
+					path, ent->d_name);
+			close (fd);
+			ret = false;
+			continue;
+		}
+
+		{
+			g_autofree gchar *subdir = g_build_path ("/",
+					path, ent->d_name, NULL);
+
+			if (! cc_oci_rm_rf_at (fd, dev, subdir)) {
+				ret = false;
+				continue;
+			}
+		}
+
+		if (unlinkat (dfd, ent->d_name, AT_REMOVEDIR) < 0
+				&& errno != ENOENT) {
+			g_critical ("failed to remove %s/%s: %s",
+					path, ent->d_name, strerror (errno));
+			ret = false;
+		}
+	}
+
+	closedir (dir);
+
+	return ret;
+}
+
+/*!
+ * Recursively delete a directory (or remove a file).
+ *
+ * A path which does not exist is not an error.
  *
  * \param path Full path to directory to delete.
  *
@@ -222,28 +326,137 @@ out:
 gboolean
 cc_oci_rm_rf (const gchar *path)
 {
-	gchar *cmd;
-	gboolean ret = false;
+	struct stat  st;
+	int          fd;
 
 	if (! path || ! *path) {
 		return false;
 	}
 
-	cmd = g_strdup_printf ("%s -rf \"%s\" >/dev/null 2>&1",
-			CC_OCI_RM_CMD, path);
-	if (! cmd) {
+	if (lstat (path, &st) < 0) {
+		return errno == ENOENT;
+	}
+
+	if (! S_ISDIR (st.st_mode)) {
+		if (unlink (path) < 0 && errno != ENOENT) {
+			g_critical ("failed to remove %s: %s",
+					path, strerror (errno));
+			return false;
+		}
+		return true;
+	}
+
+	fd = open (path, O_RDONLY | O_DIRECTORY | O_NOFOLLOW | O_CLOEXEC);
+	if (fd < 0) {
+		g_critical ("failed to open directory %s: %s",
+				path, strerror (errno));
 		return false;
 	}
 
-	if (system (cmd)) {
+	if (! cc_oci_rm_rf_at (fd, st.st_dev, path)) {
 		g_critical ("failed to remove directory %s", path);
-	} else {
-		ret = true;
+		return false;
 	}
 
-	g_free (cmd);
+	if (rmdir (path) < 0 && errno != ENOENT) {
+		g_critical ("failed to remove directory %s: %s",
+				path, strerror (errno));
+		return false;
+	}
 
-	return ret;
+	return true;
+}
+
+/*!
+ * Delete a directory in the background.
+ *
+ * The directory is first moved below \ref CC_OCI_RM_RF_ASYNC_DIR in
+ * its parent so that \p path can be reused as soon as this function
+ * returns. The contents are then removed by a detached process, which
+ * is not waited for. Since \ref CC_OCI_RM_RF_ASYNC_DIR is kept, that
+ * process never modifies the parent directory.
+ *
+ * If the directory cannot be renamed, or the process cannot be
+ * created, it is deleted synchronously.
+ *
+ * \param path Full path to directory to delete.
+ *
+ * \return \c true on success, else \c false.
+ */
+gboolean
+cc_oci_rm_rf_async (const gchar *path)
+{
+	g_autofree gchar  *dirname = NULL;
+	g_autofree gchar  *trash_dir = NULL;
+	g_autofree gchar  *trash = NULL;
+	struct stat        st;
+	pid_t              pid;
+
+	if (! path || ! *path) {
+		return false;
+	}
+
+	if (lstat (path, &st) < 0 || ! S_ISDIR (st.st_mode)) {
+		return cc_oci_rm_rf (path);
+	}
+
+	dirname = g_path_get_dirname (path);
+	trash_dir = g_build_path ("/", dirname, CC_OCI_RM_RF_ASYNC_DIR,
+			NULL);
+
+	if (g_mkdir (trash_dir, S_IRWXU) < 0 && errno != EEXIST) {
+		g_debug ("failed to create directory %s: %s",
+				trash_dir, strerror (errno));
+		return cc_oci_rm_rf (path);
+	}
+
+	trash = g_build_path ("/", trash_dir, "XXXXXX", NULL);
+
+	/* renaming a directory replaces an empty one atomically */
+	if (! g_mkdtemp_full (trash, S_IRWXU)) {
+		return cc_oci_rm_rf (path);
+	}
+
+	if (rename (path, trash) < 0) {
+		g_warning ("failed to rename %s to %s: %s",
+				path, trash, strerror (errno));
+		(void)rmdir (trash);
+		return cc_oci_rm_rf (path);
+	}
+
+	pid = fork ();
+	if (pid < 0) {
+		return cc_oci_rm_rf (trash);
+	}
+
+	if (pid == 0) {
+		int fd;
+
+		/* Detach, so that the caller's parent does not wait for
+		 * this process (nor for the end of any pipes it holds).
+		 */
+		if (fork () != 0) {
+			_exit (EXIT_SUCCESS);
+		}
+
+		(void)setsid ();
+
+		fd = open ("/dev/null", O_RDWR);
+		if (fd >= 0) {
+			(void)dup2 (fd, STDIN_FILENO);
+			(void)dup2 (fd, STDOUT_FILENO);
+			(void)dup2 (fd, STDERR_FILENO);
+			if (fd > STDERR_FILENO) {
+				close (fd);
+			}
+		}
+
+		_exit (cc_oci_rm_rf (trash) ? EXIT_SUCCESS : EXIT_FAILURE);
+	}
+
+	(void)waitpid (pid, NULL, 0);
+
+	return true;
 }
 
 /*!
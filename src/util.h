@@ -48,6 +48,11 @@
 #define close_if_set(fd) \
 	if ((fd != -1)) { close(fd); fd=-1; }
 
+/** Directory, alongside those deleted by \ref cc_oci_rm_rf_async,
+ * which they are moved below while their contents are removed.
+ */
+#define CC_OCI_RM_RF_ASYNC_DIR		".trash"
+
 #ifdef DEBUG
 	void cc_oci_node_dump(GNode* node);
 #else
@@ -78,6 +83,7 @@ gchar *cc_oci_get_iso8601_timestamp (void);
 gboolean cc_oci_setup_console (const char *console);
 gboolean cc_oci_create_pidfile (const gchar *pidfile, GPid pid);
 gboolean cc_oci_rm_rf (const gchar *path);
+gboolean cc_oci_rm_rf_async (const gchar *path);
 gchar *cc_oci_json_obj_to_string (JsonObject *obj, gboolean pretty,
 		gsize *string_len);
 gchar *cc_oci_json_arr_to_string (JsonArray *array, gboolean pretty);
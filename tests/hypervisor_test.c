@@ -20,6 +20,7 @@
 
 #include <stdlib.h>
 #include <stdbool.h>
+#include <string.h>
 
 #include <check.h>
 #include <glib.h>
@@ -30,11 +31,18 @@
 #include "../src/hypervisor.h"
 #include "../src/oci.h"
 #include "../src/proxy.h"
+#include "../src/util.h"
 
 gchar *
 cc_oci_vm_args_file_path (const struct cc_oci_config *config);
 gboolean cc_oci_expand_cmdline (struct cc_oci_config *config, gchar **args);
 void cc_free_pointer(gpointer str);
+struct cc_oci_vm_args_line *
+cc_oci_vm_args_line_compile (const gchar *text, gboolean first);
+void cc_oci_vm_args_line_free (struct cc_oci_vm_args_line *line);
+struct cc_oci_vm_args_template *
+cc_oci_vm_args_template_new (const gchar *path);
+void cc_oci_vm_args_template_free (struct cc_oci_vm_args_template *template);
 
 extern gchar *sysconfdir;
 extern gchar *defaultsdir;
@@ -743,12 +751,94 @@ START_TEST(test_cc_oci_vm_args_get) {
 	cc_oci_config_free (config);
 } END_TEST
 
+START_TEST(test_cc_oci_vm_args_line_compile) {
+	struct cc_oci_vm_args_line     *line;
+	struct cc_oci_vm_args_segment  *segment;
+
+	line = cc_oci_vm_args_line_compile ("-kernel=@KERNEL@,@foo@", false);
+	ck_assert (line);
+	ck_assert (line->segments->len == 3);
+	ck_assert (line->literal_len == 14);
+
+	segment = &g_array_index (line->segments,
+			struct cc_oci_vm_args_segment, 0);
+	ck_assert (segment->tag == CC_OCI_VM_ARGS_LITERAL);
+	ck_assert (! strncmp (segment->text, "-kernel=", segment->len));
+
+	segment = &g_array_index (line->segments,
+			struct cc_oci_vm_args_segment, 1);
+	ck_assert (segment->tag == CC_OCI_VM_ARGS_KERNEL);
+
+	/* unknown placeholders are literal text */
+	segment = &g_array_index (line->segments,
+			struct cc_oci_vm_args_segment, 2);
+	ck_assert (segment->tag == CC_OCI_VM_ARGS_LITERAL);
+	ck_assert (! strncmp (segment->text, ",@foo@", segment->len));
+
+	cc_oci_vm_args_line_free (line);
+
+	/* every occurrence of a placeholder is found */
+	line = cc_oci_vm_args_line_compile ("@NAME@@NAME@", false);
+	ck_assert (line);
+	ck_assert (line->segments->len == 2);
+	ck_assert (line->literal_len == 0);
+	cc_oci_vm_args_line_free (line);
+
+	/* comments */
+	line = cc_oci_vm_args_line_compile ("# @KERNEL@", false);
+	ck_assert (line);
+	ck_assert (! *line->text);
+	ck_assert (line->segments->len == 0);
+	cc_oci_vm_args_line_free (line);
+
+	line = cc_oci_vm_args_line_compile ("@IMAGE@ # @KERNEL@", false);
+	ck_assert (line);
+	ck_assert (! g_strcmp0 (line->text, "@IMAGE@ "));
+	ck_assert (line->segments->len == 2);
+	cc_oci_vm_args_line_free (line);
+
+	line = cc_oci_vm_args_line_compile ("a#b", false);
+	ck_assert (line);
+	ck_assert (! g_strcmp0 (line->text, "a#b"));
+	cc_oci_vm_args_line_free (line);
+} END_TEST
+
+START_TEST(test_cc_oci_vm_args_template_new) {
+	struct cc_oci_vm_args_template  *template;
+	g_autofree gchar                *tmpdir = NULL;
+	g_autofree gchar                *path = NULL;
+
+	tmpdir = g_dir_make_tmp (NULL, NULL);
+	ck_assert (tmpdir);
+
+	path = g_build_path ("/", tmpdir, CC_OCI_HYPERVISOR_CMDLINE_FILE,
+			NULL);
+
+	ck_assert (! cc_oci_vm_args_template_new (NULL));
+	ck_assert (! cc_oci_vm_args_template_new (path));
+
+	ck_assert (g_file_set_contents (path,
+				"/bin/true\n@KERNEL@\n@\n", -1, NULL));
+
+	template = cc_oci_vm_args_template_new (path);
+	ck_assert (template);
+	ck_assert (template->lines->len == 3);
+	cc_oci_vm_args_template_free (template);
+
+	/* NOP */
+	cc_oci_vm_args_template_free (NULL);
+
+	ck_assert (cc_oci_rm_rf (tmpdir));
+} END_TEST
+
 Suite* make_hypervisor_suite(void) {
 	Suite* s = suite_create(__FILE__);
 
 	ADD_TEST(test_cc_oci_vm_args_file_path, s);
 	ADD_TEST(test_cc_oci_expand_cmdline, s);
 	ADD_TEST(test_cc_oci_vm_args_get, s);
+	ADD_TEST(test_cc_oci_vm_args_line_compile, s);
+	ADD_TEST(test_cc_oci_vm_args_template_new, s);
 
 	return s;
 }
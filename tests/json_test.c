@@ -19,6 +19,7 @@
  */
 
 #include <stdlib.h>
+#include <string.h>
 
 #include <check.h>
 #include <glib.h>
@@ -46,8 +47,8 @@ START_TEST(test_cc_oci_json_parse) {
 	ck_assert(! cc_oci_json_parse(&node, TEST_DATA_DIR "/non-json.json"));
 	g_free_node(node);
 
-	/*ck_assert(! cc_oci_json_parse(&node, TEST_DATA_DIR "/invalid-extra-comma.json"));
-	g_free_node(node);*/
+	ck_assert(! cc_oci_json_parse(&node, TEST_DATA_DIR "/invalid-extra-comma.json"));
+	g_free_node(node);
 
 	ck_assert(! cc_oci_json_parse(&node, TEST_DATA_DIR "/invalid-missing-close-brace.json"));
 	g_free_node(node);
@@ -56,10 +57,96 @@ START_TEST(test_cc_oci_json_parse) {
 	g_free_node(node);
 } END_TEST
 
+START_TEST(test_cc_oci_json_parse_tree) {
+	GNode* node = NULL;
+	GNode* process;
+	GNode* child;
+
+	ck_assert(cc_oci_json_parse(&node, TEST_DATA_DIR "/node.json"));
+	ck_assert(node);
+	ck_assert(! g_strcmp0(node->data, TEST_DATA_DIR "/node.json"));
+
+	/* objects start with an empty node, followed by their members */
+	ck_assert(g_node_n_children(node) == 2);
+	ck_assert(! g_node_first_child(node)->data);
+
+	process = g_node_last_child(node);
+	ck_assert(! g_strcmp0(process->data, "process"));
+	ck_assert(g_node_n_children(process) == 7);
+
+	child = g_node_nth_child(process, 1);
+	ck_assert(! g_strcmp0(child->data, "terminal"));
+	ck_assert(! g_strcmp0(child->children->data, "true"));
+
+	/* array elements are each followed by an empty node */
+	child = g_node_nth_child(process, 3);
+	ck_assert(! g_strcmp0(child->data, "args"));
+	ck_assert(g_node_n_children(child) == 2);
+	ck_assert(! g_strcmp0(g_node_first_child(child)->data, "sh"));
+	ck_assert(! g_node_first_child(child)->children->data);
+	ck_assert(! g_strcmp0(g_node_last_child(child)->data, "-c"));
+
+	/* scalars are converted to strings */
+	child = g_node_nth_child(process, 5);
+	ck_assert(! g_strcmp0(child->data, "int"));
+	ck_assert(! g_strcmp0(child->children->data, "566"));
+
+	child = g_node_nth_child(process, 6);
+	ck_assert(! g_strcmp0(child->data, "double"));
+	ck_assert(! g_strcmp0(child->children->data, "55.550000"));
+
+	g_free_node(node);
+} END_TEST
+
+START_TEST(test_cc_oci_json_member_find) {
+	const gchar *json = "{ \"a\": [1, {\"b\": 2}], \"b\" : { \"c\": \"x\\\"y\" },"
+		" \"d\": null }";
+	const gchar *a[] = { "a", NULL };
+	const gchar *b[] = { "b", NULL };
+	const gchar *b_c[] = { "b", "c", NULL };
+	const gchar *d[] = { "d", NULL };
+	const gchar *a_b[] = { "a", "b", NULL };
+	const gchar *e[] = { "e", NULL };
+	gsize len = strlen (json);
+	gsize offset;
+	gsize length;
+	gchar *quoted;
+
+	ck_assert (! cc_oci_json_member_find (NULL, len, a, &offset, &length));
+	ck_assert (! cc_oci_json_member_find (json, len, NULL, &offset, &length));
+
+	ck_assert (cc_oci_json_member_find (json, len, a, &offset, &length));
+	ck_assert (! strncmp (json + offset, "[1, {\"b\": 2}]", length));
+
+	ck_assert (cc_oci_json_member_find (json, len, b, &offset, &length));
+	ck_assert (json[offset] == '{' && json[offset+length-1] == '}');
+
+	ck_assert (cc_oci_json_member_find (json, len, b_c, &offset, &length));
+	ck_assert (! strncmp (json + offset, "\"x\\\"y\"", length));
+
+	ck_assert (cc_oci_json_member_find (json, len, d, &offset, &length));
+	ck_assert (! strncmp (json + offset, "null", length));
+
+	/* only objects are searched */
+	ck_assert (! cc_oci_json_member_find (json, len, a_b, &offset, &length));
+	ck_assert (! cc_oci_json_member_find (json, len, e, &offset, &length));
+	ck_assert (! cc_oci_json_member_find ("[]", 2, a, &offset, &length));
+
+	quoted = cc_oci_json_quote ("a\"b\\c\n\x01");
+	ck_assert (! g_strcmp0 (quoted, "\"a\\\"b\\\\c\\n\\u0001\""));
+	g_free (quoted);
+
+	quoted = cc_oci_json_quote (NULL);
+	ck_assert (! g_strcmp0 (quoted, "\"\""));
+	g_free (quoted);
+} END_TEST
+
 Suite* make_json_suite(void) {
 	Suite* s = suite_create(__FILE__);
 
 	ADD_TEST(test_cc_oci_json_parse, s);
+	ADD_TEST(test_cc_oci_json_parse_tree, s);
+	ADD_TEST(test_cc_oci_json_member_find, s);
 
 	return s;
 }
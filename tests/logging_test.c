@@ -124,6 +124,12 @@ START_TEST(test_cc_oci_log_init) {
 
 	g_debug ("G_LOG_LEVEL_DEBUG: %s (int=%d)", "!de bug, da bug!", 13);
 
+	/* debug messages are buffered */
+	ck_assert (! g_file_test (options.filename, G_FILE_TEST_EXISTS));
+
+	/* the log file is recreated since it was removed */
+	cc_oci_log_flush ();
+
 	ret = g_file_get_contents (options.filename, &contents, NULL, &error);
 	ck_assert (ret);
 	ck_assert (! error);
@@ -203,6 +209,8 @@ START_TEST(test_cc_oci_log_init) {
 	/************************************************************/
 	/* clean up */
 
+	cc_oci_log_flush ();
+
 	ck_assert (! g_remove (options.filename));
 	ck_assert (! g_remove (tmpdir));
 	cc_oci_log_free (&options);
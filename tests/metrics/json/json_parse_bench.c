@@ -0,0 +1,165 @@
+/*
+ * This file is part of cc-oci-runtime.
+ *
+ * Copyright (C) 2017 Intel Corporation
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+/*
+ * Measures the time taken to parse JSON files (such as config.json
+ * and state.json) with cc_oci_json_parse(), compared with building a
+ * json-glib document alone.
+ *
+ * Build with "make json_parse_bench".
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+
+#include <glib.h>
+#include <json-glib/json-glib.h>
+
+#include "../../../src/json.h"
+#include "../../../src/util.h"
+
+static gint iterations = 10000;
+
+static GOptionEntry options[] =
+{
+	{
+		"iterations", 'n', G_OPTION_FLAG_NONE,
+		G_OPTION_ARG_INT, &iterations,
+		"number of times to parse each file", NULL
+	},
+
+	{NULL}
+};
+
+/*!
+ * Parse a file with json-glib.
+ *
+ * \param file Path to JSON file.
+ *
+ * \return \c true on success, else \c false.
+ */
+static gboolean
+parse_json_glib (const char *file)
+{
+	JsonParser  *parser;
+	gboolean     ret;
+
+	parser = json_parser_new ();
+	ret = json_parser_load_from_file (parser, file, NULL);
+	g_object_unref (parser);
+
+	return ret;
+}
+
+/*!
+ * Parse a file with cc_oci_json_parse().
+ *
+ * \param file Path to JSON file.
+ *
+ * \return \c true on success, else \c false.
+ */
+static gboolean
+parse_cc_oci (const char *file)
+{
+	GNode *node = NULL;
+
+	if (! cc_oci_json_parse (&node, file)) {
+		return false;
+	}
+
+	g_free_node (node);
+
+	return true;
+}
+
+/*!
+ * Time parsing a file.
+ *
+ * \param file Path to JSON file.
+ * \param parse Parse function.
+ * \param[out] usecs Average time per parse in microseconds.
+ *
+ * \return \c true on success, else \c false.
+ */
+static gboolean
+run (const char *file, gboolean (*parse) (const char *), gdouble *usecs)
+{
+	gint64  start;
+	gint    i;
+
+	/* warm the page cache and allocator */
+	if (! parse (file)) {
+		return false;
+	}
+
+	start = g_get_monotonic_time ();
+
+	for (i = 0; i < iterations; i++) {
+		if (! parse (file)) {
+			return false;
+		}
+	}
+
+	*usecs = (gdouble)(g_get_monotonic_time () - start) / iterations;
+
+	return true;
+}
+
+int
+main (int argc, char **argv)
+{
+	GOptionContext  *context;
+	GError          *error = NULL;
+	gdouble          glib_usecs;
+	gdouble          cc_oci_usecs;
+	int              i;
+
+	context = g_option_context_new ("FILE... - JSON parsing benchmark");
+	g_option_context_add_main_entries (context, options, NULL);
+
+	if (! g_option_context_parse (context, &argc, &argv, &error)) {
+		fprintf (stderr, "%s\n", error->message);
+		g_error_free (error);
+		g_option_context_free (context);
+		return EXIT_FAILURE;
+	}
+
+	g_option_context_free (context);
+
+	if (argc < 2 || iterations <= 0) {
+		fprintf (stderr, "usage: %s [--iterations N] FILE...\n",
+				argv[0]);
+		return EXIT_FAILURE;
+	}
+
+	for (i = 1; i < argc; i++) {
+		if (! run (argv[i], parse_json_glib, &glib_usecs)
+				|| ! run (argv[i], parse_cc_oci, &cc_oci_usecs)) {
+			fprintf (stderr, "failed to parse %s\n", argv[i]);
+			return EXIT_FAILURE;
+		}
+
+		printf ("%s: json-glib document %.1f us, "
+				"cc_oci_json_parse %.1f us\n",
+				argv[i], glib_usecs, cc_oci_usecs);
+	}
+
+	return EXIT_SUCCESS;
+}
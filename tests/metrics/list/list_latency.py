@@ -0,0 +1,107 @@
+#!/usr/bin/env python3
+
+#  This file is part of cc-oci-runtime.
+#
+#  Copyright (C) 2017 Intel Corporation
+#
+#  This program is free software; you can redistribute it and/or
+#  modify it under the terms of the GNU General Public License
+#  as published by the Free Software Foundation; either version 2
+#  of the License, or (at your option) any later version.
+#
+#  This program is distributed in the hope that it will be useful,
+#  but WITHOUT ANY WARRANTY; without even the implied warranty of
+#  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+#  GNU General Public License for more details.
+#
+#  You should have received a copy of the GNU General Public License
+#  along with this program; if not, write to the Free Software
+#  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+
+#  Description of the test:
+#  This test measures the latency of "cc-oci-runtime list" as the number
+#  of containers grows. For each count, it creates a runtime root
+#  directory holding that many synthetic containers (a directory with a
+#  state file based on tests/data/state.json each) and times:
+#
+#  - "cold": list without a container registry, which reads every state
+#    file and rebuilds the registry.
+#  - "warm": list using the registry built by the previous run.
+#  - "all": "list --all", which always reads every state file.
+#
+#  No virtual machine is started, so it does not require Docker.
+
+import argparse
+import json
+import os
+import shutil
+import subprocess
+import sys
+import tempfile
+import time
+
+STATE_TEMPLATE = os.path.join(os.path.dirname(os.path.abspath(__file__)),
+                              "..", "..", "data", "state.json")
+
+
+def create_containers(root, count):
+    with open(STATE_TEMPLATE) as f:
+        template = json.load(f)
+
+    for i in range(count):
+        container_id = "bench-%06d" % i
+        path = os.path.join(root, container_id)
+        os.mkdir(path)
+
+        state = dict(template)
+        state["id"] = container_id
+        state["status"] = "stopped"
+        with open(os.path.join(path, "state.json"), "w") as f:
+            json.dump(state, f)
+
+
+def run_list(runtime, root, args):
+    start = time.monotonic()
+    proc = subprocess.run([runtime, "--root", root, "list"] + args,
+                          stdout=subprocess.PIPE)
+    elapsed = time.monotonic() - start
+
+    if proc.returncode:
+        sys.exit("list failed (exit code %d)" % proc.returncode)
+
+    return elapsed, proc.stdout.count(b"\n") - 1
+
+
+def main():
+    parser = argparse.ArgumentParser(description="cc-oci-runtime list latency")
+    parser.add_argument("runtime", help="path to the cc-oci-runtime binary")
+    parser.add_argument("-c", "--counts", type=int, nargs="+",
+                        default=[100, 1000, 10000],
+                        help="numbers of containers")
+    parser.add_argument("-r", "--runs", type=int, default=3,
+                        help="number of runs")
+    args = parser.parse_args()
+
+    for count in args.counts:
+        root = tempfile.mkdtemp(prefix="cc-list-")
+        try:
+            create_containers(root, count)
+            registry = os.path.join(root, ".registry")
+
+            for i in range(args.runs):
+                shutil.rmtree(registry, ignore_errors=True)
+                cold, listed = run_list(args.runtime, root, [])
+                if listed != count:
+                    sys.exit("listed %d containers, expected %d" %
+                             (listed, count))
+                warm, _ = run_list(args.runtime, root, [])
+                full, _ = run_list(args.runtime, root, ["--all"])
+                print("containers=%d run %d: cold %.1f ms, warm %.1f ms, "
+                      "all %.1f ms" % (count, i + 1, cold * 1000,
+                                       warm * 1000, full * 1000))
+        finally:
+            shutil.rmtree(root)
+
+
+if __name__ == "__main__":
+    main()
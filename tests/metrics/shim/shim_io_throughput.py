@@ -0,0 +1,213 @@
+#!/usr/bin/env python3
+
+#  This file is part of cc-oci-runtime.
+#
+#  Copyright (C) 2017 Intel Corporation
+#
+#  This program is free software; you can redistribute it and/or
+#  modify it under the terms of the GNU General Public License
+#  as published by the Free Software Foundation; either version 2
+#  of the License, or (at your option) any later version.
+#
+#  This program is distributed in the hope that it will be useful,
+#  but WITHOUT ANY WARRANTY; without even the implied warranty of
+#  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+#  GNU General Public License for more details.
+#
+#  You should have received a copy of the GNU General Public License
+#  along with this program; if not, write to the Free Software
+#  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+
+#  Description of the test:
+#  This test measures the throughput of cc-shim when forwarding container
+#  output from the proxy to stdout. The shim is run against a fake proxy
+#  (a pair of sockets) which sends stream frames as fast as the shim
+#  accepts them, while stdout is read by cat(1). It reports the throughput
+#  in MB/s and the number of read/write system calls made by the shim per
+#  frame (from /proc/<pid>/io).
+#
+#  With --stdin, it measures the opposite direction instead: data piped
+#  into the shim's stdin is forwarded to the fake proxy. As the fake proxy
+#  may well be the bottleneck, the CPU time used by the shim is reported
+#  too. Note that send(2) and splice(2) are not accounted for in
+#  /proc/<pid>/io.
+
+import argparse
+import os
+import socket
+import struct
+import subprocess
+import sys
+import time
+
+STREAM_HEADER = ">QI"
+SEQ = 1
+
+
+def frame(seq, payload):
+    return struct.pack(STREAM_HEADER, seq, 12 + len(payload)) + payload
+
+
+def proc_io(pid):
+    io = {}
+    with open("/proc/%d/io" % pid) as f:
+        for line in f:
+            key, value = line.split(":")
+            io[key] = int(value)
+    return io
+
+
+def proc_cpu(pid):
+    with open("/proc/%d/stat" % pid) as f:
+        fields = f.read().rsplit(")", 1)[1].split()
+    # utime and stime
+    ticks = int(fields[11]) + int(fields[12])
+    return ticks / os.sysconf("SC_CLK_TCK")
+
+
+def run(shim, frames, payload_size):
+    io_proxy, io_shim = socket.socketpair()
+    ctl_proxy, ctl_shim = socket.socketpair()
+
+    sink = subprocess.Popen(["cat"], stdin=subprocess.PIPE,
+                            stdout=subprocess.DEVNULL)
+
+    proc = subprocess.Popen([shim, "--container-id", "bench",
+                             "--proxy-sock-fd", str(ctl_shim.fileno()),
+                             "--proxy-io-fd", str(io_shim.fileno()),
+                             "--seq-no", str(SEQ),
+                             "--err-seq-no", str(SEQ + 1)],
+                            pass_fds=(ctl_shim.fileno(), io_shim.fileno()),
+                            stdin=subprocess.DEVNULL, stdout=sink.stdin)
+    sink.stdin.close()
+    io_shim.close()
+    ctl_shim.close()
+
+    payload = b"x" * payload_size
+    batch = frame(SEQ, payload) * 64
+    total = frames * payload_size
+
+    time.sleep(0.1)
+    before = proc_io(proc.pid)
+    start = time.monotonic()
+
+    for _ in range(frames // 64):
+        io_proxy.sendall(batch)
+    for _ in range(frames % 64):
+        io_proxy.sendall(frame(SEQ, payload))
+
+    # wait for the shim to write everything out
+    while proc_io(proc.pid)["wchar"] - before["wchar"] < total:
+        time.sleep(0.001)
+
+    elapsed = time.monotonic() - start
+    after = proc_io(proc.pid)
+
+    # eof followed by the exit code
+    io_proxy.sendall(frame(SEQ, b"") + frame(SEQ, b"\x00"))
+    proc.wait()
+    sink.wait()
+
+    reads = after["syscr"] - before["syscr"]
+    writes = after["syscw"] - before["syscw"]
+
+    return total / elapsed / 1e6, reads / frames, writes / frames
+
+
+def run_stdin(shim, total):
+    io_proxy, io_shim = socket.socketpair()
+    ctl_proxy, ctl_shim = socket.socketpair()
+
+    source = subprocess.Popen(["head", "-c", str(total), "/dev/zero"],
+                              stdout=subprocess.PIPE)
+
+    proc = subprocess.Popen([shim, "--container-id", "bench",
+                             "--proxy-sock-fd", str(ctl_shim.fileno()),
+                             "--proxy-io-fd", str(io_shim.fileno()),
+                             "--seq-no", str(SEQ),
+                             "--err-seq-no", str(SEQ + 1)],
+                            pass_fds=(ctl_shim.fileno(), io_shim.fileno()),
+                            stdin=source.stdout, stdout=subprocess.DEVNULL)
+    source.stdout.close()
+    io_shim.close()
+    ctl_shim.close()
+
+    start = time.monotonic()
+    buf = bytearray()
+    received = 0
+    frames = 0
+    view = memoryview(bytearray(1 << 20))
+
+    # read frames until the empty one signalling EOF
+    while True:
+        n = io_proxy.recv_into(view)
+        if n == 0:
+            sys.exit("shim closed the I/O socket")
+        buf += view[:n]
+        eof = False
+        offset = 0
+        while len(buf) - offset >= 12:
+            seq, length = struct.unpack_from(STREAM_HEADER, buf, offset)
+            if seq != SEQ or not 12 <= length <= 10240:
+                sys.exit("invalid frame (seq %d, length %d)" % (seq, length))
+            if len(buf) - offset < length:
+                break
+            offset += length
+            if length == 12:
+                eof = True
+                break
+            received += length - 12
+            frames += 1
+        del buf[:offset]
+        if eof:
+            break
+
+    elapsed = time.monotonic() - start
+    after = proc_io(proc.pid)
+    cpu = proc_cpu(proc.pid)
+
+    io_proxy.sendall(frame(SEQ, b"") + frame(SEQ, b"\x00"))
+    proc.wait()
+    source.wait()
+
+    if received != total:
+        sys.exit("received %d bytes, expected %d" % (received, total))
+
+    return (total / elapsed / 1e6, after["syscr"] / frames,
+            after["syscw"] / frames, cpu)
+
+
+def main():
+    parser = argparse.ArgumentParser(description="cc-shim I/O throughput")
+    parser.add_argument("shim", help="path to the cc-shim binary")
+    parser.add_argument("-n", "--frames", type=int, default=200000,
+                        help="number of frames to send")
+    parser.add_argument("-s", "--size", type=int, default=1024,
+                        help="payload size of each frame in bytes")
+    parser.add_argument("-r", "--runs", type=int, default=3,
+                        help="number of runs")
+    parser.add_argument("--stdin", type=int, metavar="MB",
+                        help="measure forwarding MB megabytes of stdin instead")
+    args = parser.parse_args()
+
+    if args.stdin:
+        print("stdin=%d MB" % args.stdin)
+        for i in range(args.runs):
+            mbps, reads, writes, cpu = run_stdin(args.shim,
+                                                 args.stdin * 1000000)
+            print("run %d: %.1f MB/s, %.2f reads/frame, %.2f writes/frame, "
+                  "shim CPU %.2fs" % (i + 1, mbps, reads, writes, cpu))
+        return
+
+    if not 0 < args.size <= 10240 - 12:
+        sys.exit("invalid payload size")
+
+    print("frames=%d payload=%d bytes" % (args.frames, args.size))
+    for i in range(args.runs):
+        mbps, reads, writes = run(args.shim, args.frames, args.size)
+        print("run %d: %.1f MB/s, %.2f reads/frame, %.2f writes/frame" %
+              (i + 1, mbps, reads, writes))
+
+
+if __name__ == "__main__":
+    main()
@@ -568,10 +568,10 @@ START_TEST(test_cc_oci_list) {
 	ck_assert (! g_remove (outfile));
 	g_free (outfile);
 	/* clean up */
-	ck_assert (! g_remove (vm1_config->state.state_file_path));
+	ck_assert (cc_oci_state_file_delete (vm1_config));
 	ck_assert (! g_remove (vm1_config->state.runtime_path));
 
-	ck_assert (! g_remove (tmpdir));
+	ck_assert (cc_oci_rm_rf (tmpdir));
 	g_free (tmpdir);
 	cc_oci_config_free (vm1_config);
 	cc_oci_config_free (config);
@@ -778,10 +778,10 @@ START_TEST(test_cc_oci_get_config_and_state) {
 	ck_assert (! g_strcmp0 (state->vm->kernel_params, vm1_config->vm->kernel_params));
 
 	/* clean up */
-	ck_assert (! g_remove (vm1_config->state.state_file_path));
+	ck_assert (cc_oci_state_file_delete (vm1_config));
 	ck_assert (! g_remove (vm1_config->state.runtime_path));
 
-	ck_assert (! g_remove (tmpdir));
+	ck_assert (cc_oci_rm_rf (tmpdir));
 	g_free (tmpdir);
 	cc_oci_config_free (vm1_config);
 	cc_oci_config_free (config);
@@ -1003,7 +1003,7 @@ START_TEST(test_cc_oci_kill) {
 	ck_assert (state_new->status == OCI_STATUS_STOPPED);
 
 	/* clean up */
-	ck_assert (! g_remove (config_tmp->state.state_file_path));
+	ck_assert (cc_oci_state_file_delete (config_tmp));
 	ck_assert (! g_remove (config_tmp->state.runtime_path));
 
 	cc_oci_state_free (state);
@@ -1012,7 +1012,7 @@ START_TEST(test_cc_oci_kill) {
 	cc_oci_config_free (config);
 	cc_oci_config_free (config_new);
 
-	ck_assert (! g_remove (tmpdir));
+	ck_assert (cc_oci_rm_rf (tmpdir));
 
 } END_TEST
 
@@ -21,6 +21,7 @@
 #include <stdlib.h>
 #include <stdbool.h>
 #include <stdio.h>
+#include <unistd.h>
 #include <sys/types.h>
 #include <sys/socket.h>
 
@@ -44,7 +45,7 @@ gboolean cc_oci_setup_shim (struct cc_oci_config *config,
 		int proxy_io_fd,
 		int shim_flock_fd);
 GSocketConnection *cc_oci_socket_connection_from_fd (int fd);
-gboolean cc_oci_setup_child (struct cc_oci_config *config);
+gboolean cc_oci_setup_child (struct cc_oci_config *config, GArray *fds);
 gboolean cc_oci_vm_netcfg_get (struct cc_oci_config *config,
 		struct netlink_handle *hndl);
 gboolean
@@ -226,11 +227,24 @@ START_TEST(test_socket_connection_from_fd) {
 
 START_TEST(test_cc_oci_setup_child) {
 	struct cc_oci_config config = { { 0 } };
-	ck_assert (! cc_oci_setup_child (NULL));
-	ck_assert (cc_oci_setup_child (&config));
+	GArray *fds;
+	int pipefd[2] = { -1, -1 };
+
+	ck_assert (! cc_oci_setup_child (NULL, NULL));
+	ck_assert (cc_oci_setup_child (&config, NULL));
+
+	/* fds in the array must survive */
+	ck_assert (! pipe (pipefd));
+	fds = g_array_sized_new (FALSE, FALSE, sizeof (int), 1);
+	g_array_append_val (fds, pipefd[1]);
+	ck_assert (cc_oci_setup_child (&config, fds));
+	ck_assert (fcntl (pipefd[1], F_GETFD) != -1);
+	ck_assert (fcntl (pipefd[0], F_GETFD) == -1);
+	close (pipefd[1]);
+	g_array_free (fds, TRUE);
 
 	config.detached_mode = true;
-	ck_assert (cc_oci_setup_child (&config));
+	ck_assert (cc_oci_setup_child (&config, NULL));
 } END_TEST
 
 Suite* make_process_suite(void) {
@@ -20,6 +20,10 @@
 
 #include <stdlib.h>
 #include <stdbool.h>
+#include <string.h>
+#include <unistd.h>
+#include <arpa/inet.h>
+#include <sys/socket.h>
 
 #include <check.h>
 #include <glib.h>
@@ -31,6 +35,40 @@
 
 gboolean cc_proxy_connect (struct cc_proxy *proxy);
 gboolean cc_proxy_disconnect (struct cc_proxy *proxy);
+gboolean cc_proxy_msg_write (int fd, guint32 flags, const gchar *msg_to_send,
+		gsize len);
+gboolean cc_proxy_msg_read (int fd, GString *msg_received, guint32 *flags);
+gboolean cc_proxy_binary_response_parse (const GString *response,
+		gboolean *proxy_success, gchar **error, const gchar *name,
+		gint64 *value);
+
+/* Queue a reply from the "proxy" on fd */
+static void
+write_reply_len (int fd, guint32 flags, const char *reply, size_t size)
+{
+	guint32 len = htonl ((guint32)size);
+
+	flags = htonl (flags);
+
+	ck_assert (write (fd, &len, sizeof (len)) == sizeof (len));
+	ck_assert (write (fd, &flags, sizeof (flags)) == sizeof (flags));
+	ck_assert (write (fd, reply, size) == (ssize_t)size);
+}
+
+static void
+write_reply (int fd, const char *reply)
+{
+	write_reply_len (fd, 0, reply, strlen (reply));
+}
+
+/* binary reply: success, no error, ioBase=0x102 */
+static const char binary_io_base_reply[] = {
+	1,
+	0, 0,
+	1,
+	0, 6, 'i', 'o', 'B', 'a', 's', 'e',
+	0, 0, 0, 0, 0, 0, 1, 2
+};
 
 START_TEST(test_cc_proxy_connect) {
 
@@ -56,11 +94,174 @@ START_TEST(test_cc_proxy_disconnect) {
 
 } END_TEST
 
+START_TEST(test_cc_proxy_msg_write_read) {
+	int sockets[2] = { -1, -1 };
+	GString *msg = NULL;
+	guint32 flags;
+
+	ck_assert (! socketpair (AF_UNIX, SOCK_STREAM, 0, sockets));
+
+	msg = g_string_new ("");
+
+	ck_assert (cc_proxy_msg_write (sockets[0], 0,
+				"{\"id\":\"hello\"}", 14));
+	ck_assert (cc_proxy_msg_write (sockets[0], PROXY_MSG_FLAG_BINARY,
+				"\x03\0\0", 3));
+
+	/* messages are framed, so can be read back one at a time */
+	ck_assert (cc_proxy_msg_read (sockets[1], msg, &flags));
+	ck_assert_str_eq (msg->str, "{\"id\":\"hello\"}");
+	ck_assert (flags == 0);
+
+	g_string_truncate (msg, 0);
+	ck_assert (cc_proxy_msg_read (sockets[1], msg, &flags));
+	ck_assert (msg->len == 3);
+	ck_assert (! memcmp (msg->str, "\x03\0\0", 3));
+	ck_assert (flags == PROXY_MSG_FLAG_BINARY);
+
+	/* EOF */
+	close (sockets[0]);
+	g_string_truncate (msg, 0);
+	ck_assert (! cc_proxy_msg_read (sockets[1], msg, &flags));
+
+	g_string_free (msg, true);
+	close (sockets[1]);
+} END_TEST
+
+START_TEST(test_cc_proxy_attach) {
+	struct cc_proxy proxy = { 0 };
+	int sockets[2] = { -1, -1 };
+	GString *msg = NULL;
+	guint32 flags;
+
+	ck_assert (! cc_proxy_attach (NULL, NULL));
+	ck_assert (! cc_proxy_attach (&proxy, "foo"));
+
+	ck_assert (! socketpair (AF_UNIX, SOCK_STREAM, 0, sockets));
+	proxy.socket = g_socket_new_from_fd (sockets[0], NULL);
+	ck_assert (proxy.socket);
+
+	ck_assert (! cc_proxy_attach (&proxy, NULL));
+
+	msg = g_string_new ("");
+
+	write_reply (sockets[1], "{\"success\":true}");
+	ck_assert (cc_proxy_attach (&proxy, "foo"));
+
+	ck_assert (cc_proxy_msg_read (sockets[1], msg, &flags));
+	ck_assert (g_strstr_len (msg->str, -1, "\"attach\""));
+	ck_assert (g_strstr_len (msg->str, -1, "\"foo\""));
+	ck_assert (flags == 0);
+
+	/* no version reported: stick to JSON */
+	ck_assert (! proxy.binary);
+
+	write_reply (sockets[1], "{\"success\":false,\"error\":\"no\"}");
+	ck_assert (! cc_proxy_attach (&proxy, "foo"));
+
+	g_string_free (msg, true);
+	g_object_unref (proxy.socket);
+	close (sockets[1]);
+} END_TEST
+
+START_TEST(test_cc_proxy_binary_response_parse) {
+	GString *response = g_string_new ("");
+	gboolean success = false;
+	gchar *error = NULL;
+	gint64 value = 0;
+
+	ck_assert (! cc_proxy_binary_response_parse (NULL, &success,
+				NULL, NULL, NULL));
+
+	g_string_append_len (response, binary_io_base_reply,
+			sizeof (binary_io_base_reply));
+
+	ck_assert (cc_proxy_binary_response_parse (response, &success,
+				&error, "ioBase", &value));
+	ck_assert (success);
+	ck_assert_str_eq (error, "");
+	ck_assert (value == 0x102);
+	g_free (error);
+
+	/* unknown result */
+	ck_assert (! cc_proxy_binary_response_parse (response, &success,
+				NULL, "foo", &value));
+
+	/* truncated */
+	g_string_truncate (response, response->len - 1);
+	ck_assert (! cc_proxy_binary_response_parse (response, &success,
+				NULL, "ioBase", &value));
+
+	/* failure with an error message */
+	g_string_truncate (response, 0);
+	g_string_append_len (response, "\0\0\x02no\0", 6);
+	ck_assert (cc_proxy_binary_response_parse (response, &success,
+				&error, NULL, NULL));
+	ck_assert (! success);
+	ck_assert_str_eq (error, "no");
+	g_free (error);
+
+	g_string_free (response, true);
+} END_TEST
+
+START_TEST(test_cc_proxy_cmd_allocate_io_binary) {
+	struct cc_proxy proxy = { 0 };
+	int sockets[2] = { -1, -1 };
+	GString *msg = NULL;
+	guint32 flags;
+	int io_base = -1;
+
+	ck_assert (! socketpair (AF_UNIX, SOCK_STREAM, 0, sockets));
+	proxy.socket = g_socket_new_from_fd (sockets[0], NULL);
+	ck_assert (proxy.socket);
+
+	msg = g_string_new ("");
+
+	/* a version 2 proxy enables the binary encoding... */
+	write_reply (sockets[1], "{\"success\":true,"
+			"\"data\":{\"version\":2}}");
+	ck_assert (cc_proxy_attach (&proxy, "foo"));
+	ck_assert (proxy.binary);
+	ck_assert (cc_proxy_msg_read (sockets[1], msg, &flags));
+	ck_assert (flags == 0);
+
+	/* ... which is then used for allocateIO */
+	write_reply_len (sockets[1], PROXY_MSG_FLAG_BINARY,
+			binary_io_base_reply, sizeof (binary_io_base_reply));
+	ck_assert (cc_proxy_cmd_allocate_io (&proxy, NULL, &io_base, true));
+	ck_assert (io_base == 0x102);
+
+	g_string_truncate (msg, 0);
+	ck_assert (cc_proxy_msg_read (sockets[1], msg, &flags));
+	ck_assert (flags == PROXY_MSG_FLAG_BINARY);
+	ck_assert (msg->len == 5);
+	ck_assert (! memcmp (msg->str, "\x04\0\0\0\x01", 5));
+
+	/* failures are reported in the binary reply */
+	write_reply_len (sockets[1], PROXY_MSG_FLAG_BINARY,
+			"\0\0\0\0", 4);
+	ck_assert (! cc_proxy_cmd_allocate_io (&proxy, NULL, &io_base, true));
+
+	/* an older proxy disables it again */
+	write_reply (sockets[1], "{\"success\":true,"
+			"\"data\":{\"version\":1}}");
+	ck_assert (cc_proxy_attach (&proxy, "foo"));
+	ck_assert (! proxy.binary);
+
+	g_string_free (msg, true);
+	g_object_unref (proxy.socket);
+	close (sockets[1]);
+} END_TEST
+
 Suite* make_proxy_suite(void) {
 	Suite* s = suite_create(__FILE__);
 
 	ADD_TEST (test_cc_proxy_connect, s);
 	ADD_TEST (test_cc_proxy_disconnect, s);
+	ADD_TEST (test_cc_proxy_msg_write_read, s);
+	ADD_TEST (test_cc_proxy_binary_response_parse, s);
+	ADD_TEST (test_cc_proxy_attach, s);
+	ADD_TEST (test_cc_proxy_cmd_allocate_io_binary, s);
 
 	return s;
 }
@@ -0,0 +1,378 @@
+/*
+ * This file is part of cc-oci-runtime.
+ *
+ * Copyright (C) 2017 Intel Corporation
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+#include <stdlib.h>
+#include <stdbool.h>
+#include <string.h>
+#include <sys/stat.h>
+
+#include <check.h>
+#include <glib.h>
+#include <glib/gstdio.h>
+
+#include "test_common.h"
+#include "../src/oci.h"
+#include "../src/logging.h"
+#include "../src/state.h"
+#include "../src/runtime.h"
+#include "../src/util.h"
+#include "../src/registry.h"
+
+/*
+ * Read the registry header and check whether it corresponds to the
+ * current state of the root directory.
+ */
+static gboolean
+registry_matches (const char *root_dir, guint32 *count)
+{
+	struct cc_oci_registry_header  header;
+	g_autofree gchar              *path = NULL;
+	g_autofree gchar              *contents = NULL;
+	gsize                          len;
+	struct stat                    st;
+
+	path = g_build_path ("/", root_dir, CC_OCI_REGISTRY_DIR,
+			CC_OCI_REGISTRY_FILE, NULL);
+
+	if (! g_file_get_contents (path, &contents, &len, NULL)) {
+		return false;
+	}
+
+	if (len < sizeof (header)) {
+		return false;
+	}
+
+	memcpy (&header, contents, sizeof (header));
+
+	if (stat (root_dir, &st) < 0) {
+		return false;
+	}
+
+	*count = header.count;
+
+	return header.magic == CC_OCI_REGISTRY_MAGIC
+		&& len == sizeof (header) + header.count * header.record_size
+		&& header.root_mtime_sec == (gint64)st.st_mtim.tv_sec
+		&& header.root_mtime_nsec == (gint64)st.st_mtim.tv_nsec;
+}
+
+/*
+ * Determine the inode of the registry, which only changes when it is
+ * rebuilt.
+ */
+static ino_t
+registry_inode (const char *root_dir)
+{
+	g_autofree gchar  *path = NULL;
+	struct stat        st;
+
+	path = g_build_path ("/", root_dir, CC_OCI_REGISTRY_DIR,
+			CC_OCI_REGISTRY_FILE, NULL);
+
+	if (stat (path, &st) < 0) {
+		return 0;
+	}
+
+	return st.st_ino;
+}
+
+/*
+ * Wait for the directories being deleted in the background below
+ * root_dir to be gone.
+ */
+static gboolean
+trash_wait_empty (const char *root_dir)
+{
+	g_autofree gchar  *trash_dir = NULL;
+	GDir              *dir;
+	gboolean           empty = false;
+	int                i;
+
+	trash_dir = g_build_path ("/", root_dir, CC_OCI_RM_RF_ASYNC_DIR,
+			NULL);
+
+	for (i = 0; ! empty && i < 100; i++) {
+		dir = g_dir_open (trash_dir, 0, NULL);
+		if (! dir) {
+			return false;
+		}
+
+		empty = ! g_dir_read_name (dir);
+		g_dir_close (dir);
+
+		if (! empty) {
+			g_usleep (G_USEC_PER_SEC / 10);
+		}
+	}
+
+	return empty;
+}
+
+START_TEST(test_cc_oci_registry_list) {
+	struct cc_oci_config  *vm1_config = NULL;
+	struct cc_oci_config  *vm2_config = NULL;
+	struct oci_state      *state;
+	GSList                *states = NULL;
+	g_autofree gchar      *tmpdir = NULL;
+	g_autofree gchar      *root_dir = NULL;
+	g_autofree gchar      *path = NULL;
+	guint32                count = 0;
+	ino_t                  inode;
+
+	tmpdir = g_dir_make_tmp (NULL, NULL);
+	ck_assert (tmpdir);
+
+	ck_assert (! cc_oci_registry_list (NULL, false, &states));
+	ck_assert (! cc_oci_registry_list (tmpdir, false, NULL));
+
+	/* no containers yet */
+	root_dir = g_build_path ("/", tmpdir, "does-not-exist", NULL);
+	ck_assert (cc_oci_registry_list (root_dir, false, &states));
+	ck_assert (! states);
+	ck_assert (! g_file_test (root_dir, G_FILE_TEST_EXISTS));
+
+	ck_assert (cc_oci_registry_list (tmpdir, false, &states));
+	ck_assert (! states);
+	ck_assert (registry_matches (tmpdir, &count));
+	ck_assert (count == 0);
+
+	/* creating the state files updates the registry */
+	vm1_config = cc_oci_config_create ();
+	ck_assert (vm1_config);
+	ck_assert (test_helper_create_state_file ("vm1", tmpdir,
+				vm1_config));
+
+	vm2_config = cc_oci_config_create ();
+	ck_assert (vm2_config);
+	ck_assert (test_helper_create_state_file ("vm2", tmpdir,
+				vm2_config));
+
+	ck_assert (registry_matches (tmpdir, &count));
+	ck_assert (count == 2);
+
+	ck_assert (cc_oci_registry_list (tmpdir, false, &states));
+	ck_assert (g_slist_length (states) == 2);
+
+	state = states->data;
+	ck_assert (! g_strcmp0 (state->id, "vm1"));
+	ck_assert (state->pid == vm1_config->state.workload_pid);
+	ck_assert (state->status == OCI_STATUS_CREATED);
+	ck_assert (! g_strcmp0 (state->bundle_path,
+				vm1_config->bundle_path));
+	ck_assert (! g_strcmp0 (state->create_time, "timestamp for vm1"));
+	ck_assert (state->vm);
+	ck_assert (state->vm->pid == vm1_config->vm->pid);
+
+	/* the VM paths are only read in full mode */
+	ck_assert (! *state->vm->hypervisor_path);
+
+	state = states->next->data;
+	ck_assert (! g_strcmp0 (state->id, "vm2"));
+
+	g_slist_free_full (states, (GDestroyNotify)cc_oci_state_free);
+
+	/* full details */
+	ck_assert (cc_oci_registry_list (tmpdir, true, &states));
+	ck_assert (g_slist_length (states) == 2);
+
+	state = states->data;
+	ck_assert (! g_strcmp0 (state->id, "vm1"));
+	ck_assert (! g_strcmp0 (state->vm->hypervisor_path,
+				"hypervisor-path"));
+
+	g_slist_free_full (states, (GDestroyNotify)cc_oci_state_free);
+
+	/* updating a state file updates its record, in place */
+	inode = registry_inode (tmpdir);
+	ck_assert (inode);
+
+	vm1_config->state.status = OCI_STATUS_RUNNING;
+	ck_assert (cc_oci_state_file_create (vm1_config, "foo"));
+
+	ck_assert (registry_inode (tmpdir) == inode);
+
+	ck_assert (cc_oci_registry_list (tmpdir, false, &states));
+	ck_assert (g_slist_length (states) == 2);
+
+	state = states->data;
+	ck_assert (! g_strcmp0 (state->id, "vm1"));
+	ck_assert (state->status == OCI_STATUS_RUNNING);
+	ck_assert (! g_strcmp0 (state->create_time, "foo"));
+
+	g_slist_free_full (states, (GDestroyNotify)cc_oci_state_free);
+
+	/* deleting a container removes its record, without
+	 * invalidating the registry.
+	 */
+	ck_assert (cc_oci_state_file_delete (vm2_config));
+	ck_assert (cc_oci_runtime_dir_delete (vm2_config));
+
+	ck_assert (registry_matches (tmpdir, &count));
+	ck_assert (count == 1);
+	ck_assert (registry_inode (tmpdir) == inode);
+
+	ck_assert (cc_oci_registry_list (tmpdir, false, &states));
+	ck_assert (g_slist_length (states) == 1);
+
+	state = states->data;
+	ck_assert (! g_strcmp0 (state->id, "vm1"));
+
+	g_slist_free_full (states, (GDestroyNotify)cc_oci_state_free);
+
+	/* a missing registry is rebuilt */
+	path = g_build_path ("/", tmpdir, CC_OCI_REGISTRY_DIR,
+			CC_OCI_REGISTRY_FILE, NULL);
+	ck_assert (! g_remove (path));
+
+	ck_assert (cc_oci_registry_list (tmpdir, false, &states));
+	ck_assert (g_slist_length (states) == 1);
+
+	state = states->data;
+	ck_assert (! g_strcmp0 (state->id, "vm1"));
+	ck_assert (state->status == OCI_STATUS_RUNNING);
+
+	g_slist_free_full (states, (GDestroyNotify)cc_oci_state_free);
+
+	ck_assert (registry_matches (tmpdir, &count));
+	ck_assert (count == 1);
+
+	/* as is an invalid one */
+	ck_assert (g_file_set_contents (path, "garbage", -1, NULL));
+
+	ck_assert (cc_oci_registry_list (tmpdir, false, &states));
+	ck_assert (g_slist_length (states) == 1);
+
+	g_slist_free_full (states, (GDestroyNotify)cc_oci_state_free);
+
+	ck_assert (registry_matches (tmpdir, &count));
+	ck_assert (count == 1);
+
+	/* and one made out of date by changes to the root directory */
+	ck_assert (cc_oci_rm_rf (vm1_config->state.runtime_path));
+	ck_assert (! registry_matches (tmpdir, &count));
+
+	ck_assert (cc_oci_registry_list (tmpdir, false, &states));
+	ck_assert (! states);
+
+	ck_assert (registry_matches (tmpdir, &count));
+	ck_assert (count == 0);
+
+	/* clean up */
+	cc_oci_config_free (vm1_config);
+	cc_oci_config_free (vm2_config);
+	ck_assert (cc_oci_rm_rf (tmpdir));
+} END_TEST
+
+START_TEST(test_cc_oci_registry_async_delete) {
+	struct cc_oci_config  *vm1_config = NULL;
+	struct cc_oci_config  *vm2_config = NULL;
+	struct cc_oci_config  *vm3_config = NULL;
+	GSList                *states = NULL;
+	g_autofree gchar      *tmpdir = NULL;
+	guint32                count = 0;
+
+	tmpdir = g_dir_make_tmp (NULL, NULL);
+	ck_assert (tmpdir);
+
+	vm1_config = cc_oci_config_create ();
+	ck_assert (vm1_config);
+	ck_assert (test_helper_create_state_file ("vm1", tmpdir,
+				vm1_config));
+
+	vm2_config = cc_oci_config_create ();
+	ck_assert (vm2_config);
+	ck_assert (test_helper_create_state_file ("vm2", tmpdir,
+				vm2_config));
+
+	vm3_config = cc_oci_config_create ();
+	ck_assert (vm3_config);
+	ck_assert (test_helper_create_state_file ("vm3", tmpdir,
+				vm3_config));
+
+	ck_assert (registry_matches (tmpdir, &count));
+	ck_assert (count == 3);
+
+	/* removing the contents in the background doesn't invalidate
+	 * the registry, whether or not the trash directory existed.
+	 */
+	vm2_config->async_delete = true;
+	ck_assert (cc_oci_state_file_delete (vm2_config));
+	ck_assert (cc_oci_runtime_dir_delete (vm2_config));
+	ck_assert (! g_file_test (vm2_config->state.runtime_path,
+				G_FILE_TEST_EXISTS));
+	ck_assert (trash_wait_empty (tmpdir));
+
+	ck_assert (registry_matches (tmpdir, &count));
+	ck_assert (count == 2);
+
+	vm3_config->async_delete = true;
+	ck_assert (cc_oci_state_file_delete (vm3_config));
+	ck_assert (cc_oci_runtime_dir_delete (vm3_config));
+	ck_assert (trash_wait_empty (tmpdir));
+
+	ck_assert (registry_matches (tmpdir, &count));
+	ck_assert (count == 1);
+
+	/* the trash directory isn't a container */
+	ck_assert (cc_oci_registry_list (tmpdir, false, &states));
+	ck_assert (g_slist_length (states) == 1);
+	ck_assert (! g_strcmp0 (((struct oci_state *)states->data)->id,
+				"vm1"));
+
+	g_slist_free_full (states, (GDestroyNotify)cc_oci_state_free);
+
+	/* clean up */
+	cc_oci_config_free (vm1_config);
+	cc_oci_config_free (vm2_config);
+	cc_oci_config_free (vm3_config);
+	ck_assert (cc_oci_rm_rf (tmpdir));
+} END_TEST
+
+Suite* make_registry_suite(void) {
+	Suite* s = suite_create(__FILE__);
+
+	ADD_TEST(test_cc_oci_registry_list, s);
+	ADD_TEST(test_cc_oci_registry_async_delete, s);
+
+	return s;
+}
+
+int main (void) {
+	int number_failed;
+	Suite* s;
+	SRunner* sr;
+	struct cc_log_options options = { 0 };
+
+	options.enable_debug = true;
+	options.use_json = false;
+	options.filename = g_strdup ("registry_test_debug.log");
+	(void)cc_oci_log_init(&options);
+
+	s = make_registry_suite();
+	sr = srunner_create(s);
+
+	srunner_run_all(sr, CK_VERBOSE);
+	number_failed = srunner_ntests_failed(sr);
+	srunner_free(sr);
+
+	cc_oci_log_free (&options);
+
+	return (number_failed == 0) ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -20,6 +20,7 @@
 
 #include <stdlib.h>
 #include <stdbool.h>
+#include <string.h>
 #include <unistd.h>
 #include <sys/stat.h>
 #include <fcntl.h>
@@ -32,6 +33,8 @@
 #include "../src/logging.h"
 #include "../src/oci.h"
 #include "../src/state.h"
+#include "../src/util.h"
+#include "../src/json.h"
 
 #define error_free_if_set(e) if (e) { g_error_free(e); error=NULL; }
 
@@ -143,6 +146,45 @@ START_TEST(test_cc_oci_state_file_read) {
 
 } END_TEST
 
+START_TEST(test_cc_oci_state_files_read) {
+	struct oci_state  *state;
+	GPtrArray         *states;
+	const gchar       *files[32];
+	guint              i;
+
+	states = cc_oci_state_files_read (NULL, 0);
+	ck_assert (states);
+	ck_assert (states->len == 0);
+	g_ptr_array_free (states, true);
+
+	/* enough files to be read in parallel */
+	for (i = 0; i < G_N_ELEMENTS (files); i++) {
+		files[i] = i % 4 ? TEST_DATA_DIR "/state.json"
+			: i % 8 ? "/abc/123/xyz"
+			: TEST_DATA_DIR "/state-no-id.json";
+	}
+
+	for (i = 1; i <= G_N_ELEMENTS (files); i *= 2) {
+		guint j;
+
+		states = cc_oci_state_files_read (files, i);
+		ck_assert (states);
+		ck_assert (states->len == i);
+
+		for (j = 0; j < i; j++) {
+			state = g_ptr_array_index (states, j);
+			if (j % 4) {
+				ck_assert (state);
+				ck_assert (! g_strcmp0 (state->id, "foo"));
+			} else {
+				ck_assert (! state);
+			}
+		}
+
+		g_ptr_array_free (states, true);
+	}
+} END_TEST
+
 START_TEST(test_cc_oci_state_free) {
 	struct oci_state *state = g_new0 (struct oci_state, 1);
 	ck_assert(state);
@@ -260,9 +302,9 @@ START_TEST(test_cc_oci_state_file_create) {
 			G_FILE_TEST_EXISTS);
 	ck_assert (ret);
 
-	ck_assert (! g_remove (config->state.state_file_path));
+	ck_assert (cc_oci_state_file_delete (config));
 	ck_assert (! g_remove (config->state.runtime_path));
-	ck_assert (! g_remove (tmpdir));
+	ck_assert (cc_oci_rm_rf (tmpdir));
 
 	g_snprintf(config->state.runtime_path, PATH_MAX, "/abc/xyz/123");
 	ck_assert(!cc_oci_state_file_create (config, timestamp));
@@ -271,6 +313,95 @@ START_TEST(test_cc_oci_state_file_create) {
 	cc_oci_config_free (config);
 } END_TEST
 
+START_TEST(test_cc_oci_state_file_update) {
+	struct cc_oci_config     *config = NULL;
+	struct oci_state         *state = NULL;
+	struct cc_oci_state_bin   bin;
+	g_autofree gchar         *tmpdir = NULL;
+	g_autofree gchar         *before = NULL;
+	g_autofree gchar         *after = NULL;
+	const gchar              *unchanged[] = {
+		"id", "bundlePath", "created", "mounts", "process", "console"
+	};
+	gsize                     i;
+
+	ck_assert (! cc_oci_state_file_update (NULL, "foo"));
+
+	tmpdir = g_dir_make_tmp (NULL, NULL);
+	ck_assert (tmpdir);
+
+	config = cc_oci_config_create ();
+	ck_assert (config);
+
+	ck_assert (! cc_oci_state_file_update (config, NULL));
+
+	config->state.status = OCI_STATUS_CREATED;
+	ck_assert (test_helper_create_state_file ("vm1", tmpdir, config));
+
+	ck_assert (g_file_get_contents (config->state.state_file_path,
+				&before, NULL, NULL));
+
+	config->state.status = OCI_STATUS_PAUSED;
+	config->vm->pid = 1234;
+	config->proxy->agent_ctl_socket = g_strdup ("/ctl\"socket\"");
+	ck_assert (cc_oci_state_file_update (config, "timestamp for vm1"));
+
+	state = cc_oci_state_file_read (config->state.state_file_path);
+	ck_assert (state);
+	ck_assert (state->status == OCI_STATUS_PAUSED);
+	ck_assert (state->pid == config->state.workload_pid);
+	ck_assert (state->vm->pid == 1234);
+	ck_assert (! g_strcmp0 (state->proxy->agent_ctl_socket,
+				"/ctl\"socket\""));
+	ck_assert (! g_strcmp0 (state->create_time, "timestamp for vm1"));
+	ck_assert (! g_strcmp0 (state->vm->hypervisor_path,
+				config->vm->hypervisor_path));
+	cc_oci_state_free (state);
+
+	/* the binary state file is updated too */
+	ck_assert (cc_oci_state_bin_read (config->state.runtime_path, &bin));
+	ck_assert (bin.status == OCI_STATUS_PAUSED);
+	ck_assert (bin.vm_pid == 1234);
+
+	/* the other members are left as they were */
+	ck_assert (g_file_get_contents (config->state.state_file_path,
+				&after, NULL, NULL));
+
+	for (i = 0; i < G_N_ELEMENTS (unchanged); i++) {
+		const gchar *path[] = { unchanged[i], NULL };
+		gsize before_offset, before_len;
+		gsize after_offset, after_len;
+
+		ck_assert (cc_oci_json_member_find (before, strlen (before),
+					path, &before_offset, &before_len));
+		ck_assert (cc_oci_json_member_find (after, strlen (after),
+					path, &after_offset, &after_len));
+		ck_assert (before_len == after_len);
+		ck_assert (! memcmp (before + before_offset,
+					after + after_offset, before_len));
+	}
+
+	/* a state file that doesn't hold all the fields is recreated */
+	g_free (before);
+	before = g_strdup ("{ \"status\" : \"created\" }");
+	ck_assert (g_file_set_contents (config->state.state_file_path,
+				before, -1, NULL));
+
+	config->state.status = OCI_STATUS_STOPPED;
+	ck_assert (cc_oci_state_file_update (config, "timestamp for vm1"));
+
+	state = cc_oci_state_file_read (config->state.state_file_path);
+	ck_assert (state);
+	ck_assert (state->status == OCI_STATUS_STOPPED);
+	ck_assert (! g_strcmp0 (state->id, "vm1"));
+	cc_oci_state_free (state);
+
+	/* clean up */
+	ck_assert (cc_oci_state_file_delete (config));
+	cc_oci_config_free (config);
+	ck_assert (cc_oci_rm_rf (tmpdir));
+} END_TEST
+
 START_TEST(test_cc_oci_state_file_delete) {
 	struct stat st;
 	struct cc_oci_config *config = NULL;
@@ -294,6 +425,70 @@ START_TEST(test_cc_oci_state_file_delete) {
 	cc_oci_config_free (config);
 } END_TEST
 
+START_TEST(test_cc_oci_state_bin_read) {
+	struct cc_oci_config     *config = NULL;
+	struct cc_oci_state_bin   bin;
+	g_autofree gchar         *tmpdir = NULL;
+	g_autofree gchar         *path = NULL;
+	g_autofree gchar         *contents = NULL;
+
+	tmpdir = g_dir_make_tmp (NULL, NULL);
+	ck_assert (tmpdir);
+
+	ck_assert (! cc_oci_state_bin_read (NULL, &bin));
+	ck_assert (! cc_oci_state_bin_read (tmpdir, NULL));
+	ck_assert (! cc_oci_state_bin_read (tmpdir, &bin));
+
+	config = cc_oci_config_create ();
+	ck_assert (config);
+
+	config->state.status = OCI_STATUS_CREATED;
+	ck_assert (test_helper_create_state_file ("vm1", tmpdir, config));
+
+	ck_assert (cc_oci_state_bin_read (config->state.runtime_path, &bin));
+	ck_assert (bin.status == OCI_STATUS_CREATED);
+	ck_assert (bin.pid == config->state.workload_pid);
+	ck_assert (bin.vm_pid == config->vm->pid);
+	ck_assert (! g_strcmp0 (bin.comms_path, config->state.comms_path));
+
+	/* rewriting the state file updates the binary file */
+	config->state.status = OCI_STATUS_RUNNING;
+	ck_assert (cc_oci_state_file_create (config, "foo"));
+
+	ck_assert (cc_oci_state_bin_read (config->state.runtime_path, &bin));
+	ck_assert (bin.status == OCI_STATUS_RUNNING);
+
+	/* changing the state file by other means invalidates it */
+	ck_assert (g_file_get_contents (config->state.state_file_path,
+				&contents, NULL, NULL));
+	ck_assert (g_file_set_contents (config->state.state_file_path,
+				contents, -1, NULL));
+	ck_assert (! cc_oci_state_bin_read (config->state.runtime_path,
+				&bin));
+
+	/* as is an invalid binary file */
+	ck_assert (cc_oci_state_file_create (config, "foo"));
+	ck_assert (cc_oci_state_bin_read (config->state.runtime_path, &bin));
+
+	path = g_build_path ("/", config->state.runtime_path,
+			CC_OCI_STATE_BIN_FILE, NULL);
+	ck_assert (g_file_set_contents (path, "garbage", -1, NULL));
+	ck_assert (! cc_oci_state_bin_read (config->state.runtime_path,
+				&bin));
+
+	/* deleting the state file deletes the binary file */
+	ck_assert (cc_oci_state_file_create (config, "foo"));
+	ck_assert (g_file_test (path, G_FILE_TEST_EXISTS));
+	ck_assert (cc_oci_state_file_delete (config));
+	ck_assert (! g_file_test (path, G_FILE_TEST_EXISTS));
+	ck_assert (! cc_oci_state_bin_read (config->state.runtime_path,
+				&bin));
+
+	/* clean up */
+	cc_oci_config_free (config);
+	ck_assert (cc_oci_rm_rf (tmpdir));
+} END_TEST
+
 START_TEST(test_cc_oci_state_file_exists) {
 	struct cc_oci_config *config = NULL;
 
@@ -384,9 +579,12 @@ Suite* make_state_suite(void) {
 	Suite* s = suite_create(__FILE__);
 	ADD_TEST(test_cc_oci_state_file_get, s);
 	ADD_TEST(test_cc_oci_state_file_read, s);
+	ADD_TEST(test_cc_oci_state_files_read, s);
 	ADD_TEST(test_cc_oci_state_free, s);
 	ADD_TEST(test_cc_oci_state_file_create, s);
+	ADD_TEST(test_cc_oci_state_file_update, s);
 	ADD_TEST(test_cc_oci_state_file_delete, s);
+	ADD_TEST(test_cc_oci_state_bin_read, s);
 	ADD_TEST(test_cc_oci_state_file_exists, s);
 	ADD_TEST(test_cc_oci_status_get, s);
 	ADD_TEST(test_cc_oci_status_to_str, s);
@@ -0,0 +1,251 @@
+/*
+ * This file is part of cc-oci-runtime.
+ *
+ * Copyright (C) 2016 Intel Corporation
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+#include <stdlib.h>
+#include <stdbool.h>
+
+#include <check.h>
+#include <glib.h>
+#include <glib/gstdio.h>
+
+#include "test_common.h"
+#include "../src/oci.h"
+#include "../src/logging.h"
+#include "../src/timing.h"
+
+void cc_oci_timing_free (struct cc_oci_timing *timing);
+
+START_TEST(test_cc_oci_timing_free) {
+	struct cc_oci_timing *timing;
+
+	cc_oci_timing_free (NULL);
+
+	/* memory leaks will be detected by valgrind */
+	timing = g_new0 (struct cc_oci_timing, 1);
+	cc_oci_timing_free (timing);
+
+	timing = g_new0 (struct cc_oci_timing, 1);
+	timing->phase = g_strdup ("foo");
+	cc_oci_timing_free (timing);
+} END_TEST
+
+START_TEST(test_cc_oci_timing_mark) {
+	struct cc_oci_timings *timings;
+	struct cc_oci_timing *timing;
+
+	ck_assert (! cc_oci_timings_new (NULL));
+
+	/* should not crash */
+	cc_oci_timing_mark (NULL, NULL);
+	cc_oci_timing_mark (NULL, "foo");
+
+	timings = cc_oci_timings_new ("create");
+	ck_assert (timings);
+	ck_assert (! g_strcmp0 (timings->command, "create"));
+	ck_assert (timings->phases->len == 0);
+	ck_assert (timings->start == timings->mark);
+
+	cc_oci_timing_mark (timings, NULL);
+	ck_assert (timings->phases->len == 0);
+
+	cc_oci_timing_mark (timings, "foo");
+	g_usleep (1000);
+	cc_oci_timing_mark (timings, "bar");
+
+	ck_assert (timings->phases->len == 2);
+
+	timing = g_ptr_array_index (timings->phases, 0);
+	ck_assert (! g_strcmp0 (timing->phase, "foo"));
+	ck_assert (timing->duration >= 0);
+
+	timing = g_ptr_array_index (timings->phases, 1);
+	ck_assert (! g_strcmp0 (timing->phase, "bar"));
+	ck_assert (timing->duration >= 1000);
+
+	ck_assert (timings->mark >= timings->start + 1000);
+
+	cc_oci_timings_free (timings);
+	cc_oci_timings_free (NULL);
+	cc_oci_timings_free_all (NULL);
+} END_TEST
+
+START_TEST(test_cc_oci_timings_from_node) {
+	struct cc_oci_timings *timings;
+	struct cc_oci_timing *timing;
+	GNode *root;
+	GNode *node;
+
+	ck_assert (! cc_oci_timings_from_node (NULL));
+
+	/* mirror the GNode layout generated by cc_oci_json_parse() */
+	root = g_node_new (g_strdup ("create"));
+	g_node_append (root, g_node_new (NULL));
+	node = g_node_append (root, g_node_new (g_strdup ("foo")));
+	g_node_append (node, g_node_new (g_strdup ("123")));
+	node = g_node_append (root, g_node_new (g_strdup ("bar")));
+	g_node_append (node, g_node_new (g_strdup ("not a number")));
+	node = g_node_append (root, g_node_new (g_strdup ("baz")));
+	g_node_append (node, g_node_new (g_strdup ("456")));
+
+	timings = cc_oci_timings_from_node (root);
+	ck_assert (timings);
+	ck_assert (! g_strcmp0 (timings->command, "create"));
+
+	/* invalid phase ignored */
+	ck_assert (timings->phases->len == 2);
+
+	timing = g_ptr_array_index (timings->phases, 0);
+	ck_assert (! g_strcmp0 (timing->phase, "foo"));
+	ck_assert (timing->duration == 123);
+
+	timing = g_ptr_array_index (timings->phases, 1);
+	ck_assert (! g_strcmp0 (timing->phase, "baz"));
+	ck_assert (timing->duration == 456);
+
+	cc_oci_timings_free (timings);
+	g_free_node (root);
+} END_TEST
+
+START_TEST(test_cc_oci_timings_to_json) {
+	struct cc_oci_config config = { { 0 } };
+	struct cc_oci_timings *timings;
+	JsonObject *obj;
+	JsonObject *phases;
+
+	ck_assert (! cc_oci_timings_to_json (NULL));
+
+	/* no timings */
+	obj = cc_oci_timings_to_json (&config);
+	ck_assert (obj);
+	ck_assert (json_object_get_size (obj) == 0);
+	json_object_unref (obj);
+
+	/* timings from earlier commands */
+	timings = cc_oci_timings_new ("create");
+	cc_oci_timing_mark (timings, "foo");
+	config.state.timings = g_slist_append (config.state.timings, timings);
+
+	timings = cc_oci_timings_new ("start");
+	cc_oci_timing_mark (timings, "bar");
+	config.state.timings = g_slist_append (config.state.timings, timings);
+
+	/* current command replaces earlier "start" timings */
+	config.timings = cc_oci_timings_new ("start");
+	cc_oci_timing_mark (config.timings, "baz");
+	cc_oci_timing_mark (config.timings, "baz");
+
+	obj = cc_oci_timings_to_json (&config);
+	ck_assert (obj);
+	ck_assert (json_object_get_size (obj) == 2);
+
+	phases = json_object_get_object_member (obj, "create");
+	ck_assert (phases);
+	ck_assert (json_object_has_member (phases, "foo"));
+
+	phases = json_object_get_object_member (obj, "start");
+	ck_assert (phases);
+	ck_assert (! json_object_has_member (phases, "bar"));
+	ck_assert (json_object_has_member (phases, "baz"));
+	ck_assert (json_object_get_size (phases) == 1);
+
+	json_object_unref (obj);
+
+	cc_oci_timings_free (config.timings);
+	cc_oci_timings_free_all (config.state.timings);
+} END_TEST
+
+START_TEST(test_cc_oci_timings_trace) {
+	struct cc_oci_config config = { { 0 } };
+	gchar *tmpdir = g_dir_make_tmp (NULL, NULL);
+	gchar *tmpfile = g_build_path ("/", tmpdir, "timings.json", NULL);
+	gchar *contents = NULL;
+	gchar **lines;
+
+	ck_assert (! cc_oci_timings_trace (NULL, NULL, true));
+	ck_assert (! cc_oci_timings_trace (&config, NULL, true));
+
+	/* no timings */
+	ck_assert (! cc_oci_timings_trace (&config, tmpfile, true));
+
+	config.optarg_container_id = "foo";
+	config.timings = cc_oci_timings_new ("create");
+	cc_oci_timing_mark (config.timings, "bar");
+
+	ck_assert (cc_oci_timings_trace (&config, tmpfile, true));
+	ck_assert (cc_oci_timings_trace (&config, tmpfile, false));
+
+	/* file is appended to, one line per call */
+	ck_assert (g_file_get_contents (tmpfile, &contents, NULL, NULL));
+	lines = g_strsplit (contents, "\n", -1);
+	ck_assert (g_strv_length (lines) == 3);
+	ck_assert (! g_strcmp0 (lines[2], ""));
+
+	ck_assert (g_strstr_len (lines[0], -1, "\"command\":\"create\""));
+	ck_assert (g_strstr_len (lines[0], -1, "\"id\":\"foo\""));
+	ck_assert (g_strstr_len (lines[0], -1, "\"success\":true"));
+	ck_assert (g_strstr_len (lines[0], -1, "\"bar\":"));
+	ck_assert (g_strstr_len (lines[1], -1, "\"success\":false"));
+
+	g_strfreev (lines);
+	g_free (contents);
+
+	cc_oci_timings_free (config.timings);
+
+	ck_assert (! g_remove (tmpfile));
+	ck_assert (! g_remove (tmpdir));
+
+	g_free (tmpfile);
+	g_free (tmpdir);
+} END_TEST
+
+Suite* make_timing_suite(void) {
+	Suite* s = suite_create(__FILE__);
+
+	ADD_TEST(test_cc_oci_timing_free, s);
+	ADD_TEST(test_cc_oci_timing_mark, s);
+	ADD_TEST(test_cc_oci_timings_from_node, s);
+	ADD_TEST(test_cc_oci_timings_to_json, s);
+	ADD_TEST(test_cc_oci_timings_trace, s);
+
+	return s;
+}
+
+int main (void) {
+	int number_failed;
+	Suite* s;
+	SRunner* sr;
+	struct cc_log_options options = { 0 };
+
+	options.enable_debug = true;
+	options.use_json = false;
+	options.filename = g_strdup ("timing_test_debug.log");
+	(void)cc_oci_log_init(&options);
+
+	s = make_timing_suite();
+	sr = srunner_create(s);
+
+	srunner_run_all(sr, CK_VERBOSE);
+	number_failed = srunner_ntests_failed(sr);
+	srunner_free(sr);
+
+	cc_oci_log_free (&options);
+
+	return (number_failed == 0) ? EXIT_SUCCESS : EXIT_FAILURE;
+}
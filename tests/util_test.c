@@ -20,6 +20,7 @@
 
 #include <stdlib.h>
 #include <stdbool.h>
+#include <unistd.h>
 
 #include <check.h>
 #include <glib.h>
@@ -44,6 +45,96 @@ START_TEST(test_cc_oci_rm_rf) {
 
 	g_free (tmpdir);
 
+	/* non-existent path */
+	ck_assert (cc_oci_rm_rf ("/this/directory/must/not/exist"));
+
+	tmpdir = g_dir_make_tmp (NULL, NULL);
+	ck_assert (tmpdir);
+
+	{
+		g_autofree gchar *keep = g_build_path ("/", tmpdir,
+				"keep", NULL);
+		g_autofree gchar *keep_file = g_build_path ("/", keep,
+				"file", NULL);
+		g_autofree gchar *dir = g_build_path ("/", tmpdir,
+				"dir", NULL);
+		g_autofree gchar *subdir = g_build_path ("/", dir,
+				"a/b/c", NULL);
+		g_autofree gchar *file = g_build_path ("/", subdir,
+				"file", NULL);
+		g_autofree gchar *link = g_build_path ("/", dir,
+				"a/link", NULL);
+
+		ck_assert (! g_mkdir_with_parents (keep, 0750));
+		ck_assert (g_file_set_contents (keep_file, "", -1, NULL));
+		ck_assert (! g_mkdir_with_parents (subdir, 0750));
+		ck_assert (g_file_set_contents (file, "", -1, NULL));
+		ck_assert (! symlink (keep, link));
+
+		/* file */
+		ck_assert (cc_oci_rm_rf (file));
+		ck_assert (! g_file_test (file, G_FILE_TEST_EXISTS));
+
+		/* symbolic links are not followed */
+		ck_assert (cc_oci_rm_rf (dir));
+		ck_assert (! g_file_test (dir, G_FILE_TEST_EXISTS));
+		ck_assert (g_file_test (keep_file, G_FILE_TEST_EXISTS));
+	}
+
+	ck_assert (cc_oci_rm_rf (tmpdir));
+	ck_assert (! g_file_test (tmpdir, G_FILE_TEST_EXISTS));
+
+	g_free (tmpdir);
+
+} END_TEST
+
+START_TEST(test_cc_oci_rm_rf_async) {
+	g_autofree gchar  *tmpdir = NULL;
+	g_autofree gchar  *dir = NULL;
+	g_autofree gchar  *file = NULL;
+	g_autofree gchar  *trash_dir = NULL;
+	GDir              *d;
+	gboolean           found = true;
+	int                i;
+
+	ck_assert (! cc_oci_rm_rf_async (""));
+	ck_assert (! cc_oci_rm_rf_async (NULL));
+
+	tmpdir = g_dir_make_tmp (NULL, NULL);
+	ck_assert (tmpdir);
+
+	dir = g_build_path ("/", tmpdir, "dir", NULL);
+	file = g_build_path ("/", dir, "a/file", NULL);
+	trash_dir = g_build_path ("/", tmpdir, CC_OCI_RM_RF_ASYNC_DIR,
+			NULL);
+
+	ck_assert (cc_oci_rm_rf_async (dir));
+
+	ck_assert (! g_mkdir_with_parents (dir, 0750));
+	ck_assert (! g_mkdir (file, 0750));
+
+	/* the directory disappears immediately */
+	ck_assert (cc_oci_rm_rf_async (dir));
+	ck_assert (! g_file_test (dir, G_FILE_TEST_EXISTS));
+
+	/* and its contents shortly after, leaving the trash directory */
+	for (i = 0; found && i < 100; i++) {
+		d = g_dir_open (trash_dir, 0, NULL);
+		ck_assert (d);
+
+		found = g_dir_read_name (d) != NULL;
+
+		g_dir_close (d);
+
+		if (found) {
+			g_usleep (G_USEC_PER_SEC / 10);
+		}
+	}
+
+	ck_assert (! found);
+
+	ck_assert (! g_rmdir (trash_dir));
+	ck_assert (! g_rmdir (tmpdir));
 } END_TEST
 
 START_TEST(test_cc_oci_replace_string) {
@@ -554,6 +645,7 @@ Suite* make_util_suite(void) {
 	Suite* s = suite_create(__FILE__);
 
 	ADD_TEST(test_cc_oci_rm_rf, s);
+	ADD_TEST(test_cc_oci_rm_rf_async, s);
 	ADD_TEST(test_cc_oci_replace_string, s);
 	ADD_TEST(test_cc_oci_create_pidfile, s);
 	ADD_TEST(test_cc_oci_file_to_strv, s);